@@ -0,0 +1,407 @@
+//
+// ********************************************************************
+// * License and Disclaimer                                           *
+// *                                                                  *
+// * The  Geant4 software  is  copyright of the Copyright Holders  of *
+// * the Geant4 Collaboration.  It is provided  under  the terms  and *
+// * conditions of the Geant4 Software License,  included in the file *
+// * LICENSE and available at  http://cern.ch/geant4/license .  These *
+// * include a list of copyright holders.                             *
+// *                                                                  *
+// * Neither the authors of this software system, nor their employing *
+// * institutes,nor the agencies providing financial support for this *
+// * work  make  any representation or  warranty, express or implied, *
+// * regarding  this  software system or assume any liability for its *
+// * use.  Please see the license in the file  LICENSE  and URL above *
+// * for the full disclaimer and the limitation of liability.         *
+// *                                                                  *
+// * This  code  implementation is the result of  the  scientific and *
+// * technical work of the GEANT4 collaboration.                      *
+// * By using,  copying,  modifying or  distributing the software (or *
+// * any work based  on the software)  you  agree  to acknowledge its *
+// * use  in  resulting  scientific  publications,  and indicate your *
+// * acceptance of all terms of the Geant4 Software license.          *
+// ********************************************************************
+//
+/// \file benchmarkB3b.cc
+/// \brief Performance benchmark of the B3b example
+//
+// Runs a fixed matrix of scenarios in batch mode: crystal material, source
+// (F-18 or C-11, as in run2.mac) and number of threads, for the phantom of
+// this tree, with fixed seeds. Each scenario runs in its own process, so
+// that its initialisation time and memory high-water mark are its own; it
+// reports the initialisation time, the events/s and the percentiles of the
+// per-event latency. The results are written as one JSON document, one
+// scenario per line, to be diffed or compared against a stored baseline.
+//
+//   benchmarkB3b [options]
+//     -n <events>         events per scenario                (default 2000)
+//     -s <seed>           seed of the master engine         (default 12345)
+//     -j <n1,n2,...>      numbers of threads       (default 1,2,4,8,cores)
+//     -o <file>           JSON results               (default benchmark.json)
+//     -b <file>           baseline: report the scenarios slower than it
+//     -r <tolerance>      relative slowdown to report            (default 0.1)
+
+#include "G4Types.hh"
+
+#include "G4RunManagerFactory.hh"
+#include "G4UImanager.hh"
+#include "G4UserEventAction.hh"
+#include "G4Version.hh"
+#include "Randomize.hh"
+
+#include "DetectorConstruction.hh"
+#include "PhysicsList.hh"
+#include "ActionInitialization.hh"
+#include "OrganRegistry.hh"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <mutex>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <sys/resource.h>
+#include <unistd.h>
+
+#ifndef B3B_PHANTOM
+#define B3B_PHANTOM "phantom"
+#endif
+
+namespace
+{
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
+
+using Clock = std::chrono::steady_clock;
+
+double Seconds(Clock::time_point start)
+{
+  return std::chrono::duration<double>(Clock::now() - start).count();
+}
+
+struct Options
+{
+  long             fNbEvents = 2000;
+  long             fSeed = 12345;
+  std::vector<int> fThreads;
+  std::string      fOutput = "benchmark.json";
+  std::string      fBaseline;
+  double           fTolerance = 0.1;
+};
+
+struct Scenario
+{
+  std::string fMaterial;
+  std::string fSource;
+  int         fNbThreads;
+
+  std::string GetName() const
+  {
+    return std::string(B3B_PHANTOM) + "/" + fMaterial + "/" + fSource + "/"
+           + std::to_string(fNbThreads) + "t";
+  }
+};
+
+const char* const kMaterials[] = { "Lu2SiO5", "G4_BGO" };
+const char* const kSources[]   = { "F18", "C11" };
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
+
+// Per-event latency, from the beginning to the end of each event, kept by
+// every worker in its own buffer
+class LatencyEventAction : public G4UserEventAction
+{
+  public:
+    LatencyEventAction()
+    {
+      std::lock_guard<std::mutex> lock(fgMutex);
+      fgLatencies.push_back(&fLatencies);
+    }
+
+    void BeginOfEventAction(const G4Event*) override { fStart = Clock::now(); }
+    void EndOfEventAction(const G4Event*) override
+    {
+      fLatencies.push_back(float(
+        std::chrono::duration<double, std::micro>(Clock::now() - fStart).count()));
+    }
+
+    // all the latencies [us], once the run is over
+    static std::vector<float> Collect()
+    {
+      std::lock_guard<std::mutex> lock(fgMutex);
+      std::vector<float> all;
+      for (const auto* latencies : fgLatencies) {
+        all.insert(all.end(), latencies->begin(), latencies->end());
+      }
+      return all;
+    }
+
+  private:
+    std::vector<float> fLatencies;
+    Clock::time_point  fStart;
+
+    static std::mutex                       fgMutex;
+    static std::vector<std::vector<float>*> fgLatencies;
+};
+
+std::mutex                       LatencyEventAction::fgMutex;
+std::vector<std::vector<float>*> LatencyEventAction::fgLatencies;
+
+class BenchmarkActionInitialization : public B3b::ActionInitialization
+{
+  public:
+    void Build() const override
+    {
+      ActionInitialization::Build();
+      SetUserAction(new LatencyEventAction);
+    }
+};
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
+
+double Percentile(const std::vector<float>& sorted, double fraction)
+{
+  if (sorted.empty()) return 0.;
+  std::size_t i = std::size_t(fraction*(sorted.size() - 1) + 0.5);
+  return sorted[std::min(i, sorted.size() - 1)];
+}
+
+// One scenario, in this process: its JSON line is written to fragment
+int RunScenario(const Scenario& scenario, const Options& options,
+                const std::string& fragment)
+{
+  G4Random::setTheSeed(options.fSeed);
+
+  auto* runManager =
+    G4RunManagerFactory::CreateRunManager(G4RunManagerType::Default);
+  runManager->SetNumberOfThreads(scenario.fNbThreads);
+
+  auto detector = new B3::DetectorConstruction;
+  detector->SetCrystalMaterial(scenario.fMaterial);
+  // the initialisation time, without the overlap checks
+  detector->SetOverlapMode("none");
+  runManager->SetUserInitialization(detector);
+  runManager->SetUserInitialization(new B3::PhysicsList);
+  runManager->SetUserInitialization(new BenchmarkActionInitialization);
+
+  G4UImanager* UImanager = G4UImanager::GetUIpointer();
+  UImanager->ApplyCommand("/control/verbose 0");
+  UImanager->ApplyCommand("/run/verbose 0");
+  UImanager->ApplyCommand("/B3/throughput/report 0");
+  UImanager->ApplyCommand("/B3/throughput/breakdown false");
+
+  // the workers are set up by the initialisation
+  auto start = Clock::now();
+  runManager->Initialize();
+  double initTime = Seconds(start);
+
+  if (scenario.fSource == "C11") {
+    UImanager->ApplyCommand("/gun/particle ion");
+    UImanager->ApplyCommand("/gun/ion 6 11");
+  }
+
+  start = Clock::now();
+  runManager->BeamOn(G4int(options.fNbEvents));
+  double runTime = Seconds(start);
+
+  std::vector<float> latencies = LatencyEventAction::Collect();
+  std::sort(latencies.begin(), latencies.end());
+  struct rusage usage;
+  getrusage(RUSAGE_SELF, &usage);
+
+  std::ostringstream line;
+  line << "{\"name\": \"" << scenario.GetName() << "\""
+       << ", \"material\": \"" << scenario.fMaterial << "\""
+       << ", \"source\": \"" << scenario.fSource << "\""
+       << ", \"threads\": " << scenario.fNbThreads
+       << ", \"events\": " << options.fNbEvents
+       << ", \"init_s\": " << initTime
+       << ", \"run_s\": " << runTime
+       << ", \"events_per_s\": " << (runTime > 0. ? options.fNbEvents/runTime : 0.)
+       << ", \"max_rss_MB\": " << usage.ru_maxrss/1024.
+       << ", \"latency_us\": {\"p50\": " << Percentile(latencies, 0.5)
+       << ", \"p90\": " << Percentile(latencies, 0.9)
+       << ", \"p99\": " << Percentile(latencies, 0.99)
+       << ", \"max\": " << (latencies.empty() ? 0. : latencies.back()) << "}}";
+  std::ofstream(fragment) << line.str() << "\n";
+
+  delete runManager;
+  return 0;
+}
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
+
+std::string SelfPath(const char* argv0)
+{
+  char path[4096];
+  ssize_t size = readlink("/proc/self/exe", path, sizeof(path) - 1);
+  if (size <= 0) return argv0;
+  path[size] = '\0';
+  return path;
+}
+
+// Value of "key": in a JSON line written by RunScenario()
+std::string Field(const std::string& line, const std::string& key)
+{
+  std::string tag = "\"" + key + "\": ";
+  std::size_t start = line.find(tag);
+  if (start == std::string::npos) return "";
+  start += tag.size();
+  if (line[start] == '"') {
+    std::size_t end = line.find('"', start + 1);
+    return line.substr(start + 1, end - start - 1);
+  }
+  return line.substr(start, line.find_first_of(",}", start) - start);
+}
+
+// Scenarios slower than in the baseline by more than the tolerance
+int Compare(const std::vector<std::string>& results, const Options& options)
+{
+  std::ifstream input(options.fBaseline);
+  if (!input) {
+    std::fprintf(stderr, "benchmarkB3b: cannot read %s\n",
+                 options.fBaseline.c_str());
+    return 1;
+  }
+  std::vector<std::string> baseline;
+  for (std::string line; std::getline(input, line);) {
+    if (!Field(line, "name").empty()) baseline.push_back(line);
+  }
+
+  int nbSlower = 0;
+  for (const std::string& result : results) {
+    std::string name = Field(result, "name");
+    auto reference = std::find_if(baseline.begin(), baseline.end(),
+      [&name](const std::string& line) { return Field(line, "name") == name; });
+    if (reference == baseline.end()) continue;
+    double before = std::atof(Field(*reference, "events_per_s").c_str());
+    double after = std::atof(Field(result, "events_per_s").c_str());
+    if (before <= 0.) continue;
+    double change = after/before - 1.;
+    bool slower = change < -options.fTolerance;
+    if (slower) nbSlower++;
+    std::printf("%-32s %12.1f -> %12.1f events/s  %+6.1f %%%s\n", name.c_str(),
+                before, after, 100.*change, slower ? "  SLOWER" : "");
+  }
+  return nbSlower > 0 ? 2 : 0;
+}
+
+bool ParseThreads(const std::string& text, std::vector<int>& threads)
+{
+  std::istringstream input(text);
+  for (std::string item; std::getline(input, item, ',');) {
+    int nbThreads = std::atoi(item.c_str());
+    if (nbThreads < 1) return false;
+    threads.push_back(nbThreads);
+  }
+  return !threads.empty();
+}
+
+void Usage()
+{
+  std::fprintf(stderr,
+    "usage: benchmarkB3b [-n events] [-s seed] [-j n1,n2,...] [-o file.json]\n"
+    "                    [-b baseline.json] [-r tolerance]\n");
+}
+
+}
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
+
+int main(int argc, char** argv)
+{
+  Options options;
+  Scenario scenario;
+  std::string fragment;
+
+  for (int i = 1; i < argc; i++) {
+    std::string arg = argv[i];
+    bool hasValue = i+1 < argc;
+    if (arg == "-n" && hasValue) options.fNbEvents = std::atol(argv[++i]);
+    else if (arg == "-s" && hasValue) options.fSeed = std::atol(argv[++i]);
+    else if (arg == "-j" && hasValue) {
+      if (!ParseThreads(argv[++i], options.fThreads)) { Usage(); return 1; }
+    }
+    else if (arg == "-o" && hasValue) options.fOutput = argv[++i];
+    else if (arg == "-b" && hasValue) options.fBaseline = argv[++i];
+    else if (arg == "-r" && hasValue) options.fTolerance = std::atof(argv[++i]);
+    else if (arg == "--scenario" && i+4 < argc) {
+      scenario.fMaterial = argv[++i];
+      scenario.fSource = argv[++i];
+      scenario.fNbThreads = std::atoi(argv[++i]);
+      fragment = argv[++i];
+    }
+    else { Usage(); return 1; }
+  }
+  if (options.fNbEvents < 1) {
+    Usage();
+    return 1;
+  }
+  if (!fragment.empty()) return RunScenario(scenario, options, fragment);
+
+  if (options.fThreads.empty()) {
+    int nbCores = std::max(1u, std::thread::hardware_concurrency());
+    for (int nbThreads : { 1, 2, 4, 8 }) {
+      if (nbThreads < nbCores) options.fThreads.push_back(nbThreads);
+    }
+    options.fThreads.push_back(nbCores);
+  }
+
+  //every scenario in a process of its own, with its output in a log
+  //
+  const std::string self = SelfPath(argv[0]);
+  std::vector<std::string> results;
+  for (const char* material : kMaterials) {
+    for (const char* source : kSources) {
+      for (int nbThreads : options.fThreads) {
+        Scenario current{ material, source, nbThreads };
+        std::string name = current.GetName();
+        std::string base = options.fOutput + "." + material + "." + source + "."
+                           + std::to_string(nbThreads);
+        std::string command = "\"" + self + "\" -n "
+          + std::to_string(options.fNbEvents) + " -s "
+          + std::to_string(options.fSeed) + " --scenario " + material + " "
+          + source + " " + std::to_string(nbThreads) + " \"" + base
+          + ".json\" > \"" + base + ".log\" 2>&1";
+        std::printf("%-32s ", name.c_str());
+        std::fflush(stdout);
+        int status = std::system(command.c_str());
+        std::string line;
+        std::ifstream input(base + ".json");
+        if (status != 0 || !std::getline(input, line)) {
+          std::printf("failed, see %s.log\n", base.c_str());
+          continue;
+        }
+        std::remove((base + ".json").c_str());
+        std::printf("%10s events/s\n", Field(line, "events_per_s").c_str());
+        results.push_back(line);
+      }
+    }
+  }
+
+  std::ofstream output(options.fOutput);
+  output << "{\n"
+         << "  \"benchmark\": \"exampleB3b\",\n"
+         << "  \"phantom\": \"" << B3B_PHANTOM << "\",\n"
+         << "  \"geant4\": \"" << G4Version << "\",\n"
+         << "  \"cores\": " << std::thread::hardware_concurrency() << ",\n"
+         << "  \"events\": " << options.fNbEvents << ",\n"
+         << "  \"seed\": " << options.fSeed << ",\n"
+         << "  \"scenarios\": [\n";
+  for (std::size_t i = 0; i < results.size(); i++) {
+    output << "    " << results[i] << (i + 1 < results.size() ? "," : "") << "\n";
+  }
+  output << "  ]\n}\n";
+  std::printf("results written to %s\n", options.fOutput.c_str());
+
+  if (!options.fBaseline.empty()) return Compare(results, options);
+  return 0;
+}
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
@@ -0,0 +1,286 @@
+//
+// ********************************************************************
+// * License and Disclaimer                                           *
+// *                                                                  *
+// * The  Geant4 software  is  copyright of the Copyright Holders  of *
+// * the Geant4 Collaboration.  It is provided  under  the terms  and *
+// * conditions of the Geant4 Software License,  included in the file *
+// * LICENSE and available at  http://cern.ch/geant4/license .  These *
+// * include a list of copyright holders.                             *
+// *                                                                  *
+// * Neither the authors of this software system, nor their employing *
+// * institutes,nor the agencies providing financial support for this *
+// * work  make  any representation or  warranty, express or implied, *
+// * regarding  this  software system or assume any liability for its *
+// * use.  Please see the license in the file  LICENSE  and URL above *
+// * for the full disclaimer and the limitation of liability.         *
+// *                                                                  *
+// * This  code  implementation is the result of  the  scientific and *
+// * technical work of the GEANT4 collaboration.                      *
+// * By using,  copying,  modifying or  distributing the software (or *
+// * any work based  on the software)  you  agree  to acknowledge its *
+// * use  in  resulting  scientific  publications,  and indicate your *
+// * acceptance of all terms of the Geant4 Software license.          *
+// ********************************************************************
+/// \file crystalsB3b.cc
+/// \brief Per-event cost of B3::CrystalSD against the crystal hits map
+//
+// The scanner of the DetectorConstruction is built for each size, and the
+// same steps, located in its crystals, are fed event by event to:
+//  - the G4MultiFunctionalDetector with a G4PSEnergyDeposit it replaced,
+//    whose G4THitsMap is created at each event through the G4SDManager,
+//    walked as in the former Run::RecordEvent() and deleted with the event;
+//  - B3::CrystalSD, cleared in Initialize() and read back through its list
+//    of fired crystals, as in Run::RecordEvent().
+// Each event fires a few random crystals, among which its deposits are
+// spread. The time per event of each path is printed for each scanner.
+//
+//   crystalsB3b [options]
+//     -e <events>         events per scanner                   (default 1000000)
+//     -d <deposits>       energy deposits per event            (default 6)
+//     -f <crystals>       crystals fired per event             (default 3)
+//     -c <list>           scanners, crystals x rings  (default 32x9,320x9,320x90)
+//     -s <seed>           seed of the random engine            (default 12345)
+
+#include "G4Types.hh"
+
+#include "G4SDManager.hh"
+#include "G4HCofThisEvent.hh"
+#include "G4THitsMap.hh"
+#include "G4MultiFunctionalDetector.hh"
+#include "G4PSEnergyDeposit.hh"
+#include "G4Step.hh"
+#include "G4StepPoint.hh"
+#include "G4TouchableHandle.hh"
+#include "G4LogicalVolume.hh"
+#include "G4VPhysicalVolume.hh"
+#include "G4Navigator.hh"
+#include "G4GeometryManager.hh"
+#include "G4SystemOfUnits.hh"
+#include "Randomize.hh"
+
+#include "DetectorConstruction.hh"
+#include "CrystalSD.hh"
+
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <sstream>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace
+{
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
+
+using Clock = std::chrono::steady_clock;
+
+struct Options
+{
+  long  fNbEvents = 1000000;
+  int   fNbDeposits = 6;
+  int   fNbFired = 3;
+  std::vector<std::pair<int, int>> fScanners = { {32, 9}, {320, 9}, {320, 90} };
+  long  fSeed = 12345;
+};
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
+
+// centres of the placements of CrystalLV, in the global frame
+void FindCrystals(const G4VPhysicalVolume* volume, const G4RotationMatrix& rotation,
+                  const G4ThreeVector& translation,
+                  std::vector<G4ThreeVector>& centres)
+{
+  G4RotationMatrix localRotation = rotation*volume->GetObjectRotationValue();
+  G4ThreeVector localTranslation =
+    translation + rotation*volume->GetObjectTranslation();
+  const G4LogicalVolume* logical = volume->GetLogicalVolume();
+  if (logical->GetName() == "CrystalLV") {
+    centres.push_back(localTranslation);
+    return;
+  }
+  for (std::size_t i = 0; i < logical->GetNoDaughters(); i++) {
+    FindCrystals(logical->GetDaughter(i), localRotation, localTranslation,
+                 centres);
+  }
+}
+
+// one touchable per crystal, as the steps in the crystals carry them
+std::vector<G4TouchableHandle> LocateCrystals(G4VPhysicalVolume* world)
+{
+  std::vector<G4ThreeVector> centres;
+  FindCrystals(world, G4RotationMatrix(), G4ThreeVector(), centres);
+
+  G4Navigator navigator;
+  navigator.SetWorldVolume(world);
+  std::vector<G4TouchableHandle> touchables;
+  touchables.reserve(centres.size());
+  for (const G4ThreeVector& centre : centres) {
+    G4VPhysicalVolume* found =
+      navigator.LocateGlobalPointAndSetup(centre, nullptr, false, true);
+    if (found && found->GetLogicalVolume()->GetName() == "CrystalLV") {
+      touchables.push_back(navigator.CreateTouchableHistoryHandle());
+    }
+  }
+  return touchables;
+}
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
+
+// the crystal of each deposit, event after event
+std::vector<G4int> DrawDeposits(G4int nbCrystals, const Options& options)
+{
+  std::vector<G4int> deposits;
+  deposits.reserve(options.fNbEvents*options.fNbDeposits);
+  std::vector<G4int> fired(options.fNbFired);
+  for (long event = 0; event < options.fNbEvents; event++) {
+    for (G4int& crystal : fired) crystal = G4int(G4UniformRand()*nbCrystals);
+    for (int i = 0; i < options.fNbDeposits; i++) {
+      deposits.push_back(fired[G4int(G4UniformRand()*options.fNbFired)]);
+    }
+  }
+  return deposits;
+}
+
+// nanoseconds per event of the hits map, or of the crystal buffer
+double NsPerEvent(const std::vector<G4TouchableHandle>& touchables,
+                  const std::vector<G4int>& deposits, const Options& options,
+                  G4MultiFunctionalDetector* map, G4int mapID,
+                  B3::CrystalSD* buffer, G4double& total)
+{
+  G4SDManager* sdManager = G4SDManager::GetSDMpointer();
+  G4Step step;
+  G4StepPoint* preStep = step.GetPreStepPoint();
+  preStep->SetWeight(1.);
+  step.SetStepLength(1.*mm);
+
+  total = 0.;
+  std::size_t next = 0;
+  auto start = Clock::now();
+  for (long event = 0; event < options.fNbEvents; event++) {
+    G4HCofThisEvent* hce = map ? sdManager->PrepareNewEvent() : nullptr;
+    if (buffer) buffer->Initialize(nullptr);
+
+    for (int i = 0; i < options.fNbDeposits; i++) {
+      preStep->SetTouchableHandle(touchables[deposits[next++]]);
+      preStep->SetGlobalTime(i*ns);
+      step.SetTotalEnergyDeposit((50. + i)*keV);
+      if (map) map->Hit(&step);
+      else buffer->Hit(&step);
+    }
+
+    if (map) {
+      auto edep = static_cast<G4THitsMap<G4double>*>(hce->GetHC(mapID));
+      for (const auto& crystal : *edep->GetMap()) total += *crystal.second;
+      sdManager->TerminateCurrentEvent(hce);
+      delete hce;
+    }
+    else {
+      for (G4int id : buffer->GetFiredCrystals()) {
+        total += buffer->GetEdep(id);
+      }
+    }
+  }
+  auto stop = Clock::now();
+  return std::chrono::duration<double, std::nano>(stop - start).count()
+         /options.fNbEvents;
+}
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
+
+bool ParseScanners(const std::string& list,
+                   std::vector<std::pair<int, int>>& scanners)
+{
+  scanners.clear();
+  std::istringstream input(list);
+  std::string item;
+  while (std::getline(input, item, ',')) {
+    int crystals = 0, rings = 0;
+    char x = 0;
+    std::istringstream scanner(item);
+    if (!(scanner >> crystals >> x >> rings) || x != 'x' ||
+        crystals < 3 || rings < 1) return false;
+    scanners.emplace_back(crystals, rings);
+  }
+  return !scanners.empty();
+}
+
+void Usage()
+{
+  std::fprintf(stderr,
+    "usage: crystalsB3b [-e events] [-d deposits] [-f crystals]"
+    " [-c crystals x rings,...] [-s seed]\n");
+}
+
+}
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
+
+int main(int argc, char** argv)
+{
+  Options options;
+
+  for (int i = 1; i < argc; i++) {
+    std::string arg = argv[i];
+    bool hasValue = i+1 < argc;
+    if (arg == "-e" && hasValue) options.fNbEvents = std::atol(argv[++i]);
+    else if (arg == "-d" && hasValue) options.fNbDeposits = std::atoi(argv[++i]);
+    else if (arg == "-f" && hasValue) options.fNbFired = std::atoi(argv[++i]);
+    else if (arg == "-c" && hasValue) {
+      if (!ParseScanners(argv[++i], options.fScanners)) { Usage(); return 1; }
+    }
+    else if (arg == "-s" && hasValue) options.fSeed = std::atol(argv[++i]);
+    else { Usage(); return 1; }
+  }
+  if (options.fNbEvents < 1 || options.fNbDeposits < 1 || options.fNbFired < 1) {
+    Usage();
+    return 1;
+  }
+
+  // the scorer the CrystalSD replaced, as registered by the former
+  // DetectorConstruction::ConstructSDandField()
+  G4SDManager* sdManager = G4SDManager::GetSDMpointer();
+  auto map = new G4MultiFunctionalDetector("crystal");
+  map->RegisterPrimitive(new G4PSEnergyDeposit("edep"));
+  sdManager->AddNewDetector(map);
+  G4int mapID = sdManager->GetCollectionID("crystal/edep");
+
+  std::printf("%10s %8s %18s %18s %8s\n", "crystals", "rings",
+              "map [ns/event]", "buffer [ns/event]", "ratio");
+  B3::DetectorConstruction detector;
+  for (const auto& scanner : options.fScanners) {
+    detector.SetNbCrystals(scanner.first);
+    detector.SetNbRings(scanner.second);
+    G4VPhysicalVolume* world = detector.Construct();
+    G4GeometryManager::GetInstance()->CloseGeometry(true);
+    std::vector<G4TouchableHandle> touchables = LocateCrystals(world);
+    if (touchables.size() != std::size_t(scanner.first)*scanner.second) {
+      std::fprintf(stderr, "%dx%d: %zu crystals located\n", scanner.first,
+                   scanner.second, touchables.size());
+      return 1;
+    }
+    B3::CrystalSD buffer("crystalBuffer", detector.GetDetectorID());
+
+    G4Random::setTheSeed(options.fSeed);
+    std::vector<G4int> deposits = DrawDeposits(G4int(touchables.size()), options);
+
+    G4double mapTotal = 0., bufferTotal = 0.;
+    double mapTime = NsPerEvent(touchables, deposits, options, map, mapID,
+                                nullptr, mapTotal);
+    double bufferTime = NsPerEvent(touchables, deposits, options, nullptr, -1,
+                                   &buffer, bufferTotal);
+    if (std::abs(mapTotal - bufferTotal) > 1e-9*mapTotal) {
+      std::fprintf(stderr, "%dx%d: the energies differ, %g MeV against %g MeV\n",
+                   scanner.first, scanner.second, mapTotal/MeV, bufferTotal/MeV);
+      return 1;
+    }
+    std::printf("%10zu %8d %18.1f %18.1f %8.1f\n", touchables.size(),
+                scanner.second, mapTime, bufferTime,
+                bufferTime > 0. ? mapTime/bufferTime : 0.);
+  }
+
+  return 0;
+}
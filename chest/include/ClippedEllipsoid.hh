@@ -0,0 +1,132 @@
+//
+// ********************************************************************
+// * License and Disclaimer                                           *
+// *                                                                  *
+// * The  Geant4 software  is  copyright of the Copyright Holders  of *
+// * the Geant4 Collaboration.  It is provided  under  the terms  and *
+// * conditions of the Geant4 Software License,  included in the file *
+// * LICENSE and available at  http://cern.ch/geant4/license .  These *
+// * include a list of copyright holders.                             *
+// *                                                                  *
+// * Neither the authors of this software system, nor their employing *
+// * institutes,nor the agencies providing financial support for this *
+// * work  make  any representation or  warranty, express or implied, *
+// * regarding  this  software system or assume any liability for its *
+// * use.  Please see the license in the file  LICENSE  and URL above *
+// * for the full disclaimer and the limitation of liability.         *
+// *                                                                  *
+// * This  code  implementation is the result of  the  scientific and *
+// * technical work of the GEANT4 collaboration.                      *
+// * By using,  copying,  modifying or  distributing the software (or *
+// * any work based  on the software)  you  agree  to acknowledge its *
+// * use  in  resulting  scientific  publications,  and indicate your *
+// * acceptance of all terms of the Geant4 Software license.          *
+// ********************************************************************
+/// \file ClippedEllipsoid.hh
+/// \brief Definition of the B3::ClippedEllipsoid class
+
+#ifndef B3ClippedEllipsoid_h
+#define B3ClippedEllipsoid_h 1
+
+#include "G4VSolid.hh"
+#include "G4ThreeVector.hh"
+
+class G4Polyhedron;
+
+namespace B3
+{
+
+/// Clipped ellipsoid: the shape of a lung lobe.
+///
+/// The upper half (z >= 0) of the ellipsoid of semi-axes dx, dy, dz, from
+/// which the lower part (y < 0) of the same ellipsoid, moved by cutShift
+/// along x, is removed. It is the solid
+///
+///   G4Ellipsoid(dx, dy, dz, 0, dz)
+///     - (G4Ellipsoid(dx, dy, dz) - G4Box above y = 0), moved by cutShift
+///
+/// without the two levels of Boolean solids: along a ray, both parts are
+/// convex and cut it in one interval each, found in closed form from a
+/// quadratic and a plane, and the solid is the first interval minus the
+/// second. The safeties use the smallest semi-axis: in the frame where the
+/// ellipsoid is the unit sphere, the distance to the surface is 1 - r, and
+/// no distance shrinks by more than that semi-axis in the real frame.
+/// A point or a ray outside the bounding box is rejected first.
+
+class ClippedEllipsoid : public G4VSolid
+{
+  public:
+    ClippedEllipsoid(const G4String& name, G4double dx, G4double dy,
+                     G4double dz, G4double cutShift);
+    ClippedEllipsoid(const ClippedEllipsoid& other);
+    ClippedEllipsoid& operator=(const ClippedEllipsoid&) = delete;
+    ~ClippedEllipsoid() override;
+
+    EInside Inside(const G4ThreeVector& p) const override;
+    G4ThreeVector SurfaceNormal(const G4ThreeVector& p) const override;
+    G4double DistanceToIn(const G4ThreeVector& p,
+                          const G4ThreeVector& v) const override;
+    G4double DistanceToIn(const G4ThreeVector& p) const override;
+    G4double DistanceToOut(const G4ThreeVector& p, const G4ThreeVector& v,
+                           const G4bool calcNorm = false,
+                           G4bool* validNorm = nullptr,
+                           G4ThreeVector* n = nullptr) const override;
+    G4double DistanceToOut(const G4ThreeVector& p) const override;
+
+    void BoundingLimits(G4ThreeVector& pMin, G4ThreeVector& pMax) const override;
+    G4bool CalculateExtent(const EAxis pAxis, const G4VoxelLimits& pVoxelLimit,
+                           const G4AffineTransform& pTransform,
+                           G4double& pMin, G4double& pMax) const override;
+
+    G4double GetCubicVolume() override;
+    G4ThreeVector GetPointOnSurface() const override;
+
+    G4GeometryType GetEntityType() const override;
+    G4VSolid* Clone() const override;
+    std::ostream& StreamInfo(std::ostream& os) const override;
+
+    void DescribeYourselfTo(G4VGraphicsScene& scene) const override;
+    G4Polyhedron* CreatePolyhedron() const override;
+    G4Polyhedron* GetPolyhedron() const override;
+
+  private:
+    // the surfaces of the solid
+    enum Surface { kEllipsoid, kBase, kCutEllipsoid, kCutPlane };
+
+    // an interval along a ray, with the surfaces at its ends
+    struct Interval
+    {
+      G4double fIn = -kInfinity, fOut = kInfinity;
+      Surface  fInSurface = kEllipsoid, fOutSurface = kEllipsoid;
+      G4bool   fEmpty = false;
+    };
+
+    // radius in the frame where the ellipsoid centred at x0 is the unit sphere
+    G4double ScaledRadius(const G4ThreeVector& p, G4double x0) const;
+    // approximate signed distance to the ellipsoid, positive outside
+    G4double EllipsoidDistance(const G4ThreeVector& p, G4double x0) const;
+    G4ThreeVector EllipsoidNormal(const G4ThreeVector& p, G4double x0) const;
+    G4ThreeVector Normal(Surface surface, const G4ThreeVector& p) const;
+
+    Interval EllipsoidInterval(const G4ThreeVector& p, const G4ThreeVector& v,
+                               G4double x0, Surface surface) const;
+    static Interval Intersect(const Interval& a, const Interval& b);
+    // up to two intervals of the solid along the ray, in order
+    G4int Intervals(const G4ThreeVector& p, const G4ThreeVector& v,
+                    Interval pieces[2]) const;
+    G4bool HitsBoundingBox(const G4ThreeVector& p, const G4ThreeVector& v) const;
+
+    G4double fDx, fDy, fDz;
+    G4double fCutShift;
+    G4double fMinAxis;
+    G4double fHalfTolerance;
+
+    mutable G4bool fRebuildPolyhedron = false;
+    mutable G4Polyhedron* fpPolyhedron = nullptr;
+};
+
+}
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
+
+#endif
@@ -0,0 +1,93 @@
+//
+// ********************************************************************
+// * License and Disclaimer                                           *
+// *                                                                  *
+// * The  Geant4 software  is  copyright of the Copyright Holders  of *
+// * the Geant4 Collaboration.  It is provided  under  the terms  and *
+// * conditions of the Geant4 Software License,  included in the file *
+// * LICENSE and available at  http://cern.ch/geant4/license .  These *
+// * include a list of copyright holders.                             *
+// *                                                                  *
+// * Neither the authors of this software system, nor their employing *
+// * institutes,nor the agencies providing financial support for this *
+// * work  make  any representation or  warranty, express or implied, *
+// * regarding  this  software system or assume any liability for its *
+// * use.  Please see the license in the file  LICENSE  and URL above *
+// * for the full disclaimer and the limitation of liability.         *
+// *                                                                  *
+// * This  code  implementation is the result of  the  scientific and *
+// * technical work of the GEANT4 collaboration.                      *
+// * By using,  copying,  modifying or  distributing the software (or *
+// * any work based  on the software)  you  agree  to acknowledge its *
+// * use  in  resulting  scientific  publications,  and indicate your *
+// * acceptance of all terms of the Geant4 Software license.          *
+// ********************************************************************
+//
+/// \file CrystalSD.hh
+/// \brief Definition of the B3::CrystalSD class
+
+#ifndef B3CrystalSD_h
+#define B3CrystalSD_h 1
+
+#include "G4VSensitiveDetector.hh"
+#include "DetectorID.hh"
+#include "globals.hh"
+
+#include <vector>
+
+class G4Step;
+class G4HCofThisEvent;
+class G4TouchableHistory;
+
+namespace B3
+{
+
+/// Crystal sensitive detector.
+///
+/// It replaces the G4MultiFunctionalDetector + G4PSEnergyDeposit scorer:
+/// the energy deposit of the event is accumulated in a flat buffer indexed
+/// by the global detector ID (see DetectorID), pre-sized to the number of
+/// crystals of the full detector. The IDs of the crystals
+/// fired in the event are kept in a list, so that the buffer is cleared,
+/// and read back in Run::RecordEvent(), in a time proportional to the number
+/// of hits and not to the number of crystals.
+/// For each fired crystal the time of the first deposit is also kept, and
+/// whether a photon entered it with less than the annihilation energy, i.e.
+/// after a scatter in the patient or in the scanner.
+/// One instance exists per thread: the buffer needs no locking.
+
+class CrystalSD : public G4VSensitiveDetector
+{
+  public:
+    CrystalSD(const G4String& name, const DetectorID& detectorID);
+    ~CrystalSD() override;
+
+    void   Initialize(G4HCofThisEvent*) override;
+    G4bool ProcessHits(G4Step*, G4TouchableHistory*) override;
+
+    // when the scanner geometry is rebuilt
+    void SetDetectorID(const DetectorID& detectorID);
+
+  public:
+    G4int GetNbCrystals() const { return G4int(fEdep.size()); }
+    const DetectorID& GetDetectorID() const { return fDetectorID; }
+    const std::vector<G4int>& GetFiredCrystals() const { return fFired; }
+    G4double GetEdep(G4int id) const { return fEdep[id]; }
+    G4double GetTime(G4int id) const { return fTime[id]; }
+    G4bool   IsScattered(G4int id) const { return fScatter[id] != 0; }
+
+  private:
+    DetectorID            fDetectorID;
+    std::vector<G4double> fEdep;
+    std::vector<G4double> fTime;
+    std::vector<char>     fScatter;
+    std::vector<G4int>    fFired;
+    std::vector<G4int>    fScattered;
+    G4double              fScatterEnergy = 0.;
+};
+
+}
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
+
+#endif
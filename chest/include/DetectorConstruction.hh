@@ -31,10 +31,17 @@
 #define B3DetectorConstruction_h 1
 
 #include "G4VUserDetectorConstruction.hh"
+#include "DetectorID.hh"
+#include "OverlapChecker.hh"
 #include "globals.hh"
+#include "G4ThreeVector.hh"
 
 class G4VPhysicalVolume;
 class G4LogicalVolume;
+class G4VSolid;
+class G4Box;
+class G4GenericMessenger;
+class G4UIcommand;
 
 namespace B3
 {
@@ -43,6 +50,22 @@ namespace B3
 ///
 /// Crystals are positioned in Ring, with an appropriate rotation matrix.
 /// Several copies of Ring are placed in the full detector.
+///
+/// The scanner (crystal size, crystals per ring, rings, wrapping gap and
+/// scintillator) can be changed between runs with the /B3/detector/
+/// commands: the whole geometry is then built again at the next
+/// /run/beamOn, while the physics tables are kept. The sensitive detectors
+/// of the threads are reused and resized to the new detector. The world
+/// encloses both the detector and the phantom, and a scanner whose rings
+/// would cut into the phantom is rejected.
+///
+/// The overlaps are checked once the geometry is built, by an
+/// OverlapChecker: by default only the placements not found in its cache
+/// (/B3/detector/checkOverlaps, /B3/detector/overlapCache).
+///
+/// The right lung is a ClippedEllipsoid, equivalent to the original two
+/// levels of G4SubtractionSolid which /B3/detector/analyticSolids false
+/// brings back.
 
 class DetectorConstruction : public G4VUserDetectorConstruction
 {
@@ -54,10 +77,69 @@ class DetectorConstruction : public G4VUserDetectorConstruction
     G4VPhysicalVolume* Construct() override;
     void ConstructSDandField() override;
 
+    G4int GetNbCrystals() const { return fNbCrystals; }
+    G4int GetNbRings()    const { return fNbRings; }
+    G4double GetCrystalDX()  const { return fCrystalDX; }
+    G4double GetCrystalDY()  const { return fCrystalDY; }
+    G4double GetCrystalDZ()  const { return fCrystalDZ; }
+    G4double GetGap()        const { return fGap; }
+    // inner radius of the rings, for the current parameters
+    G4double GetRingRadius() const;
+    const G4String& GetCrystalMaterial() const { return fCrystalMaterial; }
+
+    // the geometry is rebuilt at the next run when changed after
+    // /run/initialize
+    void SetCrystalDX(G4double value);
+    void SetCrystalDY(G4double value);
+    void SetCrystalDZ(G4double value);
+    void SetNbCrystals(G4int value);
+    void SetNbRings(G4int value);
+    void SetGap(G4double value);
+    // a material name, or one of LSO, LYSO, BGO, LFS, GSO; an unknown one
+    // keeps the current material and fails /B3/detector/material
+    void SetCrystalMaterial(const G4String& name);
+    // none, new or all, before the geometry is built
+    void SetOverlapMode(const G4String& mode);
+    // the analytic right lung, or the Boolean one
+    void SetAnalyticSolids(G4bool value);
+    G4bool GetAnalyticSolids() const { return fAnalyticSolids; }
+    const DetectorID& GetDetectorID() const { return fDetectorID; }
+    // bounding box of the phantom, centred on the origin
+    const G4ThreeVector& GetPhantomSize() const { return fPhantomSize; }
+    // false if the rings of the current parameters would cut into the
+    // phantom, which is known once the geometry has been built
+    G4bool FitsPhantom() const;
+
+    // the right lung, built alone (also by solidsB3b)
+    static G4VSolid* BuildRightLung(G4bool analytic);
+
   private:
     void DefineMaterials();
+    void DefineCommands();
+    void GeometryChanged();
+    // the world resized to the phantom too, once it is built
+    void FitWorld(G4Box* solidWorld, G4double ringRadius,
+                  G4double worldXY, G4double worldZ) const;
+
+    G4int fNbCrystals = 32;
+    G4int fNbRings    = 9;
+    G4double fCrystalDX = 0.;
+    G4double fCrystalDY = 0.;
+    G4double fCrystalDZ = 0.;
+    G4double fGap = 0.;
+    G4String fCrystalMaterial = "Lu2SiO5";
+    DetectorID fDetectorID;
+    G4ThreeVector fPhantomSize;
+
+    // the placements are not checked one by one as they are made,
+    // but all together at the end of Construct()
+    G4bool fCheckOverlaps = false;
+    OverlapMode fOverlapMode = kOverlapNew;
+    G4String fOverlapCache = "overlaps.cache";
+    G4bool fAnalyticSolids = true;
 
-    G4bool fCheckOverlaps = true;
+    G4GenericMessenger* fMessenger = nullptr;
+    G4UIcommand* fMaterialCommand = nullptr;
 };
 
 }
@@ -0,0 +1,109 @@
+//
+// ********************************************************************
+// * License and Disclaimer                                           *
+// *                                                                  *
+// * The  Geant4 software  is  copyright of the Copyright Holders  of *
+// * the Geant4 Collaboration.  It is provided  under  the terms  and *
+// * conditions of the Geant4 Software License,  included in the file *
+// * LICENSE and available at  http://cern.ch/geant4/license .  These *
+// * include a list of copyright holders.                             *
+// *                                                                  *
+// * Neither the authors of this software system, nor their employing *
+// * institutes,nor the agencies providing financial support for this *
+// * work  make  any representation or  warranty, express or implied, *
+// * regarding  this  software system or assume any liability for its *
+// * use.  Please see the license in the file  LICENSE  and URL above *
+// * for the full disclaimer and the limitation of liability.         *
+// *                                                                  *
+// * This  code  implementation is the result of  the  scientific and *
+// * technical work of the GEANT4 collaboration.                      *
+// * By using,  copying,  modifying or  distributing the software (or *
+// * any work based  on the software)  you  agree  to acknowledge its *
+// * use  in  resulting  scientific  publications,  and indicate your *
+// * acceptance of all terms of the Geant4 Software license.          *
+// ********************************************************************
+//
+/// \file DetectorID.hh
+/// \brief Definition of the B3::DetectorID class
+
+#ifndef B3DetectorID_h
+#define B3DetectorID_h 1
+
+#include "G4VTouchable.hh"
+#include "globals.hh"
+
+namespace B3
+{
+
+/// Global detector indexing scheme.
+///
+/// A crystal is identified by (ring, sector) and, for block detectors,
+/// by (module, sub-crystal) inside the sector. The fields are packed in
+/// a single dense integer:
+///
+///   id = ((ring*nbSectors + sector)*nbModules + module)*nbSubCrystals + sub
+///
+/// so that an id is directly an index into flat per-event and per-run
+/// arrays of size GetNbDetectors().
+///
+/// To get the id from the touchable without decoding replica numbers,
+/// DetectorConstruction gives each placement level a copy number equal to
+/// its own contribution to the id (the ring copies are numbered
+/// Pack(iring,0), the crystals Pack(0,icrys)): the id is then the sum of the
+/// copy numbers of the first GetNbLevels() levels of the touchable history.
+
+class DetectorID
+{
+  public:
+    DetectorID() = default;
+    DetectorID(G4int nbRings, G4int nbSectors,
+               G4int nbModules = 1, G4int nbSubCrystals = 1)
+     : fNbRings(nbRings), fNbSectors(nbSectors),
+       fNbModules(nbModules), fNbSubCrystals(nbSubCrystals),
+       fSectorStride(nbModules*nbSubCrystals),
+       fRingStride(nbSectors*nbModules*nbSubCrystals)
+    { }
+
+  public:
+    G4int GetNbRings()       const { return fNbRings; }
+    G4int GetNbSectors()     const { return fNbSectors; }
+    G4int GetNbModules()     const { return fNbModules; }
+    G4int GetNbSubCrystals() const { return fNbSubCrystals; }
+    G4int GetNbDetectors()   const { return fNbRings*fRingStride; }
+    G4int GetNbDetectorsPerRing() const { return fRingStride; }
+    G4int GetNbLevels()      const { return fNbLevels; }
+
+    G4int Pack(G4int ring, G4int sector, G4int module = 0, G4int sub = 0) const
+    { return ring*fRingStride + sector*fSectorStride + module*fNbSubCrystals + sub; }
+
+    G4int Ring(G4int id)   const { return id/fRingStride; }
+    G4int Sector(G4int id) const { return (id/fSectorStride)%fNbSectors; }
+    G4int Module(G4int id) const { return (id/fNbSubCrystals)%fNbModules; }
+    G4int Sub(G4int id)    const { return id%fNbSubCrystals; }
+
+    // Crystal index within a ring: the transaxial coordinate of the id
+    G4int Transaxial(G4int id) const { return id%fRingStride; }
+
+    G4int FromTouchable(const G4VTouchable* touchable) const
+    {
+      G4int id = touchable->GetCopyNumber(0);
+      for (G4int depth = 1; depth < fNbLevels; depth++)
+        id += touchable->GetCopyNumber(depth);
+      return id;
+    }
+
+  private:
+    G4int fNbRings = 0;
+    G4int fNbSectors = 0;
+    G4int fNbModules = 1;
+    G4int fNbSubCrystals = 1;
+    G4int fSectorStride = 1;
+    G4int fRingStride = 0;
+    G4int fNbLevels = 2;   // crystal in ring, ring in detector
+};
+
+}
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
+
+#endif
@@ -0,0 +1,154 @@
+//
+// ********************************************************************
+// * License and Disclaimer                                           *
+// *                                                                  *
+// * The  Geant4 software  is  copyright of the Copyright Holders  of *
+// * the Geant4 Collaboration.  It is provided  under  the terms  and *
+// * conditions of the Geant4 Software License,  included in the file *
+// * LICENSE and available at  http://cern.ch/geant4/license .  These *
+// * include a list of copyright holders.                             *
+// *                                                                  *
+// * Neither the authors of this software system, nor their employing *
+// * institutes,nor the agencies providing financial support for this *
+// * work  make  any representation or  warranty, express or implied, *
+// * regarding  this  software system or assume any liability for its *
+// * use.  Please see the license in the file  LICENSE  and URL above *
+// * for the full disclaimer and the limitation of liability.         *
+// *                                                                  *
+// * This  code  implementation is the result of  the  scientific and *
+// * technical work of the GEANT4 collaboration.                      *
+// * By using,  copying,  modifying or  distributing the software (or *
+// * any work based  on the software)  you  agree  to acknowledge its *
+// * use  in  resulting  scientific  publications,  and indicate your *
+// * acceptance of all terms of the Geant4 Software license.          *
+// ********************************************************************
+//
+/// \file DoseGrid.hh
+/// \brief Definition of the B3b::DoseGrid class
+
+#ifndef B3bDoseGrid_h
+#define B3bDoseGrid_h 1
+
+#include "globals.hh"
+#include "G4ThreeVector.hh"
+
+#include <cstdint>
+#include <utility>
+#include <vector>
+
+namespace B3b
+{
+
+/// Dose map settings, set with the /B3/dose/ commands.
+
+struct DoseGridParameters
+{
+  G4int fNbBins[3] = { 128, 128, 128 };
+  G4ThreeVector fSize;            // full size; zero: the phantom bounding box
+  G4ThreeVector fCenter;
+  G4bool fUncertainty = true;     // keep the second moment
+  G4int fMaxMemory = 512;         // MiB of accumulators per grid
+};
+
+/// Voxel dose map overlaying the phantom, one per thread.
+///
+/// B3::OrganDoseSD hands every energy deposit of the phantom to Deposit():
+/// the voxel is found arithmetically from the position, without a parallel
+/// world, so the steps are not limited at the voxel boundaries (the deposit
+/// of a charged particle is put at the midpoint of its step, the one of
+/// a neutral at its end point: no random number is drawn, so scoring the
+/// dose does not change the histories). As in G4PSDoseDeposit3D, the mass is the
+/// voxel volume times the density of the material of the step.
+///
+/// The deposits of an event are listed, then folded by EndOfEvent() into
+/// flat arrays indexed by x + nx*(y + ny*z):
+///  - the sum of the event doses,
+///  - the sum of their squares, for the per-voxel statistical uncertainty.
+/// The second moment is kept as a sum of squares rather than by a Welford
+/// update: only the voxels touched by the event are visited, the events
+/// which miss a voxel count as zeros, and the per-thread arrays merge with
+/// plain additions in Add().
+///
+/// With SetTrackChanges(), EndOfEvent() also lists the previous dose of each
+/// voxel it changes, so that a DoseVolumeHistogram can be kept up to date
+/// without scanning the grid.
+///
+/// The accumulators are dense: 16 bytes per voxel with the uncertainty, 8
+/// without, in every thread and in the master. The supported grids are up
+/// to 256^3 voxels (256 MiB per thread), below the fMaxMemory default;
+/// 512^3 would need 2 GiB per thread. A G4StatDouble map as in
+/// /score/create/boxMesh takes about 128 bytes per voxel reached instead.
+/// The sums stay in double: float sums would lose the small late deposits
+/// of a long run and spoil the variance.
+
+class DoseGrid
+{
+  public:
+    explicit DoseGrid(const DoseGridParameters& parameters);
+    ~DoseGrid() = default;
+
+    // bytes of the accumulators of one grid with these parameters
+    static std::size_t GetMemory(const DoseGridParameters& parameters);
+
+    // energy deposit divided by the density of the material
+    void Deposit(const G4ThreeVector& position, G4double edepOverDensity)
+    {
+      G4double x = (position.x() - fMin[0])*fInvVoxel[0];
+      G4double y = (position.y() - fMin[1])*fInvVoxel[1];
+      G4double z = (position.z() - fMin[2])*fInvVoxel[2];
+      if (x < 0. || y < 0. || z < 0. ||
+          x >= fNbBins[0] || y >= fNbBins[1] || z >= fNbBins[2]) return;
+      std::size_t voxel = std::size_t(x)
+        + std::size_t(fNbBins[0])*(std::size_t(y)
+        + std::size_t(fNbBins[1])*std::size_t(z));
+      fDeposits.emplace_back(voxel, edepOverDensity);
+    }
+
+    void EndOfEvent();
+
+    // (voxel, dose before the change) since the last TakeChanges()
+    void SetTrackChanges(G4bool track) { fTrackChanges = track; }
+    void TakeChanges(std::vector<std::pair<std::size_t, G4double>>& changes)
+    {
+      changes.clear();
+      changes.swap(fChanges);
+    }
+
+    // Voxel by voxel sum, split over threads for large grids
+    void Add(const DoseGrid& other);
+
+    // Dose and its standard deviation, in Gy, as raw float images with an
+    // Interfile header: <base>_dose.v/.hv and <base>_error.v/.hv
+    G4bool Write(const G4String& base) const;
+
+    G4int GetNbBins(G4int axis) const { return fNbBins[axis]; }
+    G4double GetMin(G4int axis) const { return fMin[axis]; }
+    G4double GetVoxelSize(G4int axis) const { return fVoxel[axis]; }
+    G4double GetVoxelVolume() const { return fVoxel[0]*fVoxel[1]*fVoxel[2]; }
+    std::size_t GetNbVoxels() const { return fSum.size(); }
+    G4long GetNbEvents() const { return fNbEvents; }
+    G4double GetDose(std::size_t voxel) const { return fSum[voxel]*fInvMass; }
+    G4double GetDoseError(std::size_t voxel) const;
+    G4double GetMaxDose() const;
+
+  private:
+    G4bool WriteImage(const G4String& base, const std::vector<float>& image) const;
+
+    G4int    fNbBins[3];
+    G4double fMin[3];
+    G4double fVoxel[3];
+    G4double fInvVoxel[3];
+    G4double fInvMass;          // per unit density
+    G4long   fNbEvents = 0;
+    G4bool   fTrackChanges = false;
+    std::vector<G4double> fSum;
+    std::vector<G4double> fSum2;
+    std::vector<std::pair<std::size_t, G4double>> fDeposits;
+    std::vector<std::pair<std::size_t, G4double>> fChanges;
+};
+
+}
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
+
+#endif
@@ -0,0 +1,123 @@
+//
+// ********************************************************************
+// * License and Disclaimer                                           *
+// *                                                                  *
+// * The  Geant4 software  is  copyright of the Copyright Holders  of *
+// * the Geant4 Collaboration.  It is provided  under  the terms  and *
+// * conditions of the Geant4 Software License,  included in the file *
+// * LICENSE and available at  http://cern.ch/geant4/license .  These *
+// * include a list of copyright holders.                             *
+// *                                                                  *
+// * Neither the authors of this software system, nor their employing *
+// * institutes,nor the agencies providing financial support for this *
+// * work  make  any representation or  warranty, express or implied, *
+// * regarding  this  software system or assume any liability for its *
+// * use.  Please see the license in the file  LICENSE  and URL above *
+// * for the full disclaimer and the limitation of liability.         *
+// *                                                                  *
+// * This  code  implementation is the result of  the  scientific and *
+// * technical work of the GEANT4 collaboration.                      *
+// * By using,  copying,  modifying or  distributing the software (or *
+// * any work based  on the software)  you  agree  to acknowledge its *
+// * use  in  resulting  scientific  publications,  and indicate your *
+// * acceptance of all terms of the Geant4 Software license.          *
+// ********************************************************************
+//
+/// \file DoseVolumeHistogram.hh
+/// \brief Definition of the B3b::DoseVolumeHistogram class
+
+#ifndef B3bDoseVolumeHistogram_h
+#define B3bDoseVolumeHistogram_h 1
+
+#include "globals.hh"
+
+#include <cstdint>
+#include <iosfwd>
+#include <utility>
+#include <vector>
+
+namespace B3b
+{
+
+class DoseGrid;
+
+/// Dose-volume histogram settings, set with the /B3/dvh/ commands.
+
+struct DvhParameters
+{
+  G4int fSamples = 2;          // label points per voxel and per axis
+  G4int fBinsPerDecade = 10;
+  G4int fCheckpoint = 0;       // events per thread between checkpoints
+};
+
+/// Dose-volume histograms of the organs, from a DoseGrid and the organ label
+/// of each of its voxels (B3::OrganLabelMap).
+///
+/// The doses are binned logarithmically, from 1e-15 Gy to 1e3 Gy, bin 0
+/// holding the voxels below. Fill() bins the whole grid, split over threads;
+/// Update() only moves the voxels listed by DoseGrid::TakeChanges() from
+/// their previous bin to the current one. EndOfEvent() does so every
+/// fCheckpoint events and appends the histograms to the checkpoint file.
+///
+/// Write() gives the cumulative histograms as CSV: for each organ and
+/// each bin, the volume receiving at least the lower edge of the bin.
+///
+/// A checkpoint histogram comes from the grid of one thread. That grid sums
+/// the dose of the events of this thread only, about 1/nThreads of those of
+/// the run. The checkpoint file therefore lists the events of the thread
+/// and of the whole run on each row. Its doses are projected to the whole
+/// run: they are scaled by the run events over the thread events, so that
+/// they compare with the final histograms of the master. Only the dose axis
+/// is scaled, so the incremental updates still hold. The histograms are
+/// wider than the final ones, since each voxel has fewer events.
+
+class DoseVolumeHistogram
+{
+  public:
+    DoseVolumeHistogram(const std::vector<std::uint8_t>& labels,
+                        G4int nbOrgans, G4double voxelVolume,
+                        const DvhParameters& parameters = DvhParameters());
+    ~DoseVolumeHistogram() = default;
+
+    void Fill(const DoseGrid& grid);
+    void Update(DoseGrid& grid);
+
+    // Checkpoints: grid must track its changes (DoseGrid::SetTrackChanges());
+    // nbRunEvents, the events of the whole run, scales the doses written
+    void SetCheckpointFile(const G4String& fileName, G4long nbRunEvents);
+    void EndOfEvent(DoseGrid& grid);
+
+    G4bool Write(const G4String& fileName, G4long nbEvents,
+                 G4bool append = false) const;
+
+    G4int GetNbBins() const { return fNbBins; }
+    G4double GetBinLowEdge(G4int bin) const;
+    G4long GetCount(G4int organ, G4int bin) const
+    { return fCounts[std::size_t(organ)*fNbBins + bin]; }
+
+    static const std::uint8_t kNoOrgan = 255;
+
+  private:
+    G4int Bin(G4double dose) const;
+    void WriteRows(std::ostream& file, const G4String& prefix,
+                   G4double doseScale) const;
+
+    const std::vector<std::uint8_t>& fLabels;
+    G4int    fNbOrgans;
+    G4double fVoxelVolume;
+    DvhParameters fParameters;
+    G4int    fNbBins;
+    G4double fMinDose;
+    std::vector<G4long> fCounts;       // [organ][bin]
+
+    G4String fCheckpointFile;
+    G4long   fNbEvents = 0;
+    G4long   fNbRunEvents = 0;
+    std::vector<std::pair<std::size_t, G4double>> fChanges;
+};
+
+}
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
+
+#endif
@@ -0,0 +1,104 @@
+//
+// ********************************************************************
+// * License and Disclaimer                                           *
+// *                                                                  *
+// * The  Geant4 software  is  copyright of the Copyright Holders  of *
+// * the Geant4 Collaboration.  It is provided  under  the terms  and *
+// * conditions of the Geant4 Software License,  included in the file *
+// * LICENSE and available at  http://cern.ch/geant4/license .  These *
+// * include a list of copyright holders.                             *
+// *                                                                  *
+// * Neither the authors of this software system, nor their employing *
+// * institutes,nor the agencies providing financial support for this *
+// * work  make  any representation or  warranty, express or implied, *
+// * regarding  this  software system or assume any liability for its *
+// * use.  Please see the license in the file  LICENSE  and URL above *
+// * for the full disclaimer and the limitation of liability.         *
+// *                                                                  *
+// * This  code  implementation is the result of  the  scientific and *
+// * technical work of the GEANT4 collaboration.                      *
+// * By using,  copying,  modifying or  distributing the software (or *
+// * any work based  on the software)  you  agree  to acknowledge its *
+// * use  in  resulting  scientific  publications,  and indicate your *
+// * acceptance of all terms of the Geant4 Software license.          *
+// ********************************************************************
+//
+/// \file ListModeReader.hh
+/// \brief Definition of the B3b::ListModeReader class
+
+#ifndef B3bListModeReader_h
+#define B3bListModeReader_h 1
+
+// Offline tool support: must not depend on Geant4
+
+#include "ListModeFormat.hh"
+
+#include <cstddef>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace B3b
+{
+
+/// Memory-mapped list-mode file reader.
+///
+/// The records are accessed in place, without copy. ForEachChunk() splits
+/// them in contiguous chunks processed in parallel, so that a pass over a
+/// file runs at memory bandwidth once the file is in the page cache.
+/// A trailing partial record (file still being written) is ignored.
+
+class ListModeReader
+{
+  public:
+    ListModeReader() = default;
+    ~ListModeReader();
+
+    ListModeReader(const ListModeReader&) = delete;
+    ListModeReader& operator=(const ListModeReader&) = delete;
+
+    bool Open(const std::string& fileName);
+    void Close();
+
+    const ListModeHeader& GetHeader() const { return fHeader; }
+    const ListModeRecord* GetRecords() const { return fRecords; }
+    std::size_t GetNbRecords() const { return fNbRecords; }
+    const std::string& GetError() const { return fError; }
+
+    // Calls func(first, last, chunk) for nbChunks contiguous chunks of
+    // records, one thread per chunk.
+    template <class Func>
+    void ForEachChunk(unsigned nbChunks, Func&& func) const;
+
+  private:
+    void*                 fMap = nullptr;
+    std::size_t           fMapSize = 0;
+    ListModeHeader        fHeader;
+    const ListModeRecord* fRecords = nullptr;
+    std::size_t           fNbRecords = 0;
+    std::string           fError;
+};
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
+
+template <class Func>
+void ListModeReader::ForEachChunk(unsigned nbChunks, Func&& func) const
+{
+  if (nbChunks < 1) nbChunks = 1;
+  std::vector<std::thread> threads;
+  threads.reserve(nbChunks);
+  for (unsigned chunk = 0; chunk < nbChunks; chunk++) {
+    std::size_t begin = fNbRecords*chunk/nbChunks;
+    std::size_t end = fNbRecords*(chunk+1)/nbChunks;
+    threads.emplace_back([this, &func, begin, end, chunk]() {
+      func(fRecords + begin, fRecords + end, chunk);
+    });
+  }
+  for (auto& thread : threads) thread.join();
+}
+
+}
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
+
+#endif
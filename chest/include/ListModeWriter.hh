@@ -0,0 +1,142 @@
+//
+// ********************************************************************
+// * License and Disclaimer                                           *
+// *                                                                  *
+// * The  Geant4 software  is  copyright of the Copyright Holders  of *
+// * the Geant4 Collaboration.  It is provided  under  the terms  and *
+// * conditions of the Geant4 Software License,  included in the file *
+// * LICENSE and available at  http://cern.ch/geant4/license .  These *
+// * include a list of copyright holders.                             *
+// *                                                                  *
+// * Neither the authors of this software system, nor their employing *
+// * institutes,nor the agencies providing financial support for this *
+// * work  make  any representation or  warranty, express or implied, *
+// * regarding  this  software system or assume any liability for its *
+// * use.  Please see the license in the file  LICENSE  and URL above *
+// * for the full disclaimer and the limitation of liability.         *
+// *                                                                  *
+// * This  code  implementation is the result of  the  scientific and *
+// * technical work of the GEANT4 collaboration.                      *
+// * By using,  copying,  modifying or  distributing the software (or *
+// * any work based  on the software)  you  agree  to acknowledge its *
+// * use  in  resulting  scientific  publications,  and indicate your *
+// * acceptance of all terms of the Geant4 Software license.          *
+// ********************************************************************
+//
+/// \file ListModeWriter.hh
+/// \brief Definition of the B3b::ListModeWriter class
+
+#ifndef B3bListModeWriter_h
+#define B3bListModeWriter_h 1
+
+#include "ListModeFormat.hh"
+#include "globals.hh"
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdio>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace B3b
+{
+
+class ListModeWriter;
+
+/// One block of list-mode records, handed over from a worker to the writer
+/// thread through its atomic state.
+
+struct ListModeBlock
+{
+  enum State { kFree = 0, kFull = 1 };
+
+  std::vector<ListModeRecord> fRecords;
+  std::size_t                 fSize = 0;
+  std::atomic<G4int>          fState{kFree};
+};
+
+/// List-mode channel: the double-buffered output of one worker thread.
+///
+/// The worker fills the active block without any locking. When it is full
+/// the block is published to the writer thread and the worker carries on
+/// with the other block. The worker waits only if the writer has not yet
+/// emptied that second block, i.e. if the disk cannot keep up.
+
+class ListModeChannel
+{
+  public:
+    static const std::size_t kBlockSize = 4096;
+
+    explicit ListModeChannel(ListModeWriter* writer);
+    ~ListModeChannel() = default;
+
+    void Push(const ListModeRecord& record)
+    {
+      fBlocks[fActive].fRecords[fCount++] = record;
+      if (fCount == kBlockSize) Submit();
+    }
+
+    // Publish the partially filled block (end of run)
+    void Flush() { if (fCount > 0) Submit(); }
+
+  private:
+    void Submit();
+
+    friend class ListModeWriter;
+
+    ListModeWriter* fWriter = nullptr;
+    ListModeBlock   fBlocks[2];
+    G4int           fActive = 0;
+    std::size_t     fCount = 0;
+    G4int           fNextWritten = 0;   // writer thread: blocks in order
+};
+
+/// List-mode writer
+///
+/// Owns the list-mode file and a dedicated thread which writes the blocks
+/// published by the channels. It is opened by the master at the beginning
+/// of the run and closed at its end, after the workers have flushed their
+/// channels, so that I/O never blocks the event loop.
+/// Opening an existing file appends to it if its header describes the
+/// same scanner.
+
+class ListModeWriter
+{
+  public:
+    static ListModeWriter* Instance();
+    ~ListModeWriter();
+
+    G4bool Open(const G4String& fileName, const ListModeHeader& header);
+    void   Close();
+    G4bool IsOpen() const { return fOpen.load(std::memory_order_acquire); }
+
+    // One channel per worker thread and per run
+    ListModeChannel* CreateChannel();
+
+    void Notify() { fWake.notify_one(); }
+
+  private:
+    ListModeWriter() = default;
+
+    void WriterLoop();
+    std::size_t WriteFullBlocks();
+
+    std::FILE*                                    fFile = nullptr;
+    G4String                                      fFileName;
+    std::atomic<G4bool>                           fOpen{false};
+    std::atomic<G4bool>                           fStop{false};
+    std::thread                                   fThread;
+    std::mutex                                    fChannelsMutex;
+    std::vector<std::unique_ptr<ListModeChannel>> fChannels;
+    std::mutex                                    fWakeMutex;
+    std::condition_variable                       fWake;
+    std::size_t                                   fNbRecords = 0;
+};
+
+}
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
+
+#endif
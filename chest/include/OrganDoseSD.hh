@@ -0,0 +1,111 @@
+//
+// ********************************************************************
+// * License and Disclaimer                                           *
+// *                                                                  *
+// * The  Geant4 software  is  copyright of the Copyright Holders  of *
+// * the Geant4 Collaboration.  It is provided  under  the terms  and *
+// * conditions of the Geant4 Software License,  included in the file *
+// * LICENSE and available at  http://cern.ch/geant4/license .  These *
+// * include a list of copyright holders.                             *
+// *                                                                  *
+// * Neither the authors of this software system, nor their employing *
+// * institutes,nor the agencies providing financial support for this *
+// * work  make  any representation or  warranty, express or implied, *
+// * regarding  this  software system or assume any liability for its *
+// * use.  Please see the license in the file  LICENSE  and URL above *
+// * for the full disclaimer and the limitation of liability.         *
+// *                                                                  *
+// * This  code  implementation is the result of  the  scientific and *
+// * technical work of the GEANT4 collaboration.                      *
+// * By using,  copying,  modifying or  distributing the software (or *
+// * any work based  on the software)  you  agree  to acknowledge its *
+// * use  in  resulting  scientific  publications,  and indicate your *
+// * acceptance of all terms of the Geant4 Software license.          *
+// ********************************************************************
+//
+/// \file OrganDoseSD.hh
+/// \brief Definition of the B3::OrganDoseSD class
+
+#ifndef B3OrganDoseSD_h
+#define B3OrganDoseSD_h 1
+
+#include "G4VSensitiveDetector.hh"
+#include "globals.hh"
+
+#include <vector>
+
+class G4Step;
+class G4HCofThisEvent;
+class G4TouchableHistory;
+class G4LogicalVolume;
+
+namespace B3b
+{
+class DoseGrid;
+}
+
+namespace B3
+{
+
+/// Organ dose sensitive detector.
+///
+/// A single instance per thread is attached to the logical volumes of all the
+/// organs of the OrganRegistry. It replaces one G4MultiFunctionalDetector +
+/// G4PSDoseDeposit per organ: no hits collection is created, the dose of the
+/// step (energy deposit divided by the precomputed mass of the volume, as in
+/// G4PSDoseDeposit) is added straight into
+///  - the run totals, a buffer owned by the current Run (see SetRunDose()),
+///  - the event dose, only for the organs which need per-event statistics.
+///    As in CrystalSD, the touched organs are listed so that the buffer is
+///    cleared in a time proportional to the number of hits.
+///  - the voxel dose map of the current Run, when there is one
+///    (see SetRunDoseGrid()).
+/// The volumes are found from the logical volume instance ID, with a flat
+/// lookup table.
+
+class OrganDoseSD : public G4VSensitiveDetector
+{
+  public:
+    OrganDoseSD(const G4String& name, G4int nbOrgans);
+    ~OrganDoseSD() override;
+
+    void   Initialize(G4HCofThisEvent*) override;
+    G4bool ProcessHits(G4Step*, G4TouchableHistory*) override;
+
+  public:
+    // excludeDaughters: the mass is that of the volume without its
+    // daughters, for a mother volume whose daughters fill its cavities
+    void AddVolume(G4LogicalVolume* volume, G4int organ, G4bool statistics,
+                   G4bool excludeDaughters = false);
+    // when the geometry is rebuilt: the volumes are added again
+    void ClearVolumes() { fVolumes.clear(); }
+
+    void SetRunDose(G4double* runDose) { fRunDose = runDose; }
+    const G4double* GetRunDose() const { return fRunDose; }
+
+    void SetRunDoseGrid(B3b::DoseGrid* grid) { fRunDoseGrid = grid; }
+    const B3b::DoseGrid* GetRunDoseGrid() const { return fRunDoseGrid; }
+
+    G4int GetNbOrgans() const { return G4int(fEventDose.size()); }
+    G4double GetEventDose(G4int organ) const { return fEventDose[organ]; }
+
+  private:
+    struct VolumeInfo
+    {
+      G4int    fOrgan = -1;
+      G4double fInvMass = 0.;
+      G4bool   fStatistics = false;
+    };
+
+    std::vector<VolumeInfo> fVolumes;   // indexed by logical volume instance ID
+    std::vector<G4double>   fEventDose;
+    std::vector<G4int>      fTouched;
+    G4double*               fRunDose = nullptr;
+    B3b::DoseGrid*          fRunDoseGrid = nullptr;
+};
+
+}
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
+
+#endif
@@ -0,0 +1,103 @@
+//
+// ********************************************************************
+// * License and Disclaimer                                           *
+// *                                                                  *
+// * The  Geant4 software  is  copyright of the Copyright Holders  of *
+// * the Geant4 Collaboration.  It is provided  under  the terms  and *
+// * conditions of the Geant4 Software License,  included in the file *
+// * LICENSE and available at  http://cern.ch/geant4/license .  These *
+// * include a list of copyright holders.                             *
+// *                                                                  *
+// * Neither the authors of this software system, nor their employing *
+// * institutes,nor the agencies providing financial support for this *
+// * work  make  any representation or  warranty, express or implied, *
+// * regarding  this  software system or assume any liability for its *
+// * use.  Please see the license in the file  LICENSE  and URL above *
+// * for the full disclaimer and the limitation of liability.         *
+// *                                                                  *
+// * This  code  implementation is the result of  the  scientific and *
+// * technical work of the GEANT4 collaboration.                      *
+// * By using,  copying,  modifying or  distributing the software (or *
+// * any work based  on the software)  you  agree  to acknowledge its *
+// * use  in  resulting  scientific  publications,  and indicate your *
+// * acceptance of all terms of the Geant4 Software license.          *
+// ********************************************************************
+//
+/// \file OrganLabelMap.hh
+/// \brief Definition of the B3::OrganLabelMap class
+
+#ifndef B3OrganLabelMap_h
+#define B3OrganLabelMap_h 1
+
+#include "globals.hh"
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+#include <vector>
+
+class G4Navigator;
+class G4VPhysicalVolume;
+
+namespace B3b
+{
+class DoseGrid;
+}
+
+namespace B3
+{
+
+/// Organ label of each voxel of a dose grid, shared by all threads.
+///
+/// The label is the index of the organ in the OrganRegistry, or
+/// B3b::DoseVolumeHistogram::kNoOrgan; it is found by locating
+/// samples^3 points of the voxel in the geometry and keeping the most
+/// frequent volume.
+///
+/// Build() is called by every thread which processes events, at the start
+/// of a run: the threads share out the z slices of the grid, each with its
+/// own navigator, and return once all the slices are labelled. The map is
+/// kept until the grid, the sampling or the world volume change.
+
+class OrganLabelMap
+{
+  public:
+    static OrganLabelMap* Instance();
+
+    const std::vector<std::uint8_t>& Build(const B3b::DoseGrid& grid,
+                                           G4int samples);
+    const std::vector<std::uint8_t>& GetLabels() const { return fLabels; }
+
+  private:
+    OrganLabelMap() = default;
+
+    struct Key
+    {
+      G4int    fNbBins[3] = { 0, 0, 0 };
+      G4double fMin[3] = { 0., 0., 0. };
+      G4double fVoxel[3] = { 0., 0., 0. };
+      G4int    fSamples = 0;
+      G4int    fNbOrgans = 0;
+      const G4VPhysicalVolume* fWorld = nullptr;
+
+      G4bool operator==(const Key& other) const;
+    };
+
+    void LabelSlice(G4Navigator& navigator, const B3b::DoseGrid& grid,
+                    G4int z, G4int samples);
+
+    Key                       fKey;
+    std::vector<std::uint8_t> fLabels;
+    std::vector<G4int>        fOrganOfVolume;  // by logical volume instance ID
+    std::atomic<G4int>        fNextSlice{0};
+    G4int                     fNbDone = 0;
+    std::mutex                fMutex;
+    std::condition_variable   fDone;
+};
+
+}
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
+
+#endif
@@ -0,0 +1,86 @@
+//
+// ********************************************************************
+// * License and Disclaimer                                           *
+// *                                                                  *
+// * The  Geant4 software  is  copyright of the Copyright Holders  of *
+// * the Geant4 Collaboration.  It is provided  under  the terms  and *
+// * conditions of the Geant4 Software License,  included in the file *
+// * LICENSE and available at  http://cern.ch/geant4/license .  These *
+// * include a list of copyright holders.                             *
+// *                                                                  *
+// * Neither the authors of this software system, nor their employing *
+// * institutes,nor the agencies providing financial support for this *
+// * work  make  any representation or  warranty, express or implied, *
+// * regarding  this  software system or assume any liability for its *
+// * use.  Please see the license in the file  LICENSE  and URL above *
+// * for the full disclaimer and the limitation of liability.         *
+// *                                                                  *
+// * This  code  implementation is the result of  the  scientific and *
+// * technical work of the GEANT4 collaboration.                      *
+// * By using,  copying,  modifying or  distributing the software (or *
+// * any work based  on the software)  you  agree  to acknowledge its *
+// * use  in  resulting  scientific  publications,  and indicate your *
+// * acceptance of all terms of the Geant4 Software license.          *
+// ********************************************************************
+//
+/// \file OrganRegistry.hh
+/// \brief Definition of the B3::OrganRegistry class
+
+#ifndef B3OrganRegistry_h
+#define B3OrganRegistry_h 1
+
+#include "globals.hh"
+
+#include <vector>
+
+namespace B3
+{
+
+/// One scored organ: the logical volume it is attached to, the name of
+/// its dose scorer, the label used in the printouts, whether the
+/// per-event statistics (G4StatAnalysis) are needed, or the run total only,
+/// and whether the mass of the daughter volumes is left out of its own.
+
+struct OrganEntry
+{
+  G4String fVolumeName;
+  G4String fScorerName;
+  G4String fLabel;
+  G4bool   fStatistics = true;
+  G4bool   fExcludeDaughters = false;
+};
+
+/// Organ registry
+///
+/// The table of scored organs, filled in
+/// DetectorConstruction::ConstructSDandField(). The organ index returned by
+/// Register() is the index of the organ accumulators in Run, so that adding
+/// an organ to the anatomy needs no change in Run or RunAction.
+///
+/// The registry is shared by all threads. Registering an already known scorer
+/// returns its index: every worker registers the same table, and only the
+/// first one to get there actually fills it.
+
+class OrganRegistry
+{
+  public:
+    static OrganRegistry* Instance();
+
+    G4int Register(const G4String& volumeName, const G4String& scorerName,
+                   const G4String& label, G4bool statistics = true,
+                   G4bool excludeDaughters = false);
+
+    G4int GetNbOrgans() const { return G4int(fOrgans.size()); }
+    const OrganEntry& GetOrgan(G4int i) const { return fOrgans[i]; }
+
+  private:
+    OrganRegistry() = default;
+
+    std::vector<OrganEntry> fOrgans;
+};
+
+}
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
+
+#endif
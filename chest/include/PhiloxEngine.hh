@@ -0,0 +1,113 @@
+//
+// ********************************************************************
+// * License and Disclaimer                                           *
+// *                                                                  *
+// * The  Geant4 software  is  copyright of the Copyright Holders  of *
+// * the Geant4 Collaboration.  It is provided  under  the terms  and *
+// * conditions of the Geant4 Software License,  included in the file *
+// * LICENSE and available at  http://cern.ch/geant4/license .  These *
+// * include a list of copyright holders.                             *
+// *                                                                  *
+// * Neither the authors of this software system, nor their employing *
+// * institutes,nor the agencies providing financial support for this *
+// * work  make  any representation or  warranty, express or implied, *
+// * regarding  this  software system or assume any liability for its *
+// * use.  Please see the license in the file  LICENSE  and URL above *
+// * for the full disclaimer and the limitation of liability.         *
+// *                                                                  *
+// * This  code  implementation is the result of  the  scientific and *
+// * technical work of the GEANT4 collaboration.                      *
+// * By using,  copying,  modifying or  distributing the software (or *
+// * any work based  on the software)  you  agree  to acknowledge its *
+// * use  in  resulting  scientific  publications,  and indicate your *
+// * acceptance of all terms of the Geant4 Software license.          *
+// ********************************************************************
+//
+/// \file PhiloxEngine.hh
+/// \brief Definition of the B3b::PhiloxEngine class
+
+#ifndef B3bPhiloxEngine_h
+#define B3bPhiloxEngine_h 1
+
+#include "CLHEP/Random/RandomEngine.h"
+#include "globals.hh"
+
+#include <cstdint>
+#include <string>
+
+namespace B3b
+{
+
+/// Per-event random streams, set with the /B3/random/ commands.
+
+struct EventStreamParameters
+{
+  G4bool fEnabled = false;
+  G4long fSeed = 12345;             // key of all the streams
+  G4int  fRun = -1;                 // run of the streams (-1: the run ID)
+  G4int  fFirstEvent = 0;           // stream of the first event of the run
+};
+
+/// Counter-based random engine: Philox4x32-10 (Salmon et al., "Parallel
+/// random numbers: as easy as 1, 2, 3", SC11).
+///
+/// Each block of four 32-bit numbers is a keyed bijection of a 128-bit
+/// counter: there is no state but the key and the counter. SetStream()
+/// takes the key from the run seed and the counter from the run and event
+/// IDs, so that the numbers of an event depend on nothing else: not on the
+/// thread which processes it, nor on the events before it, and any event
+/// can be replayed alone. Each flat() takes two 32-bit numbers.
+
+class PhiloxEngine : public CLHEP::HepRandomEngine
+{
+  public:
+    PhiloxEngine();
+    explicit PhiloxEngine(long seed);
+    ~PhiloxEngine() override = default;
+
+    // The stream of one event
+    void SetStream(std::uint64_t seed, std::uint32_t run, std::uint32_t event);
+
+    double flat() override;
+    void flatArray(const int size, double* vect) override;
+    void setSeed(long seed, int) override;
+    void setSeeds(const long* seeds, int) override;
+    void saveStatus(const char filename[] = "Philox.conf") const override;
+    void restoreStatus(const char filename[] = "Philox.conf") override;
+    void showStatus() const override;
+    std::string name() const override { return engineName(); }
+    static std::string engineName() { return "PhiloxEngine"; }
+
+    std::ostream& put(std::ostream& os) const override;
+    std::istream& get(std::istream& is) override;
+
+    operator double() override { return flat(); }
+    operator float() override { return float(flat()); }
+    operator unsigned int() override { return Next(); }
+
+    // One block of the bijection, for tests
+    static void Block(const std::uint32_t counter[4], const std::uint32_t key[2],
+                      std::uint32_t out[4]);
+
+  private:
+    std::uint32_t Next()
+    {
+      if (fUsed == 4) {
+        Block(fCounter, fKey, fBuffer);
+        if (++fCounter[0] == 0) fCounter[1]++;
+        fUsed = 0;
+      }
+      return fBuffer[fUsed++];
+    }
+
+    std::uint32_t fKey[2] = { 0, 0 };
+    std::uint32_t fCounter[4] = { 0, 0, 0, 0 };   // draw (64 bits), event, run
+    std::uint32_t fBuffer[4] = { 0, 0, 0, 0 };
+    int           fUsed = 4;
+};
+
+}
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
+
+#endif
@@ -37,6 +37,16 @@
 class G4ParticleGun;
 class G4Event;
 
+namespace CLHEP
+{
+class HepRandomEngine;
+}
+
+namespace B3b
+{
+class PhiloxEngine;
+}
+
 namespace B3
 {
 
@@ -44,7 +54,11 @@ namespace B3
 ///
 /// It defines an ion (F18), at rest, randomly distribued within a zone
 /// in a patient defined in GeneratePrimaries(). Ion F18 can be changed
-/// with the G4ParticleGun commands (see run2.mac).
+/// with the G4ParticleGun commands (see run2.mac), and the zone moved with
+/// /B3/source/position (see B3b::SourceParameters).
+/// With per-event random streams, the random engine of the thread is
+/// replaced by a B3b::PhiloxEngine, set to the stream of each event before
+/// anything is drawn.
 
 class PrimaryGeneratorAction : public G4VUserPrimaryGeneratorAction
 {
@@ -58,6 +72,8 @@ class PrimaryGeneratorAction : public G4VUserPrimaryGeneratorAction
 
   private:
     G4ParticleGun* fParticleGun = nullptr;
+    B3b::PhiloxEngine* fEngine = nullptr;
+    CLHEP::HepRandomEngine* fPreviousEngine = nullptr;
 };
 
 }
@@ -23,7 +23,6 @@
 // * acceptance of all terms of the Geant4 Software license.          *
 // ********************************************************************
 //
-//
 /// \file Run.hh
 /// \brief Definition of the B3b::Run class
 
@@ -33,19 +32,68 @@
 #include "G4Run.hh"
 #include "globals.hh"
 #include "G4StatAnalysis.hh"
+#include "G4ThreeVector.hh"
+#include "Digitizer.hh"
+#include "PhiloxEngine.hh"
+
+#include <vector>
+
+namespace B3
+{
+class CrystalSD;
+class OrganDoseSD;
+}
 
 namespace B3b
 {
 
+class ListModeChannel;
+class SorterChannel;
+class Sinogram;
+class DoseGrid;
+class DoseVolumeHistogram;
+class ConvergenceMonitor;
+class BatchChannel;
+class ThroughputChannel;
+
+/// Centre of the source zone, when moved with /B3/source/position;
+/// otherwise B3::PrimaryGeneratorAction keeps its own.
+
+struct SourceParameters
+{
+  G4bool        fMoved = false;
+  G4ThreeVector fPosition;
+};
+
 /// Run class
 ///
 /// In RecordEvent() there is collected information event per event
-/// from Hits Collections, and accumulated statistic for the run
+/// from the sensitive detectors, and accumulated statistic for the run.
+/// The crystal energies are read directly from the buffer of B3::CrystalSD
+/// and turned into singles by the Digitizer of the thread.
+/// The organ doses are kept in contiguous arrays indexed as the entries of
+/// B3::OrganRegistry: the run totals are filled directly by B3::OrganDoseSD,
+/// the per-event statistics in RecordEvent().
+/// When list-mode output is active, each coincidence is also pushed to the
+/// ListModeChannel of the thread. When the singles sorter is active, the
+/// singles are pushed to the SorterChannel of the thread instead, and the
+/// coincidences are formed across events by the SinglesSorter.
+/// The coincidences may also be binned in a Sinogram, one per thread,
+/// summed in Merge(). Likewise, B3::OrganDoseSD may fill the voxel DoseGrid
+/// of the run, whose event deposits are folded in RecordEvent(), where the
+/// DoseVolumeHistogram of the thread is also updated at its checkpoints.
+/// With a ConvergenceMonitor, the statistics of the run are published at
+/// regular intervals, and the event loop is aborted once the monitor has
+/// converged. With a BatchChannel, the event doses of the organs with
+/// statistics and the good events are also accumulated in batches, which
+/// the master can read at any time during the run.
+/// The events are counted in the ThroughputChannel of the thread, which the
+/// master samples to report the progress of the run.
 
 class Run : public G4Run
 {
   public:
-    Run();
+    Run(const DigitizerParameters& digitizer = DigitizerParameters());
     ~Run() override;
 
     void RecordEvent(const G4Event*) override;
@@ -53,36 +101,73 @@ class Run : public G4Run
 
   public:
     G4int GetNbGoodEvents() const { return fGoodEvents; }
-    G4double GetSumDoseLeftLung()   const { return fSumDoseLeftLung; }
-    G4StatAnalysis GetStatDoseLeftLung() const { return fStatDoseLeftLung; }
-    G4double GetSumDoseRightLung()   const { return fSumDoseRightLung; }
-    G4StatAnalysis GetStatDoseRightLung() const { return fStatDoseRightLung; }
-    G4double GetSumDoseHeart()   const { return fSumDoseHeart; }
-    G4StatAnalysis GetStatDoseHeart() const { return fStatDoseHeart; }
-    G4double GetSumDoseRibs()   const { return fSumDoseRibs; }
-    G4StatAnalysis GetStatDoseRibs() const { return fStatDoseRibs; }
-    G4double GetSumDoseRibCage()   const { return fSumDoseRibCage; }
-    G4StatAnalysis GetStatDoseRibCage() const { return fStatDoseRibCage; }
+    G4long GetNbSingles() const { return fNbSingles; }
+    G4long GetNbPiledUp() const { return fNbPiledUp; }
+    G4long GetNbDeadTimeLost() const { return fNbDeadTimeLost; }
+    G4int GetNbOrgans() const { return G4int(fSumDose.size()); }
+    G4double GetSumDose(G4int organ) const { return fSumDose[organ]; }
+    const G4StatAnalysis& GetStatDose(G4int organ) const
+    { return fStatDose[organ]; }
+
+    void SetListModeChannel(ListModeChannel* channel) { fListMode = channel; }
+    ListModeChannel* GetListModeChannel() const { return fListMode; }
+
+    void SetSorterChannel(SorterChannel* channel) { fSorter = channel; }
+    SorterChannel* GetSorterChannel() const { return fSorter; }
+
+    // Owned by the run
+    void SetSinogram(Sinogram* sinogram) { fSinogram = sinogram; }
+    Sinogram* GetSinogram() const { return fSinogram; }
+
+    // Owned by the run, filled by the organ detector
+    void SetDoseGrid(DoseGrid* grid);
+    DoseGrid* GetDoseGrid() const { return fDoseGrid; }
+
+    // Owned by the run
+    void SetDoseVolumeHistogram(DoseVolumeHistogram* dvh) { fDvh = dvh; }
+
+    void SetConvergenceMonitor(ConvergenceMonitor* monitor)
+    { fConvergence = monitor; }
+
+    // Names of the quantities filled in the batch channel
+    std::vector<G4String> GetBatchQuantities() const;
+    void SetBatchChannel(BatchChannel* channel);
+
+    void SetThroughputChannel(ThroughputChannel* channel)
+    { fThroughput = channel; }
+
+    // Read by the primary generator at each event
+    void SetEventStreams(const EventStreamParameters& streams)
+    { fStreams = streams; }
+    const EventStreamParameters& GetEventStreams() const { return fStreams; }
+
+    // Read by the primary generator at each event
+    void SetSource(const SourceParameters& source) { fSource = source; }
+    const SourceParameters& GetSource() const { return fSource; }
 
   private:
-    G4int fCollID_cryst = -1;
-    G4int fCollID_leftLung = -1;
-    G4int fCollID_rightLung = -1;
-    G4int fCollID_heart = -1;
-    G4int fCollID_ribs = -1;
-    G4int fCollID_ribCage= -1;
-    G4int fPrintModulo = 10000;
+    B3::CrystalSD* fCrystalSD = nullptr;
+    B3::OrganDoseSD* fOrganSD = nullptr;
+    ListModeChannel* fListMode = nullptr;
+    SorterChannel* fSorter = nullptr;
+    Sinogram* fSinogram = nullptr;
+    DoseGrid* fDoseGrid = nullptr;
+    DoseVolumeHistogram* fDvh = nullptr;
+    ConvergenceMonitor* fConvergence = nullptr;
+    BatchChannel* fBatch = nullptr;
+    std::vector<G4double> fBatchValues;
+    ThroughputChannel* fThroughput = nullptr;
+    EventStreamParameters fStreams;
+    SourceParameters fSource;
+    Digitizer* fDigitizer = nullptr;
+    Singles fSingles;
     G4int fGoodEvents = 0;
-    G4double fSumDoseLeftLung = 0.;
-    G4StatAnalysis fStatDoseLeftLung;
-    G4double fSumDoseRightLung = 0.;
-    G4StatAnalysis fStatDoseRightLung;
-    G4double fSumDoseHeart = 0.;
-    G4StatAnalysis fStatDoseHeart;
-    G4double fSumDoseRibs = 0.;
-    G4StatAnalysis fStatDoseRibs;
-    G4double fSumDoseRibCage = 0.;
-    G4StatAnalysis fStatDoseRibCage;
+    G4long fNbSingles = 0;
+    G4long fNbPiledUp = 0;
+    G4long fNbDeadTimeLost = 0;
+    std::vector<G4int> fStatOrgans;
+    std::vector<G4double> fSumDose;
+    std::vector<G4StatAnalysis> fStatDose;
 };
 
 }
@@ -91,4 +176,3 @@ class Run : public G4Run
 
 #endif
 
-
@@ -32,13 +32,48 @@
 
 #include "G4UserRunAction.hh"
 #include "globals.hh"
+#include "Digitizer.hh"
+#include "SinglesSorter.hh"
+#include "Sinogram.hh"
+#include "DoseGrid.hh"
+#include "DoseVolumeHistogram.hh"
+#include "ConvergenceMonitor.hh"
+#include "BatchStatistics.hh"
+#include "ThroughputMonitor.hh"
+#include "Run.hh"
 
 class G4Run;
+class G4GenericMessenger;
 
 namespace B3b
 {
 
 /// Run action class
+///
+/// The master opens and closes the list-mode output (/B3/listmode/ commands),
+/// each thread which processes events attaches a channel to its Run.
+/// The digitizer settings (/B3/digitizer/ commands) are handed to each Run.
+/// The master also opens and closes the singles sorter (/B3/sorter/
+/// commands), each thread which processes events then feeds it.
+/// With /B3/sinogram/enable, each Run bins its coincidences in a Sinogram,
+/// written by the master at the end of the run.
+/// With /B3/dose/enable, each Run also fills a voxel DoseGrid over the
+/// phantom, merged and written by the master in the same way. With
+/// /B3/dvh/enable, the master also writes the dose-volume histograms of the
+/// organs, and each thread may write its own at checkpoints.
+/// With /B3/convergence/enable, the run stops as soon as the relative errors
+/// set with the /B3/convergence/ commands are reached (ConvergenceMonitor).
+/// With /B3/batch/enable, each thread accumulates batch means, which the
+/// master reports during and at the end of the run (BatchStatistics).
+/// The master also reports the progress and the throughput of the run from
+/// the counters of the threads (/B3/throughput/ commands, ThroughputMonitor);
+/// with /B3/throughput/breakdown, each thread installs the SteppingAction
+/// and TrackingAction that count its steps and tracks.
+/// With /B3/random/eventStreams, the random numbers of each event come from
+/// its own stream, derived from the seed and the run and event IDs
+/// (PhiloxEngine): the results no longer depend on the number of threads.
+/// /B3/source/position moves the source zone of the primary generator, from
+/// the next run on.
 
 class RunAction : public G4UserRunAction
 {
@@ -49,6 +84,49 @@ class RunAction : public G4UserRunAction
     G4Run* GenerateRun() override;
     void BeginOfRunAction(const G4Run*) override;
     void   EndOfRunAction(const G4Run*) override;
+
+  private:
+    void DefineCommands();
+    void SetMultiplesPolicy(const G4String& policy);
+    void SetDoseBins(const G4String& bins);
+    void AddOrganTarget(const G4String& target);
+    void ClearTargets();
+    void SetSourcePosition(const G4ThreeVector& position);
+    void ResetSource();
+
+    G4GenericMessenger* fMessenger = nullptr;
+    G4GenericMessenger* fDigitizerMessenger = nullptr;
+    G4GenericMessenger* fSorterMessenger = nullptr;
+    G4GenericMessenger* fSinogramMessenger = nullptr;
+    G4GenericMessenger* fDoseMessenger = nullptr;
+    G4GenericMessenger* fDvhMessenger = nullptr;
+    G4GenericMessenger* fConvergenceMessenger = nullptr;
+    G4GenericMessenger* fBatchMessenger = nullptr;
+    G4GenericMessenger* fThroughputMessenger = nullptr;
+    G4GenericMessenger* fRandomMessenger = nullptr;
+    G4GenericMessenger* fSourceMessenger = nullptr;
+    G4bool   fListMode = false;
+    G4String fListModeFile = "listmode.lm";
+    DigitizerParameters fDigitizer;
+    G4bool   fSorting = false;
+    SorterParameters fSorter;
+    G4bool   fSinogramOn = false;
+    G4String fSinogramFile = "sinogram";
+    SinogramParameters fSinogram;
+    G4bool   fDoseOn = false;
+    G4String fDoseFile = "dose";
+    DoseGridParameters fDose;
+    G4bool   fDvhOn = false;
+    G4String fDvhFile = "dvh";
+    DvhParameters fDvh;
+    G4bool   fConvergenceOn = false;
+    ConvergenceTargets fConvergence;
+    G4bool   fBatchOn = false;
+    BatchParameters fBatch;
+    ThroughputParameters fThroughput;
+    G4bool   fCounting = false;         // stepping and tracking actions set
+    EventStreamParameters fStreams;
+    SourceParameters fSource;
 };
 
 }
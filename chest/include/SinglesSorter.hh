@@ -0,0 +1,223 @@
+//
+// ********************************************************************
+// * License and Disclaimer                                           *
+// *                                                                  *
+// * The  Geant4 software  is  copyright of the Copyright Holders  of *
+// * the Geant4 Collaboration.  It is provided  under  the terms  and *
+// * conditions of the Geant4 Software License,  included in the file *
+// * LICENSE and available at  http://cern.ch/geant4/license .  These *
+// * include a list of copyright holders.                             *
+// *                                                                  *
+// * Neither the authors of this software system, nor their employing *
+// * institutes,nor the agencies providing financial support for this *
+// * work  make  any representation or  warranty, express or implied, *
+// * regarding  this  software system or assume any liability for its *
+// * use.  Please see the license in the file  LICENSE  and URL above *
+// * for the full disclaimer and the limitation of liability.         *
+// *                                                                  *
+// * This  code  implementation is the result of  the  scientific and *
+// * technical work of the GEANT4 collaboration.                      *
+// * By using,  copying,  modifying or  distributing the software (or *
+// * any work based  on the software)  you  agree  to acknowledge its *
+// * use  in  resulting  scientific  publications,  and indicate your *
+// * acceptance of all terms of the Geant4 Software license.          *
+// ********************************************************************
+//
+/// \file SinglesSorter.hh
+/// \brief Definition of the B3b::SinglesSorter class
+
+#ifndef B3bSinglesSorter_h
+#define B3bSinglesSorter_h 1
+
+#include "Digitizer.hh"
+#include "ListModeFormat.hh"
+#include "globals.hh"
+
+#include <atomic>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace B3b
+{
+
+class ListModeChannel;
+class SinglesSorter;
+class Sinogram;
+
+/// Multiples policies: what to do with more than two singles in one
+/// coincidence window.
+
+enum MultiplesPolicy
+{
+  kTakeAll = 0,     // every pair of the window
+  kKillAll = 1,     // no coincidence
+  kTakeWinner = 2   // the pair of the two highest energies
+};
+
+/// Sorter settings, set with the /B3/sorter/ commands.
+
+struct SorterParameters
+{
+  G4double fActivity = 0.;          // decays per unit time of the source
+  G4double fWindow = 0.;            // coincidence window
+  G4int    fPolicy = kTakeWinner;
+};
+
+/// Sorter counts for one run, with the simulated time they span.
+
+struct SorterStatistics
+{
+  G4long   fNbSingles = 0;          // singles from the crystals
+  G4long   fNbDetected = 0;         // singles out of the digitizer
+  G4long   fNbPrompts = 0;
+  G4long   fNbTrues = 0;
+  G4long   fNbScatters = 0;
+  G4long   fNbRandoms = 0;
+  G4long   fNbMultiples = 0;        // windows with more than two singles
+  G4double fDuration = 0.;
+};
+
+/// One single in the time-ordered stream of a thread.
+
+struct SingleRecord
+{
+  G4double      fTime;
+  G4double      fEnergy;
+  G4long        fEventID;
+  G4int         fDetector;
+  std::uint32_t fFlags;
+};
+
+/// Sorter channel: the singles stream of one worker thread.
+///
+/// Each event takes the next tick of the activity clock, and its singles
+/// are shifted to it. They wait in a small local heap until the next event,
+/// as all later singles of the thread come after its time: the older ones
+/// then go to a fixed size single-producer single-consumer ring, in time
+/// order, and the event time is published as the watermark of the channel.
+/// The worker waits only if the ring is full, i.e. if the sorter, or
+/// another worker, lags behind.
+/// A channel counts for the sorter only once a thread has opened it for
+/// the run: with the tasking run manager some threads may process no event
+/// at all, and their channels must not hold the others back.
+/// Likewise, a thread may run out of events long before the end of the
+/// run, where it closes its channel: its watermark would then hold back
+/// the others until their rings are full, and they would wait forever. The
+/// sorter parks such an idle channel: it takes the singles left in its
+/// heap, under the channel mutex which the worker holds only within
+/// PushEvent() and Close(), and leaves it out of the lowest watermark. The
+/// next event of the thread unparks it, with the current clock as its
+/// watermark, before it takes its tick: its singles cannot come earlier.
+
+class SorterChannel
+{
+  public:
+    static const std::size_t kRingSize = 1 << 16;
+
+    explicit SorterChannel(SinglesSorter* sorter);
+    ~SorterChannel() = default;
+
+    // Worker side: the singles of one event, time-ordered
+    void PushEvent(const Singles& singles);
+
+    // Worker side: no more singles in this run
+    void Close();
+
+  private:
+    void Release(G4double watermark);
+
+    friend class SinglesSorter;
+
+    SinglesSorter*            fSorter = nullptr;
+    std::mutex                fMutex;         // fLocal, fParked changes
+    std::vector<SingleRecord> fLocal;         // heap, earliest first
+    std::vector<SingleRecord> fRing;
+    std::atomic<std::size_t>  fHead{0};       // written by the worker
+    std::atomic<std::size_t>  fTail{0};       // written by the sorter
+    std::atomic<G4double>     fWatermark{-DBL_MAX};
+    std::atomic<G4bool>       fOpened{false};
+    std::atomic<G4bool>       fParked{false}; // idle, heap taken by the sorter
+};
+
+/// Singles sorter
+///
+/// Owns one channel per thread and a sorter thread which merges them into
+/// a global time order. The sorter takes from the rings only the singles
+/// earlier than the lowest watermark, which no thread can precede anymore,
+/// so memory is bounded by the rings. The merged singles go through the
+/// Digitizer, whose dead time and pile-up now act across events, then
+/// through a non-paralyzable coincidence window opened by each single out
+/// of a window. Singles of different events make a random coincidence.
+/// The coincidences are written to the list-mode output and binned in the
+/// sinogram, if any.
+/// It is opened by the master at the beginning of the run and closed at
+/// its end, after the workers have closed their channels.
+
+class SinglesSorter
+{
+  public:
+    static SinglesSorter* Instance();
+    ~SinglesSorter();
+
+    void Open(const SorterParameters& parameters,
+              const DigitizerParameters& digitizer, G4int nbDetectors,
+              G4int nbChannels, ListModeChannel* output,
+              Sinogram* sinogram = nullptr);
+    void Close();
+    G4bool IsOpen() const { return fOpen.load(std::memory_order_acquire); }
+
+    // The channel of a thread, by thread id, which it takes for this run
+    SorterChannel* OpenChannel(G4int thread);
+
+    // Next tick of the activity clock, and the last one taken
+    G4double NextEventTime();
+    G4double GetClock() const { return fClock.load(std::memory_order_acquire); }
+
+    void Notify() { fWake.notify_one(); }
+
+    // Valid once closed
+    const SorterStatistics& GetStatistics() const { return fStatistics; }
+
+  private:
+    SinglesSorter() = default;
+
+    void SorterLoop();
+    void Park(SorterChannel& channel);
+    std::size_t Merge(G4double horizon);
+    void Digitize(G4double horizon);
+    void Coincide(G4double horizon);
+    void Coincidence(std::size_t i, std::size_t j);
+
+    SorterParameters                            fParameters;
+    std::unique_ptr<Digitizer>                  fDigitizer;
+    ListModeChannel*                            fOutput = nullptr;
+    Sinogram*                                   fSinogram = nullptr;
+    std::vector<std::unique_ptr<SorterChannel>> fChannels;
+    std::atomic<G4double>                       fClock{0.};
+    std::atomic<G4bool>                         fOpen{false};
+    std::atomic<G4bool>                         fStop{false};
+    std::thread                                 fThread;
+    std::mutex                                  fWakeMutex;
+    std::condition_variable                     fWake;
+
+    // sorter thread only
+    std::vector<std::pair<G4double, std::size_t>> fHeads;
+    std::vector<G4double>                       fWatermarks;
+    std::vector<G4double>                       fIdleWatermarks;
+    G4double                                    fHorizon = -DBL_MAX;
+    std::vector<SingleRecord>                   fParkedSingles; // heap
+    Singles                                     fMerged;
+    Singles                                     fCarry;
+    Singles                                     fPending;  // digitized
+    std::size_t                                 fNbTaken = 0;
+    SorterStatistics                            fStatistics;
+};
+
+}
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
+
+#endif
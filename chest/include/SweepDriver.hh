@@ -0,0 +1,106 @@
+//
+// ********************************************************************
+// * License and Disclaimer                                           *
+// *                                                                  *
+// * The  Geant4 software  is  copyright of the Copyright Holders  of *
+// * the Geant4 Collaboration.  It is provided  under  the terms  and *
+// * conditions of the Geant4 Software License,  included in the file *
+// * LICENSE and available at  http://cern.ch/geant4/license .  These *
+// * include a list of copyright holders.                             *
+// *                                                                  *
+// * Neither the authors of this software system, nor their employing *
+// * institutes,nor the agencies providing financial support for this *
+// * work  make  any representation or  warranty, express or implied, *
+// * regarding  this  software system or assume any liability for its *
+// * use.  Please see the license in the file  LICENSE  and URL above *
+// * for the full disclaimer and the limitation of liability.         *
+// *                                                                  *
+// * This  code  implementation is the result of  the  scientific and *
+// * technical work of the GEANT4 collaboration.                      *
+// * By using,  copying,  modifying or  distributing the software (or *
+// * any work based  on the software)  you  agree  to acknowledge its *
+// * use  in  resulting  scientific  publications,  and indicate your *
+// * acceptance of all terms of the Geant4 Software license.          *
+// ********************************************************************
+/// \file SweepDriver.hh
+/// \brief Definition of the B3b::SweepDriver class
+
+#ifndef B3bSweepDriver_h
+#define B3bSweepDriver_h 1
+
+#include "globals.hh"
+
+#include <vector>
+
+namespace B3b
+{
+
+/// One parameter of a sweep: the command which sets it, its values as
+/// written in the grid file and their unit, if any.
+
+struct SweepAxis
+{
+  G4String              fName;
+  G4String              fCommand;
+  G4int                 fRank = 0;    // smaller ranks change less often
+  G4String              fUnit;
+  std::vector<G4String> fValues;
+};
+
+/// In-process sweep driver
+///
+/// Runs every point of a parameter grid in the same process, one run per
+/// point, so that the physics tables are built once: between two points
+/// only the changed parameters are set again, through their UI commands.
+/// A change of the scanner rebuilds the geometry (/B3/detector/ commands),
+/// a change of material also adds the tables of the new material, and a
+/// change of source position rebuilds nothing. The points are ordered with
+/// the material changing the least often, then the scanner, then the source.
+///
+/// The grid file has one parameter per line, followed by its values and,
+/// for lengths, a unit; the source positions are written x,y,z:
+///
+///   material    LSO LYSO BGO
+///   crystalDZ   20 25 30 mm
+///   nbCrystals  32 48
+///   nbRings     9
+///   source      0,0,0 4,4,4 cm
+///   events      20000
+///   table       sweep.tsv
+///
+/// The other parameters are crystalDX, crystalDY and gap. Each point appends
+/// a row to the table (tab separated, with a header when the file is new):
+/// the values of the point, the events, good events, efficiency, singles,
+/// the wall time of the run, and the total dose of each organ. A point
+/// whose command fails, such as an unknown material, or whose rings would
+/// cut into the phantom is skipped and counted as failed, with no row.
+
+class SweepDriver
+{
+  public:
+    SweepDriver() = default;
+    ~SweepDriver() = default;
+
+    // false if the file cannot be read or has an unknown parameter
+    G4bool Read(const G4String& fileName);
+
+    // number of points which failed
+    G4int Run();
+
+    G4int GetNbPoints() const;
+
+  private:
+    G4bool AddAxis(const G4String& name, std::vector<G4String>& tokens);
+    void WriteRow(const std::vector<G4int>& point, G4double seconds,
+                  G4bool header) const;
+
+    std::vector<SweepAxis> fAxes;
+    G4int    fNbEvents = 10000;
+    G4String fTable = "sweep.tsv";
+};
+
+}
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
+
+#endif
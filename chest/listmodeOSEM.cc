@@ -0,0 +1,543 @@
+//
+// ********************************************************************
+// * License and Disclaimer                                           *
+// *                                                                  *
+// * The  Geant4 software  is  copyright of the Copyright Holders  of *
+// * the Geant4 Collaboration.  It is provided  under  the terms  and *
+// * conditions of the Geant4 Software License,  included in the file *
+// * LICENSE and available at  http://cern.ch/geant4/license .  These *
+// * include a list of copyright holders.                             *
+// *                                                                  *
+// * Neither the authors of this software system, nor their employing *
+// * institutes,nor the agencies providing financial support for this *
+// * work  make  any representation or  warranty, express or implied, *
+// * regarding  this  software system or assume any liability for its *
+// * use.  Please see the license in the file  LICENSE  and URL above *
+// * for the full disclaimer and the limitation of liability.         *
+// *                                                                  *
+// * This  code  implementation is the result of  the  scientific and *
+// * technical work of the GEANT4 collaboration.                      *
+// * By using,  copying,  modifying or  distributing the software (or *
+// * any work based  on the software)  you  agree  to acknowledge its *
+// * use  in  resulting  scientific  publications,  and indicate your *
+// * acceptance of all terms of the Geant4 Software license.          *
+// ********************************************************************
+//
+/// \file listmodeOSEM.cc
+/// \brief List-mode OSEM reconstruction of the B3b coincidences
+//
+// Reconstructs an activity image from list-mode files, with Siddon's
+// projector, ordered subsets and a sensitivity image cached on disk.
+// With -M the projections are read from a precomputed system matrix
+// (B3b::SystemMatrix), generated in the cache directory on first use.
+//
+//   listmodeOSEM [options] file.lm [file2.lm ...]
+//     -i <iterations>     number of iterations               (default 3)
+//     -S <subsets>        number of subsets                  (default 8)
+//     -n <nx>:<ny>:<nz>   image size                (default 128:128:2*rings-1)
+//     -v <vx>:<vy>:<vz>   voxel size [mm]   (default 90% of the bore, ring/2)
+//     -d <depth>          interaction depth in the crystal [mm]
+//                                                      (default half crystal)
+//     -x                  reject the coincidences flagged as scattered
+//     -t                  trues only: reject scattered and random coincidences
+//     -j <threads>        number of threads                  (default all)
+//     -M                  use the system matrix cache instead of tracing
+//     -c <dir>            sensitivity image and system matrix cache
+//                                                            (default .)
+//     -o <prefix>         output image <prefix>.v/.hv        (default osem)
+//     -k                  also write the image of every iteration
+
+#include "ListModeReader.hh"
+#include "ListModeProjector.hh"
+#include "SystemMatrix.hh"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+using namespace B3b;
+
+namespace
+{
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
+
+struct Options
+{
+  int         fIterations = 3;
+  int         fSubsets = 8;
+  ImageGrid   fGrid;
+  float       fDepth = -1.f;
+  bool        fRejectScatter = false;
+  bool        fTruesOnly = false;
+  unsigned    fNbThreads = std::thread::hardware_concurrency();
+  std::string fCacheDir = ".";
+  std::string fPrefix = "osem";
+  bool        fKeepIterations = false;
+  bool        fSystemMatrix = false;
+};
+
+struct Lor
+{
+  std::int32_t fDetector1;
+  std::int32_t fDetector2;
+};
+
+using Clock = std::chrono::steady_clock;
+
+double Seconds(Clock::time_point start)
+{
+  return std::chrono::duration<double>(Clock::now() - start).count();
+}
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
+
+// Siddon's projector traced for every use, with the interface of
+// B3b::SystemMatrix
+struct TracingProjector
+{
+  const ScannerGeometry&   fScanner;
+  const ListModeProjector& fProjector;
+
+  float Forward(int d1, int d2, const float* image) const
+  {
+    return fProjector.Forward(fScanner.GetPosition(d1),
+                              fScanner.GetPosition(d2), image);
+  }
+
+  void Back(int d1, int d2, float value, float* image) const
+  {
+    fProjector.Back(fScanner.GetPosition(d1), fScanner.GetPosition(d2),
+                    value, image);
+  }
+};
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
+
+// Sum of the per-thread back projections into out; the buffers are left
+// cleared for the next pass. Plain contiguous loops, vectorized by the
+// compiler.
+void Reduce(std::vector<std::vector<float>>& buffers, std::vector<float>& out,
+            unsigned nbThreads)
+{
+  ParallelFor(nbThreads, out.size(), 1 << 16,
+    [&](std::size_t first, std::size_t last, unsigned) {
+      float* sum = out.data();
+      for (std::size_t i = first; i < last; i++) sum[i] = 0.f;
+      for (auto& buffer : buffers) {
+        float* partial = buffer.data();
+        for (std::size_t i = first; i < last; i++) {
+          sum[i] += partial[i];
+          partial[i] = 0.f;
+        }
+      }
+    });
+}
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
+
+// Sensitivity and system matrix cache: the file names carry a hash of
+// everything they depend on.
+struct SensitivityFileHeader
+{
+  char          fMagic[8];
+  std::uint64_t fKey;
+  std::int32_t  fNx, fNy, fNz;
+  std::int32_t  fReserved;
+};
+
+const char kSensitivityMagic[8] = { 'B','3','S','E','N','S','1','\0' };
+
+// voxels below this fraction of the maximum sensitivity are not reconstructed
+const float kSensitivityThreshold = 0.05f;
+
+std::uint64_t CacheKey(const ListModeHeader& header, const Options& options)
+{
+  std::uint64_t hash = 0xcbf29ce484222325ULL;
+  auto mix = [&hash](const void* data, std::size_t size) {
+    const unsigned char* bytes = static_cast<const unsigned char*>(data);
+    for (std::size_t i = 0; i < size; i++) {
+      hash = (hash ^ bytes[i])*0x100000001b3ULL;
+    }
+  };
+  mix(&header.fNbRings, 4*sizeof(std::int32_t) + 5*sizeof(float));
+  mix(&options.fDepth, sizeof(options.fDepth));
+  const ImageGrid& grid = options.fGrid;
+  int size[3] = { grid.fNx, grid.fNy, grid.fNz };
+  float voxel[3] = { grid.fVx, grid.fVy, grid.fVz };
+  mix(size, sizeof(size));
+  mix(voxel, sizeof(voxel));
+  return hash;
+}
+
+std::string CacheFile(const char* kind, std::uint64_t key,
+                      const Options& options)
+{
+  char name[64];
+  std::snprintf(name, sizeof(name), "/%s_%016llx", kind,
+                (unsigned long long)key);
+  return options.fCacheDir + name;
+}
+
+bool LoadSensitivity(const std::string& fileName, std::uint64_t key,
+                     const ImageGrid& grid, std::vector<float>& sensitivity)
+{
+  std::FILE* file = std::fopen(fileName.c_str(), "rb");
+  if (!file) return false;
+  SensitivityFileHeader header;
+  bool ok = std::fread(&header, sizeof(header), 1, file) == 1
+         && std::memcmp(header.fMagic, kSensitivityMagic, 8) == 0
+         && header.fKey == key && header.fNx == grid.fNx
+         && header.fNy == grid.fNy && header.fNz == grid.fNz
+         && std::fread(sensitivity.data(), sizeof(float), sensitivity.size(),
+                       file) == sensitivity.size();
+  std::fclose(file);
+  return ok;
+}
+
+void SaveSensitivity(const std::string& fileName, std::uint64_t key,
+                     const ImageGrid& grid, const std::vector<float>& sensitivity)
+{
+  std::FILE* file = std::fopen(fileName.c_str(), "wb");
+  if (!file) {
+    std::fprintf(stderr, "listmodeOSEM: cannot cache %s\n", fileName.c_str());
+    return;
+  }
+  SensitivityFileHeader header;
+  std::memset(&header, 0, sizeof(header));
+  std::memcpy(header.fMagic, kSensitivityMagic, 8);
+  header.fKey = key;
+  header.fNx = grid.fNx;  header.fNy = grid.fNy;  header.fNz = grid.fNz;
+  std::fwrite(&header, sizeof(header), 1, file);
+  std::fwrite(sensitivity.data(), sizeof(float), sensitivity.size(), file);
+  std::fclose(file);
+}
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
+
+// Back projection of every line of response of the scanner (two crystals
+// of the same transaxial position excepted): the sensitivity image.
+template <class Projector>
+void ComputeSensitivity(const ScannerGeometry& scanner,
+                        const Projector& projector,
+                        std::vector<std::vector<float>>& buffers,
+                        std::vector<float>& sensitivity, unsigned nbThreads)
+{
+  const int nbDetectors = scanner.GetNbDetectors();
+  const int nbCrystals = scanner.GetNbCrystals();
+  ParallelFor(nbThreads, std::size_t(nbDetectors), 1,
+    [&](std::size_t first, std::size_t last, unsigned thread) {
+      float* image = buffers[thread].data();
+      for (std::size_t d1 = first; d1 < last; d1++) {
+        for (int d2 = int(d1) + 1; d2 < nbDetectors; d2++) {
+          if (d2%nbCrystals == int(d1)%nbCrystals) continue;
+          projector.Back(int(d1), d2, 1.f, image);
+        }
+      }
+    });
+  Reduce(buffers, sensitivity, nbThreads);
+}
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
+
+bool WriteImage(const std::string& prefix, const ImageGrid& grid,
+                const std::vector<float>& image)
+{
+  std::string dataFile = prefix + ".v";
+  std::FILE* file = std::fopen(dataFile.c_str(), "wb");
+  if (!file) return false;
+  std::size_t nbWritten =
+    std::fwrite(image.data(), sizeof(float), image.size(), file);
+  std::fclose(file);
+
+  const std::uint16_t probe = 1;
+  bool littleEndian = *reinterpret_cast<const char*>(&probe) == 1;
+  std::ofstream header(prefix + ".hv");
+  header
+    << "!INTERFILE  :=\n"
+    << "!imaging modality := PT\n"
+    << "name of data file := "
+    << dataFile.substr(dataFile.find_last_of('/') + 1) << "\n"
+    << "!GENERAL DATA :=\n"
+    << "!GENERAL IMAGE DATA :=\n"
+    << "!type of data := PET\n"
+    << "imagedata byte order := "
+    << (littleEndian ? "LITTLEENDIAN" : "BIGENDIAN") << "\n"
+    << "!PET STUDY (General) :=\n"
+    << "!PET data type := Image\n"
+    << "process status := Reconstructed\n"
+    << "!number format := float\n"
+    << "!number of bytes per pixel := 4\n"
+    << "number of dimensions := 3\n"
+    << "matrix axis label [1] := x\n"
+    << "!matrix size [1] := " << grid.fNx << "\n"
+    << "scaling factor (mm/pixel) [1] := " << grid.fVx << "\n"
+    << "matrix axis label [2] := y\n"
+    << "!matrix size [2] := " << grid.fNy << "\n"
+    << "scaling factor (mm/pixel) [2] := " << grid.fVy << "\n"
+    << "matrix axis label [3] := z\n"
+    << "!matrix size [3] := " << grid.fNz << "\n"
+    << "scaling factor (mm/pixel) [3] := " << grid.fVz << "\n"
+    << "number of time frames := 1\n"
+    << "!END OF INTERFILE :=\n";
+  return nbWritten == image.size() && bool(header);
+}
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
+
+// OSEM: x <- x/(s/S) * sum over the subset of a/(a.x)
+//
+// The voxels seen by too few lines of response are left out.
+template <class Projector>
+std::vector<float> Reconstruct(const Projector& projector,
+                               const std::vector<Lor>& lors,
+                               const std::vector<float>& sensitivity,
+                               std::vector<std::vector<float>>& buffers,
+                               const Options& options)
+{
+  const ImageGrid& grid = options.fGrid;
+  const std::size_t nbVoxels = grid.GetNbVoxels();
+  const unsigned nbThreads = options.fNbThreads;
+  const int nbSubsets = options.fSubsets;
+  float threshold = kSensitivityThreshold
+                  *(*std::max_element(sensitivity.begin(), sensitivity.end()));
+  std::vector<float> image(nbVoxels), ratio(nbVoxels), update(nbVoxels);
+  for (std::size_t j = 0; j < nbVoxels; j++) {
+    bool seen = sensitivity[j] > threshold;
+    image[j] = seen ? 1.f : 0.f;
+    update[j] = seen ? nbSubsets/sensitivity[j] : 0.f;
+  }
+
+  for (int iteration = 1; iteration <= options.fIterations; iteration++) {
+    auto start = Clock::now();
+    for (int subset = 0; subset < nbSubsets; subset++) {
+      std::size_t nbInSubset =
+        (lors.size() - subset + nbSubsets - 1)/nbSubsets;
+      ParallelFor(nbThreads, nbInSubset, 4096,
+        [&](std::size_t first, std::size_t last, unsigned thread) {
+          float* back = buffers[thread].data();
+          for (std::size_t k = first; k < last; k++) {
+            const Lor& lor = lors[subset + k*nbSubsets];
+            float forward =
+              projector.Forward(lor.fDetector1, lor.fDetector2, image.data());
+            if (forward > 0.f) {
+              projector.Back(lor.fDetector1, lor.fDetector2, 1.f/forward, back);
+            }
+          }
+        });
+      Reduce(buffers, ratio, nbThreads);
+
+      ParallelFor(nbThreads, nbVoxels, 1 << 16,
+        [&](std::size_t first, std::size_t last, unsigned) {
+          float* x = image.data();
+          const float* r = ratio.data();
+          const float* u = update.data();
+          for (std::size_t j = first; j < last; j++) x[j] *= r[j]*u[j];
+        });
+    }
+    std::printf("iteration %3d     : %.2f s\n", iteration, Seconds(start));
+
+    if (options.fKeepIterations && iteration < options.fIterations) {
+      WriteImage(options.fPrefix + "_it" + std::to_string(iteration), grid, image);
+    }
+  }
+  return image;
+}
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
+
+bool ParseTriple(const std::string& text, double values[3])
+{
+  std::size_t first = text.find(':'), second = text.rfind(':');
+  if (first == std::string::npos || first == second) return false;
+  values[0] = std::atof(text.substr(0, first).c_str());
+  values[1] = std::atof(text.substr(first + 1, second - first - 1).c_str());
+  values[2] = std::atof(text.substr(second + 1).c_str());
+  return values[0] > 0. && values[1] > 0. && values[2] > 0.;
+}
+
+void Usage()
+{
+  std::fprintf(stderr,
+    "usage: listmodeOSEM [-i iterations] [-S subsets] [-n nx:ny:nz]\n"
+    "                    [-v vx:vy:vz] [-d depth] [-x] [-t] [-j threads]\n"
+    "                    [-M] [-c cachedir] [-o prefix] [-k] file.lm [...]\n");
+}
+
+}
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
+
+int main(int argc, char** argv)
+{
+  Options options;
+  double size[3] = { 0., 0., 0. }, voxel[3] = { 0., 0., 0. };
+  std::vector<std::string> inputs;
+
+  for (int i = 1; i < argc; i++) {
+    std::string arg = argv[i];
+    bool hasValue = i+1 < argc;
+    if (arg == "-i" && hasValue) options.fIterations = std::atoi(argv[++i]);
+    else if (arg == "-S" && hasValue) options.fSubsets = std::atoi(argv[++i]);
+    else if (arg == "-n" && hasValue) {
+      if (!ParseTriple(argv[++i], size)) { Usage(); return 1; }
+    }
+    else if (arg == "-v" && hasValue) {
+      if (!ParseTriple(argv[++i], voxel)) { Usage(); return 1; }
+    }
+    else if (arg == "-d" && hasValue) options.fDepth = float(std::atof(argv[++i]));
+    else if (arg == "-j" && hasValue) options.fNbThreads = std::atoi(argv[++i]);
+    else if (arg == "-c" && hasValue) options.fCacheDir = argv[++i];
+    else if (arg == "-o" && hasValue) options.fPrefix = argv[++i];
+    else if (arg == "-x") options.fRejectScatter = true;
+    else if (arg == "-t") options.fTruesOnly = true;
+    else if (arg == "-k") options.fKeepIterations = true;
+    else if (arg == "-M") options.fSystemMatrix = true;
+    else if (!arg.empty() && arg[0] != '-') inputs.push_back(arg);
+    else { Usage(); return 1; }
+  }
+  if (inputs.empty() || options.fIterations < 1 || options.fSubsets < 1) {
+    Usage();
+    return 1;
+  }
+  if (options.fNbThreads < 1) options.fNbThreads = 1;
+  const unsigned nbThreads = options.fNbThreads;
+
+  //lines of response of the selected coincidences
+  //
+  auto start = Clock::now();
+  ListModeHeader scannerHeader;
+  std::vector<Lor> lors;
+  std::size_t nbRead = 0;
+  for (std::size_t f = 0; f < inputs.size(); f++) {
+    ListModeReader reader;
+    if (!reader.Open(inputs[f])) {
+      std::fprintf(stderr, "listmodeOSEM: %s\n", reader.GetError().c_str());
+      return 1;
+    }
+    if (f == 0) scannerHeader = reader.GetHeader();
+    else if (!IsSameScanner(scannerHeader, reader.GetHeader())) {
+      std::fprintf(stderr, "listmodeOSEM: %s was written for another scanner\n",
+                   inputs[f].c_str());
+      return 1;
+    }
+    const int nbDetectors = scannerHeader.fNbRings*scannerHeader.fNbSectors
+                          *scannerHeader.fNbModules*scannerHeader.fNbSubCrystals;
+    const ListModeRecord* records = reader.GetRecords();
+    for (std::size_t r = 0; r < reader.GetNbRecords(); r++) {
+      const ListModeRecord& record = records[r];
+      if (options.fRejectScatter && (record.fFlags & kScatter)) continue;
+      if (options.fTruesOnly && record.fFlags != kTrue) continue;
+      if (record.fDetector1 == record.fDetector2 ||
+          record.fDetector1 < 0 || record.fDetector1 >= nbDetectors ||
+          record.fDetector2 < 0 || record.fDetector2 >= nbDetectors) continue;
+      lors.push_back({record.fDetector1, record.fDetector2});
+    }
+    nbRead += reader.GetNbRecords();
+  }
+  std::printf("coincidences      : %zu of %zu read (%.2f s)\n",
+              lors.size(), nbRead, Seconds(start));
+  if (lors.empty()) return 1;
+
+  //scanner and image
+  //
+  if (options.fDepth < 0.f) options.fDepth = 0.5f*scannerHeader.fCrystalDZ;
+  ScannerGeometry scanner(scannerHeader, options.fDepth);
+  ImageGrid& grid = options.fGrid;
+  grid.fNx = size[0] > 0. ? int(size[0]) : 128;
+  grid.fNy = size[1] > 0. ? int(size[1]) : 128;
+  grid.fNz = size[2] > 0. ? int(size[2]) : 2*scanner.GetNbRings() - 1;
+  float bore = 1.8f*scannerHeader.fRingRadius;
+  grid.fVx = voxel[0] > 0. ? float(voxel[0]) : bore/grid.fNx;
+  grid.fVy = voxel[1] > 0. ? float(voxel[1]) : bore/grid.fNy;
+  grid.fVz = voxel[2] > 0. ? float(voxel[2]) : 0.5f*scannerHeader.fCrystalDX;
+  ListModeProjector projector(grid);
+  TracingProjector tracing{scanner, projector};
+  const std::size_t nbVoxels = grid.GetNbVoxels();
+  std::printf("image             : %d x %d x %d voxels of %.2f x %.2f x %.2f mm\n",
+              grid.fNx, grid.fNy, grid.fNz, grid.fVx, grid.fVy, grid.fVz);
+
+  // one back projection buffer per thread
+  std::vector<std::vector<float>> buffers(nbThreads,
+                                          std::vector<float>(nbVoxels, 0.f));
+
+  //system matrix, generated once per scanner and image grid
+  //
+  std::uint64_t key = CacheKey(scannerHeader, options);
+  std::unique_ptr<SystemMatrix> systemMatrix;
+  if (options.fSystemMatrix) {
+    start = Clock::now();
+    systemMatrix.reset(new SystemMatrix(scanner, grid));
+    std::string matrixFile = CacheFile("system", key, options) + ".csr";
+    if (systemMatrix->Open(matrixFile, key)) {
+      std::printf("system matrix     : read from %s\n", matrixFile.c_str());
+    }
+    else if (systemMatrix->Generate(matrixFile, key, nbThreads)) {
+      std::printf("system matrix     : generated in %.2f s, cached in %s\n",
+                  Seconds(start), matrixFile.c_str());
+    }
+    else {
+      std::fprintf(stderr, "listmodeOSEM: %s\n",
+                   systemMatrix->GetError().c_str());
+      return 1;
+    }
+    double nbLors = 0.5*scanner.GetNbDetectors()
+                  *(scanner.GetNbDetectors() - scanner.GetNbRings());
+    std::printf("                    %zu rows for %.0f LORs (%.1fx), "
+                "%zu entries, %.1f MB\n",
+                systemMatrix->GetNbRows(), nbLors,
+                nbLors/systemMatrix->GetNbRows(), systemMatrix->GetNbEntries(),
+                8.e-6*systemMatrix->GetNbEntries());
+  }
+
+  //sensitivity image, computed once per scanner and image grid
+  //
+  start = Clock::now();
+  std::vector<float> sensitivity(nbVoxels, 0.f);
+  std::string cacheFile = CacheFile("sensitivity", key, options) + ".img";
+  if (LoadSensitivity(cacheFile, key, grid, sensitivity)) {
+    std::printf("sensitivity       : read from %s\n", cacheFile.c_str());
+  }
+  else {
+    if (systemMatrix) {
+      ComputeSensitivity(scanner, *systemMatrix, buffers, sensitivity,
+                         nbThreads);
+    }
+    else {
+      ComputeSensitivity(scanner, tracing, buffers, sensitivity, nbThreads);
+    }
+    SaveSensitivity(cacheFile, key, grid, sensitivity);
+    std::printf("sensitivity       : computed in %.2f s, cached in %s\n",
+                Seconds(start), cacheFile.c_str());
+  }
+
+  //OSEM, projecting with the system matrix or by tracing
+  //
+  std::vector<float> image;
+  if (systemMatrix) {
+    image = Reconstruct(*systemMatrix, lors, sensitivity, buffers, options);
+  }
+  else {
+    image = Reconstruct(tracing, lors, sensitivity, buffers, options);
+  }
+
+  if (!WriteImage(options.fPrefix, grid, image)) {
+    std::fprintf(stderr, "listmodeOSEM: cannot write %s.v\n",
+                 options.fPrefix.c_str());
+    return 1;
+  }
+  std::printf("image written to  : %s.v (%s.hv)\n",
+              options.fPrefix.c_str(), options.fPrefix.c_str());
+  return 0;
+}
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
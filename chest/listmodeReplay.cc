@@ -0,0 +1,297 @@
+//
+// ********************************************************************
+// * License and Disclaimer                                           *
+// *                                                                  *
+// * The  Geant4 software  is  copyright of the Copyright Holders  of *
+// * the Geant4 Collaboration.  It is provided  under  the terms  and *
+// * conditions of the Geant4 Software License,  included in the file *
+// * LICENSE and available at  http://cern.ch/geant4/license .  These *
+// * include a list of copyright holders.                             *
+// *                                                                  *
+// * Neither the authors of this software system, nor their employing *
+// * institutes,nor the agencies providing financial support for this *
+// * work  make  any representation or  warranty, express or implied, *
+// * regarding  this  software system or assume any liability for its *
+// * use.  Please see the license in the file  LICENSE  and URL above *
+// * for the full disclaimer and the limitation of liability.         *
+// *                                                                  *
+// * This  code  implementation is the result of  the  scientific and *
+// * technical work of the GEANT4 collaboration.                      *
+// * By using,  copying,  modifying or  distributing the software (or *
+// * any work based  on the software)  you  agree  to acknowledge its *
+// * use  in  resulting  scientific  publications,  and indicate your *
+// * acceptance of all terms of the Geant4 Software license.          *
+// ********************************************************************
+//
+/// \file listmodeReplay.cc
+/// \brief Offline re-analysis of the list-mode files of the B3b example
+//
+// Re-applies the energy window, the energy resolution and the coincidence
+// time window to stored list-mode files, without Geant4 transport, and
+// bins the accepted coincidences again in a sinogram.
+//
+// The files hold coincidences, not singles: the coincidences cannot be
+// sorted again, with a wider window or another multiples policy. They can
+// only be narrowed, by a shorter time window, an energy window applied to
+// both photons and the rejection of the scattered ones. The sinogram is
+// binned by the B3b::Sinogram of the simulation.
+//
+//   listmodeReplay [options] file.lm [file2.lm ...]
+//     -e <low>:<high>   energy window [keV]                (default 0:inf)
+//     -r <fwhm>         energy resolution at 511 keV, e.g. 0.12 (default 0)
+//     -w <window>       coincidence time window [ns]        (default inf)
+//     -s <seed>         seed of the energy blurring         (default 1)
+//     -x                reject the coincidences flagged as scattered
+//     -j <threads>      number of threads                   (default all)
+//     -o <file.lm>      write the accepted coincidences
+//     -g <name>         bin them in the sinogram name.s / name.hs
+//     -p <span>         span of the sinogram                (default 3)
+//     -d <difference>   maximum ring difference             (default all)
+//
+// All the files must come from the same scanner.
+
+#include "ListModeReader.hh"
+#include "Sinogram.hh"
+
+#include "G4SystemOfUnits.hh"
+
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <limits>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+using namespace B3b;
+
+namespace
+{
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
+
+struct Criteria
+{
+  double fLowEnergy = 0.;
+  double fHighEnergy = std::numeric_limits<double>::infinity();
+  double fResolution = 0.;
+  double fTimeWindow = std::numeric_limits<double>::infinity();
+  std::uint64_t fSeed = 1;
+  bool fRejectScatter = false;
+};
+
+struct Tally
+{
+  std::uint64_t fRead = 0;
+  std::uint64_t fPrompts = 0;
+  std::uint64_t fTrues = 0;
+  std::uint64_t fScatters = 0;
+  std::uint64_t fRandoms = 0;
+};
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
+
+// Counter-based random numbers: the blurring of a record depends only on
+// (seed, file, record, event, single), not on the thread or the chunk which
+// processes it. The records of one event are blurred independently.
+inline std::uint64_t SplitMix64(std::uint64_t x)
+{
+  x += 0x9e3779b97f4a7c15ULL;
+  x = (x ^ (x >> 30))*0xbf58476d1ce4e5b9ULL;
+  x = (x ^ (x >> 27))*0x94d049bb133111ebULL;
+  return x ^ (x >> 31);
+}
+
+inline double Gauss(std::uint64_t key)
+{
+  std::uint64_t a = SplitMix64(key), b = SplitMix64(a);
+  double u1 = ((a >> 11) + 0.5)*0x1.0p-53;
+  double u2 = (b >> 11)*0x1.0p-53;
+  return std::sqrt(-2.*std::log(u1))*std::cos(6.283185307179586*u2);
+}
+
+inline double Blur(double energy, double resolution, std::uint64_t key)
+{
+  if (resolution <= 0. || energy <= 0.) return energy;
+  // resolution scales as 1/sqrt(E) from its value at 511 keV
+  double sigma = resolution/2.3548*std::sqrt(511.*energy);
+  return energy + sigma*Gauss(key);
+}
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
+
+inline std::uint64_t RecordKey(const Criteria& criteria, std::size_t file,
+                               std::size_t record, std::int64_t event)
+{
+  std::uint64_t key = SplitMix64(criteria.fSeed*0x100000001b3ULL ^ file);
+  key = SplitMix64(key ^ record);
+  return (key ^ SplitMix64(std::uint64_t(event))) << 1;
+}
+
+inline bool Accept(const ListModeRecord& in, std::uint64_t key,
+                   const Criteria& criteria, ListModeRecord& out)
+{
+  if (criteria.fRejectScatter && (in.fFlags & kScatter)) return false;
+  if (std::fabs(in.fDeltaTime) > criteria.fTimeWindow) return false;
+
+  double e1 = Blur(in.fEnergy1, criteria.fResolution, key);
+  double e2 = Blur(in.fEnergy2, criteria.fResolution, key | 1);
+  if (e1 < criteria.fLowEnergy || e1 > criteria.fHighEnergy) return false;
+  if (e2 < criteria.fLowEnergy || e2 > criteria.fHighEnergy) return false;
+
+  out = in;
+  out.fEnergy1 = float(e1);
+  out.fEnergy2 = float(e2);
+  return true;
+}
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
+
+void Usage()
+{
+  std::fprintf(stderr,
+    "usage: listmodeReplay [-e low:high] [-r fwhm] [-w ns] [-s seed] [-x]\n"
+    "                      [-j threads] [-o out.lm] [-g sinogram]\n"
+    "                      [-p span] [-d difference] file.lm [...]\n");
+}
+
+}
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
+
+int main(int argc, char** argv)
+{
+  Criteria criteria;
+  unsigned nbThreads = std::thread::hardware_concurrency();
+  std::string outName, sinogramName;
+  SinogramParameters sinogramParameters;
+  std::vector<std::string> inputs;
+
+  for (int i = 1; i < argc; i++) {
+    std::string arg = argv[i];
+    bool hasValue = i+1 < argc;
+    if (arg == "-e" && hasValue) {
+      std::string window = argv[++i];
+      std::size_t colon = window.find(':');
+      if (colon == std::string::npos) { Usage(); return 1; }
+      criteria.fLowEnergy = std::atof(window.substr(0, colon).c_str());
+      if (colon+1 < window.size())
+        criteria.fHighEnergy = std::atof(window.substr(colon+1).c_str());
+    }
+    else if (arg == "-r" && hasValue) criteria.fResolution = std::atof(argv[++i]);
+    else if (arg == "-w" && hasValue) criteria.fTimeWindow = std::atof(argv[++i]);
+    else if (arg == "-s" && hasValue) criteria.fSeed = std::strtoull(argv[++i], nullptr, 10);
+    else if (arg == "-j" && hasValue) nbThreads = std::atoi(argv[++i]);
+    else if (arg == "-o" && hasValue) outName = argv[++i];
+    else if (arg == "-g" && hasValue) sinogramName = argv[++i];
+    else if (arg == "-p" && hasValue) sinogramParameters.fSpan = std::atoi(argv[++i]);
+    else if (arg == "-d" && hasValue)
+      sinogramParameters.fMaxRingDifference = std::atoi(argv[++i]);
+    else if (arg == "-x") criteria.fRejectScatter = true;
+    else if (!arg.empty() && arg[0] != '-') inputs.push_back(arg);
+    else { Usage(); return 1; }
+  }
+  if (inputs.empty() || sinogramParameters.fSpan < 1 ||
+      sinogramParameters.fSpan%2 == 0) { Usage(); return 1; }
+  if (nbThreads < 1) nbThreads = 1;
+
+  std::FILE* out = nullptr;
+  std::unique_ptr<Sinogram> sinogram;
+  ListModeHeader scannerHeader;
+  Tally total;
+  std::size_t nbBytes = 0;
+  auto start = std::chrono::steady_clock::now();
+
+  for (std::size_t f = 0; f < inputs.size(); f++) {
+    const std::string& input = inputs[f];
+    ListModeReader reader;
+    if (!reader.Open(input)) {
+      std::fprintf(stderr, "listmodeReplay: %s\n", reader.GetError().c_str());
+      return 1;
+    }
+    if (f == 0) scannerHeader = reader.GetHeader();
+    else if (!IsSameScanner(scannerHeader, reader.GetHeader())) {
+      std::fprintf(stderr, "listmodeReplay: %s was written for another scanner\n",
+                   input.c_str());
+      return 1;
+    }
+    if (!sinogramName.empty() && !sinogram) {
+      sinogram.reset(new Sinogram(scannerHeader.fNbRings,
+                                  scannerHeader.fNbSectors*scannerHeader.fNbModules
+                                  *scannerHeader.fNbSubCrystals,
+                                  sinogramParameters));
+    }
+    if (!outName.empty() && !out) {
+      out = std::fopen(outName.c_str(), "wb");
+      if (!out) {
+        std::fprintf(stderr, "listmodeReplay: cannot write %s\n", outName.c_str());
+        return 1;
+      }
+      std::fwrite(&reader.GetHeader(), sizeof(ListModeHeader), 1, out);
+    }
+
+    std::vector<Tally> tallies(nbThreads);
+    const bool keep = out || sinogram;
+    std::vector<std::vector<ListModeRecord>> accepted(keep ? nbThreads : 0);
+    const ListModeRecord* records = reader.GetRecords();
+
+    reader.ForEachChunk(nbThreads,
+      [&](const ListModeRecord* first, const ListModeRecord* last, unsigned chunk)
+      {
+        Tally& tally = tallies[chunk];
+        ListModeRecord record;
+        for (const ListModeRecord* in = first; in != last; ++in) {
+          tally.fRead++;
+          std::uint64_t key = RecordKey(criteria, f, in - records, in->fEventID);
+          if (!Accept(*in, key, criteria, record)) continue;
+          tally.fPrompts++;
+          if (record.fFlags == kTrue)   tally.fTrues++;
+          if (record.fFlags & kScatter) tally.fScatters++;
+          if (record.fFlags & kRandom)  tally.fRandoms++;
+          if (keep) accepted[chunk].push_back(record);
+        }
+      });
+
+    // chunks are written back and binned in file order
+    for (unsigned chunk = 0; chunk < nbThreads; chunk++) {
+      total.fRead     += tallies[chunk].fRead;
+      total.fPrompts  += tallies[chunk].fPrompts;
+      total.fTrues    += tallies[chunk].fTrues;
+      total.fScatters += tallies[chunk].fScatters;
+      total.fRandoms  += tallies[chunk].fRandoms;
+      if (out) std::fwrite(accepted[chunk].data(), sizeof(ListModeRecord),
+                           accepted[chunk].size(), out);
+      if (sinogram) {
+        for (const ListModeRecord& record : accepted[chunk])
+          sinogram->Fill(record.fDetector1, record.fDetector2);
+      }
+    }
+    nbBytes += reader.GetNbRecords()*sizeof(ListModeRecord);
+  }
+  if (out) std::fclose(out);
+  if (sinogram &&
+      !sinogram->Write(sinogramName + ".s", sinogramName + ".hs",
+                       scannerHeader.fRingRadius*mm,
+                       scannerHeader.fCrystalDX*mm)) return 1;
+
+  double seconds = std::chrono::duration<double>(
+    std::chrono::steady_clock::now() - start).count();
+  std::printf("records read      : %llu\n", (unsigned long long)total.fRead);
+  std::printf("prompts accepted  : %llu\n", (unsigned long long)total.fPrompts);
+  std::printf("  trues           : %llu\n", (unsigned long long)total.fTrues);
+  std::printf("  scatters        : %llu\n", (unsigned long long)total.fScatters);
+  std::printf("  randoms         : %llu\n", (unsigned long long)total.fRandoms);
+  if (sinogram) {
+    std::printf("sinogram          : %llu coincidences binned in %s.s\n",
+                (unsigned long long)sinogram->GetTotal(), sinogramName.c_str());
+  }
+  std::printf("time              : %.3f s (%.2f GB/s, %u threads)\n",
+              seconds, nbBytes/seconds*1.e-9, nbThreads);
+  return 0;
+}
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
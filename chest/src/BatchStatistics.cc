@@ -0,0 +1,325 @@
+//
+// ********************************************************************
+// * License and Disclaimer                                           *
+// *                                                                  *
+// * The  Geant4 software  is  copyright of the Copyright Holders  of *
+// * the Geant4 Collaboration.  It is provided  under  the terms  and *
+// * conditions of the Geant4 Software License,  included in the file *
+// * LICENSE and available at  http://cern.ch/geant4/license .  These *
+// * include a list of copyright holders.                             *
+// *                                                                  *
+// * Neither the authors of this software system, nor their employing *
+// * institutes,nor the agencies providing financial support for this *
+// * work  make  any representation or  warranty, express or implied, *
+// * regarding  this  software system or assume any liability for its *
+// * use.  Please see the license in the file  LICENSE  and URL above *
+// * for the full disclaimer and the limitation of liability.         *
+// *                                                                  *
+// * This  code  implementation is the result of  the  scientific and *
+// * technical work of the GEANT4 collaboration.                      *
+// * By using,  copying,  modifying or  distributing the software (or *
+// * any work based  on the software)  you  agree  to acknowledge its *
+// * use  in  resulting  scientific  publications,  and indicate your *
+// * acceptance of all terms of the Geant4 Software license.          *
+// ********************************************************************
+//
+/// \file BatchStatistics.cc
+/// \brief Implementation of the B3b::BatchStatistics class
+
+#include "BatchStatistics.hh"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <iomanip>
+#include <sstream>
+
+namespace
+{
+  // two-sided 95 % quantile of the Student t distribution
+  G4double StudentT95(G4long dof)
+  {
+    static const G4double table[30] = {
+      12.706, 4.303, 3.182, 2.776, 2.571, 2.447, 2.365, 2.306, 2.262, 2.228,
+      2.201, 2.179, 2.160, 2.145, 2.131, 2.120, 2.110, 2.101, 2.093, 2.086,
+      2.080, 2.074, 2.069, 2.064, 2.060, 2.056, 2.052, 2.048, 2.045, 2.042 };
+    if (dof < 1) return 0.;
+    if (dof <= 30) return table[dof - 1];
+    return 1.960 + 2.37/dof;
+  }
+}
+
+namespace B3b
+{
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
+
+BatchAccumulator& BatchAccumulator::operator+=(const BatchAccumulator& other)
+{
+  if (fSum.size() < other.fSum.size()) {
+    fSum.resize(other.fSum.size(), 0.);
+    fSquare.resize(other.fSquare.size(), 0.);
+  }
+  fNbBatches += other.fNbBatches;
+  for (std::size_t i = 0; i < other.fSum.size(); i++) {
+    fSum[i]    += other.fSum[i];
+    fSquare[i] += other.fSquare[i];
+  }
+  return *this;
+}
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
+
+BatchChannel::BatchChannel(G4int nbQuantities, G4int batchSize)
+  : fNbQuantities(nbQuantities), fBatchSize(std::max(1, batchSize)),
+    fBatch(nbQuantities, 0.),
+    fShared(new std::atomic<G4double>[1 + 2*nbQuantities])
+{
+  fLocal.fSum.resize(nbQuantities, 0.);
+  fLocal.fSquare.resize(nbQuantities, 0.);
+  for (G4int i = 0; i < 1 + 2*nbQuantities; i++) {
+    fShared[i].store(0., std::memory_order_relaxed);
+  }
+}
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
+
+void BatchChannel::Fill(const G4double* values)
+{
+  for (G4int i = 0; i < fNbQuantities; i++) fBatch[i] += values[i];
+  if (++fNbInBatch == fBatchSize) Publish();
+}
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
+
+void BatchChannel::Publish()
+{
+  const G4double invBatchSize = 1./fBatchSize;
+  fLocal.fNbBatches++;
+  for (G4int i = 0; i < fNbQuantities; i++) {
+    G4double mean = fBatch[i]*invBatchSize;
+    fLocal.fSum[i]    += mean;
+    fLocal.fSquare[i] += mean*mean;
+    fBatch[i] = 0.;
+  }
+  fNbInBatch = 0;
+
+  // odd sequence while the accumulators are being written
+  std::uint32_t sequence = fSequence.load(std::memory_order_relaxed);
+  fSequence.store(sequence + 1, std::memory_order_relaxed);
+  std::atomic_thread_fence(std::memory_order_release);
+  fShared[0].store(G4double(fLocal.fNbBatches), std::memory_order_relaxed);
+  for (G4int i = 0; i < fNbQuantities; i++) {
+    fShared[1 + i].store(fLocal.fSum[i], std::memory_order_relaxed);
+    fShared[1 + fNbQuantities + i].store(fLocal.fSquare[i],
+                                         std::memory_order_relaxed);
+  }
+  fSequence.store(sequence + 2, std::memory_order_release);
+}
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
+
+void BatchChannel::Read(BatchAccumulator& accumulator) const
+{
+  accumulator.fSum.resize(fNbQuantities);
+  accumulator.fSquare.resize(fNbQuantities);
+  for (;;) {
+    std::uint32_t sequence = fSequence.load(std::memory_order_acquire);
+    if (sequence & 1) {
+      std::this_thread::yield();
+      continue;
+    }
+    accumulator.fNbBatches =
+      G4long(fShared[0].load(std::memory_order_relaxed));
+    for (G4int i = 0; i < fNbQuantities; i++) {
+      accumulator.fSum[i] = fShared[1 + i].load(std::memory_order_relaxed);
+      accumulator.fSquare[i] =
+        fShared[1 + fNbQuantities + i].load(std::memory_order_relaxed);
+    }
+    std::atomic_thread_fence(std::memory_order_acquire);
+    if (fSequence.load(std::memory_order_relaxed) == sequence) return;
+  }
+}
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
+
+BatchStatistics* BatchStatistics::Instance()
+{
+  static BatchStatistics instance;
+  return &instance;
+}
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
+
+BatchStatistics::~BatchStatistics()
+{
+  Close();
+}
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
+
+void BatchStatistics::Open(const BatchParameters& parameters,
+                           G4int nbChannels)
+{
+  Close();
+  fParameters = parameters;
+
+  // the channels of the previous run are released only now: the workers
+  // are done with them
+  std::size_t size = std::max(1, nbChannels);
+  fChannels.clear();
+  fChannels.resize(size);
+  fPublished.reset(new std::atomic<BatchChannel*>[size]);
+  for (std::size_t i = 0; i < size; i++) {
+    fPublished[i].store(nullptr, std::memory_order_relaxed);
+  }
+  {
+    std::lock_guard<std::mutex> lock(fNamesMutex);
+    fNames.clear();
+  }
+  fStop = false;
+  fOpen.store(true, std::memory_order_release);
+
+  if (fParameters.fReport > 0.) {
+    fThread = std::thread(&BatchStatistics::ReporterLoop, this);
+  }
+}
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
+
+void BatchStatistics::Close()
+{
+  if (!IsOpen()) return;
+  {
+    std::lock_guard<std::mutex> lock(fWakeMutex);
+    fStop = true;
+  }
+  fWake.notify_one();
+  if (fThread.joinable()) fThread.join();
+
+  Report(Snapshot(), true);
+  fOpen.store(false, std::memory_order_release);
+}
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
+
+BatchChannel* BatchStatistics::CreateChannel(G4int thread,
+                                             const std::vector<G4String>& names)
+{
+  std::size_t slot = std::max(0, thread);
+  if (slot >= fChannels.size()) {
+    G4ExceptionDescription msg;
+    msg << "No batch channel for thread " << thread << ".";
+    G4Exception("BatchStatistics::CreateChannel()", "B3bBatch001",
+                JustWarning, msg);
+    return nullptr;
+  }
+  fChannels[slot] =
+    std::make_unique<BatchChannel>(G4int(names.size()), fParameters.fBatchSize);
+  {
+    std::lock_guard<std::mutex> lock(fNamesMutex);
+    if (fNames.size() < names.size()) fNames = names;
+  }
+  fPublished[slot].store(fChannels[slot].get(), std::memory_order_release);
+  return fChannels[slot].get();
+}
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
+
+std::vector<BatchAccumulator> BatchStatistics::Snapshot() const
+{
+  std::vector<BatchAccumulator> snapshot(fChannels.size());
+  for (std::size_t i = 0; i < snapshot.size(); i++) {
+    const BatchChannel* channel = fPublished[i].load(std::memory_order_acquire);
+    if (channel) channel->Read(snapshot[i]);
+  }
+  return snapshot;
+}
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
+
+void BatchStatistics::Report(const std::vector<BatchAccumulator>& snapshot,
+                             G4bool final) const
+{
+  std::vector<G4String> names;
+  {
+    std::lock_guard<std::mutex> lock(fNamesMutex);
+    names = fNames;
+  }
+  BatchAccumulator total;
+  for (const BatchAccumulator& thread : snapshot) total += thread;
+  const G4long nbBatches = total.fNbBatches;
+
+  std::ostringstream out;
+  out << G4endl
+      << (final ? "--------------------Batch statistics, end of run-----------"
+                : "--------------------Batch statistics, live----------------")
+      << G4endl
+      << " " << nbBatches << " batches of " << fParameters.fBatchSize
+      << " events" << G4endl;
+  if (nbBatches < 2) {
+    out << " Not enough batches for an estimate" << G4endl;
+  }
+  else {
+    // mean per event, from the batch means, and the variance of the batch
+    // means, which holds the correlations within the batches
+    const G4double t95 = StudentT95(nbBatches - 1);
+    std::size_t nbQuantities = total.fSum.size();
+    std::vector<G4double> mean(nbQuantities), variance(nbQuantities);
+    for (std::size_t q = 0; q < nbQuantities; q++) {
+      mean[q] = total.fSum[q]/nbBatches;
+      variance[q] = std::max(0., (total.fSquare[q] - nbBatches*mean[q]*mean[q])
+                                 /(nbBatches - 1));
+      G4double halfWidth = t95*std::sqrt(variance[q]/nbBatches);
+      out << "  " << std::setw(20) << std::left
+          << (q < names.size() ? names[q] : G4String("quantity"))
+          << std::right << " " << mean[q] << " +- " << halfWidth
+          << " per event (95 %)";
+      if (mean[q] != 0.) {
+        out << ", " << 100.*halfWidth/std::abs(mean[q]) << " %";
+      }
+      out << G4endl;
+    }
+
+    // a thread deviates if its mean is too far from the mean of the batches
+    // of the other threads: their difference has the variance
+    // s^2 (1/k + 1/(K - k))
+    for (std::size_t i = 0; i < snapshot.size(); i++) {
+      const BatchAccumulator& thread = snapshot[i];
+      G4long nbOthers = nbBatches - thread.fNbBatches;
+      if (thread.fNbBatches < 2 || nbOthers < 2) continue;
+      for (std::size_t q = 0; q < thread.fSum.size(); q++) {
+        G4double sigma =
+          std::sqrt(variance[q]*(1./thread.fNbBatches + 1./nbOthers));
+        if (sigma <= 0.) continue;
+        G4double others = (total.fSum[q] - thread.fSum[q])/nbOthers;
+        G4double deviation = (thread.fSum[q]/thread.fNbBatches - others)/sigma;
+        if (std::abs(deviation) > fParameters.fOutlier) {
+          out << " ! thread " << i << ": "
+              << (q < names.size() ? names[q] : G4String("quantity")) << " "
+              << thread.fSum[q]/thread.fNbBatches << " per event, "
+              << deviation << " standard errors from the others" << G4endl;
+        }
+      }
+    }
+  }
+  out << "------------------------------------------------------------" << G4endl;
+  G4cout << out.str() << std::flush;
+}
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
+
+void BatchStatistics::ReporterLoop()
+{
+  const auto period = std::chrono::duration<G4double>(fParameters.fReport);
+  std::unique_lock<std::mutex> lock(fWakeMutex);
+  while (!fWake.wait_for(lock, period, [this] { return fStop; })) {
+    lock.unlock();
+    Report(Snapshot(), false);
+    lock.lock();
+  }
+}
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
+
+}
@@ -0,0 +1,537 @@
+//
+// ********************************************************************
+// * License and Disclaimer                                           *
+// *                                                                  *
+// * The  Geant4 software  is  copyright of the Copyright Holders  of *
+// * the Geant4 Collaboration.  It is provided  under  the terms  and *
+// * conditions of the Geant4 Software License,  included in the file *
+// * LICENSE and available at  http://cern.ch/geant4/license .  These *
+// * include a list of copyright holders.                             *
+// *                                                                  *
+// * Neither the authors of this software system, nor their employing *
+// * institutes,nor the agencies providing financial support for this *
+// * work  make  any representation or  warranty, express or implied, *
+// * regarding  this  software system or assume any liability for its *
+// * use.  Please see the license in the file  LICENSE  and URL above *
+// * for the full disclaimer and the limitation of liability.         *
+// *                                                                  *
+// * This  code  implementation is the result of  the  scientific and *
+// * technical work of the GEANT4 collaboration.                      *
+// * By using,  copying,  modifying or  distributing the software (or *
+// * any work based  on the software)  you  agree  to acknowledge its *
+// * use  in  resulting  scientific  publications,  and indicate your *
+// * acceptance of all terms of the Geant4 Software license.          *
+// ********************************************************************
+/// \file ClippedEllipsoid.cc
+/// \brief Implementation of the B3::ClippedEllipsoid class
+
+#include "ClippedEllipsoid.hh"
+
+#include "G4Ellipsoid.hh"
+#include "G4Box.hh"
+#include "G4SubtractionSolid.hh"
+#include "G4BoundingEnvelope.hh"
+#include "G4VGraphicsScene.hh"
+#include "G4Polyhedron.hh"
+#include "G4QuickRand.hh"
+#include "G4AutoLock.hh"
+#include "G4PhysicalConstants.hh"
+#include "G4SystemOfUnits.hh"
+
+#include <algorithm>
+#include <cmath>
+
+namespace
+{
+  G4Mutex polyhedronMutex = G4MUTEX_INITIALIZER;
+}
+
+namespace B3
+{
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
+
+ClippedEllipsoid::ClippedEllipsoid(const G4String& name, G4double dx,
+                                   G4double dy, G4double dz, G4double cutShift)
+ : G4VSolid(name), fDx(dx), fDy(dy), fDz(dz), fCutShift(cutShift)
+{
+  if (dx <= 0. || dy <= 0. || dz <= 0.) {
+    G4ExceptionDescription msg;
+    msg << "Invalid semi-axes (" << dx/mm << ", " << dy/mm << ", " << dz/mm
+        << ") mm of solid " << name << ".";
+    G4Exception("ClippedEllipsoid::ClippedEllipsoid()", "B3ClippedEllipsoid001",
+                FatalErrorInArgument, msg);
+  }
+  fMinAxis = std::min({ fDx, fDy, fDz });
+  fHalfTolerance = 0.5*kCarTolerance;
+}
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
+
+ClippedEllipsoid::ClippedEllipsoid(const ClippedEllipsoid& other)
+ : G4VSolid(other), fDx(other.fDx), fDy(other.fDy), fDz(other.fDz),
+   fCutShift(other.fCutShift), fMinAxis(other.fMinAxis),
+   fHalfTolerance(other.fHalfTolerance)
+{ }
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
+
+ClippedEllipsoid::~ClippedEllipsoid()
+{
+  delete fpPolyhedron;
+}
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
+
+G4double ClippedEllipsoid::ScaledRadius(const G4ThreeVector& p, G4double x0) const
+{
+  G4double x = (p.x() - x0)/fDx, y = p.y()/fDy, z = p.z()/fDz;
+  return std::sqrt(x*x + y*y + z*z);
+}
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
+
+G4double ClippedEllipsoid::EllipsoidDistance(const G4ThreeVector& p,
+                                             G4double x0) const
+{
+  // F/|grad F|, exact to first order near the surface
+  G4double x = (p.x() - x0)/fDx, y = p.y()/fDy, z = p.z()/fDz;
+  G4double f = x*x + y*y + z*z - 1.;
+  G4double gx = x/fDx, gy = y/fDy, gz = z/fDz;
+  G4double gradient = 2.*std::sqrt(gx*gx + gy*gy + gz*gz);
+  return gradient > 0. ? f/gradient : -fMinAxis;
+}
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
+
+G4ThreeVector ClippedEllipsoid::EllipsoidNormal(const G4ThreeVector& p,
+                                                G4double x0) const
+{
+  G4ThreeVector normal((p.x() - x0)/(fDx*fDx), p.y()/(fDy*fDy),
+                       p.z()/(fDz*fDz));
+  G4double mag = normal.mag();
+  return mag > 0. ? normal/mag : G4ThreeVector(0., 0., 1.);
+}
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
+
+G4ThreeVector ClippedEllipsoid::Normal(Surface surface,
+                                       const G4ThreeVector& p) const
+{
+  // on the part cut away, the solid is outside it
+  switch (surface) {
+    case kEllipsoid:    return EllipsoidNormal(p, 0.);
+    case kBase:         return G4ThreeVector(0., 0., -1.);
+    case kCutEllipsoid: return -EllipsoidNormal(p, fCutShift);
+    case kCutPlane:     return G4ThreeVector(0., -1., 0.);
+  }
+  return G4ThreeVector(0., 0., 1.);
+}
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
+
+EInside ClippedEllipsoid::Inside(const G4ThreeVector& p) const
+{
+  if (std::abs(p.x()) > fDx + fHalfTolerance ||
+      std::abs(p.y()) > fDy + fHalfTolerance ||
+      p.z() < -fHalfTolerance || p.z() > fDz + fHalfTolerance) return kOutside;
+
+  G4double whole = std::max(EllipsoidDistance(p, 0.), -p.z());
+  G4double cut = std::max(EllipsoidDistance(p, fCutShift), p.y());
+  G4double distance = std::max(whole, -cut);
+  if (distance > fHalfTolerance) return kOutside;
+  return distance < -fHalfTolerance ? kInside : kSurface;
+}
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
+
+G4ThreeVector ClippedEllipsoid::SurfaceNormal(const G4ThreeVector& p) const
+{
+  G4double ellipsoid = EllipsoidDistance(p, 0.), base = -p.z();
+  G4double cutEllipsoid = EllipsoidDistance(p, fCutShift), cutPlane = p.y();
+  G4double whole = std::max(ellipsoid, base);
+  G4double cut = std::max(cutEllipsoid, cutPlane);
+
+  // sum of the normals of the faces the point is on
+  G4ThreeVector normal;
+  G4int nbFaces = 0;
+  if (cut >= -fHalfTolerance) {
+    if (std::abs(ellipsoid) <= fHalfTolerance && base <= fHalfTolerance) {
+      normal += Normal(kEllipsoid, p);
+      nbFaces++;
+    }
+    if (std::abs(base) <= fHalfTolerance && ellipsoid <= fHalfTolerance) {
+      normal += Normal(kBase, p);
+      nbFaces++;
+    }
+  }
+  if (whole <= fHalfTolerance) {
+    if (std::abs(cutEllipsoid) <= fHalfTolerance && cutPlane <= fHalfTolerance) {
+      normal += Normal(kCutEllipsoid, p);
+      nbFaces++;
+    }
+    if (std::abs(cutPlane) <= fHalfTolerance && cutEllipsoid <= fHalfTolerance) {
+      normal += Normal(kCutPlane, p);
+      nbFaces++;
+    }
+  }
+  if (nbFaces == 1) return normal;
+  if (nbFaces > 1 && normal.mag2() > 0.) return normal.unit();
+
+  // not on the surface: the face nearest to the point
+  Surface surface;
+  if (whole >= -cut) surface = ellipsoid >= base ? kEllipsoid : kBase;
+  else surface = cutEllipsoid >= cutPlane ? kCutEllipsoid : kCutPlane;
+  return Normal(surface, p);
+}
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
+
+ClippedEllipsoid::Interval
+ClippedEllipsoid::EllipsoidInterval(const G4ThreeVector& p,
+                                    const G4ThreeVector& v,
+                                    G4double x0, Surface surface) const
+{
+  // |P + t V|^2 = 1 in the frame of the unit sphere
+  G4double px = (p.x() - x0)/fDx, py = p.y()/fDy, pz = p.z()/fDz;
+  G4double vx = v.x()/fDx, vy = v.y()/fDy, vz = v.z()/fDz;
+  G4double a = vx*vx + vy*vy + vz*vz;
+  G4double b = px*vx + py*vy + pz*vz;
+  G4double c = px*px + py*py + pz*pz - 1.;
+  G4double discriminant = b*b - a*c;
+
+  Interval interval;
+  interval.fInSurface = interval.fOutSurface = surface;
+  if (discriminant <= 0.) {
+    interval.fEmpty = true;
+    return interval;
+  }
+  // roots without cancellation
+  G4double q = -(b + std::copysign(std::sqrt(discriminant), b));
+  G4double t1 = q/a, t2 = c/q;
+  interval.fIn = std::min(t1, t2);
+  interval.fOut = std::max(t1, t2);
+  return interval;
+}
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
+
+ClippedEllipsoid::Interval
+ClippedEllipsoid::Intersect(const Interval& a, const Interval& b)
+{
+  Interval both;
+  if (a.fIn >= b.fIn) { both.fIn = a.fIn; both.fInSurface = a.fInSurface; }
+  else                { both.fIn = b.fIn; both.fInSurface = b.fInSurface; }
+  if (a.fOut <= b.fOut) { both.fOut = a.fOut; both.fOutSurface = a.fOutSurface; }
+  else                  { both.fOut = b.fOut; both.fOutSurface = b.fOutSurface; }
+  both.fEmpty = a.fEmpty || b.fEmpty || both.fIn >= both.fOut;
+  return both;
+}
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
+
+G4int ClippedEllipsoid::Intervals(const G4ThreeVector& p, const G4ThreeVector& v,
+                                  Interval pieces[2]) const
+{
+  // the half ellipsoid, z >= 0
+  Interval above;
+  if (v.z() > 0.) {
+    above.fIn = -p.z()/v.z();
+    above.fInSurface = kBase;
+  }
+  else if (v.z() < 0.) {
+    above.fOut = -p.z()/v.z();
+    above.fOutSurface = kBase;
+  }
+  else {
+    above.fEmpty = p.z() < 0.;
+  }
+  Interval whole = Intersect(EllipsoidInterval(p, v, 0., kEllipsoid), above);
+  if (whole.fEmpty) return 0;
+
+  // the part cut away: the moved ellipsoid, y < 0
+  Interval below;
+  if (v.y() < 0.) {
+    below.fIn = -p.y()/v.y();
+    below.fInSurface = kCutPlane;
+  }
+  else if (v.y() > 0.) {
+    below.fOut = -p.y()/v.y();
+    below.fOutSurface = kCutPlane;
+  }
+  else {
+    below.fEmpty = p.y() >= 0.;
+  }
+  Interval cut =
+    Intersect(EllipsoidInterval(p, v, fCutShift, kCutEllipsoid), below);
+
+  if (cut.fEmpty || cut.fOut <= whole.fIn || cut.fIn >= whole.fOut) {
+    pieces[0] = whole;
+    return 1;
+  }
+  G4int nbPieces = 0;
+  if (cut.fIn > whole.fIn) {
+    pieces[nbPieces] = whole;
+    pieces[nbPieces].fOut = cut.fIn;
+    pieces[nbPieces].fOutSurface = cut.fInSurface;
+    nbPieces++;
+  }
+  if (cut.fOut < whole.fOut) {
+    pieces[nbPieces] = whole;
+    pieces[nbPieces].fIn = cut.fOut;
+    pieces[nbPieces].fInSurface = cut.fOutSurface;
+    nbPieces++;
+  }
+  return nbPieces;
+}
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
+
+G4bool ClippedEllipsoid::HitsBoundingBox(const G4ThreeVector& p,
+                                         const G4ThreeVector& v) const
+{
+  const G4double low[3]  = { -fDx, -fDy, 0. };
+  const G4double high[3] = {  fDx,  fDy, fDz };
+  G4double tMin = 0., tMax = kInfinity;
+  for (G4int axis = 0; axis < 3; axis++) {
+    G4double lo = low[axis] - fHalfTolerance, hi = high[axis] + fHalfTolerance;
+    if (v[axis] == 0.) {
+      if (p[axis] < lo || p[axis] > hi) return false;
+      continue;
+    }
+    G4double t1 = (lo - p[axis])/v[axis], t2 = (hi - p[axis])/v[axis];
+    tMin = std::max(tMin, std::min(t1, t2));
+    tMax = std::min(tMax, std::max(t1, t2));
+    if (tMax < tMin) return false;
+  }
+  return true;
+}
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
+
+G4double ClippedEllipsoid::DistanceToIn(const G4ThreeVector& p,
+                                        const G4ThreeVector& v) const
+{
+  if (!HitsBoundingBox(p, v)) return kInfinity;
+
+  Interval pieces[2];
+  G4int nbPieces = Intervals(p, v, pieces);
+  for (G4int i = 0; i < nbPieces; i++) {
+    // behind the point, or only grazing the surface
+    if (pieces[i].fOut <= fHalfTolerance ||
+        pieces[i].fOut - pieces[i].fIn <= fHalfTolerance) continue;
+    return pieces[i].fIn > fHalfTolerance ? pieces[i].fIn : 0.;
+  }
+  return kInfinity;
+}
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
+
+G4double ClippedEllipsoid::DistanceToIn(const G4ThreeVector& p) const
+{
+  // outside the bounding box or the half ellipsoid
+  G4double box = std::max({ std::abs(p.x()) - fDx, std::abs(p.y()) - fDy,
+                            -p.z(), p.z() - fDz });
+  G4double outside = std::max({ box, fMinAxis*(ScaledRadius(p, 0.) - 1.),
+                                -p.z() });
+  if (outside > 0.) return outside;
+
+  // in the part cut away
+  G4double inCut = std::min(fMinAxis*(1. - ScaledRadius(p, fCutShift)), -p.y());
+  return std::max(inCut, 0.);
+}
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
+
+G4double ClippedEllipsoid::DistanceToOut(const G4ThreeVector& p,
+                                         const G4ThreeVector& v,
+                                         const G4bool calcNorm,
+                                         G4bool* validNorm,
+                                         G4ThreeVector* n) const
+{
+  Interval pieces[2];
+  G4int nbPieces = Intervals(p, v, pieces);
+  for (G4int i = 0; i < nbPieces; i++) {
+    if (pieces[i].fIn > fHalfTolerance || pieces[i].fOut < -fHalfTolerance) continue;
+    G4double distance = std::max(pieces[i].fOut, 0.);
+    if (calcNorm) {
+      // the solid is inside the half ellipsoid, which is convex
+      Surface surface = pieces[i].fOutSurface;
+      *validNorm = surface == kEllipsoid || surface == kBase;
+      *n = Normal(surface, p + distance*v);
+    }
+    return distance;
+  }
+
+  // the point is not inside
+  if (calcNorm) {
+    *validNorm = false;
+    *n = SurfaceNormal(p);
+  }
+  return 0.;
+}
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
+
+G4double ClippedEllipsoid::DistanceToOut(const G4ThreeVector& p) const
+{
+  G4double safety = std::min(fMinAxis*(1. - ScaledRadius(p, 0.)), p.z());
+  G4double cut = std::max(fMinAxis*(ScaledRadius(p, fCutShift) - 1.), p.y());
+  return std::max(std::min(safety, cut), 0.);
+}
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
+
+void ClippedEllipsoid::BoundingLimits(G4ThreeVector& pMin,
+                                      G4ThreeVector& pMax) const
+{
+  pMin.set(-fDx, -fDy, 0.);
+  pMax.set( fDx,  fDy, fDz);
+}
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
+
+G4bool ClippedEllipsoid::CalculateExtent(const EAxis pAxis,
+                                         const G4VoxelLimits& pVoxelLimit,
+                                         const G4AffineTransform& pTransform,
+                                         G4double& pMin, G4double& pMax) const
+{
+  G4ThreeVector bmin, bmax;
+  BoundingLimits(bmin, bmax);
+  G4BoundingEnvelope bbox(bmin, bmax);
+  return bbox.CalculateExtent(pAxis, pVoxelLimit, pTransform, pMin, pMax);
+}
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
+
+G4double ClippedEllipsoid::GetCubicVolume()
+{
+  // the half ellipsoid minus a quarter of the lens common to the two
+  // ellipsoids, both symmetric in y and in z. In the frame of the unit
+  // sphere, the lens of two spheres at a distance d is pi (4+d)(2-d)^2/12
+  G4double d = std::min(std::abs(fCutShift)/fDx, 2.);
+  G4double lens = pi*(4. + d)*(2. - d)*(2. - d)/12.;
+  return fDx*fDy*fDz*(2.*pi/3. - 0.25*lens);
+}
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
+
+G4ThreeVector ClippedEllipsoid::GetPointOnSurface() const
+{
+  // rough areas of the four faces (Thomsen's formula for the ellipsoid);
+  // the points which fall outside the solid are drawn again
+  const G4double k = 1.6075;
+  G4double ellipsoid = 4.*pi*std::pow((std::pow(fDx*fDy, k) + std::pow(fDx*fDz, k)
+                                       + std::pow(fDy*fDz, k))/3., 1./k);
+  const G4double areas[4] = { 0.5*ellipsoid, pi*fDx*fDy,
+                              0.25*ellipsoid, 0.5*pi*fDx*fDz };
+  const G4double total = areas[0] + areas[1] + areas[2] + areas[3];
+
+  for (G4int attempt = 0; attempt < 10000; attempt++) {
+    G4double select = total*G4QuickRand();
+    G4double cost = 2.*G4QuickRand() - 1.;
+    G4double sint = std::sqrt((1. - cost)*(1. + cost));
+    G4double phi = twopi*G4QuickRand();
+    G4double rho = std::sqrt(G4QuickRand());
+    G4ThreeVector point;
+    G4bool onSolid = false;
+    if (select < areas[0]) {
+      point.set(fDx*sint*std::cos(phi), fDy*sint*std::sin(phi), fDz*std::abs(cost));
+      onSolid = std::max(EllipsoidDistance(point, fCutShift), point.y())
+                >= -fHalfTolerance;
+    }
+    else if (select < areas[0] + areas[1]) {
+      point.set(fDx*rho*std::cos(phi), fDy*rho*std::sin(phi), 0.);
+      onSolid = std::max(EllipsoidDistance(point, fCutShift), point.y())
+                >= -fHalfTolerance;
+    }
+    else if (select < areas[0] + areas[1] + areas[2]) {
+      point.set(fCutShift + fDx*sint*std::cos(phi),
+                -fDy*std::abs(sint*std::sin(phi)), fDz*std::abs(cost));
+      onSolid = std::max(EllipsoidDistance(point, 0.), -point.z())
+                <= fHalfTolerance;
+    }
+    else {
+      point.set(fCutShift + fDx*rho*std::cos(phi), 0.,
+                fDz*rho*std::abs(std::sin(phi)));
+      onSolid = std::max(EllipsoidDistance(point, 0.), -point.z())
+                <= fHalfTolerance;
+    }
+    if (onSolid) return point;
+  }
+  return G4ThreeVector(0., 0., fDz);
+}
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
+
+G4GeometryType ClippedEllipsoid::GetEntityType() const
+{
+  return G4String("ClippedEllipsoid");
+}
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
+
+G4VSolid* ClippedEllipsoid::Clone() const
+{
+  return new ClippedEllipsoid(*this);
+}
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
+
+std::ostream& ClippedEllipsoid::StreamInfo(std::ostream& os) const
+{
+  std::streamsize oldPrecision = os.precision(16);
+  os << "-----------------------------------------------------------\n"
+     << "    *** Dump for solid - " << GetName() << " ***\n"
+     << "    ===================================================\n"
+     << " Solid type: " << GetEntityType() << "\n"
+     << " Parameters: \n"
+     << "    semi-axis x: " << fDx/mm << " mm \n"
+     << "    semi-axis y: " << fDy/mm << " mm \n"
+     << "    semi-axis z: " << fDz/mm << " mm \n"
+     << "    shift of the cut along x: " << fCutShift/mm << " mm \n"
+     << "-----------------------------------------------------------\n";
+  os.precision(oldPrecision);
+  return os;
+}
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
+
+void ClippedEllipsoid::DescribeYourselfTo(G4VGraphicsScene& scene) const
+{
+  scene.AddSolid(*this);
+}
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
+
+G4Polyhedron* ClippedEllipsoid::CreatePolyhedron() const
+{
+  // drawn as the equivalent Boolean solid
+  G4Ellipsoid half("half", fDx, fDy, fDz, 0., fDz);
+  G4Ellipsoid whole("whole", fDx, fDy, fDz);
+  G4Box above("above", 1.1*fDx, fDy, 1.1*fDz);
+  G4SubtractionSolid below("below", &whole, &above, nullptr,
+                           G4ThreeVector(0., fDy, 0.));
+  G4SubtractionSolid lobe(GetName(), &half, &below, nullptr,
+                          G4ThreeVector(fCutShift, 0., 0.));
+  return lobe.CreatePolyhedron();
+}
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
+
+G4Polyhedron* ClippedEllipsoid::GetPolyhedron() const
+{
+  if (fpPolyhedron == nullptr || fRebuildPolyhedron ||
+      fpPolyhedron->GetNumberOfRotationStepsAtTimeOfCreation() !=
+      fpPolyhedron->GetNumberOfRotationSteps()) {
+    G4AutoLock lock(&polyhedronMutex);
+    delete fpPolyhedron;
+    fpPolyhedron = CreatePolyhedron();
+    fRebuildPolyhedron = false;
+  }
+  return fpPolyhedron;
+}
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
+
+}
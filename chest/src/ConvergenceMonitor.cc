@@ -0,0 +1,196 @@
+//
+// ********************************************************************
+// * License and Disclaimer                                           *
+// *                                                                  *
+// * The  Geant4 software  is  copyright of the Copyright Holders  of *
+// * the Geant4 Collaboration.  It is provided  under  the terms  and *
+// * conditions of the Geant4 Software License,  included in the file *
+// * LICENSE and available at  http://cern.ch/geant4/license .  These *
+// * include a list of copyright holders.                             *
+// *                                                                  *
+// * Neither the authors of this software system, nor their employing *
+// * institutes,nor the agencies providing financial support for this *
+// * work  make  any representation or  warranty, express or implied, *
+// * regarding  this  software system or assume any liability for its *
+// * use.  Please see the license in the file  LICENSE  and URL above *
+// * for the full disclaimer and the limitation of liability.         *
+// *                                                                  *
+// * This  code  implementation is the result of  the  scientific and *
+// * technical work of the GEANT4 collaboration.                      *
+// * By using,  copying,  modifying or  distributing the software (or *
+// * any work based  on the software)  you  agree  to acknowledge its *
+// * use  in  resulting  scientific  publications,  and indicate your *
+// * acceptance of all terms of the Geant4 Software license.          *
+// ********************************************************************
+//
+/// \file ConvergenceMonitor.cc
+/// \brief Implementation of the B3b::ConvergenceMonitor class
+
+#include "ConvergenceMonitor.hh"
+#include "OrganRegistry.hh"
+
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+#include <iomanip>
+
+namespace B3b
+{
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
+
+ConvergenceMonitor* ConvergenceMonitor::Instance()
+{
+  static ConvergenceMonitor instance;
+  return &instance;
+}
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
+
+void ConvergenceMonitor::Start(const ConvergenceTargets& targets)
+{
+  std::lock_guard<std::mutex> lock(fMutex);
+  fTargets = targets;
+  fTargets.fInterval = std::max(1, fTargets.fInterval);
+  fActive = !fTargets.fOrgans.empty() || fTargets.fEfficiency > 0. ||
+            fTargets.fCoincidences > 0.;
+  fConverged = false;
+  fSnapshots.clear();
+  fErrors.clear();
+  fWarned = false;
+  fNbEvents = 0;
+  fNbEventsAtConvergence = 0;
+  fStart = Clock::now();
+}
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
+
+void ConvergenceMonitor::Publish(G4int thread, G4long nbEvents,
+                                 G4long nbGoodEvents,
+                                 const std::vector<G4StatAnalysis>& statDose)
+{
+  std::lock_guard<std::mutex> lock(fMutex);
+  std::size_t slot = std::max(0, thread);
+  if (slot >= fSnapshots.size()) fSnapshots.resize(slot + 1);
+  Snapshot& snapshot = fSnapshots[slot];
+  snapshot.fNbEvents = nbEvents;
+  snapshot.fNbGoodEvents = nbGoodEvents;
+  snapshot.fStatDose = statDose;
+  Evaluate();
+}
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
+
+void ConvergenceMonitor::Evaluate()
+{
+  const B3::OrganRegistry* organs = B3::OrganRegistry::Instance();
+
+  // statistics of all the threads so far
+  G4long nbGoodEvents = 0;
+  std::vector<G4StatAnalysis> statDose(organs->GetNbOrgans());
+  fNbEvents = 0;
+  for (const Snapshot& snapshot : fSnapshots) {
+    fNbEvents += snapshot.fNbEvents;
+    nbGoodEvents += snapshot.fNbGoodEvents;
+    std::size_t nbOrgans = std::min(statDose.size(), snapshot.fStatDose.size());
+    for (std::size_t i = 0; i < nbOrgans; i++) {
+      statDose[i] += snapshot.fStatDose[i];
+    }
+  }
+
+  fErrors.clear();
+  G4bool met = fNbEvents >= fTargets.fMinEvents;
+  auto check = [this, &met](const G4String& name, G4double error,
+                            G4double target) {
+    fErrors.push_back({name, error, target});
+    if (!(error <= target)) met = false;
+  };
+
+  for (const auto& target : fTargets.fOrgans) {
+    G4bool found = false;
+    for (G4int i = 0; i < organs->GetNbOrgans(); i++) {
+      const B3::OrganEntry& organ = organs->GetOrgan(i);
+      if (!organ.fStatistics) continue;
+      if (target.first != "all" && target.first != organ.fScorerName) continue;
+      found = true;
+      G4double mean = statDose[i].GetMean();
+      check(organ.fScorerName,
+            mean > 0. ? statDose[i].GetRelativeError() : DBL_MAX, target.second);
+    }
+    if (!found && !fWarned) {
+      G4ExceptionDescription msg;
+      msg << "No organ with statistics named " << target.first
+          << ": target ignored.";
+      G4Exception("ConvergenceMonitor::Evaluate()", "B3bConvergence001",
+                  JustWarning, msg);
+    }
+  }
+  fWarned = true;
+
+  // binomial error on the fraction of good events, Poisson error on their
+  // number
+  if (fTargets.fEfficiency > 0.) {
+    G4double efficiency = fNbEvents > 0 ? G4double(nbGoodEvents)/fNbEvents : 0.;
+    check("efficiency",
+          nbGoodEvents > 0 ? std::sqrt((1. - efficiency)/nbGoodEvents) : DBL_MAX,
+          fTargets.fEfficiency);
+  }
+  if (fTargets.fCoincidences > 0.) {
+    check("coincidences",
+          nbGoodEvents > 0 ? 1./std::sqrt(G4double(nbGoodEvents)) : DBL_MAX,
+          fTargets.fCoincidences);
+  }
+
+  if (met && !fConverged) {
+    fNbEventsAtConvergence = fNbEvents;
+    fConvergence = Clock::now();
+    fConverged = true;
+  }
+}
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
+
+void ConvergenceMonitor::Stop(G4int nbRequested, G4int nbProcessed)
+{
+  std::lock_guard<std::mutex> lock(fMutex);
+  if (!fActive) return;
+  fActive = false;
+
+  G4double elapsed =
+    std::chrono::duration<G4double>(Clock::now() - fStart).count();
+  G4cout
+    << G4endl
+    << "--------------------Convergence-----------------------------" << G4endl;
+  if (fConverged) {
+    G4double atConvergence =
+      std::chrono::duration<G4double>(fConvergence - fStart).count();
+    G4cout
+      << " Targets met after " << fNbEventsAtConvergence << " events ("
+      << atConvergence << " s); run stopped at " << nbProcessed << " of "
+      << nbRequested << " events" << G4endl;
+  }
+  else {
+    G4cout
+      << " Targets not met after " << nbProcessed << " of " << nbRequested
+      << " events" << G4endl;
+  }
+  for (const TargetError& error : fErrors) {
+    G4cout << "  " << std::setw(14) << std::left << error.fName << std::right
+           << " relative error ";
+    if (error.fError < DBL_MAX) G4cout << 100.*error.fError << " %";
+    else                        G4cout << "undefined";
+    G4cout << " (target " << 100.*error.fTarget << " %)" << G4endl;
+  }
+  if (nbProcessed > 0 && nbProcessed < nbRequested) {
+    G4cout
+      << " " << nbRequested - nbProcessed << " events and about "
+      << elapsed*(nbRequested - nbProcessed)/nbProcessed << " s saved"
+      << " (run time " << elapsed << " s)" << G4endl;
+  }
+  G4cout
+    << "------------------------------------------------------------" << G4endl;
+}
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
+
+}
@@ -0,0 +1,126 @@
+//
+// ********************************************************************
+// * License and Disclaimer                                           *
+// *                                                                  *
+// * The  Geant4 software  is  copyright of the Copyright Holders  of *
+// * the Geant4 Collaboration.  It is provided  under  the terms  and *
+// * conditions of the Geant4 Software License,  included in the file *
+// * LICENSE and available at  http://cern.ch/geant4/license .  These *
+// * include a list of copyright holders.                             *
+// *                                                                  *
+// * Neither the authors of this software system, nor their employing *
+// * institutes,nor the agencies providing financial support for this *
+// * work  make  any representation or  warranty, express or implied, *
+// * regarding  this  software system or assume any liability for its *
+// * use.  Please see the license in the file  LICENSE  and URL above *
+// * for the full disclaimer and the limitation of liability.         *
+// *                                                                  *
+// * This  code  implementation is the result of  the  scientific and *
+// * technical work of the GEANT4 collaboration.                      *
+// * By using,  copying,  modifying or  distributing the software (or *
+// * any work based  on the software)  you  agree  to acknowledge its *
+// * use  in  resulting  scientific  publications,  and indicate your *
+// * acceptance of all terms of the Geant4 Software license.          *
+// ********************************************************************
+//
+/// \file CrystalSD.cc
+/// \brief Implementation of the B3::CrystalSD class
+
+#include "CrystalSD.hh"
+
+#include "G4Step.hh"
+#include "G4StepPoint.hh"
+#include "G4VTouchable.hh"
+#include "G4Track.hh"
+#include "G4Gamma.hh"
+#include "G4SystemOfUnits.hh"
+
+namespace B3
+{
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
+
+CrystalSD::CrystalSD(const G4String& name, const DetectorID& detectorID)
+ : G4VSensitiveDetector(name),
+   fDetectorID(detectorID),
+   fEdep(detectorID.GetNbDetectors(), 0.),
+   fTime(detectorID.GetNbDetectors(), 0.),
+   fScatter(detectorID.GetNbDetectors(), 0)
+{
+  // a PET event rarely fires more than a handful of crystals
+  fFired.reserve(64);
+  fScattered.reserve(64);
+
+  // below this energy a photon entering a crystal has been scattered
+  // (leaves room for the Doppler broadening of the annihilation photons)
+  fScatterEnergy = 505*keV;
+}
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
+
+CrystalSD::~CrystalSD()
+{ }
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
+
+void CrystalSD::SetDetectorID(const DetectorID& detectorID)
+{
+  fDetectorID = detectorID;
+  fEdep.assign(detectorID.GetNbDetectors(), 0.);
+  fTime.assign(detectorID.GetNbDetectors(), 0.);
+  fScatter.assign(detectorID.GetNbDetectors(), 0);
+  fFired.clear();
+  fScattered.clear();
+}
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
+
+void CrystalSD::Initialize(G4HCofThisEvent*)
+{
+  // clear only what the previous event has touched
+  for (G4int id : fFired) fEdep[id] = 0.;
+  fFired.clear();
+  for (G4int id : fScattered) fScatter[id] = 0;
+  fScattered.clear();
+}
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
+
+G4bool CrystalSD::ProcessHits(G4Step* step, G4TouchableHistory*)
+{
+  G4StepPoint* preStep = step->GetPreStepPoint();
+
+  // photon entering the crystal after a scatter
+  if (preStep->GetStepStatus() == fGeomBoundary &&
+      step->GetTrack()->GetDefinition() == G4Gamma::Gamma() &&
+      preStep->GetKineticEnergy() < fScatterEnergy) {
+    G4int id = fDetectorID.FromTouchable(preStep->GetTouchable());
+    if (! fScatter[id]) {
+      fScatter[id] = 1;
+      fScattered.push_back(id);
+    }
+  }
+
+  G4double edep = step->GetTotalEnergyDeposit();
+  if (edep <= 0.) return false;
+
+  // same weighting as G4PSEnergyDeposit
+  edep *= preStep->GetWeight();
+
+  G4int id = fDetectorID.FromTouchable(preStep->GetTouchable());
+  G4double time = preStep->GetGlobalTime();
+
+  // the steps of the secondaries are not processed in time order
+  if (fEdep[id] == 0.) {
+    fFired.push_back(id);
+    fTime[id] = time;
+  }
+  else if (time < fTime[id]) fTime[id] = time;
+  fEdep[id] += edep;
+
+  return true;
+}
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
+
+}
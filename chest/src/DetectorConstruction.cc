@@ -28,6 +28,10 @@
 /// \brief Implementation of the B3::DetectorConstruction class
 
 #include "DetectorConstruction.hh"
+#include "CrystalSD.hh"
+#include "OrganRegistry.hh"
+#include "OrganDoseSD.hh"
+#include "ClippedEllipsoid.hh"
 
 #include "G4NistManager.hh"
 #include "G4Box.hh"
@@ -38,18 +42,25 @@
 #include "G4SubtractionSolid.hh"
 #include "G4EllipticalTube.hh"
 #include "G4LogicalVolume.hh"
+#include "G4LogicalVolumeStore.hh"
+#include "G4PhysicalVolumeStore.hh"
+#include "G4SolidStore.hh"
+#include "G4GeometryManager.hh"
 #include "G4PVPlacement.hh"
 #include "G4RotationMatrix.hh"
 #include "G4Transform3D.hh"
 #include "G4SDManager.hh"
-#include "G4MultiFunctionalDetector.hh"
-#include "G4VPrimitiveScorer.hh"
-#include "G4PSEnergyDeposit.hh"
-#include "G4PSDoseDeposit.hh"
+#include "G4RunManager.hh"
+#include "G4StateManager.hh"
+#include "G4GenericMessenger.hh"
+#include "G4UIcommand.hh"
+#include "G4UIcommandStatus.hh"
 #include "G4VisAttributes.hh"
 #include "G4PhysicalConstants.hh"
 #include "G4SystemOfUnits.hh"
 
+#include <algorithm>
+
 namespace B3
 {
 
@@ -57,13 +68,23 @@ namespace B3
 
 DetectorConstruction::DetectorConstruction()
 {
+  // Gamma detector Parameters
+  //
+  fCrystalDX = 6*cm;
+  fCrystalDY = 6*cm;
+  fCrystalDZ = 3*cm;
+  fGap = 0.5*mm;        //a gap for wrapping
+
   DefineMaterials();
+  DefineCommands();
 }
 
 //....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
 
 DetectorConstruction::~DetectorConstruction()
-{ }
+{
+  delete fMessenger;
+}
 
 //....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
 
@@ -81,17 +102,50 @@ void DetectorConstruction::DefineMaterials()
   LSO->AddElement(Lu, 2);
   LSO->AddElement(Si, 1);
   LSO->AddElement(O , 5);
+
+  // the other scintillators selectable with /B3/detector/material
+  // (BGO is G4_BGO); the cerium doping is neglected
+  //
+  G4Element*  Y = man->FindOrBuildElement("Y" , isotopes);
+  G4Element* Gd = man->FindOrBuildElement("Gd", isotopes);
+
+  // Lu1.8Y0.2SiO5
+  G4Material* LYSO = new G4Material("LYSO", 7.1*g/cm3, 4);
+  LYSO->AddElement(Lu, 18);
+  LYSO->AddElement(Y ,  2);
+  LYSO->AddElement(Si, 10);
+  LYSO->AddElement(O , 50);
+
+  // Lu1.8Gd0.2SiO5
+  G4Material* LFS = new G4Material("LFS", 7.35*g/cm3, 4);
+  LFS->AddElement(Lu, 18);
+  LFS->AddElement(Gd,  2);
+  LFS->AddElement(Si, 10);
+  LFS->AddElement(O , 50);
+
+  G4Material* GSO = new G4Material("GSO", 6.71*g/cm3, 3);
+  GSO->AddElement(Gd, 2);
+  GSO->AddElement(Si, 1);
+  GSO->AddElement(O , 5);
 }
 
 //....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
 
 G4VPhysicalVolume* DetectorConstruction::Construct()
 {
+  // the previous geometry, when the scanner has been changed
+  //
+  G4GeometryManager::GetInstance()->OpenGeometry();
+  G4PhysicalVolumeStore::GetInstance()->Clean();
+  G4LogicalVolumeStore::GetInstance()->Clean();
+  G4SolidStore::GetInstance()->Clean();
+
   // Gamma detector Parameters
   //
-  G4double cryst_dX = 6*cm, cryst_dY = 6*cm, cryst_dZ = 3*cm;
-  G4int nb_cryst = 32;
-  G4int nb_rings = 9;
+  G4double cryst_dX = fCrystalDX, cryst_dY = fCrystalDY, cryst_dZ = fCrystalDZ;
+  G4int nb_cryst = fNbCrystals;
+  G4int nb_rings = fNbRings;
+  fDetectorID = DetectorID(nb_rings, nb_cryst);
   //
   G4double dPhi = twopi/nb_cryst, half_dPhi = 0.5*dPhi;
   G4double cosdPhi = std::cos(half_dPhi);
@@ -104,7 +158,7 @@ G4VPhysicalVolume* DetectorConstruction::Construct()
   //
   G4NistManager* nist = G4NistManager::Instance();
   G4Material* default_mat = nist->FindOrBuildMaterial("G4_AIR");
-  G4Material* cryst_mat   = nist->FindOrBuildMaterial("Lu2SiO5");
+  G4Material* cryst_mat   = nist->FindOrBuildMaterial(fCrystalMaterial);
 
   //
   // World
@@ -145,7 +199,7 @@ G4VPhysicalVolume* DetectorConstruction::Construct()
   //
   // define crystal
   //
-  G4double gap = 0.5*mm;        //a gap for wrapping
+  G4double gap = fGap;
   G4double dX = cryst_dX - gap, dY = cryst_dY - gap;
   G4Box* solidCryst = new G4Box("crystal", dX/2, dY/2, cryst_dZ/2);
 
@@ -170,7 +224,7 @@ G4VPhysicalVolume* DetectorConstruction::Construct()
                       "crystal",             //its name
                       logicRing,             //its mother  volume
                       false,                 //no boolean operation
-                      icrys,                 //copy number
+                      fDetectorID.Pack(0,icrys), //copy number
                       fCheckOverlaps);       // checking overlaps
   }
 
@@ -197,7 +251,7 @@ G4VPhysicalVolume* DetectorConstruction::Construct()
                       "ring",                //its name
                       logicDetector,         //its mother  volume
                       false,                 //no boolean operation
-                      iring,                 //copy number
+                      fDetectorID.Pack(iring,0), //copy number
                       fCheckOverlaps);       // checking overlaps
   }
 
@@ -245,6 +299,12 @@ G4VPhysicalVolume* DetectorConstruction::Construct()
   G4EllipticalTube* cage = new G4EllipticalTube("outCage",dx, dy, thickness/2.);
   G4LogicalVolume* logicRibCage = new G4LogicalVolume(cage, soft, "logicalCage", 0, 0, 0);
 
+  // the cage encloses all the organs
+  G4ThreeVector phantomMin, phantomMax;
+  cage->BoundingLimits(phantomMin, phantomMax);
+  fPhantomSize = phantomMax - phantomMin;
+  FitWorld(solidWorld, ring_R1, world_sizeXY, world_sizeZ);
+
 /*  G4VPhysicalVolume* physRibCage =*/new G4PVPlacement(0,G4ThreeVector(0.0, 0.0, 0.0),
 						     // with respect to the trunk
 						     logicRibCage,
@@ -420,9 +480,6 @@ G4VPhysicalVolume* DetectorConstruction::Construct()
   cz = 24.*cm; //c
   zcut1 = 0.0 *cm; 
   zcut2=24. *cm;
-  dx = 5.5* cm;
-  dy = 8.5 * cm;
-  G4double dz = 24. * cm;
 
   G4Material* lung_material = nist->FindOrBuildMaterial("G4_LUNG_ICRP");
 
@@ -479,20 +536,7 @@ G4VPhysicalVolume* DetectorConstruction::Construct()
 
 //POLMONE DESTRO 
  
-  auto twoLung = new G4Ellipsoid("TwoLung",ax, by, cz, zcut1,zcut2);
-
-  auto subtrLungtwo = new G4Ellipsoid("subtrLungtwo",ax, by, cz);
-
-  // y<0
-
-  auto boxtwo = new G4Box("Boxtwo", dx, dy, dz);
- 
-  auto sectiontwo = new G4SubtractionSolid("BoxSubtwo", subtrLungtwo, boxtwo, nullptr, G4ThreeVector(0.*cm, 8.5* cm, 0.*cm)); 
-  //G4SubtractionSolid* section2 = new G4SubtractionSolid("BoxSub2", subtrLung, box, 0, G4ThreeVector(0.*cm, -8.5* cm, 0.*cm)); 
-
-  auto lung1 =  new G4SubtractionSolid("Lung1", twoLung,
-					  sectiontwo,
-				          nullptr, G4ThreeVector(6.*cm,0*cm,0.0*cm));
+  G4VSolid* lung1 = BuildRightLung(fAnalyticSolids);
  
   auto logicRightLung = new G4LogicalVolume(lung1,lung_material,
 							"Lung1"); 
@@ -539,6 +583,10 @@ new G4PVPlacement(rmLungDX,G4ThreeVector(-8.50 *cm, 0.0*cm, 8.5*cm-15.32*cm),
   // Print materials
   G4cout << *(G4Material::GetMaterialTable()) << G4endl;
 
+  // overlaps of the placements which are not in the cache
+  //
+  OverlapChecker(fOverlapCache).Check(physWorld, fOverlapMode);
+
   //always return the physical World
   //
   return physWorld;
@@ -546,52 +594,296 @@ new G4PVPlacement(rmLungDX,G4ThreeVector(-8.50 *cm, 0.0*cm, 8.5*cm-15.32*cm),
 
 //....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
 
+G4VSolid* DetectorConstruction::BuildRightLung(G4bool analytic)
+{
+  // upper half of the ellipsoid, without the lower part (y < 0) of the
+  // same ellipsoid moved by 6 cm towards the heart
+  G4double ax = 5.*cm, by = 7.5*cm, cz = 24.*cm;
+  G4double shift = 6.*cm;
+  if (analytic) return new ClippedEllipsoid("Lung1", ax, by, cz, shift);
+
+  auto twoLung = new G4Ellipsoid("TwoLung",ax, by, cz, 0.*cm, cz);
+
+  auto subtrLungtwo = new G4Ellipsoid("subtrLungtwo",ax, by, cz);
+
+  // y<0
+
+  auto boxtwo = new G4Box("Boxtwo", 5.5*cm, 8.5*cm, 24.*cm);
+ 
+  auto sectiontwo = new G4SubtractionSolid("BoxSubtwo", subtrLungtwo, boxtwo, nullptr, G4ThreeVector(0.*cm, 8.5* cm, 0.*cm)); 
+
+  return new G4SubtractionSolid("Lung1", twoLung,
+				sectiontwo,
+				nullptr, G4ThreeVector(shift,0*cm,0.0*cm));
+}
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
+
 void DetectorConstruction::ConstructSDandField()
 {
   G4SDManager::GetSDMpointer()->SetVerboseLevel(1);
 
-  // declare crystal as a MultiFunctionalDetector scorer
+  // declare crystal as a CrystalSD: flat per-thread energy buffer
+  // indexed by global (ring, crystal) detector ID.
+  // When the geometry is rebuilt the detectors of the thread already exist:
+  // they are resized and attached to the new volumes.
   //
-  G4MultiFunctionalDetector* cryst = new G4MultiFunctionalDetector("crystal");
-  G4SDManager::GetSDMpointer()->AddNewDetector(cryst);
-  G4VPrimitiveScorer* primitiv1 = new G4PSEnergyDeposit("edep");
-  cryst->RegisterPrimitive(primitiv1);
+  G4SDManager* sdManager = G4SDManager::GetSDMpointer();
+  auto cryst =
+    static_cast<CrystalSD*>(sdManager->FindSensitiveDetector("crystal", false));
+  if (cryst == nullptr) {
+    cryst = new CrystalSD("crystal", fDetectorID);
+    sdManager->AddNewDetector(cryst);
+  }
+  else {
+    cryst->SetDetectorID(fDetectorID);
+  }
   SetSensitiveDetector("CrystalLV",cryst);
 
-  // declare patient as a MultiFunctionalDetector scorer
+  // declare the organs of the patient, as listed in the organ registry:
+  // a single OrganDoseSD accumulates the dose of all of them
   //
-  G4MultiFunctionalDetector* leftLung = new G4MultiFunctionalDetector("leftLung");
-  G4SDManager::GetSDMpointer()->AddNewDetector(leftLung);
-  G4VPrimitiveScorer* primitiv2 = new G4PSDoseDeposit("doseLeftLung");
-  leftLung->RegisterPrimitive(primitiv2);
-  SetSensitiveDetector("Lung2",leftLung);
-
-  G4MultiFunctionalDetector* rightLung= new G4MultiFunctionalDetector("rightLung");
-  G4SDManager::GetSDMpointer()->AddNewDetector(rightLung);
-  G4VPrimitiveScorer* primitiv3 = new G4PSDoseDeposit("doseRightLung");
-  rightLung->RegisterPrimitive(primitiv3);
-  SetSensitiveDetector("Lung1",rightLung);
-
-  G4MultiFunctionalDetector* heart = new G4MultiFunctionalDetector("heart");
-  G4SDManager::GetSDMpointer()->AddNewDetector(heart);
-  G4VPrimitiveScorer* primitiv4 = new G4PSDoseDeposit("doseHeart");
-  heart->RegisterPrimitive(primitiv4);
-  SetSensitiveDetector("HeartVolume",heart);
-
-  G4MultiFunctionalDetector* ribs = new G4MultiFunctionalDetector("ribs");
-  G4SDManager::GetSDMpointer()->AddNewDetector(ribs);
-  G4VPrimitiveScorer* primitiv5 = new G4PSDoseDeposit("doseRibs");
-  ribs->RegisterPrimitive(primitiv5);
-  SetSensitiveDetector("logicalRib",ribs);
-
-  G4MultiFunctionalDetector* ribCage = new G4MultiFunctionalDetector("ribCage");
-  G4SDManager::GetSDMpointer()->AddNewDetector(ribCage);
-  G4VPrimitiveScorer* primitiv6 = new G4PSDoseDeposit("doseRibCage");
-  ribCage->RegisterPrimitive(primitiv6);
-  SetSensitiveDetector("logicalCage",ribCage);
-
- //  logicRibCage
+  OrganRegistry* organs = OrganRegistry::Instance();
+  organs->Register("Lung2",       "leftLung",  "the left lung");
+  organs->Register("Lung1",       "rightLung", "the right lung");
+  organs->Register("HeartVolume", "heart",     "the heart");
+  organs->Register("logicalRib",  "ribs",      "the ribs");
+  organs->Register("logicalCage", "ribCage",   "the ribcage");
+
+  auto organDose =
+    static_cast<OrganDoseSD*>(sdManager->FindSensitiveDetector("organDose", false));
+  if (organDose == nullptr) {
+    organDose = new OrganDoseSD("organDose", organs->GetNbOrgans());
+    sdManager->AddNewDetector(organDose);
+  }
+  else {
+    organDose->ClearVolumes();
+  }
+
+  G4LogicalVolumeStore* lvStore = G4LogicalVolumeStore::GetInstance();
+  for (G4int i = 0; i < organs->GetNbOrgans(); i++) {
+    const OrganEntry& organ = organs->GetOrgan(i);
+    G4LogicalVolume* logicOrgan = lvStore->GetVolume(organ.fVolumeName);
+    organDose->AddVolume(logicOrgan, i, organ.fStatistics,
+                         organ.fExcludeDaughters);
+    SetSensitiveDetector(logicOrgan, organDose);
+  }
+}
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
+
+void DetectorConstruction::SetCrystalDX(G4double value)
+{
+  fCrystalDX = value;
+  GeometryChanged();
+}
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
+
+void DetectorConstruction::SetCrystalDY(G4double value)
+{
+  fCrystalDY = value;
+  GeometryChanged();
+}
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
+
+void DetectorConstruction::SetCrystalDZ(G4double value)
+{
+  fCrystalDZ = value;
+  GeometryChanged();
+}
 
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
+
+void DetectorConstruction::SetNbCrystals(G4int value)
+{
+  fNbCrystals = value;
+  GeometryChanged();
+}
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
+
+void DetectorConstruction::SetNbRings(G4int value)
+{
+  fNbRings = value;
+  GeometryChanged();
+}
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
+
+void DetectorConstruction::SetGap(G4double value)
+{
+  fGap = value;
+  GeometryChanged();
+}
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
+
+void DetectorConstruction::SetCrystalMaterial(const G4String& name)
+{
+  // short names of the usual PET scintillators
+  G4String material = name;
+  if (name == "LSO")      material = "Lu2SiO5";
+  else if (name == "BGO") material = "G4_BGO";
+
+  if (G4NistManager::Instance()->FindOrBuildMaterial(material) == nullptr) {
+    G4ExceptionDescription msg;
+    msg << "Unknown crystal material " << name
+        << ": the crystals stay in " << fCrystalMaterial << ".";
+    G4Exception("DetectorConstruction::SetCrystalMaterial()", "B3Detector001",
+                JustWarning, msg);
+    // through the command, its caller (a macro, the sweep) sees the failure
+    if (fMaterialCommand) {
+      fMaterialCommand->CommandFailed(fParameterOutOfCandidates, msg);
+    }
+    return;
+  }
+
+  fCrystalMaterial = material;
+  GeometryChanged();
+}
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
+
+void DetectorConstruction::SetOverlapMode(const G4String& mode)
+{
+  if (mode == "none")     fOverlapMode = kOverlapNone;
+  else if (mode == "all") fOverlapMode = kOverlapAll;
+  else                    fOverlapMode = kOverlapNew;
+}
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
+
+void DetectorConstruction::SetAnalyticSolids(G4bool value)
+{
+  fAnalyticSolids = value;
+  GeometryChanged();
+}
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
+
+G4double DetectorConstruction::GetRingRadius() const
+{
+  // the crystals touch along their inner face
+  return 0.5*fCrystalDY/std::tan(pi/fNbCrystals);
+}
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
+
+G4bool DetectorConstruction::FitsPhantom() const
+{
+  return GetRingRadius() > 0.5*std::max(fPhantomSize.x(), fPhantomSize.y());
+}
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
+
+void DetectorConstruction::FitWorld(G4Box* solidWorld, G4double ringRadius,
+                                    G4double worldXY, G4double worldZ) const
+{
+  // the crystals must stay outside the phantom, whatever the scanner
+  G4double phantomRadius = 0.5*std::max(fPhantomSize.x(), fPhantomSize.y());
+  if (ringRadius <= phantomRadius) {
+    G4ExceptionDescription msg;
+    msg << "The inner radius of the rings, " << ringRadius/cm
+        << " cm, is inside the phantom, which extends to " << phantomRadius/cm
+        << " cm: more crystals per ring or wider crystals are needed.";
+    G4Exception("DetectorConstruction::FitWorld()", "B3Detector002",
+                FatalException, msg);
+  }
+
+  // the world encloses the detector and the phantom, with the same margin
+  solidWorld->SetXHalfLength(0.5*std::max(worldXY, 1.2*fPhantomSize.x()));
+  solidWorld->SetYHalfLength(0.5*std::max(worldXY, 1.2*fPhantomSize.y()));
+  solidWorld->SetZHalfLength(0.5*std::max(worldZ, 1.2*fPhantomSize.z()));
+}
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
+
+void DetectorConstruction::GeometryChanged()
+{
+  // before /run/initialize, Construct() simply takes the new values;
+  // afterwards the geometry is rebuilt at the next run, on all the threads
+  // (the same as /run/reinitializeGeometry). The physics tables are kept,
+  // only those of a new material are added.
+  if (G4StateManager::GetStateManager()->GetCurrentState() != G4State_PreInit)
+    G4RunManager::GetRunManager()->ReinitializeGeometry();
+}
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
+
+void DetectorConstruction::DefineCommands()
+{
+  fMessenger = new G4GenericMessenger(this, "/B3/detector/",
+                                      "Scanner geometry");
+
+  // the detector construction is shared: the commands act on the master
+  // only, which propagates the geometry change to the workers
+  fMessenger->DeclareMethodWithUnit("crystalDX", "cm",
+                                    &DetectorConstruction::SetCrystalDX,
+                                    "Crystal size along the scanner axis.")
+    .SetParameterName("dX", false)
+    .SetRange("dX>0.")
+    .SetToBeBroadcasted(false);
+
+  fMessenger->DeclareMethodWithUnit("crystalDY", "cm",
+                                    &DetectorConstruction::SetCrystalDY,
+                                    "Crystal size along the ring.")
+    .SetParameterName("dY", false)
+    .SetRange("dY>0.")
+    .SetToBeBroadcasted(false);
+
+  fMessenger->DeclareMethodWithUnit("crystalDZ", "cm",
+                                    &DetectorConstruction::SetCrystalDZ,
+                                    "Crystal depth, along the radius.")
+    .SetParameterName("dZ", false)
+    .SetRange("dZ>0.")
+    .SetToBeBroadcasted(false);
+
+  fMessenger->DeclareMethod("nbCrystals", &DetectorConstruction::SetNbCrystals,
+                            "Number of crystals per ring.")
+    .SetParameterName("nb", false)
+    .SetRange("nb>=3")
+    .SetToBeBroadcasted(false);
+
+  fMessenger->DeclareMethod("nbRings", &DetectorConstruction::SetNbRings,
+                            "Number of rings.")
+    .SetParameterName("nb", false)
+    .SetRange("nb>=1")
+    .SetToBeBroadcasted(false);
+
+  fMessenger->DeclareMethodWithUnit("gap", "mm", &DetectorConstruction::SetGap,
+                                    "Wrapping gap between the crystals.")
+    .SetParameterName("gap", false)
+    .SetRange("gap>=0.")
+    .SetToBeBroadcasted(false);
+
+  fMaterialCommand =
+    fMessenger->DeclareMethod("material", &DetectorConstruction::SetCrystalMaterial,
+                              "Crystal material: LSO, LYSO, BGO, LFS, GSO or any"
+                              " material name.")
+      .SetParameterName("material", false)
+      .SetToBeBroadcasted(false)
+      .command;
+
+  fMessenger->DeclareMethod("checkOverlaps", &DetectorConstruction::SetOverlapMode,
+                            "Check the overlaps of no placement, of the new"
+                            " ones (not in the cache) or of all of them.")
+    .SetParameterName("mode", false)
+    .SetCandidates("none new all")
+    .SetToBeBroadcasted(false);
+
+  fMessenger->DeclareProperty("overlapCache", fOverlapCache,
+                              "File of the placements found free of overlaps.")
+    .SetToBeBroadcasted(false);
+
+  fMessenger->DeclareMethod("analyticSolids",
+                            &DetectorConstruction::SetAnalyticSolids,
+                            "Build the right lung as one analytic solid rather"
+                            " than as nested Boolean solids.")
+    .SetParameterName("analytic", true)
+    .SetDefaultValue("true")
+    .SetToBeBroadcasted(false);
 }
 
 //....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
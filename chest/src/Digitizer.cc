@@ -0,0 +1,253 @@
+//
+// ********************************************************************
+// * License and Disclaimer                                           *
+// *                                                                  *
+// * The  Geant4 software  is  copyright of the Copyright Holders  of *
+// * the Geant4 Collaboration.  It is provided  under  the terms  and *
+// * conditions of the Geant4 Software License,  included in the file *
+// * LICENSE and available at  http://cern.ch/geant4/license .  These *
+// * include a list of copyright holders.                             *
+// *                                                                  *
+// * Neither the authors of this software system, nor their employing *
+// * institutes,nor the agencies providing financial support for this *
+// * work  make  any representation or  warranty, express or implied, *
+// * regarding  this  software system or assume any liability for its *
+// * use.  Please see the license in the file  LICENSE  and URL above *
+// * for the full disclaimer and the limitation of liability.         *
+// *                                                                  *
+// * This  code  implementation is the result of  the  scientific and *
+// * technical work of the GEANT4 collaboration.                      *
+// * By using,  copying,  modifying or  distributing the software (or *
+// * any work based  on the software)  you  agree  to acknowledge its *
+// * use  in  resulting  scientific  publications,  and indicate your *
+// * acceptance of all terms of the Geant4 Software license.          *
+// ********************************************************************
+//
+/// \file Digitizer.cc
+/// \brief Implementation of the B3b::Digitizer class
+
+#include "Digitizer.hh"
+
+#include "Randomize.hh"
+#include "G4SystemOfUnits.hh"
+
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+#include <numeric>
+
+namespace
+{
+  const G4double kNever = -DBL_MAX;
+}
+
+namespace B3b
+{
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
+
+void Singles::SortByTime()
+{
+  std::size_t n = Size();
+  if (n < 2 || std::is_sorted(fTime.begin(), fTime.end())) return;
+
+  std::vector<std::size_t> order(n);
+  std::iota(order.begin(), order.end(), 0);
+  std::sort(order.begin(), order.end(),
+            [this](std::size_t a, std::size_t b) { return fTime[a] < fTime[b]; });
+
+  Singles sorted;
+  for (std::size_t i : order) {
+    sorted.Add(fDetector[i], fEnergy[i], fTime[i], fFlags[i], fEventID[i]);
+  }
+  std::swap(*this, sorted);
+}
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
+
+void Singles::Append(const Singles& other)
+{
+  fDetector.insert(fDetector.end(), other.fDetector.begin(), other.fDetector.end());
+  fEnergy.insert(fEnergy.end(), other.fEnergy.begin(), other.fEnergy.end());
+  fTime.insert(fTime.end(), other.fTime.begin(), other.fTime.end());
+  fFlags.insert(fFlags.end(), other.fFlags.begin(), other.fFlags.end());
+  fEventID.insert(fEventID.end(), other.fEventID.begin(), other.fEventID.end());
+}
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
+
+void Singles::EraseFront(std::size_t count)
+{
+  fDetector.erase(fDetector.begin(), fDetector.begin() + count);
+  fEnergy.erase(fEnergy.begin(), fEnergy.begin() + count);
+  fTime.erase(fTime.begin(), fTime.begin() + count);
+  fFlags.erase(fFlags.begin(), fFlags.begin() + count);
+  fEventID.erase(fEventID.begin(), fEventID.begin() + count);
+}
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
+
+Digitizer::Digitizer(const DigitizerParameters& parameters, G4int nbDetectors)
+ : fParameters(parameters)
+{
+  if (fParameters.fDeadTimeBlock < 1) fParameters.fDeadTimeBlock = 1;
+  G4int nbUnits = Unit(nbDetectors - 1) + 1;
+
+  fDeadUntil.assign(nbUnits, kNever);
+  fPulseTime.assign(nbUnits, kNever);
+  fPulseIndex.assign(nbUnits, -1);
+}
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
+
+void Digitizer::ResetState()
+{
+  for (G4int unit : fTouched) fDeadUntil[unit] = kNever;
+  fTouched.clear();
+}
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
+
+void Digitizer::Process(Singles& singles, G4double horizon, Singles* carry)
+{
+  if (singles.Size() == 0) return;
+  PileUp(singles, carry ? horizon : DBL_MAX, carry);
+  Blur(singles);
+  DeadTime(singles);
+  Window(singles);
+}
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
+
+void Digitizer::PileUp(Singles& singles, G4double horizon, Singles* carry)
+{
+  if (fParameters.fPileUpWindow <= 0.) return;
+
+  std::size_t n = singles.Size();
+  fKeep.assign(n, 1);
+  G4bool merged = false;
+
+  for (std::size_t i = 0; i < n; i++) {
+    G4int unit = Unit(singles.fDetector[i]);
+    G4int pulse = fPulseIndex[unit];
+    if (pulse >= 0 &&
+        singles.fTime[i] - fPulseTime[unit] <= fParameters.fPileUpWindow) {
+      singles.fEnergy[pulse] += singles.fEnergy[i];
+      singles.fFlags[pulse]  |= singles.fFlags[i];
+      fKeep[i] = 0;
+      fNbPiledUp++;
+      merged = true;
+    }
+    else if (singles.fTime[i] >= horizon) {
+      // opens a pulse which may still grow: left to the next batch
+      carry->Add(singles.fDetector[i], singles.fEnergy[i], singles.fTime[i],
+                 singles.fFlags[i], singles.fEventID[i]);
+      fKeep[i] = 0;
+      merged = true;
+    }
+    else {
+      fPulseIndex[unit] = G4int(i);
+      fPulseTime[unit]  = singles.fTime[i];
+    }
+  }
+
+  // the open pulses refer to this batch only
+  for (std::size_t i = 0; i < n; i++) {
+    fPulseIndex[Unit(singles.fDetector[i])] = -1;
+  }
+
+  if (merged) Compact(singles, fKeep);
+}
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
+
+void Digitizer::Blur(Singles& singles)
+{
+  if (fParameters.fResolution <= 0.) return;
+
+  std::size_t n = singles.Size();
+  fGauss.resize(n);
+  G4RandGauss::shootArray(G4int(n), fGauss.data());
+
+  // sigma(E) = R/2.355 * E * sqrt(511 keV/E)
+  const G4double coeff = fParameters.fResolution/2.3548;
+  const G4double e511 = 511*keV;
+  G4double* energy = singles.fEnergy.data();
+  const G4double* gauss = fGauss.data();
+  for (std::size_t i = 0; i < n; i++) {
+    G4double e = energy[i] + coeff*std::sqrt(e511*energy[i])*gauss[i];
+    energy[i] = e > 0. ? e : 0.;
+  }
+}
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
+
+void Digitizer::DeadTime(Singles& singles)
+{
+  if (fParameters.fDeadTime <= 0.) return;
+
+  std::size_t n = singles.Size();
+  fKeep.assign(n, 1);
+  G4bool lost = false;
+
+  for (std::size_t i = 0; i < n; i++) {
+    G4int unit = Unit(singles.fDetector[i]);
+    G4double time = singles.fTime[i];
+    if (time < fDeadUntil[unit]) {
+      fKeep[i] = 0;
+      fNbDeadTimeLost++;
+      lost = true;
+      if (fParameters.fParalyzable) fDeadUntil[unit] = time + fParameters.fDeadTime;
+    }
+    else {
+      if (fDeadUntil[unit] == kNever) fTouched.push_back(unit);
+      fDeadUntil[unit] = time + fParameters.fDeadTime;
+    }
+  }
+
+  if (lost) Compact(singles, fKeep);
+}
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
+
+void Digitizer::Window(Singles& singles)
+{
+  std::size_t n = singles.Size();
+  fKeep.resize(n);
+
+  const G4double low = fParameters.fLowEnergy, high = fParameters.fHighEnergy;
+  const G4double* energy = singles.fEnergy.data();
+  char* keep = fKeep.data();
+  std::size_t nbKept = 0;
+  for (std::size_t i = 0; i < n; i++) {
+    keep[i] = (energy[i] >= low) & (energy[i] <= high);
+    nbKept += keep[i];
+  }
+
+  if (nbKept < n) Compact(singles, fKeep);
+}
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
+
+void Digitizer::Compact(Singles& singles, const std::vector<char>& keep)
+{
+  std::size_t n = singles.Size(), j = 0;
+  for (std::size_t i = 0; i < n; i++) {
+    if (!keep[i]) continue;
+    singles.fDetector[j] = singles.fDetector[i];
+    singles.fEnergy[j]   = singles.fEnergy[i];
+    singles.fTime[j]     = singles.fTime[i];
+    singles.fFlags[j]    = singles.fFlags[i];
+    singles.fEventID[j]  = singles.fEventID[i];
+    j++;
+  }
+  singles.fDetector.resize(j);
+  singles.fEnergy.resize(j);
+  singles.fTime.resize(j);
+  singles.fFlags.resize(j);
+  singles.fEventID.resize(j);
+}
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
+
+}
@@ -0,0 +1,237 @@
+//
+// ********************************************************************
+// * License and Disclaimer                                           *
+// *                                                                  *
+// * The  Geant4 software  is  copyright of the Copyright Holders  of *
+// * the Geant4 Collaboration.  It is provided  under  the terms  and *
+// * conditions of the Geant4 Software License,  included in the file *
+// * LICENSE and available at  http://cern.ch/geant4/license .  These *
+// * include a list of copyright holders.                             *
+// *                                                                  *
+// * Neither the authors of this software system, nor their employing *
+// * institutes,nor the agencies providing financial support for this *
+// * work  make  any representation or  warranty, express or implied, *
+// * regarding  this  software system or assume any liability for its *
+// * use.  Please see the license in the file  LICENSE  and URL above *
+// * for the full disclaimer and the limitation of liability.         *
+// *                                                                  *
+// * This  code  implementation is the result of  the  scientific and *
+// * technical work of the GEANT4 collaboration.                      *
+// * By using,  copying,  modifying or  distributing the software (or *
+// * any work based  on the software)  you  agree  to acknowledge its *
+// * use  in  resulting  scientific  publications,  and indicate your *
+// * acceptance of all terms of the Geant4 Software license.          *
+// ********************************************************************
+//
+/// \file DoseGrid.cc
+/// \brief Implementation of the B3b::DoseGrid class
+
+#include "DoseGrid.hh"
+
+#include "G4SystemOfUnits.hh"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <fstream>
+#include <thread>
+
+namespace
+{
+  // below this size a plain loop beats spawning threads
+  const std::size_t kParallelAddSize = std::size_t(1) << 22;
+}
+
+namespace B3b
+{
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
+
+DoseGrid::DoseGrid(const DoseGridParameters& parameters)
+{
+  std::size_t nbVoxels = 1;
+  for (G4int axis = 0; axis < 3; axis++) {
+    fNbBins[axis] = std::max(1, parameters.fNbBins[axis]);
+    fVoxel[axis] = parameters.fSize[axis]/fNbBins[axis];
+    fInvVoxel[axis] = 1./fVoxel[axis];
+    fMin[axis] = parameters.fCenter[axis] - 0.5*parameters.fSize[axis];
+    nbVoxels *= fNbBins[axis];
+  }
+  fInvMass = 1./(fVoxel[0]*fVoxel[1]*fVoxel[2]);
+  fSum.resize(nbVoxels, 0.);
+  if (parameters.fUncertainty) fSum2.resize(nbVoxels, 0.);
+}
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
+
+std::size_t DoseGrid::GetMemory(const DoseGridParameters& parameters)
+{
+  std::size_t nbVoxels = 1;
+  for (G4int axis = 0; axis < 3; axis++) {
+    nbVoxels *= std::max(1, parameters.fNbBins[axis]);
+  }
+  return nbVoxels*sizeof(G4double)*(parameters.fUncertainty ? 2 : 1);
+}
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
+
+void DoseGrid::EndOfEvent()
+{
+  fNbEvents++;
+  if (fDeposits.empty()) return;
+
+  // the deposits of the event, voxel by voxel
+  std::sort(fDeposits.begin(), fDeposits.end(),
+            [](const auto& a, const auto& b) { return a.first < b.first; });
+  G4double* sum = fSum.data();
+  G4double* sum2 = fSum2.empty() ? nullptr : fSum2.data();
+  auto add = [&](std::size_t voxel, G4double value) {
+    if (fTrackChanges) fChanges.emplace_back(voxel, sum[voxel]*fInvMass);
+    sum[voxel] += value;
+    if (sum2) sum2[voxel] += value*value;
+  };
+  std::size_t voxel = fDeposits.front().first;
+  G4double value = 0.;
+  for (const auto& deposit : fDeposits) {
+    if (deposit.first != voxel) {
+      add(voxel, value);
+      voxel = deposit.first;
+      value = 0.;
+    }
+    value += deposit.second;
+  }
+  add(voxel, value);
+  fDeposits.clear();
+}
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
+
+void DoseGrid::Add(const DoseGrid& other)
+{
+  if (other.fSum.size() != fSum.size() || other.fSum2.size() != fSum2.size()) {
+    G4ExceptionDescription msg;
+    msg << "Dose grids of different sizes: not added.";
+    G4Exception("DoseGrid::Add()", "B3bDoseGrid001", JustWarning, msg);
+    return;
+  }
+  fNbEvents += other.fNbEvents;
+
+  auto addRange = [this, &other](std::size_t first, std::size_t last) {
+    G4double* sum = fSum.data();
+    const G4double* otherSum = other.fSum.data();
+    for (std::size_t i = first; i < last; i++) sum[i] += otherSum[i];
+    if (fSum2.empty()) return;
+    G4double* sum2 = fSum2.data();
+    const G4double* otherSum2 = other.fSum2.data();
+    for (std::size_t i = first; i < last; i++) sum2[i] += otherSum2[i];
+  };
+
+  std::size_t size = fSum.size();
+  std::size_t nbThreads = std::min<std::size_t>(
+    std::max(1u, std::thread::hardware_concurrency()), size/kParallelAddSize);
+  if (nbThreads < 2) {
+    addRange(0, size);
+    return;
+  }
+
+  std::vector<std::thread> threads;
+  std::size_t chunk = (size + nbThreads - 1)/nbThreads;
+  for (std::size_t first = chunk; first < size; first += chunk) {
+    threads.emplace_back(addRange, first, std::min(first + chunk, size));
+  }
+  addRange(0, chunk);
+  for (std::thread& thread : threads) thread.join();
+}
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
+
+G4double DoseGrid::GetDoseError(std::size_t voxel) const
+{
+  // standard deviation of the sum of fNbEvents event doses
+  if (fSum2.empty() || fNbEvents < 2) return 0.;
+  G4double n = G4double(fNbEvents);
+  G4double variance = (fSum2[voxel] - fSum[voxel]*fSum[voxel]/n)*n/(n - 1.);
+  return variance > 0. ? std::sqrt(variance)*fInvMass : 0.;
+}
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
+
+G4double DoseGrid::GetMaxDose() const
+{
+  if (fSum.empty()) return 0.;
+  return *std::max_element(fSum.begin(), fSum.end())*fInvMass;
+}
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
+
+G4bool DoseGrid::Write(const G4String& base) const
+{
+  std::vector<float> image(fSum.size());
+  for (std::size_t i = 0; i < image.size(); i++) {
+    image[i] = float(GetDose(i)/gray);
+  }
+  G4bool ok = WriteImage(base + "_dose", image);
+  if (!fSum2.empty()) {
+    for (std::size_t i = 0; i < image.size(); i++) {
+      image[i] = float(GetDoseError(i)/gray);
+    }
+    ok = WriteImage(base + "_error", image) && ok;
+  }
+  return ok;
+}
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
+
+G4bool DoseGrid::WriteImage(const G4String& base,
+                            const std::vector<float>& image) const
+{
+  G4String dataFile = base + ".v";
+  std::FILE* file = std::fopen(dataFile.c_str(), "wb");
+  std::size_t nbWritten = 0;
+  if (file) {
+    nbWritten = std::fwrite(image.data(), sizeof(float), image.size(), file);
+    std::fclose(file);
+  }
+  std::ofstream header(base + ".hv");
+  if (nbWritten != image.size() || !header) {
+    G4ExceptionDescription msg;
+    msg << "Cannot write the dose map to " << dataFile << " and " << base
+        << ".hv";
+    G4Exception("DoseGrid::Write()", "B3bDoseGrid002", JustWarning, msg);
+    return false;
+  }
+
+  const std::uint16_t probe = 1;
+  G4bool littleEndian = *reinterpret_cast<const char*>(&probe) == 1;
+  const char* label[3] = { "x", "y", "z" };
+  header
+    << "!INTERFILE  :=\n"
+    << "name of data file := "
+    << dataFile.substr(dataFile.find_last_of('/') + 1) << "\n"
+    << "originating system := B3 Geant4 example\n"
+    << "!GENERAL DATA :=\n"
+    << "!GENERAL IMAGE DATA :=\n"
+    << "imagedata byte order := "
+    << (littleEndian ? "LITTLEENDIAN" : "BIGENDIAN") << "\n"
+    << "!number format := float\n"
+    << "!number of bytes per pixel := 4\n"
+    << "quantification units := Gy\n"
+    << "number of dimensions := 3\n";
+  for (G4int axis = 0; axis < 3; axis++) {
+    header
+      << "matrix axis label [" << axis+1 << "] := " << label[axis] << "\n"
+      << "!matrix size [" << axis+1 << "] := " << fNbBins[axis] << "\n"
+      << "scaling factor (mm/pixel) [" << axis+1 << "] := "
+      << fVoxel[axis]/mm << "\n"
+      << "first pixel offset (mm) [" << axis+1 << "] := "
+      << (fMin[axis] + 0.5*fVoxel[axis])/mm << "\n";
+  }
+  header
+    << "number of time frames := 1\n"
+    << "!END OF INTERFILE :=\n";
+  return true;
+}
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
+
+}
@@ -0,0 +1,71 @@
+//
+// ********************************************************************
+// * License and Disclaimer                                           *
+// *                                                                  *
+// * The  Geant4 software  is  copyright of the Copyright Holders  of *
+// * the Geant4 Collaboration.  It is provided  under  the terms  and *
+// * conditions of the Geant4 Software License,  included in the file *
+// * LICENSE and available at  http://cern.ch/geant4/license .  These *
+// * include a list of copyright holders.                             *
+// *                                                                  *
+// * Neither the authors of this software system, nor their employing *
+// * institutes,nor the agencies providing financial support for this *
+// * work  make  any representation or  warranty, express or implied, *
+// * regarding  this  software system or assume any liability for its *
+// * use.  Please see the license in the file  LICENSE  and URL above *
+// * for the full disclaimer and the limitation of liability.         *
+// *                                                                  *
+// * This  code  implementation is the result of  the  scientific and *
+// * technical work of the GEANT4 collaboration.                      *
+// * By using,  copying,  modifying or  distributing the software (or *
+// * any work based  on the software)  you  agree  to acknowledge its *
+// * use  in  resulting  scientific  publications,  and indicate your *
+// * acceptance of all terms of the Geant4 Software license.          *
+// ********************************************************************
+//
+/// \file ListModeProjector.cc
+/// \brief Implementation of the B3b::ListModeProjector class
+
+#include "ListModeProjector.hh"
+
+namespace B3b
+{
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
+
+ScannerGeometry::ScannerGeometry(const ListModeHeader& header, float depth)
+ : fNbRings(header.fNbRings),
+   fNbCrystals(header.fNbSectors*header.fNbModules*header.fNbSubCrystals),
+   fRingPitch(header.fCrystalDX)
+{
+  const double twopi = 6.283185307179586;
+  double radius = header.fRingRadius + depth;
+  fPositions.resize(3*std::size_t(GetNbDetectors()));
+  for (int ring = 0; ring < fNbRings; ring++) {
+    double z = (ring - 0.5*(fNbRings - 1))*header.fCrystalDX;
+    for (int crystal = 0; crystal < fNbCrystals; crystal++) {
+      double phi = crystal*twopi/fNbCrystals;
+      float* position = &fPositions[3*std::size_t(ring*fNbCrystals + crystal)];
+      position[0] = float(radius*std::cos(phi));
+      position[1] = float(radius*std::sin(phi));
+      position[2] = float(z);
+    }
+  }
+}
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
+
+ListModeProjector::ListModeProjector(const ImageGrid& grid)
+ : fGrid(grid)
+{
+  fN[0] = grid.fNx;  fN[1] = grid.fNy;  fN[2] = grid.fNz;
+  fVoxel[0] = grid.fVx;  fVoxel[1] = grid.fVy;  fVoxel[2] = grid.fVz;
+  for (int axis = 0; axis < 3; axis++) fMin[axis] = -0.5*fN[axis]*fVoxel[axis];
+  fStride[0] = 1;
+  fStride[1] = grid.fNx;
+  fStride[2] = std::ptrdiff_t(grid.fNx)*grid.fNy;
+}
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
+
+}
@@ -0,0 +1,104 @@
+//
+// ********************************************************************
+// * License and Disclaimer                                           *
+// *                                                                  *
+// * The  Geant4 software  is  copyright of the Copyright Holders  of *
+// * the Geant4 Collaboration.  It is provided  under  the terms  and *
+// * conditions of the Geant4 Software License,  included in the file *
+// * LICENSE and available at  http://cern.ch/geant4/license .  These *
+// * include a list of copyright holders.                             *
+// *                                                                  *
+// * Neither the authors of this software system, nor their employing *
+// * institutes,nor the agencies providing financial support for this *
+// * work  make  any representation or  warranty, express or implied, *
+// * regarding  this  software system or assume any liability for its *
+// * use.  Please see the license in the file  LICENSE  and URL above *
+// * for the full disclaimer and the limitation of liability.         *
+// *                                                                  *
+// * This  code  implementation is the result of  the  scientific and *
+// * technical work of the GEANT4 collaboration.                      *
+// * By using,  copying,  modifying or  distributing the software (or *
+// * any work based  on the software)  you  agree  to acknowledge its *
+// * use  in  resulting  scientific  publications,  and indicate your *
+// * acceptance of all terms of the Geant4 Software license.          *
+// ********************************************************************
+//
+/// \file ListModeReader.cc
+/// \brief Implementation of the B3b::ListModeReader class
+
+#include "ListModeReader.hh"
+
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace B3b
+{
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
+
+ListModeReader::~ListModeReader()
+{
+  Close();
+}
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
+
+bool ListModeReader::Open(const std::string& fileName)
+{
+  Close();
+
+  int fd = ::open(fileName.c_str(), O_RDONLY);
+  if (fd < 0) {
+    fError = "cannot open " + fileName + ": " + std::strerror(errno);
+    return false;
+  }
+  struct stat status;
+  if (::fstat(fd, &status) != 0 ||
+      std::size_t(status.st_size) < sizeof(ListModeHeader)) {
+    fError = fileName + " is not a list-mode file (too short)";
+    ::close(fd);
+    return false;
+  }
+
+  fMapSize = status.st_size;
+  fMap = ::mmap(nullptr, fMapSize, PROT_READ, MAP_PRIVATE, fd, 0);
+  ::close(fd);
+  if (fMap == MAP_FAILED) {
+    fMap = nullptr;
+    fError = "cannot map " + fileName + ": " + std::strerror(errno);
+    return false;
+  }
+  ::madvise(fMap, fMapSize, MADV_SEQUENTIAL);
+
+  std::memcpy(&fHeader, fMap, sizeof(fHeader));
+  if (!IsValidListModeHeader(fHeader)) {
+    fError = fileName + " has no valid list-mode header";
+    Close();
+    return false;
+  }
+
+  // the header size is a multiple of the record alignment
+  fRecords = reinterpret_cast<const ListModeRecord*>(
+    static_cast<const char*>(fMap) + sizeof(ListModeHeader));
+  fNbRecords = (fMapSize - sizeof(ListModeHeader))/sizeof(ListModeRecord);
+  return true;
+}
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
+
+void ListModeReader::Close()
+{
+  if (fMap) ::munmap(fMap, fMapSize);
+  fMap = nullptr;
+  fMapSize = 0;
+  fRecords = nullptr;
+  fNbRecords = 0;
+}
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
+
+}
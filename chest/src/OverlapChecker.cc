@@ -0,0 +1,238 @@
+//
+// ********************************************************************
+// * License and Disclaimer                                           *
+// *                                                                  *
+// * The  Geant4 software  is  copyright of the Copyright Holders  of *
+// * the Geant4 Collaboration.  It is provided  under  the terms  and *
+// * conditions of the Geant4 Software License,  included in the file *
+// * LICENSE and available at  http://cern.ch/geant4/license .  These *
+// * include a list of copyright holders.                             *
+// *                                                                  *
+// * Neither the authors of this software system, nor their employing *
+// * institutes,nor the agencies providing financial support for this *
+// * work  make  any representation or  warranty, express or implied, *
+// * regarding  this  software system or assume any liability for its *
+// * use.  Please see the license in the file  LICENSE  and URL above *
+// * for the full disclaimer and the limitation of liability.         *
+// *                                                                  *
+// * This  code  implementation is the result of  the  scientific and *
+// * technical work of the GEANT4 collaboration.                      *
+// * By using,  copying,  modifying or  distributing the software (or *
+// * any work based  on the software)  you  agree  to acknowledge its *
+// * use  in  resulting  scientific  publications,  and indicate your *
+// * acceptance of all terms of the Geant4 Software license.          *
+// ********************************************************************
+/// \file OverlapChecker.cc
+/// \brief Implementation of the B3::OverlapChecker class
+
+#include "OverlapChecker.hh"
+#include "PhiloxEngine.hh"
+
+#include "G4VPhysicalVolume.hh"
+#include "G4PVPlacement.hh"
+#include "G4LogicalVolume.hh"
+#include "G4VSolid.hh"
+#include "G4RotationMatrix.hh"
+#include "G4ThreeVector.hh"
+#include "Randomize.hh"
+
+#include <algorithm>
+#include <atomic>
+#include <fstream>
+#include <set>
+#include <sstream>
+#include <thread>
+#include <unordered_set>
+#include <vector>
+
+namespace B3
+{
+
+namespace
+{
+
+// FNV-1a: the keys must not change from one build to the next
+std::uint64_t Hash(const std::string& text,
+                   std::uint64_t hash = 14695981039346656037ull)
+{
+  for (unsigned char c : text) {
+    hash ^= c;
+    hash *= 1099511628211ull;
+  }
+  return hash;
+}
+
+std::uint64_t Combine(std::uint64_t hash, std::uint64_t value)
+{
+  return Hash(std::string(reinterpret_cast<const char*>(&value), sizeof(value)),
+              hash);
+}
+
+}
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
+
+OverlapChecker::OverlapChecker(const G4String& cacheFile,
+                               G4int resolution, G4double tolerance)
+ : fCacheFile(cacheFile), fResolution(resolution), fTolerance(tolerance)
+{ }
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
+
+std::uint64_t OverlapChecker::SolidHash(const G4VSolid* solid)
+{
+  auto known = fSolidHashes.find(solid);
+  if (known != fSolidHashes.end()) return known->second;
+
+  // the parameters of the solid, as dumped by the solid itself
+  std::ostringstream info;
+  info.precision(17);
+  solid->StreamInfo(info);
+  std::uint64_t hash = Hash(info.str());
+  fSolidHashes[solid] = hash;
+  return hash;
+}
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
+
+std::uint64_t OverlapChecker::PlacementHash(const G4VPhysicalVolume* placement)
+{
+  std::ostringstream transform;
+  transform.precision(17);
+  const G4ThreeVector translation = placement->GetObjectTranslation();
+  const G4RotationMatrix rotation = placement->GetObjectRotationValue();
+  transform << translation.x() << ' ' << translation.y() << ' '
+            << translation.z() << ' '
+            << rotation.xx() << ' ' << rotation.xy() << ' ' << rotation.xz() << ' '
+            << rotation.yx() << ' ' << rotation.yy() << ' ' << rotation.yz() << ' '
+            << rotation.zx() << ' ' << rotation.zy() << ' ' << rotation.zz();
+  return Combine(Hash(transform.str()),
+                 SolidHash(placement->GetLogicalVolume()->GetSolid()));
+}
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
+
+G4int OverlapChecker::Check(G4VPhysicalVolume* world, OverlapMode mode)
+{
+  if (mode == kOverlapNone || world == nullptr) return 0;
+
+  // the logical volumes of the tree, each with its daughters
+  std::vector<G4LogicalVolume*> mothers;
+  std::set<G4LogicalVolume*> known;
+  mothers.push_back(world->GetLogicalVolume());
+  known.insert(mothers.front());
+  for (std::size_t i = 0; i < mothers.size(); i++) {
+    for (std::size_t d = 0; d < std::size_t(mothers[i]->GetNoDaughters()); d++) {
+      G4LogicalVolume* daughter = mothers[i]->GetDaughter(d)->GetLogicalVolume();
+      if (known.insert(daughter).second) mothers.push_back(daughter);
+    }
+  }
+
+  // the key of each placement: itself, its mother and its siblings
+  struct Placement
+  {
+    G4VPhysicalVolume* fVolume = nullptr;
+    std::uint64_t      fKey = 0;
+  };
+  std::vector<Placement> placements;
+  for (G4LogicalVolume* mother : mothers) {
+    const std::size_t nbDaughters = std::size_t(mother->GetNoDaughters());
+    std::vector<std::uint64_t> hashes(nbDaughters);
+    for (std::size_t d = 0; d < nbDaughters; d++) {
+      hashes[d] = PlacementHash(mother->GetDaughter(d));
+    }
+    std::uint64_t common = Combine(SolidHash(mother->GetSolid()), fResolution);
+    common = Combine(common, std::uint64_t(fTolerance*1.e9));
+    for (std::size_t d = 0; d < nbDaughters; d++) {
+      G4VPhysicalVolume* daughter = mother->GetDaughter(d);
+      if (dynamic_cast<G4PVPlacement*>(daughter) == nullptr) continue;
+      std::uint64_t key = Combine(common, hashes[d]);
+      for (std::size_t s = 0; s < nbDaughters; s++) {
+        if (s != d) key = Combine(key, hashes[s]);
+      }
+      placements.push_back({ daughter, key });
+    }
+  }
+
+  // the placements to check
+  std::unordered_set<std::uint64_t> cache;
+  std::ifstream input(fCacheFile);
+  input >> std::hex;
+  for (std::uint64_t key; input >> key;) cache.insert(key);
+  input.close();
+
+  std::vector<std::vector<std::size_t>> tasks;
+  std::map<const G4LogicalVolume*, std::size_t> taskOfVolume;
+  for (std::size_t i = 0; i < placements.size(); i++) {
+    if (mode == kOverlapNew && cache.count(placements[i].fKey)) continue;
+    const G4LogicalVolume* volume = placements[i].fVolume->GetLogicalVolume();
+    auto task = taskOfVolume.find(volume);
+    if (task == taskOfVolume.end()) {
+      task = taskOfVolume.emplace(volume, tasks.size()).first;
+      tasks.emplace_back();
+    }
+    tasks[task->second].push_back(i);
+  }
+
+  // the solids keep lazily computed data (surface areas, the primitives of
+  // boolean solids), filled here before the threads sample them
+  for (const auto& solid : fSolidHashes) solid.first->GetPointOnSurface();
+
+  // these threads have no engine of their own set up by Geant4: each one
+  // installs a counter-based engine, on the stream of the first placement
+  // of each task, so that the points sampled do not depend on the threads
+  // and the engine of the master is left untouched
+  std::vector<char> overlaps(placements.size(), 0);
+  std::atomic<std::size_t> nextTask(0);
+  auto checkTasks = [&]() {
+    B3b::PhiloxEngine engine;
+    CLHEP::HepRandomEngine* previous = G4Random::getTheEngine();
+    G4Random::setTheEngine(&engine);
+    for (std::size_t t; (t = nextTask.fetch_add(1)) < tasks.size();) {
+      engine.SetStream(placements[tasks[t].front()].fKey, 0, 0);
+      for (std::size_t i : tasks[t]) {
+        overlaps[i] = placements[i].fVolume->CheckOverlaps(fResolution, fTolerance,
+                                                           false, 1);
+      }
+    }
+    G4Random::setTheEngine(previous);
+  };
+#ifdef G4MULTITHREADED
+  std::size_t nbThreads = std::min<std::size_t>(
+    std::max(1u, std::thread::hardware_concurrency()), tasks.size());
+#else
+  // a sequential build has one engine for the whole process
+  std::size_t nbThreads = std::min<std::size_t>(1, tasks.size());
+#endif
+  std::vector<std::thread> threads;
+  for (std::size_t i = 1; i < nbThreads; i++) threads.emplace_back(checkTasks);
+  checkTasks();
+  for (std::thread& thread : threads) thread.join();
+
+  // cache the placements found free of overlaps
+  G4int nbChecked = 0, nbOverlaps = 0;
+  for (const auto& task : tasks) {
+    for (std::size_t i : task) {
+      nbChecked++;
+      if (overlaps[i]) nbOverlaps++;
+      else cache.insert(placements[i].fKey);
+    }
+  }
+  if (nbChecked > 0) {
+    std::ofstream output(fCacheFile);
+    output << std::hex;
+    for (std::uint64_t key : cache) output << key << '\n';
+  }
+
+  G4cout << "### Overlaps: " << nbChecked << " of " << placements.size()
+         << " placements checked";
+  if (nbChecked > 0) {
+    G4cout << " on " << nbThreads << " thread" << (nbThreads > 1 ? "s" : "");
+  }
+  G4cout << ", " << nbOverlaps << " with overlaps" << G4endl;
+  return nbOverlaps;
+}
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
+
+}
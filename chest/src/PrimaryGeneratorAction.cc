@@ -28,6 +28,8 @@
 /// \brief Implementation of the B3::PrimaryGeneratorAction class
 
 #include "PrimaryGeneratorAction.hh"
+#include "PhiloxEngine.hh"
+#include "Run.hh"
 
 #include "G4RunManager.hh"
 #include "G4Event.hh"
@@ -65,12 +67,37 @@ PrimaryGeneratorAction::PrimaryGeneratorAction()
 PrimaryGeneratorAction::~PrimaryGeneratorAction()
 {
   delete fParticleGun;
+  if (fEngine) {
+    G4Random::setTheEngine(fPreviousEngine);
+    delete fEngine;
+  }
 }
 
 //....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
 
 void PrimaryGeneratorAction::GeneratePrimaries(G4Event* anEvent)
 {
+  // per-event random streams: the engine of this thread restarts from
+  // the stream of the event, whatever the events before it
+  const auto run = static_cast<const B3b::Run*>(
+    G4RunManager::GetRunManager()->GetCurrentRun());
+  const B3b::EventStreamParameters& streams = run->GetEventStreams();
+  if (streams.fEnabled) {
+    if (!fEngine) {
+      fEngine = new B3b::PhiloxEngine;
+      fPreviousEngine = G4Random::getTheEngine();
+      G4Random::setTheEngine(fEngine);
+    }
+    G4int streamRun = streams.fRun < 0 ? run->GetRunID() : streams.fRun;
+    fEngine->SetStream(std::uint64_t(streams.fSeed), std::uint32_t(streamRun),
+                       std::uint32_t(streams.fFirstEvent + anEvent->GetEventID()));
+  }
+  else if (fEngine) {
+    G4Random::setTheEngine(fPreviousEngine);
+    delete fEngine;
+    fEngine = nullptr;
+  }
+
   G4ParticleDefinition* particle = fParticleGun->GetParticleDefinition();
   if (particle == G4ChargedGeantino::ChargedGeantino()) {
     //fluorine
@@ -90,6 +117,12 @@ void PrimaryGeneratorAction::GeneratePrimaries(G4Event* anEvent)
   ///G4double dx0 = 0*cm, dy0 = 0*cm, dz0 = 0*cm;
   G4double x0  = 4*cm, y0  = 4*cm, z0  = 4*cm;
   G4double dx0 = 1*cm, dy0 = 1*cm, dz0 = 1*cm;
+  const B3b::SourceParameters& source = run->GetSource();
+  if (source.fMoved) {
+    x0 = source.fPosition.x();
+    y0 = source.fPosition.y();
+    z0 = source.fPosition.z();
+  }
   x0 += dx0*(G4UniformRand()-0.5);
   y0 += dy0*(G4UniformRand()-0.5);
   z0 += dz0*(G4UniformRand()-0.5);
@@ -23,168 +23,186 @@
 // * acceptance of all terms of the Geant4 Software license.          *
 // ********************************************************************
 //
-//
 /// \file Run.cc
 /// \brief Implementation of the B3b::Run class
 
 #include "Run.hh"
+#include "CrystalSD.hh"
+#include "OrganRegistry.hh"
+#include "OrganDoseSD.hh"
+#include "ListModeWriter.hh"
+#include "SinglesSorter.hh"
+#include "Sinogram.hh"
+#include "DoseGrid.hh"
+#include "DoseVolumeHistogram.hh"
+#include "ConvergenceMonitor.hh"
+#include "BatchStatistics.hh"
+#include "ThroughputMonitor.hh"
 
 #include "G4RunManager.hh"
 #include "G4Event.hh"
 
 #include "G4SDManager.hh"
-#include "G4HCofThisEvent.hh"
-#include "G4THitsMap.hh"
+#include "G4Threading.hh"
 #include "G4SystemOfUnits.hh"
 
+
 namespace B3b
 {
 
 //....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
 
-Run::Run()
-{ }
+Run::Run(const DigitizerParameters& digitizer)
+{
+  const B3::OrganRegistry* organs = B3::OrganRegistry::Instance();
+  G4int nbOrgans = organs->GetNbOrgans();
+  fSumDose.resize(nbOrgans, 0.);
+  fStatDose.resize(nbOrgans);
+
+  // the master of a multi-threaded run has no sensitive detectors:
+  // it only merges the worker runs
+  if (G4Threading::IsMultithreadedApplication() &&
+      G4Threading::IsMasterThread()) return;
+
+  // find the sensitive detectors once per run, and let the organ
+  // detector accumulate the run totals directly in this run
+  G4SDManager* sdManager = G4SDManager::GetSDMpointer();
+  fCrystalSD =
+    static_cast<B3::CrystalSD*>(sdManager->FindSensitiveDetector("crystal"));
+  fOrganSD =
+    static_cast<B3::OrganDoseSD*>(sdManager->FindSensitiveDetector("organDose"));
+  fOrganSD->SetRunDose(fSumDose.data());
+  fDigitizer = new Digitizer(digitizer, fCrystalSD->GetNbCrystals());
+
+  for (G4int i = 0; i < nbOrgans; i++) {
+    if (organs->GetOrgan(i).fStatistics) fStatOrgans.push_back(i);
+  }
+}
 
 //....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
 
 Run::~Run()
-{ }
-
-//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
-
-void Run::RecordEvent(const G4Event* event)
 {
-  if ( fCollID_cryst < 0 ) {
-   fCollID_cryst
-     = G4SDManager::GetSDMpointer()->GetCollectionID("crystal/edep");
-   //G4cout << " fCollID_cryst: " << fCollID_cryst << G4endl;
+  if (fOrganSD && fOrganSD->GetRunDose() == fSumDose.data()) {
+    fOrganSD->SetRunDose(nullptr);
   }
-
-  if ( fCollID_leftLung < 0 ) {
-   fCollID_leftLung
-     = G4SDManager::GetSDMpointer()->GetCollectionID("leftLung/doseLeftLung");
-   //G4cout << " fCollID_patient: " << fCollID_patient << G4endl;
+  if (fOrganSD && fOrganSD->GetRunDoseGrid() == fDoseGrid) {
+    fOrganSD->SetRunDoseGrid(nullptr);
   }
+  delete fDigitizer;
+  delete fSinogram;
+  delete fDoseGrid;
+  delete fDvh;
+}
 
-if ( fCollID_rightLung < 0 ) {
-   fCollID_rightLung
-     = G4SDManager::GetSDMpointer()->GetCollectionID("rightLung/doseRightLung");
-   //G4cout << " fCollID_patient: " << fCollID_patient << G4endl;
-  }
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
 
-if ( fCollID_heart < 0 ) {
-   fCollID_heart
-     = G4SDManager::GetSDMpointer()->GetCollectionID("heart/doseHeart");
-   //G4cout << " fCollID_patient: " << fCollID_patient << G4endl;
-  }
+void Run::SetDoseGrid(DoseGrid* grid)
+{
+  fDoseGrid = grid;
+  if (fOrganSD) fOrganSD->SetRunDoseGrid(grid);
+}
 
-if ( fCollID_ribs < 0 ) {
-   fCollID_ribs
-     = G4SDManager::GetSDMpointer()->GetCollectionID("ribs/doseRibs");
-   //G4cout << " fCollID_patient: " << fCollID_patient << G4endl;
-  }
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
 
-if ( fCollID_ribCage < 0 ) {
-   fCollID_ribCage
-     = G4SDManager::GetSDMpointer()->GetCollectionID("ribCage/doseRibCage");
-   //G4cout << " fCollID_patient: " << fCollID_patient << G4endl;
+std::vector<G4String> Run::GetBatchQuantities() const
+{
+  const B3::OrganRegistry* organs = B3::OrganRegistry::Instance();
+  std::vector<G4String> names;
+  for (G4int organ : fStatOrgans) {
+    names.push_back(organs->GetOrgan(organ).fScorerName + " [Gy]");
   }
+  names.push_back("good events");
+  return names;
+}
 
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
 
-  G4int evtNb = event->GetEventID();
+void Run::SetBatchChannel(BatchChannel* channel)
+{
+  fBatch = channel;
+  fBatchValues.assign(fStatOrgans.size() + 1, 0.);
+}
 
-  if (evtNb%fPrintModulo == 0) {
-    G4cout << G4endl << "---> end of event: " << evtNb << G4endl;
-  }
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
 
-  //Hits collections
-  //
-  G4HCofThisEvent* HCE = event->GetHCofThisEvent();
-  if(!HCE) return;
+void Run::RecordEvent(const G4Event* event)
+{
+  G4int evtNb = event->GetEventID();
 
-  //Energy in crystals : identify 'good events'
-  //
-  const G4double eThreshold = 500*keV;
-  G4int nbOfFired = 0;
-
-  G4THitsMap<G4double>* evtMap =
-    static_cast<G4THitsMap<G4double>*>(HCE->GetHC(fCollID_cryst));
-
-  std::map<G4int,G4double*>::iterator itr;
-  for (itr = evtMap->GetMap()->begin(); itr != evtMap->GetMap()->end(); itr++) {
-    G4double edep = *(itr->second);
-    if (edep > eThreshold) nbOfFired++;
-    ///G4int copyNb  = (itr->first);
-    ///G4cout << G4endl << "  cryst" << copyNb << ": " << edep/keV << " keV ";
-  }
-  if (nbOfFired == 2) fGoodEvents++;
+  // the progress is reported by the master, from the counters
+  if (fThroughput) fThroughput->CountEvent();
 
-  //Dose deposit in patient
+  //Energy in crystals : digitize the singles, identify 'good events'
   //
-  G4double doseLeftLung = 0.;
-
-  evtMap = static_cast<G4THitsMap<G4double>*>(HCE->GetHC(fCollID_leftLung));
-
-  for (itr = evtMap->GetMap()->begin(); itr != evtMap->GetMap()->end(); itr++) {
-    ///G4int copyNb  = (itr->first);
-    doseLeftLung = *(itr->second);
+  fSingles.Clear();
+  for (G4int detID : fCrystalSD->GetFiredCrystals()) {
+    fSingles.Add(detID, fCrystalSD->GetEdep(detID), fCrystalSD->GetTime(detID),
+                 fCrystalSD->IsScattered(detID) ? kScatter : kTrue, evtNb);
   }
-  fSumDoseLeftLung += doseLeftLung;
-  fStatDoseLeftLung += doseLeftLung;
-
-  G4Run::RecordEvent(event);
-
-  G4double doseRightLung = 0.;
-
-  evtMap = static_cast<G4THitsMap<G4double>*>(HCE->GetHC(fCollID_rightLung));
-
-  for (itr = evtMap->GetMap()->begin(); itr != evtMap->GetMap()->end(); itr++) {
-    ///G4int copyNb  = (itr->first);
-    doseRightLung = *(itr->second);
+  fSingles.SortByTime();
+  if (fSorter) fSorter->PushEvent(fSingles);
+
+  // per event, dead time and pile-up only act among the singles of the
+  // event; the sorter applies them across events
+  fDigitizer->ResetState();
+  fDigitizer->Process(fSingles);
+  fNbSingles += fSingles.Size();
+  fNbPiledUp = fDigitizer->GetNbPiledUp();
+  fNbDeadTimeLost = fDigitizer->GetNbDeadTimeLost();
+
+  G4bool good = fSingles.Size() == 2;
+  if (good) {
+    fGoodEvents++;
+    // with the sorter, the coincidences are binned by the sorter
+    if (fSinogram && !fSorter) {
+      fSinogram->Fill(fSingles.fDetector[0], fSingles.fDetector[1]);
+    }
+    if (fListMode) {
+      // singles are time-ordered: first single first
+      ListModeRecord record;
+      record.fEventID   = evtNb;
+      record.fTime      = fSingles.fTime[0]/ns;
+      record.fDeltaTime = (fSingles.fTime[1] - fSingles.fTime[0])/ns;
+      record.fEnergy1   = fSingles.fEnergy[0]/keV;
+      record.fEnergy2   = fSingles.fEnergy[1]/keV;
+      record.fDetector1 = fSingles.fDetector[0];
+      record.fDetector2 = fSingles.fDetector[1];
+      record.fFlags     = fSingles.fFlags[0] | fSingles.fFlags[1];
+      fListMode->Push(record);
+    }
   }
-  fSumDoseRightLung += doseRightLung;
-  fStatDoseRightLung += doseRightLung;
-
-  G4Run::RecordEvent(event);
-
-  G4double doseHeart = 0.;
 
-  evtMap = static_cast<G4THitsMap<G4double>*>(HCE->GetHC(fCollID_heart));
-
-  for (itr = evtMap->GetMap()->begin(); itr != evtMap->GetMap()->end(); itr++) {
-    ///G4int copyNb  = (itr->first);
-    doseHeart = *(itr->second);
+  //Dose deposit in the organs: the run totals are already accumulated
+  //by the organ detector, only the statistics need the event dose
+  //
+  for (G4int organ : fStatOrgans) {
+    fStatDose[organ] += fOrganSD->GetEventDose(organ);
   }
-  fSumDoseHeart += doseHeart;
-  fStatDoseHeart += doseHeart;
-
-  G4Run::RecordEvent(event);
-
-  G4double doseRibs = 0.;
-
-  evtMap = static_cast<G4THitsMap<G4double>*>(HCE->GetHC(fCollID_ribs));
-
-  for (itr = evtMap->GetMap()->begin(); itr != evtMap->GetMap()->end(); itr++) {
-    ///G4int copyNb  = (itr->first);
-    doseRibs = *(itr->second);
+  if (fBatch) {
+    for (std::size_t i = 0; i < fStatOrgans.size(); i++) {
+      fBatchValues[i] = fOrganSD->GetEventDose(fStatOrgans[i])/gray;
+    }
+    fBatchValues.back() = good ? 1. : 0.;
+    fBatch->Fill(fBatchValues.data());
   }
-  fSumDoseRibs += doseRibs;
-  fStatDoseRibs += doseRibs;
+  if (fDoseGrid) fDoseGrid->EndOfEvent();
+  if (fDvh) fDvh->EndOfEvent(*fDoseGrid);
 
   G4Run::RecordEvent(event);
 
-  G4double doseRibCage = 0.;
-
-  evtMap = static_cast<G4THitsMap<G4double>*>(HCE->GetHC(fCollID_ribCage));
-
-  for (itr = evtMap->GetMap()->begin(); itr != evtMap->GetMap()->end(); itr++) {
-    ///G4int copyNb  = (itr->first);
-    doseRibCage = *(itr->second);
+  // publish the statistics of the thread now and then; once the targets
+  // are met, finish the current event and stop
+  if (fConvergence) {
+    if (numberOfEvent%fConvergence->GetInterval() == 0) {
+      fConvergence->Publish(G4Threading::G4GetThreadId(), numberOfEvent,
+                            fGoodEvents, fStatDose);
+    }
+    if (fConvergence->IsConverged()) {
+      fConvergence = nullptr;
+      G4RunManager::GetRunManager()->AbortRun(true);
+    }
   }
-  fSumDoseRibCage += doseRibCage;
-  fStatDoseRibCage += doseRibCage;
-
-  G4Run::RecordEvent(event);
 }
 
 //....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
@@ -193,16 +211,23 @@ void Run::Merge(const G4Run* aRun)
 {
   const Run* localRun = static_cast<const Run*>(aRun);
   fGoodEvents += localRun->fGoodEvents;
-  fSumDoseLeftLung    += localRun->fSumDoseLeftLung ;
-  fStatDoseLeftLung    += localRun->fStatDoseLeftLung ;
-  fSumDoseRightLung     += localRun->fSumDoseRightLung;
-  fStatDoseRightLung   += localRun->fStatDoseRightLung;
-  fSumDoseHeart    += localRun->fSumDoseHeart ;
-  fStatDoseHeart    += localRun->fStatDoseHeart ;
-  fSumDoseRibs    += localRun->fSumDoseRibs;
-  fStatDoseRibs   += localRun->fStatDoseRibs;
-  fSumDoseRibCage    += localRun->fSumDoseRibCage;
-  fStatDoseRibCage   += localRun->fStatDoseRibCage;
+  fNbSingles += localRun->fNbSingles;
+  fNbPiledUp += localRun->fNbPiledUp;
+  fNbDeadTimeLost += localRun->fNbDeadTimeLost;
+  if (fSinogram && localRun->fSinogram) fSinogram->Add(*localRun->fSinogram);
+  if (fDoseGrid && localRun->fDoseGrid) fDoseGrid->Add(*localRun->fDoseGrid);
+
+  // the master run may have been created before the workers
+  // filled the organ registry
+  std::size_t nbOrgans = localRun->fSumDose.size();
+  if (fSumDose.size() < nbOrgans) {
+    fSumDose.resize(nbOrgans, 0.);
+    fStatDose.resize(nbOrgans);
+  }
+  for (std::size_t i = 0; i < nbOrgans; i++) {
+    fSumDose[i]  += localRun->fSumDose[i];
+    fStatDose[i] += localRun->fStatDose[i];
+  }
   G4Run::Merge(aRun);
 }
 
@@ -0,0 +1,475 @@
+//
+// ********************************************************************
+// * License and Disclaimer                                           *
+// *                                                                  *
+// * The  Geant4 software  is  copyright of the Copyright Holders  of *
+// * the Geant4 Collaboration.  It is provided  under  the terms  and *
+// * conditions of the Geant4 Software License,  included in the file *
+// * LICENSE and available at  http://cern.ch/geant4/license .  These *
+// * include a list of copyright holders.                             *
+// *                                                                  *
+// * Neither the authors of this software system, nor their employing *
+// * institutes,nor the agencies providing financial support for this *
+// * work  make  any representation or  warranty, express or implied, *
+// * regarding  this  software system or assume any liability for its *
+// * use.  Please see the license in the file  LICENSE  and URL above *
+// * for the full disclaimer and the limitation of liability.         *
+// *                                                                  *
+// * This  code  implementation is the result of  the  scientific and *
+// * technical work of the GEANT4 collaboration.                      *
+// * By using,  copying,  modifying or  distributing the software (or *
+// * any work based  on the software)  you  agree  to acknowledge its *
+// * use  in  resulting  scientific  publications,  and indicate your *
+// * acceptance of all terms of the Geant4 Software license.          *
+// ********************************************************************
+//
+/// \file SinglesSorter.cc
+/// \brief Implementation of the B3b::SinglesSorter class
+
+#include "SinglesSorter.hh"
+#include "ListModeWriter.hh"
+#include "Sinogram.hh"
+
+#include "Randomize.hh"
+#include "G4SystemOfUnits.hh"
+
+#include <algorithm>
+#include <chrono>
+#include <functional>
+
+namespace
+{
+  // heap order: earliest single on top
+  G4bool Later(const B3b::SingleRecord& a, const B3b::SingleRecord& b)
+  { return a.fTime > b.fTime; }
+}
+
+namespace B3b
+{
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
+
+SorterChannel::SorterChannel(SinglesSorter* sorter)
+ : fSorter(sorter)
+{
+  fRing.resize(kRingSize);
+}
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
+
+void SorterChannel::PushEvent(const Singles& singles)
+{
+  std::lock_guard<std::mutex> lock(fMutex);
+
+  // back from idle: no tick this thread takes can precede the clock
+  if (fParked.load(std::memory_order_relaxed)) {
+    fWatermark.store(fSorter->GetClock(), std::memory_order_seq_cst);
+    fParked.store(false, std::memory_order_seq_cst);
+  }
+
+  // every decay takes a tick, detected or not; the earliest single of the
+  // event is put at that time, the decay delay of an ion is forgotten
+  G4double eventTime = fSorter->NextEventTime();
+
+  if (singles.Size() > 0) {
+    G4double shift = eventTime - singles.fTime[0];
+    for (std::size_t i = 0; i < singles.Size(); i++) {
+      fLocal.push_back({singles.fTime[i] + shift, singles.fEnergy[i],
+                        singles.fEventID[i], singles.fDetector[i],
+                        singles.fFlags[i]});
+      std::push_heap(fLocal.begin(), fLocal.end(), Later);
+    }
+  }
+
+  // the next events of this thread come later
+  Release(eventTime);
+}
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
+
+void SorterChannel::Close()
+{
+  std::lock_guard<std::mutex> lock(fMutex);
+  Release(DBL_MAX);
+}
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
+
+void SorterChannel::Release(G4double watermark)
+{
+  std::size_t head = fHead.load(std::memory_order_relaxed);
+  while (!fLocal.empty() && fLocal.front().fTime < watermark) {
+    if (head - fTail.load(std::memory_order_acquire) == kRingSize) {
+      // ring full: publish what is there and wait for the sorter
+      fHead.store(head, std::memory_order_release);
+      fSorter->Notify();
+      while (head - fTail.load(std::memory_order_acquire) == kRingSize) {
+        std::this_thread::yield();
+      }
+    }
+    std::pop_heap(fLocal.begin(), fLocal.end(), Later);
+    fRing[head & (kRingSize - 1)] = fLocal.back();
+    fLocal.pop_back();
+    head++;
+  }
+  fHead.store(head, std::memory_order_release);
+  fWatermark.store(watermark, std::memory_order_release);
+
+  if (watermark == DBL_MAX ||
+      head - fTail.load(std::memory_order_relaxed) > kRingSize/2) {
+    fSorter->Notify();
+  }
+}
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
+
+SinglesSorter* SinglesSorter::Instance()
+{
+  static SinglesSorter instance;
+  return &instance;
+}
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
+
+SinglesSorter::~SinglesSorter()
+{
+  Close();
+}
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
+
+void SinglesSorter::Open(const SorterParameters& parameters,
+                         const DigitizerParameters& digitizer,
+                         G4int nbDetectors, G4int nbChannels,
+                         ListModeChannel* output, Sinogram* sinogram)
+{
+  if (IsOpen()) Close();
+
+  if (parameters.fActivity <= 0.) {
+    G4ExceptionDescription msg;
+    msg << "The source activity must be positive: singles sorter disabled.";
+    G4Exception("SinglesSorter::Open()", "B3bSorter001", JustWarning, msg);
+    return;
+  }
+
+  fParameters = parameters;
+  fDigitizer.reset(new Digitizer(digitizer, nbDetectors));
+  fOutput = output;
+  fSinogram = sinogram;
+  fChannels.clear();
+  for (G4int i = 0; i < nbChannels; i++) {
+    fChannels.emplace_back(new SorterChannel(this));
+  }
+  fClock.store(0.);
+  fMerged.Clear();
+  fParkedSingles.clear();
+  fIdleWatermarks.clear();
+  fHorizon = -DBL_MAX;
+  fCarry.Clear();
+  fPending.Clear();
+  fStatistics = SorterStatistics();
+
+  fStop.store(false);
+  fThread = std::thread(&SinglesSorter::SorterLoop, this);
+  fOpen.store(true, std::memory_order_release);
+
+  G4cout << "### Singles sorter: " << fParameters.fActivity*s/1.e6
+         << " MBq, coincidence window " << fParameters.fWindow/ns << " ns"
+         << G4endl;
+}
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
+
+void SinglesSorter::Close()
+{
+  if (!IsOpen()) return;
+  fOpen.store(false, std::memory_order_release);
+
+  // the channels have been closed: drain them and stop
+  fStop.store(true, std::memory_order_release);
+  Notify();
+  fThread.join();
+  fChannels.clear();
+  fStatistics.fDuration = fClock.load();
+
+  const SorterStatistics& st = fStatistics;
+  G4double duration = st.fDuration/s;
+  G4double necr = st.fNbPrompts > 0 ?
+    G4double(st.fNbTrues)*st.fNbTrues/st.fNbPrompts : 0.;
+  if (duration > 0.) necr /= duration;
+  G4cout
+    << "### Singles sorter: " << st.fNbSingles << " singles over "
+    << duration << " s, " << st.fNbDetected << " detected" << G4endl
+    << "    prompts: " << st.fNbPrompts << " (trues: " << st.fNbTrues
+    << ", scatters: " << st.fNbScatters << ", randoms: " << st.fNbRandoms
+    << "), multiples: " << st.fNbMultiples << G4endl
+    << "    NECR: " << necr << " cps" << G4endl;
+}
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
+
+SorterChannel* SinglesSorter::OpenChannel(G4int thread)
+{
+  std::size_t index = thread < 0 ? 0 : std::size_t(thread);
+  if (index >= fChannels.size()) return nullptr;
+
+  // opened before the first tick this thread takes from the clock: the
+  // sorter, which reads the flags after the watermarks, either waits for
+  // this channel or has only seen watermarks earlier than its first event
+  SorterChannel* channel = fChannels[index].get();
+  channel->fOpened.store(true, std::memory_order_seq_cst);
+  std::atomic_thread_fence(std::memory_order_seq_cst);
+  return channel;
+}
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
+
+G4double SinglesSorter::NextEventTime()
+{
+  // acquire-release: a watermark published after this tick tells the
+  // sorter of the channels unparked before it
+  G4double interval = G4RandExponential::shoot(1./fParameters.fActivity);
+  G4double time = fClock.load(std::memory_order_acquire);
+  while (!fClock.compare_exchange_weak(time, time + interval,
+                                       std::memory_order_acq_rel,
+                                       std::memory_order_acquire)) {}
+  return time + interval;
+}
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
+
+void SinglesSorter::Park(SorterChannel& channel)
+{
+  // the worker is within PushEvent() or Close(): it is not idle
+  std::unique_lock<std::mutex> lock(channel.fMutex, std::try_to_lock);
+  if (!lock.owns_lock() || channel.fParked.load(std::memory_order_relaxed)) {
+    return;
+  }
+  for (const SingleRecord& single : channel.fLocal) {
+    fParkedSingles.push_back(single);
+    std::push_heap(fParkedSingles.begin(), fParkedSingles.end(), Later);
+  }
+  channel.fLocal.clear();
+  channel.fParked.store(true, std::memory_order_seq_cst);
+}
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
+
+std::size_t SinglesSorter::Merge(G4double horizon)
+{
+  // k-way merge of the rings, each one time-ordered
+  const std::size_t mask = SorterChannel::kRingSize - 1;
+  std::greater<std::pair<G4double, std::size_t>> later;
+  std::size_t nbTaken = 0;
+
+  // the singles taken from the parked channels come as one more ring
+  const std::size_t parked = fChannels.size();
+  fHeads.clear();
+  if (!fParkedSingles.empty() && fParkedSingles.front().fTime < horizon) {
+    fHeads.emplace_back(fParkedSingles.front().fTime, parked);
+  }
+  for (std::size_t k = 0; k < fChannels.size(); k++) {
+    const SorterChannel& channel = *fChannels[k];
+    std::size_t tail = channel.fTail.load(std::memory_order_relaxed);
+    if (tail == channel.fHead.load(std::memory_order_acquire)) continue;
+    const SingleRecord& first = channel.fRing[tail & mask];
+    if (first.fTime < horizon) fHeads.emplace_back(first.fTime, k);
+  }
+  std::make_heap(fHeads.begin(), fHeads.end(), later);
+
+  while (!fHeads.empty()) {
+    std::pop_heap(fHeads.begin(), fHeads.end(), later);
+    std::size_t k = fHeads.back().second;
+    fHeads.pop_back();
+
+    if (k == parked) {
+      std::pop_heap(fParkedSingles.begin(), fParkedSingles.end(), Later);
+      const SingleRecord& single = fParkedSingles.back();
+      fMerged.Add(single.fDetector, single.fEnergy, single.fTime,
+                  single.fFlags, single.fEventID);
+      fParkedSingles.pop_back();
+      nbTaken++;
+      if (!fParkedSingles.empty() && fParkedSingles.front().fTime < horizon) {
+        fHeads.emplace_back(fParkedSingles.front().fTime, parked);
+        std::push_heap(fHeads.begin(), fHeads.end(), later);
+      }
+      continue;
+    }
+
+    SorterChannel& channel = *fChannels[k];
+    std::size_t tail = channel.fTail.load(std::memory_order_relaxed);
+    const SingleRecord& single = channel.fRing[tail & mask];
+    fMerged.Add(single.fDetector, single.fEnergy, single.fTime, single.fFlags,
+                single.fEventID);
+    channel.fTail.store(++tail, std::memory_order_release);
+    nbTaken++;
+
+    if (tail == channel.fHead.load(std::memory_order_acquire)) continue;
+    const SingleRecord& next = channel.fRing[tail & mask];
+    if (next.fTime < horizon) {
+      fHeads.emplace_back(next.fTime, k);
+      std::push_heap(fHeads.begin(), fHeads.end(), later);
+    }
+  }
+
+  fStatistics.fNbSingles += nbTaken;
+  return nbTaken;
+}
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
+
+void SinglesSorter::Digitize(G4double horizon)
+{
+  // the pulses which may still pile up were carried: they come first
+  if (fCarry.Size() > 0) {
+    fCarry.Append(fMerged);
+    std::swap(fCarry, fMerged);
+    fCarry.Clear();
+  }
+  fDigitizer->Process(fMerged, horizon, &fCarry);
+
+  fStatistics.fNbDetected += fMerged.Size();
+  fPending.Append(fMerged);
+  fMerged.Clear();
+}
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
+
+void SinglesSorter::Coincide(G4double horizon)
+{
+  const G4double window = fParameters.fWindow;
+  std::size_t n = fPending.Size(), i = 0;
+
+  while (i < n) {
+    // a window is complete once no later single can fall in it
+    G4double end = fPending.fTime[i] + window;
+    if (end >= horizon) break;
+    std::size_t j = i + 1;
+    while (j < n && fPending.fTime[j] <= end) j++;
+
+    if (j - i == 2) {
+      Coincidence(i, i + 1);
+    }
+    else if (j - i > 2) {
+      fStatistics.fNbMultiples++;
+      if (fParameters.fPolicy == kTakeAll) {
+        for (std::size_t a = i; a < j; a++) {
+          for (std::size_t b = a + 1; b < j; b++) Coincidence(a, b);
+        }
+      }
+      else if (fParameters.fPolicy == kTakeWinner) {
+        std::size_t first = i, second = i + 1;
+        if (fPending.fEnergy[second] > fPending.fEnergy[first])
+          std::swap(first, second);
+        for (std::size_t a = i + 2; a < j; a++) {
+          if (fPending.fEnergy[a] > fPending.fEnergy[first]) {
+            second = first;
+            first = a;
+          }
+          else if (fPending.fEnergy[a] > fPending.fEnergy[second]) {
+            second = a;
+          }
+        }
+        Coincidence(std::min(first, second), std::max(first, second));
+      }
+    }
+    i = j;
+  }
+
+  fPending.EraseFront(i);
+}
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
+
+void SinglesSorter::Coincidence(std::size_t i, std::size_t j)
+{
+  std::uint32_t flags = fPending.fFlags[i] | fPending.fFlags[j];
+  if (fPending.fEventID[i] != fPending.fEventID[j]) flags |= kRandom;
+
+  fStatistics.fNbPrompts++;
+  if (flags & kRandom)        fStatistics.fNbRandoms++;
+  else if (flags & kScatter)  fStatistics.fNbScatters++;
+  else                        fStatistics.fNbTrues++;
+
+  if (fSinogram) fSinogram->Fill(fPending.fDetector[i], fPending.fDetector[j]);
+
+  if (!fOutput) return;
+  ListModeRecord record;
+  record.fEventID   = fPending.fEventID[i];
+  record.fTime      = fPending.fTime[i]/ns;
+  record.fDeltaTime = (fPending.fTime[j] - fPending.fTime[i])/ns;
+  record.fEnergy1   = fPending.fEnergy[i]/keV;
+  record.fEnergy2   = fPending.fEnergy[j]/keV;
+  record.fDetector1 = fPending.fDetector[i];
+  record.fDetector2 = fPending.fDetector[j];
+  record.fFlags     = flags;
+  fOutput->Push(record);
+}
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
+
+void SinglesSorter::SorterLoop()
+{
+  const G4double pileUp = fDigitizer->GetParameters().fPileUpWindow;
+
+  while (true) {
+    // read the stop flag, then the clock and the watermarks, before the
+    // rings: no thread can push a single earlier than the lowest watermark
+    // of the channels opened by a thread and not parked anymore; the others
+    // may never be, or take their next tick after this clock
+    G4bool stop = fStop.load(std::memory_order_acquire);
+    G4double horizon = DBL_MAX;
+    std::size_t lowest = fChannels.size();
+    if (!stop) {
+      horizon = GetClock();
+      fWatermarks.resize(fChannels.size());
+      for (std::size_t k = 0; k < fChannels.size(); k++) {
+        fWatermarks[k] = fChannels[k]->fWatermark.load(std::memory_order_acquire);
+      }
+      std::atomic_thread_fence(std::memory_order_seq_cst);
+      for (std::size_t k = 0; k < fChannels.size(); k++) {
+        const SorterChannel& channel = *fChannels[k];
+        if (!channel.fOpened.load(std::memory_order_seq_cst) ||
+            channel.fParked.load(std::memory_order_seq_cst)) continue;
+        if (fWatermarks[k] < horizon) {
+          horizon = fWatermarks[k];
+          lowest = k;
+        }
+      }
+      // the stale watermark of a channel just back from idle may be read:
+      // the singles it will push still come after the last horizon
+      horizon = std::max(horizon, fHorizon);
+      fHorizon = horizon;
+    }
+
+    std::size_t nbTaken = Merge(horizon);
+    if (nbTaken > 0 || stop) {
+      // pulses opened within the pile-up window of the horizon may grow
+      G4double digitized = horizon == DBL_MAX ? DBL_MAX : horizon - pileUp;
+      Digitize(digitized);
+      Coincide(digitized);
+    }
+    if (stop) break;
+    if (nbTaken > 0) {
+      fIdleWatermarks.clear();
+      continue;
+    }
+
+    // nothing to take: the channel holding the others back has not moved
+    // since the last time either, its thread is idle
+    fIdleWatermarks.resize(fChannels.size(), -DBL_MAX);
+    if (lowest < fChannels.size()) {
+      if (fIdleWatermarks[lowest] == horizon) Park(*fChannels[lowest]);
+      fIdleWatermarks[lowest] = horizon;
+    }
+
+    std::unique_lock<std::mutex> lock(fWakeMutex);
+    fWake.wait_for(lock, std::chrono::milliseconds(20));
+  }
+
+  if (fOutput) fOutput->Flush();
+}
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
+
+}
@@ -0,0 +1,190 @@
+//
+// ********************************************************************
+// * License and Disclaimer                                           *
+// *                                                                  *
+// * The  Geant4 software  is  copyright of the Copyright Holders  of *
+// * the Geant4 Collaboration.  It is provided  under  the terms  and *
+// * conditions of the Geant4 Software License,  included in the file *
+// * LICENSE and available at  http://cern.ch/geant4/license .  These *
+// * include a list of copyright holders.                             *
+// *                                                                  *
+// * Neither the authors of this software system, nor their employing *
+// * institutes,nor the agencies providing financial support for this *
+// * work  make  any representation or  warranty, express or implied, *
+// * regarding  this  software system or assume any liability for its *
+// * use.  Please see the license in the file  LICENSE  and URL above *
+// * for the full disclaimer and the limitation of liability.         *
+// *                                                                  *
+// * This  code  implementation is the result of  the  scientific and *
+// * technical work of the GEANT4 collaboration.                      *
+// * By using,  copying,  modifying or  distributing the software (or *
+// * any work based  on the software)  you  agree  to acknowledge its *
+// * use  in  resulting  scientific  publications,  and indicate your *
+// * acceptance of all terms of the Geant4 Software license.          *
+// ********************************************************************
+//
+/// \file WorkerInitialization.cc
+/// \brief Implementation of the B3b::WorkerInitialization class
+
+#include "WorkerInitialization.hh"
+
+#include "G4GenericMessenger.hh"
+#include "G4MTRunManager.hh"
+#include "G4TaskRunManager.hh"
+#include "G4Threading.hh"
+
+#include <algorithm>
+#include <cstdlib>
+#include <fstream>
+#include <sstream>
+
+#include <pthread.h>
+#include <sched.h>
+
+namespace
+{
+  // CPUs of a sysfs list such as "0-7,16-23"
+  std::vector<G4int> ParseCpuList(const std::string& text)
+  {
+    std::vector<G4int> cpus;
+    std::istringstream input(text);
+    for (std::string range; std::getline(input, range, ',');) {
+      std::size_t dash = range.find('-');
+      G4int first = std::atoi(range.c_str());
+      G4int last = dash == std::string::npos ? first
+                                             : std::atoi(range.c_str() + dash + 1);
+      for (G4int cpu = first; cpu <= last; cpu++) cpus.push_back(cpu);
+    }
+    return cpus;
+  }
+}
+
+namespace B3b
+{
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
+
+WorkerInitialization::WorkerInitialization()
+{
+  // the CPUs this process may use, by NUMA node; a single node if the
+  // topology is not available
+  cpu_set_t allowed;
+  CPU_ZERO(&allowed);
+  sched_getaffinity(0, sizeof(allowed), &allowed);
+  for (G4int node = 0;; node++) {
+    std::ifstream input("/sys/devices/system/node/node" + std::to_string(node)
+                        + "/cpulist");
+    std::string list;
+    if (!std::getline(input, list)) break;
+    std::vector<G4int> cpus;
+    for (G4int cpu : ParseCpuList(list)) {
+      if (cpu < CPU_SETSIZE && CPU_ISSET(cpu, &allowed)) cpus.push_back(cpu);
+    }
+    if (!cpus.empty()) fNodes.push_back(cpus);
+  }
+  if (fNodes.empty()) {
+    fNodes.emplace_back();
+    for (G4int cpu = 0; cpu < CPU_SETSIZE; cpu++) {
+      if (CPU_ISSET(cpu, &allowed)) fNodes[0].push_back(cpu);
+    }
+  }
+
+  DefineCommands();
+}
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
+
+WorkerInitialization::~WorkerInitialization()
+{
+  delete fMessenger;
+}
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
+
+G4int WorkerInitialization::GetWorkerCpu(G4int worker) const
+{
+  if (fPinPolicy == kPinNone || worker < 0) return -1;
+
+  if (fPinPolicy == kPinCompact) {
+    G4int nbCpus = 0;
+    for (const auto& node : fNodes) nbCpus += G4int(node.size());
+    G4int index = worker%nbCpus;
+    for (const auto& node : fNodes) {
+      if (index < G4int(node.size())) return node[index];
+      index -= G4int(node.size());
+    }
+    return -1;
+  }
+
+  // one worker per node in turn, then the next CPU of each node
+  const auto& node = fNodes[worker%fNodes.size()];
+  return node[(worker/fNodes.size())%node.size()];
+}
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
+
+void WorkerInitialization::WorkerStart() const
+{
+  G4int worker = G4Threading::G4GetThreadId();
+  G4int cpu = GetWorkerCpu(worker);
+  if (cpu < 0) return;
+
+  cpu_set_t set;
+  CPU_ZERO(&set);
+  CPU_SET(cpu, &set);
+  if (pthread_setaffinity_np(pthread_self(), sizeof(set), &set) != 0) {
+    G4ExceptionDescription msg;
+    msg << "Worker " << worker << " could not be pinned to CPU " << cpu << ".";
+    G4Exception("WorkerInitialization::WorkerStart()", "B3bWorker001",
+                JustWarning, msg);
+  }
+}
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
+
+void WorkerInitialization::ConfigureEventLoop(G4int nbEvents) const
+{
+  if (fEventsPerTask < 1) return;
+
+  G4RunManager* runManager = G4RunManager::GetRunManager();
+  if (auto tasking = dynamic_cast<G4TaskRunManager*>(runManager)) {
+    // the grain size is the number of tasks of the run
+    tasking->SetGrainsize(
+      std::max(1, (nbEvents + fEventsPerTask - 1)/fEventsPerTask));
+  }
+  else if (auto mt = dynamic_cast<G4MTRunManager*>(runManager)) {
+    mt->SetEventModulo(fEventsPerTask);
+  }
+}
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
+
+void WorkerInitialization::DefineCommands()
+{
+  fMessenger = new G4GenericMessenger(this, "/B3/threads/",
+                                      "Placement and grain of the workers");
+
+  fMessenger->DeclareMethod("pin", &WorkerInitialization::SetPinPolicyName,
+                            "Pin the workers to CPUs, before /run/initialize.")
+    .SetParameterName("policy", false)
+    .SetCandidates("none compact numa");
+
+  fMessenger->DeclareProperty("eventsPerTask", fEventsPerTask,
+                              "Events per task (tasking run manager) or per"
+                              " request of a worker (0: default).")
+    .SetParameterName("events", false)
+    .SetRange("events>=0");
+}
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
+
+void WorkerInitialization::SetPinPolicyName(const G4String& policy)
+{
+  if (policy == "compact")   fPinPolicy = kPinCompact;
+  else if (policy == "numa") fPinPolicy = kPinNuma;
+  else                       fPinPolicy = kPinNone;
+}
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
+
+}
@@ -26,6 +26,24 @@
 //
 /// \file exampleB3b.cc
 /// \brief Main program of the B3b example
+//
+//   exampleB3b [options] [macro]
+//     -t <threads>        number of threads
+//     -m <type>           run manager: default, serial, mt, tasking
+//     -e <events>         events per task (tasking) or per request of a
+//                         worker (mt)
+//     -p <policy>         pin the workers: none, compact, numa
+//     -S <n1,n2,...>      scaling sweep: runs the macro once per number of
+//                         threads, each in its own process, and reports the
+//                         parallel efficiency
+//     -f <file>           append the threads, events and seconds of each run
+//                         to file (/B3/throughput/file)
+//     -c <mode>           overlap checks: none, new (not in the cache,
+//                         the default) or all (/B3/detector/checkOverlaps)
+//     -g <grid>           geometry sweep: runs every point of the grid file
+//                         in this process, after the macro if any (see
+//                         B3b::SweepDriver)
+//   Without a macro or a grid, the interactive session starts.
 
 #include "G4Types.hh"
 
@@ -42,15 +60,140 @@
 #include "DetectorConstruction.hh"
 #include "PhysicsList.hh"
 #include "ActionInitialization.hh"
+#include "WorkerInitialization.hh"
+#include "SweepDriver.hh"
+
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include <unistd.h>
+
+namespace
+{
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
+
+struct Options
+{
+  G4int            fNbThreads = 0;          // 0: run manager default
+  G4String         fType = "default";
+  G4int            fEventsPerTask = 0;
+  G4String         fPin = "none";
+  std::vector<int> fSweep;
+  G4String         fFile;
+  G4String         fOverlaps;
+  G4String         fGrid;
+  G4String         fMacro;
+};
+
+void Usage()
+{
+  std::fprintf(stderr,
+    "usage: exampleB3b [-t threads] [-m default|serial|mt|tasking] [-e events]\n"
+    "                  [-p none|compact|numa] [-S n1,n2,...] [-f file]\n"
+    "                  [-c none|new|all] [-g grid] [macro]\n");
+}
+
+// Runs the macro once per number of threads, each time in a new process,
+// and prints the events/s with the speedup and the parallel efficiency
+// relative to the first number of threads
+int ScalingSweep(const Options& options, const char* argv0)
+{
+  char path[4096];
+  ssize_t size = readlink("/proc/self/exe", path, sizeof(path) - 1);
+  std::string self = size > 0 ? std::string(path, size) : std::string(argv0);
+
+  std::printf("%8s %14s %10s %12s\n", "threads", "events/s", "speedup",
+              "efficiency");
+  G4double firstRate = 0.;
+  G4int firstThreads = 0, knee = 0;
+  for (int nbThreads : options.fSweep) {
+    std::string base = "scaling_" + std::to_string(nbThreads);
+    std::remove((base + ".txt").c_str());
+    std::string command = "\"" + self + "\" -m " + options.fType + " -t "
+      + std::to_string(nbThreads) + " -e " + std::to_string(options.fEventsPerTask)
+      + " -p " + options.fPin + " -f " + base + ".txt \"" + options.fMacro
+      + "\" > " + base + ".log 2>&1";
+    if (std::system(command.c_str()) != 0) {
+      std::printf("%8d failed, see %s.log\n", nbThreads, base.c_str());
+      continue;
+    }
+
+    // all the runs of the macro
+    G4double events = 0., seconds = 0.;
+    std::ifstream input(base + ".txt");
+    for (G4double threads, runEvents, runSeconds;
+         input >> threads >> runEvents >> runSeconds;) {
+      events += runEvents;
+      seconds += runSeconds;
+    }
+    std::remove((base + ".txt").c_str());
+    if (seconds <= 0.) {
+      std::printf("%8d no events, see %s.log\n", nbThreads, base.c_str());
+      continue;
+    }
+
+    G4double rate = events/seconds;
+    if (firstThreads == 0) {
+      firstRate = rate;
+      firstThreads = nbThreads;
+    }
+    G4double speedup = rate/firstRate*firstThreads;
+    G4double efficiency = speedup/nbThreads;
+    if (efficiency >= 0.8) knee = nbThreads;
+    std::printf("%8d %14.1f %10.2f %10.1f %%\n", nbThreads, rate, speedup,
+                100.*efficiency);
+  }
+  if (knee > 0) {
+    std::printf("largest number of threads at 80 %% efficiency or more: %d\n",
+                knee);
+  }
+  return 0;
+}
+
+}
 
 //....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
 
 int main(int argc,char** argv)
 {
-  // Detect interactive mode (if no arguments) and define UI session
+  Options options;
+  for (int i = 1; i < argc; i++) {
+    std::string arg = argv[i];
+    bool hasValue = i+1 < argc;
+    if (arg == "-t" && hasValue) options.fNbThreads = std::atoi(argv[++i]);
+    else if (arg == "-m" && hasValue) options.fType = argv[++i];
+    else if (arg == "-e" && hasValue) options.fEventsPerTask = std::atoi(argv[++i]);
+    else if (arg == "-p" && hasValue) options.fPin = argv[++i];
+    else if (arg == "-S" && hasValue) {
+      std::istringstream input(argv[++i]);
+      for (std::string item; std::getline(input, item, ',');) {
+        if (std::atoi(item.c_str()) > 0) options.fSweep.push_back(std::atoi(item.c_str()));
+      }
+    }
+    else if (arg == "-f" && hasValue) options.fFile = argv[++i];
+    else if (arg == "-c" && hasValue) options.fOverlaps = argv[++i];
+    else if (arg == "-g" && hasValue) options.fGrid = argv[++i];
+    else if (!arg.empty() && arg[0] != '-' && options.fMacro.empty()) {
+      options.fMacro = arg;
+    }
+    else { Usage(); return 1; }
+  }
+  if (!options.fSweep.empty()) {
+    if (options.fMacro.empty()) { Usage(); return 1; }
+    return ScalingSweep(options, argv[0]);
+  }
+
+  // Detect interactive mode (if no macro nor grid) and define UI session
   //
   G4UIExecutive* ui = nullptr;
-  if ( argc == 1 ) { ui = new G4UIExecutive(argc, argv);}
+  if ( options.fMacro.empty() && options.fGrid.empty() ) {
+    ui = new G4UIExecutive(argc, argv);
+  }
 
   // Optionally: choose a different Random engine...
   // G4Random::setTheEngine(new CLHEP::MTwistEngine);
@@ -59,10 +202,15 @@ int main(int argc,char** argv)
   G4int precision = 4;
   G4SteppingVerbose::UseBestUnit(precision);
 
-  // Construct the default run manager
+  // Construct the run manager: the default one (from the environment, or
+  // the tasking one), or the one asked for
   //
-  auto* runManager =
-    G4RunManagerFactory::CreateRunManager(G4RunManagerType::Default);
+  G4RunManagerType type = G4RunManagerType::Default;
+  if (options.fType == "serial")       type = G4RunManagerType::Serial;
+  else if (options.fType == "mt")      type = G4RunManagerType::MT;
+  else if (options.fType == "tasking") type = G4RunManagerType::Tasking;
+  auto* runManager = G4RunManagerFactory::CreateRunManager(type);
+  if (options.fNbThreads > 0) runManager->SetNumberOfThreads(options.fNbThreads);
 
   // Set mandatory initialization classes
   //
@@ -74,6 +222,14 @@ int main(int argc,char** argv)
   //
   runManager->SetUserInitialization(new B3b::ActionInitialization());
 
+  // Worker placement and event grain
+  //
+  auto workerInitialization = new B3b::WorkerInitialization;
+  workerInitialization->SetEventsPerTask(options.fEventsPerTask);
+  if (options.fPin == "compact")   workerInitialization->SetPinPolicy(B3b::kPinCompact);
+  else if (options.fPin == "numa") workerInitialization->SetPinPolicy(B3b::kPinNuma);
+  runManager->SetUserInitialization(workerInitialization);
+
   // Initialize visualization
   //
   G4VisManager* visManager = new G4VisExecutive;
@@ -92,13 +248,28 @@ int main(int argc,char** argv)
   // The default file type ("root") can be changed in xml, csv, hdf5
   // scoreNtupleWriter.SetDefaultFileType("xml");
 
+  // before the geometry is built, by the macro or the session
+  if (!options.fOverlaps.empty()) {
+    UImanager->ApplyCommand("/B3/detector/checkOverlaps " + options.fOverlaps);
+  }
+
   // Process macro or start UI session
   //
+  G4int status = 0;
   if ( ! ui ) {
     // batch mode
-    G4String command = "/control/execute ";
-    G4String fileName = argv[1];
-    UImanager->ApplyCommand(command+fileName);
+    if (!options.fFile.empty()) {
+      UImanager->ApplyCommand("/B3/throughput/file " + options.fFile);
+    }
+    if (!options.fMacro.empty()) {
+      G4String command = "/control/execute ";
+      UImanager->ApplyCommand(command+options.fMacro);
+    }
+    // the sweep reuses the physics tables of the first point
+    if (!options.fGrid.empty()) {
+      B3b::SweepDriver sweep;
+      status = sweep.Read(options.fGrid) ? sweep.Run() : 1;
+    }
   }
   else {
     // interactive mode
@@ -114,6 +285,7 @@ int main(int argc,char** argv)
 
   delete visManager;
   delete runManager;
+  return status == 0 ? 0 : 1;
 }
 
 //....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo.....
@@ -0,0 +1,156 @@
+//
+// ********************************************************************
+// * License and Disclaimer                                           *
+// *                                                                  *
+// * The  Geant4 software  is  copyright of the Copyright Holders  of *
+// * the Geant4 Collaboration.  It is provided  under  the terms  and *
+// * conditions of the Geant4 Software License,  included in the file *
+// * LICENSE and available at  http://cern.ch/geant4/license .  These *
+// * include a list of copyright holders.                             *
+// *                                                                  *
+// * Neither the authors of this software system, nor their employing *
+// * institutes,nor the agencies providing financial support for this *
+// * work  make  any representation or  warranty, express or implied, *
+// * regarding  this  software system or assume any liability for its *
+// * use.  Please see the license in the file  LICENSE  and URL above *
+// * for the full disclaimer and the limitation of liability.         *
+// *                                                                  *
+// * This  code  implementation is the result of  the  scientific and *
+// * technical work of the GEANT4 collaboration.                      *
+// * By using,  copying,  modifying or  distributing the software (or *
+// * any work based  on the software)  you  agree  to acknowledge its *
+// * use  in  resulting  scientific  publications,  and indicate your *
+// * acceptance of all terms of the Geant4 Software license.          *
+// ********************************************************************
+//
+/// \file BatchStatistics.hh
+/// \brief Definition of the B3b::BatchStatistics class
+
+#ifndef B3bBatchStatistics_h
+#define B3bBatchStatistics_h 1
+
+#include "globals.hh"
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace B3b
+{
+
+/// Batch settings, set with the /B3/batch/ commands.
+
+struct BatchParameters
+{
+  G4int    fBatchSize = 1000;       // events per batch
+  G4double fReport = 0.;            // seconds between live reports (0: none)
+  G4double fOutlier = 4.;           // deviation of a thread, in std errors
+};
+
+/// Batch-means accumulators: the number of complete batches, and the sums
+/// of the batch means of each quantity and of their squares.
+
+struct BatchAccumulator
+{
+  G4long                fNbBatches = 0;
+  std::vector<G4double> fSum;
+  std::vector<G4double> fSquare;
+
+  BatchAccumulator& operator+=(const BatchAccumulator& other);
+};
+
+/// Batch channel: the batch accumulators of one worker thread.
+///
+/// The worker adds the values of each event to the current batch, in plain
+/// memory. When a batch completes, its means are added to the accumulators,
+/// which are published under a sequence lock: the sequence is odd while
+/// they are written, so that a reader may copy them at any time, without
+/// ever blocking the worker, and retries if the sequence changed meanwhile.
+/// The events of the last, incomplete batch are not published.
+
+class BatchChannel
+{
+  public:
+    BatchChannel(G4int nbQuantities, G4int batchSize);
+    ~BatchChannel() = default;
+
+    // Worker side: the values of the quantities for one event
+    void Fill(const G4double* values);
+
+    // Any thread: a consistent copy of the published accumulators
+    void Read(BatchAccumulator& accumulator) const;
+
+    G4int GetNbQuantities() const { return fNbQuantities; }
+
+  private:
+    void Publish();
+
+    G4int                 fNbQuantities = 0;
+    G4int                 fBatchSize = 1;
+    G4int                 fNbInBatch = 0;
+    std::vector<G4double> fBatch;           // worker only: current batch
+    BatchAccumulator      fLocal;           // worker only: published copy
+
+    // shared: number of batches, sums and sums of squares
+    std::atomic<std::uint32_t>             fSequence{0};
+    std::unique_ptr<std::atomic<G4double>[]> fShared;
+};
+
+/// Batch statistics
+///
+/// Owns one channel per thread, created by the thread itself at the start
+/// of the run, as only the workers know the scored organs on the first run.
+/// Snapshot() copies the accumulators of all the threads without locking
+/// them; Report() turns a snapshot into the mean per event of each quantity
+/// with its batch-means confidence interval, and flags the threads whose
+/// batch means deviate from the others by more than fOutlier standard
+/// errors. With fReport, a reporter thread prints such a report
+/// periodically during the run.
+/// It is opened by the master at the beginning of the run and closed at
+/// its end, which prints the final report.
+
+class BatchStatistics
+{
+  public:
+    static BatchStatistics* Instance();
+    ~BatchStatistics();
+
+    void Open(const BatchParameters& parameters, G4int nbChannels);
+    void Close();
+    G4bool IsOpen() const { return fOpen.load(std::memory_order_acquire); }
+
+    // The channel of a thread, by thread id, with the names of its quantities
+    BatchChannel* CreateChannel(G4int thread,
+                                const std::vector<G4String>& names);
+
+    // Accumulators of each thread; empty for the threads with no channel
+    std::vector<BatchAccumulator> Snapshot() const;
+    void Report(const std::vector<BatchAccumulator>& snapshot,
+                G4bool final) const;
+
+  private:
+    BatchStatistics() = default;
+
+    void ReporterLoop();
+
+    BatchParameters                            fParameters;
+    std::vector<std::unique_ptr<BatchChannel>> fChannels;
+    std::unique_ptr<std::atomic<BatchChannel*>[]> fPublished;
+    std::vector<G4String>                      fNames;
+    mutable std::mutex                         fNamesMutex;
+    std::atomic<G4bool>                        fOpen{false};
+    G4bool                                     fStop = false;
+    std::thread                                fThread;
+    std::mutex                                 fWakeMutex;
+    std::condition_variable                    fWake;
+};
+
+}
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
+
+#endif
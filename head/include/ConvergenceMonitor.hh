@@ -0,0 +1,124 @@
+//
+// ********************************************************************
+// * License and Disclaimer                                           *
+// *                                                                  *
+// * The  Geant4 software  is  copyright of the Copyright Holders  of *
+// * the Geant4 Collaboration.  It is provided  under  the terms  and *
+// * conditions of the Geant4 Software License,  included in the file *
+// * LICENSE and available at  http://cern.ch/geant4/license .  These *
+// * include a list of copyright holders.                             *
+// *                                                                  *
+// * Neither the authors of this software system, nor their employing *
+// * institutes,nor the agencies providing financial support for this *
+// * work  make  any representation or  warranty, express or implied, *
+// * regarding  this  software system or assume any liability for its *
+// * use.  Please see the license in the file  LICENSE  and URL above *
+// * for the full disclaimer and the limitation of liability.         *
+// *                                                                  *
+// * This  code  implementation is the result of  the  scientific and *
+// * technical work of the GEANT4 collaboration.                      *
+// * By using,  copying,  modifying or  distributing the software (or *
+// * any work based  on the software)  you  agree  to acknowledge its *
+// * use  in  resulting  scientific  publications,  and indicate your *
+// * acceptance of all terms of the Geant4 Software license.          *
+// ********************************************************************
+//
+/// \file ConvergenceMonitor.hh
+/// \brief Definition of the B3b::ConvergenceMonitor class
+
+#ifndef B3bConvergenceMonitor_h
+#define B3bConvergenceMonitor_h 1
+
+#include "globals.hh"
+#include "G4StatAnalysis.hh"
+
+#include <atomic>
+#include <chrono>
+#include <mutex>
+#include <utility>
+#include <vector>
+
+namespace B3b
+{
+
+/// Convergence targets, set with the /B3/convergence/ commands: relative
+/// statistical errors to reach; 0 means no target.
+
+struct ConvergenceTargets
+{
+  // organ scorer name ("all": every organ with statistics), relative error
+  std::vector<std::pair<G4String, G4double>> fOrgans;
+  G4double fEfficiency = 0.;        // good events / events
+  G4double fCoincidences = 0.;      // number of good events
+  G4int    fInterval = 1000;        // events of a thread between publications
+  G4int    fMinEvents = 10000;      // no decision below this many events
+};
+
+/// Convergence monitor: stops a run once the statistical targets are met.
+///
+/// Every fInterval events, each thread which processes events publishes a
+/// snapshot of its partial statistics (Publish(), from Run::RecordEvent()):
+/// its numbers of events and good events, and its per-organ G4StatAnalysis.
+/// The publishing thread merges the snapshots of all the threads and checks
+/// the targets; once they are all met, IsConverged() turns true and every
+/// thread aborts its event loop (soft abort: the current event completes),
+/// so that no further event is dispatched.
+///
+/// The master opens the monitor at the start of the run and reports at the
+/// end the events used, out of the requested ones, and the time saved.
+
+class ConvergenceMonitor
+{
+  public:
+    static ConvergenceMonitor* Instance();
+
+    void Start(const ConvergenceTargets& targets);
+    void Stop(G4int nbRequested, G4int nbProcessed);
+    G4bool IsActive() const { return fActive; }
+
+    void Publish(G4int thread, G4long nbEvents, G4long nbGoodEvents,
+                 const std::vector<G4StatAnalysis>& statDose);
+    G4bool IsConverged() const
+    { return fConverged.load(std::memory_order_relaxed); }
+    G4int GetInterval() const { return fTargets.fInterval; }
+
+  private:
+    ConvergenceMonitor() = default;
+
+    struct Snapshot
+    {
+      G4long fNbEvents = 0;
+      G4long fNbGoodEvents = 0;
+      std::vector<G4StatAnalysis> fStatDose;
+    };
+
+    struct TargetError
+    {
+      G4String fName;
+      G4double fError;
+      G4double fTarget;
+    };
+
+    // relative error of each target, for the current snapshots
+    void Evaluate();
+
+    using Clock = std::chrono::steady_clock;
+
+    ConvergenceTargets    fTargets;
+    G4bool                fActive = false;
+    std::atomic<G4bool>   fConverged{false};
+    std::mutex            fMutex;
+    std::vector<Snapshot> fSnapshots;
+    std::vector<TargetError> fErrors;
+    G4bool                fWarned = false;
+    G4long                fNbEvents = 0;
+    G4long                fNbEventsAtConvergence = 0;
+    Clock::time_point     fStart;
+    Clock::time_point     fConvergence;
+};
+
+}
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
+
+#endif
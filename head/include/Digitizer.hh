@@ -0,0 +1,143 @@
+//
+// ********************************************************************
+// * License and Disclaimer                                           *
+// *                                                                  *
+// * The  Geant4 software  is  copyright of the Copyright Holders  of *
+// * the Geant4 Collaboration.  It is provided  under  the terms  and *
+// * conditions of the Geant4 Software License,  included in the file *
+// * LICENSE and available at  http://cern.ch/geant4/license .  These *
+// * include a list of copyright holders.                             *
+// *                                                                  *
+// * Neither the authors of this software system, nor their employing *
+// * institutes,nor the agencies providing financial support for this *
+// * work  make  any representation or  warranty, express or implied, *
+// * regarding  this  software system or assume any liability for its *
+// * use.  Please see the license in the file  LICENSE  and URL above *
+// * for the full disclaimer and the limitation of liability.         *
+// *                                                                  *
+// * This  code  implementation is the result of  the  scientific and *
+// * technical work of the GEANT4 collaboration.                      *
+// * By using,  copying,  modifying or  distributing the software (or *
+// * any work based  on the software)  you  agree  to acknowledge its *
+// * use  in  resulting  scientific  publications,  and indicate your *
+// * acceptance of all terms of the Geant4 Software license.          *
+// ********************************************************************
+//
+/// \file Digitizer.hh
+/// \brief Definition of the B3b::Digitizer class
+
+#ifndef B3bDigitizer_h
+#define B3bDigitizer_h 1
+
+#include "globals.hh"
+
+#include <cfloat>
+#include <cstdint>
+#include <vector>
+
+namespace B3b
+{
+
+/// Digitizer settings, set with the /B3/digitizer/ commands.
+/// RunAction initializes them to the former ideal detector: a 500 keV
+/// threshold on the raw energy deposit.
+
+struct DigitizerParameters
+{
+  G4double fResolution = 0.;       // energy FWHM/E at 511 keV (0: ideal)
+  G4double fLowEnergy = 0.;        // energy window
+  G4double fHighEnergy = DBL_MAX;
+  G4double fDeadTime = 0.;         // per dead-time unit (0: none)
+  G4bool   fParalyzable = false;
+  G4int    fDeadTimeBlock = 1;     // crystals sharing a dead-time unit
+  G4double fPileUpWindow = 0.;     // pulses merged within it (0: none)
+};
+
+/// A batch of time-ordered singles, in structure-of-arrays layout.
+
+struct Singles
+{
+  std::vector<G4int>         fDetector;
+  std::vector<G4double>      fEnergy;
+  std::vector<G4double>      fTime;
+  std::vector<std::uint32_t> fFlags;
+  std::vector<G4long>        fEventID;
+
+  std::size_t Size() const { return fDetector.size(); }
+  void SortByTime();
+  void Clear()
+  {
+    fDetector.clear(); fEnergy.clear(); fTime.clear(); fFlags.clear();
+    fEventID.clear();
+  }
+  void Add(G4int detector, G4double energy, G4double time, std::uint32_t flags,
+           G4long eventID)
+  {
+    fDetector.push_back(detector);
+    fEnergy.push_back(energy);
+    fTime.push_back(time);
+    fFlags.push_back(flags);
+    fEventID.push_back(eventID);
+  }
+  void Append(const Singles& other);
+  void EraseFront(std::size_t count);
+};
+
+/// Digitizer: turns the crystal energy deposits into detected singles.
+///
+/// Stages, applied in order to a time-ordered batch of singles:
+///  - pile-up: pulses of the same dead-time unit closer than the pile-up
+///    window are merged, energies summed, time of the first one kept;
+///  - energy blurring, with a resolution scaling as 1/sqrt(E);
+///  - dead time per unit (crystal, or block of fDeadTimeBlock consecutive
+///    crystals), paralyzable or not;
+///  - energy window.
+/// The per-unit state (end of dead time, open pulse) lives in flat arrays
+/// indexed by unit; the blurring and the window are plain loops over the
+/// singles arrays. The state persists between batches, as singles carry an
+/// absolute time; ResetState() forgets it, for independent events.
+/// For a stream cut into batches, singles at or after the horizon which are
+/// not piled up on an earlier pulse are moved to the carry, as later
+/// singles may still pile up on them: they start the next batch.
+
+class Digitizer
+{
+  public:
+    Digitizer(const DigitizerParameters& parameters, G4int nbDetectors);
+    ~Digitizer() = default;
+
+    void Process(Singles& singles, G4double horizon = DBL_MAX,
+                 Singles* carry = nullptr);
+    void ResetState();
+
+    const DigitizerParameters& GetParameters() const { return fParameters; }
+
+    // statistics
+    G4long GetNbPiledUp() const { return fNbPiledUp; }
+    G4long GetNbDeadTimeLost() const { return fNbDeadTimeLost; }
+
+  private:
+    void PileUp(Singles& singles, G4double horizon, Singles* carry);
+    void Blur(Singles& singles);
+    void DeadTime(Singles& singles);
+    void Window(Singles& singles);
+    void Compact(Singles& singles, const std::vector<char>& keep);
+
+    G4int Unit(G4int detector) const { return detector/fParameters.fDeadTimeBlock; }
+
+    DigitizerParameters   fParameters;
+    std::vector<G4double> fDeadUntil;    // per unit
+    std::vector<G4double> fPulseTime;    // per unit: open pile-up pulse
+    std::vector<G4int>    fPulseIndex;   // per unit: its index in the batch
+    std::vector<G4int>    fTouched;      // units with a non default state
+    std::vector<G4double> fGauss;
+    std::vector<char>     fKeep;
+    G4long                fNbPiledUp = 0;
+    G4long                fNbDeadTimeLost = 0;
+};
+
+}
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
+
+#endif
@@ -0,0 +1,136 @@
+//
+// ********************************************************************
+// * License and Disclaimer                                           *
+// *                                                                  *
+// * The  Geant4 software  is  copyright of the Copyright Holders  of *
+// * the Geant4 Collaboration.  It is provided  under  the terms  and *
+// * conditions of the Geant4 Software License,  included in the file *
+// * LICENSE and available at  http://cern.ch/geant4/license .  These *
+// * include a list of copyright holders.                             *
+// *                                                                  *
+// * Neither the authors of this software system, nor their employing *
+// * institutes,nor the agencies providing financial support for this *
+// * work  make  any representation or  warranty, express or implied, *
+// * regarding  this  software system or assume any liability for its *
+// * use.  Please see the license in the file  LICENSE  and URL above *
+// * for the full disclaimer and the limitation of liability.         *
+// *                                                                  *
+// * This  code  implementation is the result of  the  scientific and *
+// * technical work of the GEANT4 collaboration.                      *
+// * By using,  copying,  modifying or  distributing the software (or *
+// * any work based  on the software)  you  agree  to acknowledge its *
+// * use  in  resulting  scientific  publications,  and indicate your *
+// * acceptance of all terms of the Geant4 Software license.          *
+// ********************************************************************
+/// \file EllipsoidalShell.hh
+/// \brief Definition of the B3::EllipsoidalShell class
+
+#ifndef B3EllipsoidalShell_h
+#define B3EllipsoidalShell_h 1
+
+#include "G4VSolid.hh"
+#include "G4ThreeVector.hh"
+
+class G4Polyhedron;
+
+namespace B3
+{
+
+/// Ellipsoidal shell: the shape of the skull.
+///
+/// The ellipsoid of semi-axes outer, centred on the origin, with an
+/// ellipsoidal cavity of semi-axes inner centred on cavityCentre. It is the
+/// solid
+///
+///   G4Ellipsoid(outer) - G4Ellipsoid(inner), moved by cavityCentre
+///
+/// without the Boolean solid: along a ray each ellipsoid is one interval,
+/// the roots of a quadratic, and the shell is the outer interval minus the
+/// inner one. The cavity must lie inside the outer ellipsoid, so that both
+/// surfaces belong to the shell entirely: the constructor checks that the
+/// largest value of the outer quadric over the cavity surface is below 1. The safeties use the smallest
+/// semi-axis of each ellipsoid: in the frame where it is the unit sphere,
+/// the distance to its surface is |1 - r|, and no distance shrinks by more
+/// than that semi-axis in the real frame.
+
+class EllipsoidalShell : public G4VSolid
+{
+  public:
+    EllipsoidalShell(const G4String& name, const G4ThreeVector& outer,
+                     const G4ThreeVector& inner,
+                     const G4ThreeVector& cavityCentre);
+    EllipsoidalShell(const EllipsoidalShell& other);
+    EllipsoidalShell& operator=(const EllipsoidalShell&) = delete;
+    ~EllipsoidalShell() override;
+
+    const G4ThreeVector& GetOuterSemiAxes() const { return fOuter.fSemiAxes; }
+    const G4ThreeVector& GetInnerSemiAxes() const { return fInner.fSemiAxes; }
+    const G4ThreeVector& GetCavityCentre()  const { return fInner.fCentre; }
+
+    EInside Inside(const G4ThreeVector& p) const override;
+    G4ThreeVector SurfaceNormal(const G4ThreeVector& p) const override;
+    G4double DistanceToIn(const G4ThreeVector& p,
+                          const G4ThreeVector& v) const override;
+    G4double DistanceToIn(const G4ThreeVector& p) const override;
+    G4double DistanceToOut(const G4ThreeVector& p, const G4ThreeVector& v,
+                           const G4bool calcNorm = false,
+                           G4bool* validNorm = nullptr,
+                           G4ThreeVector* n = nullptr) const override;
+    G4double DistanceToOut(const G4ThreeVector& p) const override;
+
+    void BoundingLimits(G4ThreeVector& pMin, G4ThreeVector& pMax) const override;
+    G4bool CalculateExtent(const EAxis pAxis, const G4VoxelLimits& pVoxelLimit,
+                           const G4AffineTransform& pTransform,
+                           G4double& pMin, G4double& pMax) const override;
+
+    G4double GetCubicVolume() override;
+    G4double GetSurfaceArea() override;
+    G4ThreeVector GetPointOnSurface() const override;
+
+    G4GeometryType GetEntityType() const override;
+    G4VSolid* Clone() const override;
+    std::ostream& StreamInfo(std::ostream& os) const override;
+
+    void DescribeYourselfTo(G4VGraphicsScene& scene) const override;
+    G4Polyhedron* CreatePolyhedron() const override;
+    G4Polyhedron* GetPolyhedron() const override;
+
+  private:
+    struct Ellipsoid
+    {
+      G4ThreeVector fSemiAxes;
+      G4ThreeVector fCentre;
+      G4double      fMinAxis = 0.;
+
+      // radius in the frame where the ellipsoid is the unit sphere
+      G4double ScaledRadius(const G4ThreeVector& p) const;
+      // approximate signed distance to the surface, positive outside
+      G4double Distance(const G4ThreeVector& p) const;
+      // outward normal of the ellipsoid
+      G4ThreeVector Normal(const G4ThreeVector& p) const;
+      // the chord [t1, t2] of the ray, false if it misses
+      G4bool Chord(const G4ThreeVector& p, const G4ThreeVector& v,
+                   G4double& t1, G4double& t2) const;
+      // area of the surface, from Thomsen's formula
+      G4double Area() const;
+      // a point of the surface, uniform in area
+      G4ThreeVector PointOnSurface() const;
+    };
+
+    G4bool HitsBoundingBox(const G4ThreeVector& p, const G4ThreeVector& v) const;
+    // largest value of the outer quadric over the cavity surface
+    G4double MaxOuterQuadric() const;
+
+    Ellipsoid fOuter;
+    Ellipsoid fInner;
+    G4double fHalfTolerance;
+
+    mutable G4bool fRebuildPolyhedron = false;
+    mutable G4Polyhedron* fpPolyhedron = nullptr;
+};
+
+}
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
+
+#endif
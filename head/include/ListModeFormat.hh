@@ -0,0 +1,123 @@
+//
+// ********************************************************************
+// * License and Disclaimer                                           *
+// *                                                                  *
+// * The  Geant4 software  is  copyright of the Copyright Holders  of *
+// * the Geant4 Collaboration.  It is provided  under  the terms  and *
+// * conditions of the Geant4 Software License,  included in the file *
+// * LICENSE and available at  http://cern.ch/geant4/license .  These *
+// * include a list of copyright holders.                             *
+// *                                                                  *
+// * Neither the authors of this software system, nor their employing *
+// * institutes,nor the agencies providing financial support for this *
+// * work  make  any representation or  warranty, express or implied, *
+// * regarding  this  software system or assume any liability for its *
+// * use.  Please see the license in the file  LICENSE  and URL above *
+// * for the full disclaimer and the limitation of liability.         *
+// *                                                                  *
+// * This  code  implementation is the result of  the  scientific and *
+// * technical work of the GEANT4 collaboration.                      *
+// * By using,  copying,  modifying or  distributing the software (or *
+// * any work based  on the software)  you  agree  to acknowledge its *
+// * use  in  resulting  scientific  publications,  and indicate your *
+// * acceptance of all terms of the Geant4 Software license.          *
+// ********************************************************************
+//
+/// \file ListModeFormat.hh
+/// \brief Definition of the list-mode file format
+
+#ifndef B3bListModeFormat_h
+#define B3bListModeFormat_h 1
+
+// This header is shared with the offline tools and must not depend on Geant4
+
+#include <cstdint>
+#include <cstring>
+
+namespace B3b
+{
+
+/// List-mode file layout
+///
+/// A list-mode file is a ListModeHeader followed by a stream of fixed-size
+/// ListModeRecord, one per coincidence, in native (little-endian) byte order.
+/// There is no trailer and no index: a file can be read while it is written,
+/// and later runs with the same scanner geometry append their records.
+/// Lengths are in mm, energies in keV and times in ns.
+
+const std::uint32_t kListModeVersion = 1;
+const char kListModeMagic[8] = { 'B','3','L','M','O','D','E','\0' };
+
+struct ListModeHeader
+{
+  char          fMagic[8];
+  std::uint32_t fVersion;
+  std::uint32_t fRecordSize;
+  // scanner geometry, see B3::DetectorID for the detector numbering
+  std::int32_t  fNbRings;
+  std::int32_t  fNbSectors;
+  std::int32_t  fNbModules;
+  std::int32_t  fNbSubCrystals;
+  float         fRingRadius;      // inner radius of the ring
+  float         fCrystalDX;       // axial crystal pitch
+  float         fCrystalDY;       // transaxial crystal pitch
+  float         fCrystalDZ;       // crystal depth
+  float         fGap;             // wrapping gap
+  char          fMaterial[32];
+  std::uint8_t  fReserved[44];
+};
+
+struct ListModeRecord
+{
+  std::int64_t  fEventID;
+  double        fTime;            // absolute time of the first single
+  float         fDeltaTime;       // time of the second single - fTime
+  float         fEnergy1;
+  float         fEnergy2;
+  std::int32_t  fDetector1;
+  std::int32_t  fDetector2;
+  std::uint32_t fFlags;
+};
+
+/// ListModeRecord::fFlags bits
+enum ListModeFlags : std::uint32_t
+{
+  kTrue    = 0,
+  kScatter = 1u << 0,   // at least one photon scattered before the detector
+  kRandom  = 1u << 1    // the two singles come from different decays
+};
+
+static_assert(sizeof(ListModeHeader) == 128, "unexpected list-mode header size");
+static_assert(sizeof(ListModeRecord) == 40, "unexpected list-mode record size");
+
+inline void InitListModeHeader(ListModeHeader& header)
+{
+  std::memset(&header, 0, sizeof(header));
+  std::memcpy(header.fMagic, kListModeMagic, sizeof(kListModeMagic));
+  header.fVersion = kListModeVersion;
+  header.fRecordSize = sizeof(ListModeRecord);
+}
+
+inline bool IsValidListModeHeader(const ListModeHeader& header)
+{
+  return std::memcmp(header.fMagic, kListModeMagic, sizeof(kListModeMagic)) == 0
+      && header.fVersion == kListModeVersion
+      && header.fRecordSize == sizeof(ListModeRecord);
+}
+
+/// Two headers describe the same scanner (records can be appended)
+inline bool IsSameScanner(const ListModeHeader& a, const ListModeHeader& b)
+{
+  return a.fNbRings == b.fNbRings && a.fNbSectors == b.fNbSectors
+      && a.fNbModules == b.fNbModules && a.fNbSubCrystals == b.fNbSubCrystals
+      && a.fRingRadius == b.fRingRadius && a.fCrystalDX == b.fCrystalDX
+      && a.fCrystalDY == b.fCrystalDY && a.fCrystalDZ == b.fCrystalDZ
+      && a.fGap == b.fGap
+      && std::strncmp(a.fMaterial, b.fMaterial, sizeof(a.fMaterial)) == 0;
+}
+
+}
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
+
+#endif
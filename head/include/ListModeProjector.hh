@@ -0,0 +1,211 @@
+//
+// ********************************************************************
+// * License and Disclaimer                                           *
+// *                                                                  *
+// * The  Geant4 software  is  copyright of the Copyright Holders  of *
+// * the Geant4 Collaboration.  It is provided  under  the terms  and *
+// * conditions of the Geant4 Software License,  included in the file *
+// * LICENSE and available at  http://cern.ch/geant4/license .  These *
+// * include a list of copyright holders.                             *
+// *                                                                  *
+// * Neither the authors of this software system, nor their employing *
+// * institutes,nor the agencies providing financial support for this *
+// * work  make  any representation or  warranty, express or implied, *
+// * regarding  this  software system or assume any liability for its *
+// * use.  Please see the license in the file  LICENSE  and URL above *
+// * for the full disclaimer and the limitation of liability.         *
+// *                                                                  *
+// * This  code  implementation is the result of  the  scientific and *
+// * technical work of the GEANT4 collaboration.                      *
+// * By using,  copying,  modifying or  distributing the software (or *
+// * any work based  on the software)  you  agree  to acknowledge its *
+// * use  in  resulting  scientific  publications,  and indicate your *
+// * acceptance of all terms of the Geant4 Software license.          *
+// ********************************************************************
+//
+/// \file ListModeProjector.hh
+/// \brief Definition of the B3b::ListModeProjector class
+
+#ifndef B3bListModeProjector_h
+#define B3bListModeProjector_h 1
+
+// Offline tool support: must not depend on Geant4
+
+#include "ListModeFormat.hh"
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <cstddef>
+#include <limits>
+#include <thread>
+#include <vector>
+
+namespace B3b
+{
+
+/// Image grid: nx*ny*nz voxels centred on the scanner axis, x fastest.
+/// Lengths are in mm, as in the list-mode files.
+
+struct ImageGrid
+{
+  int   fNx = 0, fNy = 0, fNz = 0;
+  float fVx = 0.f, fVy = 0.f, fVz = 0.f;
+
+  std::size_t GetNbVoxels() const { return std::size_t(fNx)*fNy*fNz; }
+};
+
+/// Crystal positions of the scanner described by a list-mode header,
+/// with the numbering of B3::DetectorID and the placement of
+/// B3::DetectorConstruction: crystal i of a ring at angle 2*pi*i/nbCrystals,
+/// rings along z centred on the origin. The interaction point is taken at
+/// the given depth in the crystal.
+
+class ScannerGeometry
+{
+  public:
+    ScannerGeometry(const ListModeHeader& header, float depth);
+
+    int GetNbRings() const { return fNbRings; }
+    int GetNbCrystals() const { return fNbCrystals; }
+    int GetNbDetectors() const { return fNbRings*fNbCrystals; }
+    float GetRingPitch() const { return fRingPitch; }
+
+    // x, y, z of a detector, in mm
+    const float* GetPosition(int detector) const
+    { return &fPositions[3*std::size_t(detector)]; }
+
+  private:
+    int fNbRings;
+    int fNbCrystals;
+    float fRingPitch;
+    std::vector<float> fPositions;
+};
+
+/// List-mode projector: Siddon's exact path lengths of a line of response
+/// through the image grid.
+///
+/// Trace() walks the voxels crossed by the segment p1-p2 and calls
+/// f(voxel, length) for each; Forward() and Back() are built on it.
+/// The walk is branchy and data dependent, so it stays scalar: the
+/// parallelism is over lines of response.
+
+class ListModeProjector
+{
+  public:
+    explicit ListModeProjector(const ImageGrid& grid);
+
+    const ImageGrid& GetGrid() const { return fGrid; }
+
+    template <class Func>
+    void Trace(const float* p1, const float* p2, Func&& f) const;
+
+    float Forward(const float* p1, const float* p2, const float* image) const
+    {
+      float sum = 0.f;
+      Trace(p1, p2, [&](std::size_t voxel, float length)
+                    { sum += length*image[voxel]; });
+      return sum;
+    }
+
+    void Back(const float* p1, const float* p2, float value, float* image) const
+    {
+      Trace(p1, p2, [&](std::size_t voxel, float length)
+                    { image[voxel] += length*value; });
+    }
+
+  private:
+    ImageGrid fGrid;
+    double    fMin[3];
+    double    fVoxel[3];
+    int       fN[3];
+    std::ptrdiff_t fStride[3];
+};
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
+
+/// Calls func(first, last, thread) on chunks of [0, size), handed out
+/// dynamically to nbThreads threads.
+
+template <class Func>
+void ParallelFor(unsigned nbThreads, std::size_t size, std::size_t grain,
+                 Func&& func)
+{
+  std::atomic<std::size_t> next{0};
+  auto worker = [&](unsigned thread) {
+    std::size_t first;
+    while ((first = next.fetch_add(grain)) < size) {
+      func(first, std::min(first + grain, size), thread);
+    }
+  };
+  std::vector<std::thread> threads;
+  for (unsigned thread = 1; thread < nbThreads; thread++) {
+    threads.emplace_back(worker, thread);
+  }
+  worker(0);
+  for (auto& thread : threads) thread.join();
+}
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
+
+template <class Func>
+void ListModeProjector::Trace(const float* p1, const float* p2, Func&& f) const
+{
+  const double inf = std::numeric_limits<double>::infinity();
+  double d[3], alphaMin = 0., alphaMax = 1.;
+
+  // parametric range [alphaMin, alphaMax] of the segment inside the grid
+  for (int axis = 0; axis < 3; axis++) {
+    d[axis] = double(p2[axis]) - p1[axis];
+    double low = fMin[axis], high = fMin[axis] + fN[axis]*fVoxel[axis];
+    if (d[axis] == 0.) {
+      if (p1[axis] <= low || p1[axis] >= high) return;
+      continue;
+    }
+    double a0 = (low - p1[axis])/d[axis], a1 = (high - p1[axis])/d[axis];
+    alphaMin = std::max(alphaMin, std::min(a0, a1));
+    alphaMax = std::min(alphaMax, std::max(a0, a1));
+  }
+  if (alphaMin >= alphaMax) return;
+
+  const double length = std::sqrt(d[0]*d[0] + d[1]*d[1] + d[2]*d[2]);
+  double next[3], delta[3];
+  int index[3], step[3];
+  for (int axis = 0; axis < 3; axis++) {
+    double entry = p1[axis] + alphaMin*d[axis] - fMin[axis];
+    index[axis] = std::min(std::max(int(std::floor(entry/fVoxel[axis])), 0),
+                           fN[axis] - 1);
+    if (d[axis] == 0.) {
+      step[axis] = 0;
+      next[axis] = delta[axis] = inf;
+      continue;
+    }
+    step[axis] = d[axis] > 0. ? 1 : -1;
+    double boundary = fMin[axis] + (index[axis] + (step[axis] > 0))*fVoxel[axis];
+    next[axis] = (boundary - p1[axis])/d[axis];
+    delta[axis] = fVoxel[axis]/std::fabs(d[axis]);
+  }
+
+  std::ptrdiff_t voxel = index[0]*fStride[0] + index[1]*fStride[1]
+                       + index[2]*fStride[2];
+  double alpha = alphaMin;
+  while (alpha < alphaMax) {
+    int axis = next[0] < next[1] ? (next[0] < next[2] ? 0 : 2)
+                                 : (next[1] < next[2] ? 1 : 2);
+    double crossing = std::min(next[axis], alphaMax);
+    if (crossing > alpha) f(std::size_t(voxel), float((crossing - alpha)*length));
+    alpha = crossing;
+    if (alpha >= alphaMax) break;
+
+    index[axis] += step[axis];
+    if (index[axis] < 0 || index[axis] >= fN[axis]) break;
+    voxel += step[axis]*fStride[axis];
+    next[axis] += delta[axis];
+  }
+}
+
+}
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
+
+#endif
@@ -0,0 +1,95 @@
+//
+// ********************************************************************
+// * License and Disclaimer                                           *
+// *                                                                  *
+// * The  Geant4 software  is  copyright of the Copyright Holders  of *
+// * the Geant4 Collaboration.  It is provided  under  the terms  and *
+// * conditions of the Geant4 Software License,  included in the file *
+// * LICENSE and available at  http://cern.ch/geant4/license .  These *
+// * include a list of copyright holders.                             *
+// *                                                                  *
+// * Neither the authors of this software system, nor their employing *
+// * institutes,nor the agencies providing financial support for this *
+// * work  make  any representation or  warranty, express or implied, *
+// * regarding  this  software system or assume any liability for its *
+// * use.  Please see the license in the file  LICENSE  and URL above *
+// * for the full disclaimer and the limitation of liability.         *
+// *                                                                  *
+// * This  code  implementation is the result of  the  scientific and *
+// * technical work of the GEANT4 collaboration.                      *
+// * By using,  copying,  modifying or  distributing the software (or *
+// * any work based  on the software)  you  agree  to acknowledge its *
+// * use  in  resulting  scientific  publications,  and indicate your *
+// * acceptance of all terms of the Geant4 Software license.          *
+// ********************************************************************
+/// \file OverlapChecker.hh
+/// \brief Definition of the B3::OverlapChecker class
+
+#ifndef B3OverlapChecker_h
+#define B3OverlapChecker_h 1
+
+#include "globals.hh"
+
+#include <cstdint>
+#include <map>
+#include <string>
+
+class G4VPhysicalVolume;
+class G4VSolid;
+
+namespace B3
+{
+
+/// What is checked for overlaps once the geometry is built.
+
+enum OverlapMode
+{
+  kOverlapNone,     // nothing
+  kOverlapNew,      // the placements not found in the cache
+  kOverlapAll       // every placement
+};
+
+/// Overlap checker with a cache on disk.
+///
+/// The placements are checked once the whole geometry is built, and not
+/// while it is built. Each placement (a daughter of a logical volume) gets a
+/// key, a hash of all that its check depends on: its solid and
+/// transformation, the solid of its mother, the solids and transformations
+/// of its siblings, and the resolution and tolerance of the check.
+/// The keys of the placements found free of overlaps are kept in the cache
+/// file: an unchanged geometry is not checked again and, after a change,
+/// only the placements which are new or have moved are.
+/// The checks run in parallel, one task per placed logical volume, so that
+/// a solid is sampled by a single thread. Each thread samples with its own
+/// PhiloxEngine, on a stream given by the task: the points do not depend on
+/// the number of threads, and the engine of the master is not used (with a
+/// sequential Geant4, whose engine is shared, the checks run on one thread).
+/// The placements with overlaps are reported by
+/// G4VPhysicalVolume::CheckOverlaps() and never cached: they are reported
+/// again at every start.
+
+class OverlapChecker
+{
+  public:
+    OverlapChecker(const G4String& cacheFile,
+                   G4int resolution = 1000, G4double tolerance = 0.);
+    ~OverlapChecker() = default;
+
+    // number of placements with overlaps
+    G4int Check(G4VPhysicalVolume* world, OverlapMode mode);
+
+  private:
+    std::uint64_t SolidHash(const G4VSolid* solid);
+    std::uint64_t PlacementHash(const G4VPhysicalVolume* placement);
+
+    G4String fCacheFile;
+    G4int    fResolution = 1000;
+    G4double fTolerance = 0.;
+    std::map<const G4VSolid*, std::uint64_t> fSolidHashes;
+};
+
+}
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
+
+#endif
@@ -0,0 +1,122 @@
+//
+// ********************************************************************
+// * License and Disclaimer                                           *
+// *                                                                  *
+// * The  Geant4 software  is  copyright of the Copyright Holders  of *
+// * the Geant4 Collaboration.  It is provided  under  the terms  and *
+// * conditions of the Geant4 Software License,  included in the file *
+// * LICENSE and available at  http://cern.ch/geant4/license .  These *
+// * include a list of copyright holders.                             *
+// *                                                                  *
+// * Neither the authors of this software system, nor their employing *
+// * institutes,nor the agencies providing financial support for this *
+// * work  make  any representation or  warranty, express or implied, *
+// * regarding  this  software system or assume any liability for its *
+// * use.  Please see the license in the file  LICENSE  and URL above *
+// * for the full disclaimer and the limitation of liability.         *
+// *                                                                  *
+// * This  code  implementation is the result of  the  scientific and *
+// * technical work of the GEANT4 collaboration.                      *
+// * By using,  copying,  modifying or  distributing the software (or *
+// * any work based  on the software)  you  agree  to acknowledge its *
+// * use  in  resulting  scientific  publications,  and indicate your *
+// * acceptance of all terms of the Geant4 Software license.          *
+// ********************************************************************
+//
+/// \file Sinogram.hh
+/// \brief Definition of the B3b::Sinogram class
+
+#ifndef B3bSinogram_h
+#define B3bSinogram_h 1
+
+#include "globals.hh"
+
+#include <cstdint>
+#include <vector>
+
+namespace B3b
+{
+
+/// Sinogram settings, set with the /B3/sinogram/ commands.
+
+struct SinogramParameters
+{
+  G4int fSpan = 3;                  // odd
+  G4int fMaxRingDifference = -1;    // -1: all the ring differences
+};
+
+/// Sinogram: the coincidences of a run binned in 3D (Michelogram with span).
+///
+/// Layout, the last index running fastest:
+///   [segment][axial plane][view][tangential]
+/// with segments in the order 0, +1, -1, +2, -2, ... Segment k holds the
+/// ring differences within (span-1)/2 of k*span, up to the maximum ring
+/// difference; its planes are indexed by the ring sum (by half the ring sum
+/// for span 1). With an even number of crystals per ring, two neighbouring
+/// angles are interleaved into one view: nbCrystals/2 views of nbCrystals
+/// tangential bins.
+///
+/// The detector ids are the dense ring*nbCrystals + crystal ids of
+/// B3::DetectorID. Two lookup tables, transaxial (crystal pair) and axial
+/// (ring pair), make the binning O(1): one histogram increment per
+/// coincidence.
+
+class Sinogram
+{
+  public:
+    Sinogram(G4int nbRings, G4int nbCrystals,
+             const SinogramParameters& parameters = SinogramParameters());
+    ~Sinogram() = default;
+
+    void Fill(G4int detector1, G4int detector2)
+    {
+      G4int crystal1 = detector1%fNbCrystals, ring1 = detector1/fNbCrystals;
+      G4int crystal2 = detector2%fNbCrystals, ring2 = detector2/fNbCrystals;
+      G4int transaxial = fTransaxial[crystal1*fNbCrystals + crystal2];
+      if (transaxial < 0) return;
+      // the bit 0 tells the orientation of the pair in the sinogram
+      G4int plane = (transaxial & 1) ? fAxial[ring2*fNbRings + ring1]
+                                     : fAxial[ring1*fNbRings + ring2];
+      if (plane < 0) return;
+      fCounts[std::size_t(plane)*fPlaneSize + (transaxial >> 1)]++;
+    }
+
+    // Bin by bin sum, split over threads for large sinograms
+    void Add(const Sinogram& other);
+    void Reset();
+
+    // Raw counts (uint32, native byte order) and Interfile header
+    G4bool Write(const G4String& dataFile, const G4String& headerFile,
+                 G4double ringRadius, G4double ringSpacing) const;
+
+    G4int GetNbViews() const { return fNbViews; }
+    G4int GetNbTangential() const { return fNbTangential; }
+    G4int GetNbSegments() const { return G4int(fSegmentPlanes.size()); }
+    G4int GetNbPlanes() const { return fNbPlanes; }
+    std::size_t GetSize() const { return fCounts.size(); }
+    std::uint64_t GetTotal() const;
+
+  private:
+    G4int Segment(G4int ringDifference) const;
+    G4int SegmentIndex(G4int segment) const
+    { return segment > 0 ? 2*segment - 1 : -2*segment; }
+    G4int MinRingDifference(G4int segment) const;
+
+    G4int fNbRings;
+    G4int fNbCrystals;
+    SinogramParameters fParameters;
+    G4int fNbViews = 0;
+    G4int fNbTangential = 0;
+    G4int fNbPlanes = 0;
+    std::size_t fPlaneSize = 0;
+    std::vector<G4int> fSegmentPlanes;   // per segment index
+    std::vector<G4int> fTransaxial;      // crystal pair -> 2*bin + flip, -1
+    std::vector<G4int> fAxial;           // ring pair -> plane, -1
+    std::vector<std::uint32_t> fCounts;
+};
+
+}
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
+
+#endif
@@ -0,0 +1,202 @@
+//
+// ********************************************************************
+// * License and Disclaimer                                           *
+// *                                                                  *
+// * The  Geant4 software  is  copyright of the Copyright Holders  of *
+// * the Geant4 Collaboration.  It is provided  under  the terms  and *
+// * conditions of the Geant4 Software License,  included in the file *
+// * LICENSE and available at  http://cern.ch/geant4/license .  These *
+// * include a list of copyright holders.                             *
+// *                                                                  *
+// * Neither the authors of this software system, nor their employing *
+// * institutes,nor the agencies providing financial support for this *
+// * work  make  any representation or  warranty, express or implied, *
+// * regarding  this  software system or assume any liability for its *
+// * use.  Please see the license in the file  LICENSE  and URL above *
+// * for the full disclaimer and the limitation of liability.         *
+// *                                                                  *
+// * This  code  implementation is the result of  the  scientific and *
+// * technical work of the GEANT4 collaboration.                      *
+// * By using,  copying,  modifying or  distributing the software (or *
+// * any work based  on the software)  you  agree  to acknowledge its *
+// * use  in  resulting  scientific  publications,  and indicate your *
+// * acceptance of all terms of the Geant4 Software license.          *
+// ********************************************************************
+//
+/// \file SystemMatrix.hh
+/// \brief Definition of the B3b::SystemMatrix class
+
+#ifndef B3bSystemMatrix_h
+#define B3bSystemMatrix_h 1
+
+// Offline tool support: must not depend on Geant4
+
+#include "ListModeProjector.hh"
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace B3b
+{
+
+/// Precomputed system matrix of the ring scanner, in CSR form on disk.
+///
+/// Only the lines of response that are unique under the exact symmetries
+/// of the scanner and of the image grid are traced:
+///  - transaxially, the reflections and the diagonal swap of the square
+///    grid that map crystals onto crystals (up to 8 with nbCrystals%4 == 0),
+///  - axially, the mirror z -> -z and, when the ring pitch is a multiple of
+///    the voxel height, the translation by one ring.
+/// The other lines of response are expanded on the fly: voxel indices are
+/// remapped through a per-symmetry table, the path lengths are shared.
+///
+/// File layout: SystemMatrixHeader, nbRows+1 row offsets (uint64), then
+/// the entries, each the voxel (x,y in the low 20 bits, z in the high 12)
+/// and the path length in mm. The file is memory-mapped, read only.
+
+struct SystemMatrixHeader
+{
+  char          fMagic[8];
+  std::uint64_t fKey;
+  std::uint64_t fNbRows;
+  std::uint64_t fNbEntries;
+  std::int32_t  fNbPairs;
+  std::int32_t  fNbAxialRows;
+  std::int32_t  fNx, fNy, fNz;
+  std::int32_t  fReserved[3];
+};
+
+class SystemMatrix
+{
+  public:
+    SystemMatrix(const ScannerGeometry& scanner, const ImageGrid& grid);
+    ~SystemMatrix();
+
+    SystemMatrix(const SystemMatrix&) = delete;
+    SystemMatrix& operator=(const SystemMatrix&) = delete;
+
+    // Traces the unique rows with nbThreads threads and writes them to
+    // fileName; key identifies the scanner and grid the file is valid for.
+    bool Generate(const std::string& fileName, std::uint64_t key,
+                  unsigned nbThreads);
+    bool Open(const std::string& fileName, std::uint64_t key);
+    void Close();
+
+    const ImageGrid& GetGrid() const { return fGrid; }
+    const std::string& GetError() const { return fError; }
+
+    std::size_t GetNbRows() const
+    { return std::size_t(fCanonicalPairs.size())*fNbAxialRows; }
+    std::size_t GetNbEntries() const { return fNbEntries; }
+    // number of transaxial symmetries used (axial ones excluded)
+    int GetNbTransforms() const { return fNbTransforms; }
+    bool HasAxialTranslation() const { return fTranslation; }
+
+    // Calls f(voxel, length) for the voxels crossed by the line of
+    // response d1-d2 (Open() must have succeeded).
+    template <class Func>
+    void ForEachEntry(int d1, int d2, Func&& f) const;
+
+    float Forward(int d1, int d2, const float* image) const
+    {
+      float sum = 0.f;
+      ForEachEntry(d1, d2, [&](std::size_t voxel, float length)
+                           { sum += length*image[voxel]; });
+      return sum;
+    }
+
+    void Back(int d1, int d2, float value, float* image) const
+    {
+      ForEachEntry(d1, d2, [&](std::size_t voxel, float length)
+                           { image[voxel] += length*value; });
+    }
+
+  private:
+    struct Entry
+    {
+      std::uint32_t fVoxel;
+      float         fLength;
+    };
+
+    // ordered crystal pair -> unique pair, symmetry, endpoints swapped
+    struct PairEntry
+    {
+      std::int32_t fPair = -1;
+      std::uint8_t fTransform = 0;
+      std::uint8_t fSwap = 0;
+    };
+
+    // ordered ring pair -> unique axial row, z shift, z mirror
+    struct AxialEntry
+    {
+      std::int32_t fRow;
+      std::int32_t fShift;
+      bool         fMirror;
+    };
+
+    static const int kXYBits = 20;
+
+    void BuildSymmetries();
+    void TraceRow(std::size_t row, std::vector<Entry>& entries) const;
+
+    const ScannerGeometry& fScanner;
+    ImageGrid              fGrid;
+    ListModeProjector      fProjector;
+    int                    fNbCrystals;
+    int                    fNbRings;
+    int                    fNbXY;
+    int                    fNbTransforms = 0;
+    bool                   fTranslation = false;
+
+    std::vector<PairEntry>           fPairs;
+    std::vector<std::pair<int, int>> fCanonicalPairs;
+    std::vector<AxialEntry>          fAxial;
+    std::vector<std::pair<int, int>> fCanonicalRings;
+    int                              fNbAxialRows = 0;
+    // per symmetry: voxel x,y of the unique row -> voxel x,y of the LOR
+    std::vector<std::int32_t>        fXYMaps;
+
+    void*                fMap = nullptr;
+    std::size_t          fMapSize = 0;
+    const std::uint64_t* fRowOffsets = nullptr;
+    const Entry*         fEntries = nullptr;
+    std::size_t          fNbEntries = 0;
+    std::string          fError;
+};
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
+
+template <class Func>
+void SystemMatrix::ForEachEntry(int d1, int d2, Func&& f) const
+{
+  const PairEntry& pair =
+    fPairs[std::size_t(d1%fNbCrystals)*fNbCrystals + d2%fNbCrystals];
+  if (pair.fPair < 0) return;
+  int r1 = d1/fNbCrystals, r2 = d2/fNbCrystals;
+  if (pair.fSwap) std::swap(r1, r2);
+  const AxialEntry& axial = fAxial[std::size_t(r1)*fNbRings + r2];
+
+  std::size_t row = std::size_t(pair.fPair)*fNbAxialRows + axial.fRow;
+  const std::int32_t* xyMap = &fXYMaps[std::size_t(pair.fTransform)*fNbXY];
+  // z of the line of response = base + sign*z of the unique row
+  std::ptrdiff_t base = axial.fMirror ? fGrid.fNz - 1 - axial.fShift
+                                      : axial.fShift;
+  std::ptrdiff_t sign = axial.fMirror ? -1 : 1;
+  const std::uint32_t xyMask = (1u << kXYBits) - 1;
+
+  const Entry* entry = fEntries + fRowOffsets[row];
+  const Entry* end = fEntries + fRowOffsets[row+1];
+  for (; entry != end; ++entry) {
+    std::ptrdiff_t z = base + sign*std::ptrdiff_t(entry->fVoxel >> kXYBits);
+    f(std::size_t(xyMap[entry->fVoxel & xyMask] + z*fNbXY), entry->fLength);
+  }
+}
+
+}
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
+
+#endif
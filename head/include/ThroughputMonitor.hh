@@ -0,0 +1,180 @@
+//
+// ********************************************************************
+// * License and Disclaimer                                           *
+// *                                                                  *
+// * The  Geant4 software  is  copyright of the Copyright Holders  of *
+// * the Geant4 Collaboration.  It is provided  under  the terms  and *
+// * conditions of the Geant4 Software License,  included in the file *
+// * LICENSE and available at  http://cern.ch/geant4/license .  These *
+// * include a list of copyright holders.                             *
+// *                                                                  *
+// * Neither the authors of this software system, nor their employing *
+// * institutes,nor the agencies providing financial support for this *
+// * work  make  any representation or  warranty, express or implied, *
+// * regarding  this  software system or assume any liability for its *
+// * use.  Please see the license in the file  LICENSE  and URL above *
+// * for the full disclaimer and the limitation of liability.         *
+// *                                                                  *
+// * This  code  implementation is the result of  the  scientific and *
+// * technical work of the GEANT4 collaboration.                      *
+// * By using,  copying,  modifying or  distributing the software (or *
+// * any work based  on the software)  you  agree  to acknowledge its *
+// * use  in  resulting  scientific  publications,  and indicate your *
+// * acceptance of all terms of the Geant4 Software license.          *
+// ********************************************************************
+//
+/// \file ThroughputMonitor.hh
+/// \brief Definition of the B3b::ThroughputMonitor class
+
+#ifndef B3bThroughputMonitor_h
+#define B3bThroughputMonitor_h 1
+
+#include "globals.hh"
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+class G4ParticleDefinition;
+
+namespace B3b
+{
+
+class ThroughputMonitor;
+
+/// Throughput settings, set with the /B3/throughput/ commands.
+
+struct ThroughputParameters
+{
+  G4double fReport = 0.;            // seconds between progress lines (0: none)
+  G4bool   fBreakdown = false;      // steps per volume and tracks per particle
+  G4String fFile;                   // appended "threads events seconds" per run
+
+  G4bool IsActive() const
+  {
+    return fReport > 0. || fBreakdown || !fFile.empty();
+  }
+};
+
+/// Throughput channel: the counters of one thread.
+///
+/// Each counter has a single writer, the thread, which increments it with
+/// relaxed atomic loads and stores: no locked instruction on the hot path,
+/// and the master may read the counters at any time. The events are always
+/// counted, by the Run. The steps, per logical volume and indexed by
+/// instance ID as in B3::OrganDoseSD, and the tracks, per particle in a
+/// small table filled as the particles show up, are counted only by the
+/// SteppingAction and TrackingAction that the RunAction installs with
+/// fBreakdown.
+
+class ThroughputChannel
+{
+  public:
+    static const G4int kMaxParticles = 32;
+
+    explicit ThroughputChannel(ThroughputMonitor* monitor);
+    ~ThroughputChannel() = default;
+
+    // Worker side
+    void CountEvent() { Increment(fNbEvents); }
+    void CountStep(G4int volume)
+    {
+      Increment(volume < fNbVolumes ? fSteps[volume] : fOtherSteps);
+    }
+    void CountTrack(const G4ParticleDefinition* particle);
+
+    // Worker side, out of the event loop: room for all the logical volumes
+    void Reserve(G4int nbVolumes);
+
+  private:
+    static void Increment(std::atomic<G4long>& counter)
+    {
+      counter.store(counter.load(std::memory_order_relaxed) + 1,
+                    std::memory_order_relaxed);
+    }
+
+    friend class ThroughputMonitor;
+
+    ThroughputMonitor*                       fMonitor = nullptr;
+    std::atomic<G4long>                      fNbEvents{0};
+    std::atomic<G4long>                      fOtherSteps{0};
+    G4int                                    fNbVolumes = 0;
+    std::unique_ptr<std::atomic<G4long>[]>   fSteps;
+    std::atomic<G4long>                      fTracks[kMaxParticles + 1];
+    const G4ParticleDefinition*              fParticles[kMaxParticles];
+    G4int                                    fNbParticles = 0;
+};
+
+/// Counts read from all the channels at one time.
+
+struct ThroughputSample
+{
+  std::chrono::steady_clock::time_point fTime;
+  std::vector<G4long>   fEvents;            // per thread
+  std::vector<G4long>   fSteps;             // per thread
+  std::vector<G4long>   fVolumeSteps;       // per logical volume, + other
+  std::vector<G4String> fParticles;
+  std::vector<G4long>   fTracks;            // per particle, + other
+};
+
+/// Throughput monitor
+///
+/// Owns the counters of every thread, which live as long as the application
+/// so that the user actions can keep a pointer to them. The master starts
+/// it at the beginning of the run, when any of the settings is on: it takes
+/// the counts as the baseline of the run and, with fReport, a sampler thread
+/// prints the events done and the events/s since the previous sample. At
+/// the end of the run, Stop() prints the rates of each thread and, with
+/// fBreakdown, the steps/s, the share of the steps taken in each logical
+/// volume and the tracks of each particle: the steps are counted only
+/// then. With fFile, it also appends the threads, events and seconds of
+/// the run to that file, for the scaling sweep of exampleB3b.
+
+class ThroughputMonitor
+{
+  public:
+    static ThroughputMonitor* Instance();
+    ~ThroughputMonitor();
+
+    // The channel of a thread, by thread id; created on first use
+    ThroughputChannel* GetChannel(G4int thread);
+
+    void Start(const ThroughputParameters& parameters, G4long nbRequested);
+    void Stop();
+
+  private:
+    ThroughputMonitor() = default;
+
+    friend class ThroughputChannel;
+
+    ThroughputSample Sample() const;
+    void SamplerLoop();
+    void Progress(const ThroughputSample& previous,
+                  const ThroughputSample& current) const;
+    void Summary(const ThroughputSample& current) const;
+
+    ThroughputParameters                            fParameters;
+    G4long                                          fNbRequested = 0;
+    G4bool                                          fStarted = false;
+    ThroughputSample                                fBaseline;
+
+    // channels, their volume and particle tables: guarded by fMutex, which
+    // the workers take only out of the event loop or for a new particle
+    mutable std::mutex                              fMutex;
+    std::vector<std::unique_ptr<ThroughputChannel>> fChannels;
+
+    G4bool                                          fStop = false;
+    std::thread                                     fThread;
+    std::mutex                                      fWakeMutex;
+    std::condition_variable                         fWake;
+};
+
+}
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
+
+#endif
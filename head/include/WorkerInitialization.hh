@@ -0,0 +1,95 @@
+//
+// ********************************************************************
+// * License and Disclaimer                                           *
+// *                                                                  *
+// * The  Geant4 software  is  copyright of the Copyright Holders  of *
+// * the Geant4 Collaboration.  It is provided  under  the terms  and *
+// * conditions of the Geant4 Software License,  included in the file *
+// * LICENSE and available at  http://cern.ch/geant4/license .  These *
+// * include a list of copyright holders.                             *
+// *                                                                  *
+// * Neither the authors of this software system, nor their employing *
+// * institutes,nor the agencies providing financial support for this *
+// * work  make  any representation or  warranty, express or implied, *
+// * regarding  this  software system or assume any liability for its *
+// * use.  Please see the license in the file  LICENSE  and URL above *
+// * for the full disclaimer and the limitation of liability.         *
+// *                                                                  *
+// * This  code  implementation is the result of  the  scientific and *
+// * technical work of the GEANT4 collaboration.                      *
+// * By using,  copying,  modifying or  distributing the software (or *
+// * any work based  on the software)  you  agree  to acknowledge its *
+// * use  in  resulting  scientific  publications,  and indicate your *
+// * acceptance of all terms of the Geant4 Software license.          *
+// ********************************************************************
+//
+/// \file WorkerInitialization.hh
+/// \brief Definition of the B3b::WorkerInitialization class
+
+#ifndef B3bWorkerInitialization_h
+#define B3bWorkerInitialization_h 1
+
+#include "G4UserWorkerInitialization.hh"
+#include "globals.hh"
+
+#include <vector>
+
+class G4GenericMessenger;
+
+namespace B3b
+{
+
+/// Worker placement policies.
+
+enum PinPolicy
+{
+  kPinNone = 0,     // left to the operating system
+  kPinCompact = 1,  // worker i on the i-th allowed CPU
+  kPinNuma = 2      // workers dealt round-robin over the NUMA nodes
+};
+
+/// Worker initialization class: places the worker threads and sets the
+/// event grain of the run manager (/B3/threads/ commands, or the command
+/// line of exampleB3b).
+///
+/// WorkerStart() pins each worker, before it builds its geometry and
+/// physics tables: with the default first-touch policy of Linux, their
+/// memory then lives on the NUMA node of the worker. With kPinNuma,
+/// consecutive workers go to different nodes, to use all the memory
+/// controllers even with few threads.
+/// ConfigureEventLoop(), called by the master at the beginning of each run,
+/// turns the events per task into the grain size of the tasking run
+/// manager, or into the event modulo of the multi-threaded one.
+
+class WorkerInitialization : public G4UserWorkerInitialization
+{
+  public:
+    WorkerInitialization();
+    ~WorkerInitialization() override;
+
+    void WorkerStart() const override;
+
+    void SetPinPolicy(G4int policy) { fPinPolicy = policy; }
+    void SetEventsPerTask(G4int events) { fEventsPerTask = events; }
+    void ConfigureEventLoop(G4int nbEvents) const;
+
+    // CPU of a worker under the pin policy, -1 for none
+    G4int GetWorkerCpu(G4int worker) const;
+
+  private:
+    void DefineCommands();
+    void SetPinPolicyName(const G4String& policy);
+
+    G4GenericMessenger* fMessenger = nullptr;
+    G4int fPinPolicy = kPinNone;
+    G4int fEventsPerTask = 0;          // 0: run manager default
+
+    // allowed CPUs, grouped by NUMA node
+    std::vector<std::vector<G4int>> fNodes;
+};
+
+}
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
+
+#endif
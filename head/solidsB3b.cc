@@ -0,0 +1,341 @@
+//
+// ********************************************************************
+// * License and Disclaimer                                           *
+// *                                                                  *
+// * The  Geant4 software  is  copyright of the Copyright Holders  of *
+// * the Geant4 Collaboration.  It is provided  under  the terms  and *
+// * conditions of the Geant4 Software License,  included in the file *
+// * LICENSE and available at  http://cern.ch/geant4/license .  These *
+// * include a list of copyright holders.                             *
+// *                                                                  *
+// * Neither the authors of this software system, nor their employing *
+// * institutes,nor the agencies providing financial support for this *
+// * work  make  any representation or  warranty, express or implied, *
+// * regarding  this  software system or assume any liability for its *
+// * use.  Please see the license in the file  LICENSE  and URL above *
+// * for the full disclaimer and the limitation of liability.         *
+// *                                                                  *
+// * This  code  implementation is the result of  the  scientific and *
+// * technical work of the GEANT4 collaboration.                      *
+// * By using,  copying,  modifying or  distributing the software (or *
+// * any work based  on the software)  you  agree  to acknowledge its *
+// * use  in  resulting  scientific  publications,  and indicate your *
+// * acceptance of all terms of the Geant4 Software license.          *
+// ********************************************************************
+/// \file solidsB3b.cc
+/// \brief Checks the analytic solids of the B3b phantom against Boolean ones
+//
+// Each analytic solid of the phantom is compared with the Boolean solid it
+// replaces, built by the same DetectorConstruction function:
+//  - Inside() at random points of the bounding box, away from the surface;
+//  - DistanceToIn(p,v) and DistanceToOut(p,v) along random rays, which must
+//    agree within the tolerance;
+//  - the safeties, which must never exceed the distance along the ray;
+//  - GetPointOnSurface(), whose points must be on the Boolean surface.
+// Then each is placed alone in a box of air and random rays are tracked
+// through it with a G4Navigator, to compare the navigation steps per second.
+// The same is done for the whole head, with the brain beside the skull as
+// originally (where part of it overlaps the bone) and inside it.
+// The exit status is not zero if any check fails.
+//
+//   solidsB3b [options]
+//     -n <points>         random points and rays per check   (default 1000000)
+//     -m <rays>           rays tracked by the navigator       (default 200000)
+//     -t <tolerance>      distance tolerance [mm]              (default 1e-6)
+//     -s <seed>           seed of the random engine            (default 12345)
+
+#include "G4Types.hh"
+
+#include "G4NistManager.hh"
+#include "G4Box.hh"
+#include "G4LogicalVolume.hh"
+#include "G4PVPlacement.hh"
+#include "G4Navigator.hh"
+#include "G4GeometryManager.hh"
+#include "G4RandomDirection.hh"
+#include "G4SystemOfUnits.hh"
+#include "Randomize.hh"
+
+#include "DetectorConstruction.hh"
+
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+
+namespace
+{
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
+
+using Clock = std::chrono::steady_clock;
+
+struct Options
+{
+  long   fNbPoints = 1000000;
+  long   fNbRays = 200000;
+  double fTolerance = 1e-6*mm;
+  long   fSeed = 12345;
+};
+
+// an analytic solid and the Boolean one it replaces
+struct Case
+{
+  const char* fName;
+  const char* fMaterial;
+  G4VSolid* (*fBuild)(G4bool analytic);
+};
+
+const Case kCases[] = {
+  { "skull", "G4_BONE_COMPACT_ICRU", &B3::DetectorConstruction::BuildSkull }
+};
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
+
+// a random point of the bounding box of the solid, enlarged by 10%
+G4ThreeVector RandomPoint(const G4VSolid* solid)
+{
+  G4ThreeVector pMin, pMax;
+  solid->BoundingLimits(pMin, pMax);
+  G4ThreeVector centre = 0.5*(pMin + pMax), half = 0.55*(pMax - pMin);
+  return G4ThreeVector(centre.x() + half.x()*(2.*G4UniformRand() - 1.),
+                       centre.y() + half.y()*(2.*G4UniformRand() - 1.),
+                       centre.z() + half.z()*(2.*G4UniformRand() - 1.));
+}
+
+G4bool SameDistance(G4double a, G4double b, G4double tolerance)
+{
+  if (a >= kInfinity || b >= kInfinity) return a >= kInfinity && b >= kInfinity;
+  return std::abs(a - b) <= tolerance;
+}
+
+// number of failed checks
+long Compare(const G4VSolid* analytic, const G4VSolid* boolean,
+             const Options& options)
+{
+  long inside = 0, rays = 0, safeties = 0, surface = 0;
+  long nbRays = 0;
+
+  for (long i = 0; i < options.fNbPoints; i++) {
+    G4ThreeVector p = RandomPoint(boolean);
+    EInside expected = boolean->Inside(p), found = analytic->Inside(p);
+    if (expected != kSurface && found != kSurface && expected != found) inside++;
+  }
+
+  for (long i = 0; i < options.fNbPoints; i++) {
+    G4ThreeVector p = RandomPoint(boolean);
+    G4ThreeVector v = G4RandomDirection();
+    EInside where = boolean->Inside(p);
+    if (where == kSurface || analytic->Inside(p) != where) continue;
+    nbRays++;
+    if (where == kOutside) {
+      G4double distance = analytic->DistanceToIn(p, v);
+      if (!SameDistance(distance, boolean->DistanceToIn(p, v), options.fTolerance))
+        rays++;
+      if (analytic->DistanceToIn(p) > distance + options.fTolerance) safeties++;
+    }
+    else {
+      G4double distance = analytic->DistanceToOut(p, v);
+      if (!SameDistance(distance, boolean->DistanceToOut(p, v), options.fTolerance))
+        rays++;
+      if (analytic->DistanceToOut(p) > distance + options.fTolerance) safeties++;
+    }
+  }
+
+  for (long i = 0; i < options.fNbPoints/10; i++) {
+    if (boolean->Inside(analytic->GetPointOnSurface()) != kSurface) surface++;
+  }
+
+  std::printf("  Inside()              %8ld of %ld points differ\n",
+              inside, options.fNbPoints);
+  std::printf("  DistanceToIn/Out(p,v) %8ld of %ld rays differ by more than %g mm\n",
+              rays, nbRays, options.fTolerance/mm);
+  std::printf("  safeties              %8ld beyond the distance along the ray\n",
+              safeties);
+  std::printf("  GetPointOnSurface()   %8ld of %ld points off the surface\n",
+              surface, options.fNbPoints/10);
+  std::printf("  volume                %12.6g cm3 (Boolean estimate %.6g cm3)\n",
+              const_cast<G4VSolid*>(analytic)->GetCubicVolume()/cm3,
+              const_cast<G4VSolid*>(boolean)->GetCubicVolume()/cm3);
+  return inside + rays + safeties + surface;
+}
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
+
+// a box of air of half sizes half, centred on the origin
+G4LogicalVolume* MakeWorld(const G4ThreeVector& half, G4VPhysicalVolume*& world)
+{
+  G4Material* air = G4NistManager::Instance()->FindOrBuildMaterial("G4_AIR");
+  auto worldBox = new G4Box("World", half.x(), half.y(), half.z());
+  auto worldLV = new G4LogicalVolume(worldBox, air, "World");
+  world = new G4PVPlacement(nullptr, G4ThreeVector(), worldLV, "World",
+                            nullptr, false, 0);
+  return worldLV;
+}
+
+// navigation steps per second along random rays through the world, from
+// random points of the box of half sizes half
+double StepsPerSecond(G4VPhysicalVolume* world, const G4ThreeVector& half,
+                      const Options& options, long& nbSteps)
+{
+  G4GeometryManager::GetInstance()->CloseGeometry(true, false, world);
+
+  G4Navigator navigator;
+  navigator.SetWorldVolume(world);
+  nbSteps = 0;
+  auto start = Clock::now();
+  for (long i = 0; i < options.fNbRays; i++) {
+    G4ThreeVector p(half.x()*(2.*G4UniformRand() - 1.),
+                    half.y()*(2.*G4UniformRand() - 1.),
+                    half.z()*(2.*G4UniformRand() - 1.));
+    G4ThreeVector v = G4RandomDirection();
+    G4VPhysicalVolume* volume = navigator.LocateGlobalPointAndSetup(p, &v, false);
+    while (volume != nullptr) {
+      G4double safety = 0.;
+      G4double step = navigator.ComputeStep(p, v, kInfinity, safety);
+      if (step >= kInfinity) break;
+      p += step*v;
+      navigator.SetGeometricallyLimitedStep();
+      volume = navigator.LocateGlobalPointAndSetup(p, &v, true);
+      nbSteps++;
+    }
+  }
+  double seconds = std::chrono::duration<double>(Clock::now() - start).count();
+
+  G4GeometryManager::GetInstance()->OpenGeometry(world);
+  return seconds > 0. ? nbSteps/seconds : 0.;
+}
+
+// the same, through the solid alone in a box of air
+double StepsPerSecond(G4VSolid* solid, const char* materialName,
+                      const Options& options, long& nbSteps)
+{
+  G4Material* material = G4NistManager::Instance()->FindOrBuildMaterial(materialName);
+
+  G4ThreeVector pMin, pMax;
+  solid->BoundingLimits(pMin, pMax);
+  G4ThreeVector half = 0.6*(pMax - pMin), centre = 0.5*(pMin + pMax);
+  G4VPhysicalVolume* world = nullptr;
+  G4LogicalVolume* worldLV = MakeWorld(half, world);
+  auto solidLV = new G4LogicalVolume(solid, material, solid->GetName());
+  new G4PVPlacement(nullptr, -centre, solidLV, solid->GetName(), worldLV,
+                    false, 0);
+  return StepsPerSecond(world, half, options, nbSteps);
+}
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
+
+// the head, as DetectorConstruction places it: the brain beside the
+// Boolean skull (the original layout), beside the analytic skull, and inside
+// the skull
+void CompareLayouts(const Options& options)
+{
+  struct Layout
+  {
+    const char* fName;
+    G4bool fNested;
+    G4bool fAnalytic;
+  };
+  const Layout layouts[] = { { "flat, Boolean skull",  false, false },
+                             { "flat, analytic skull", false, true },
+                             { "nested",               true,  true } };
+
+  G4ThreeVector pMin, pMax;
+  B3::DetectorConstruction::BuildSkull(true)->BoundingLimits(pMin, pMax);
+  G4ThreeVector half = 0.6*(pMax - pMin);
+
+  std::printf("head layouts:\n");
+  double firstRate = 0.;
+  for (const Layout& layout : layouts) {
+    G4VPhysicalVolume* world = nullptr;
+    G4LogicalVolume* worldLV = MakeWorld(half, world);
+    G4LogicalVolume* skullLV =
+      B3::DetectorConstruction::PlaceHead(worldLV, layout.fNested, layout.fAnalytic);
+
+    if (!layout.fNested) {
+      // the points of the brain which are also in the skull
+      G4VSolid* brain = worldLV->GetDaughter(0)->GetLogicalVolume()->GetSolid();
+      G4VSolid* skull = skullLV->GetSolid();
+      G4ThreeVector bMin, bMax;
+      brain->BoundingLimits(bMin, bMax);
+      long inBrain = 0, inBoth = 0;
+      G4Random::setTheSeed(options.fSeed);
+      for (long i = 0; i < options.fNbPoints; i++) {
+        G4ThreeVector p(bMin.x() + (bMax.x() - bMin.x())*G4UniformRand(),
+                        bMin.y() + (bMax.y() - bMin.y())*G4UniformRand(),
+                        bMin.z() + (bMax.z() - bMin.z())*G4UniformRand());
+        if (brain->Inside(p) != kInside) continue;
+        inBrain++;
+        if (skull->Inside(p) == kInside) inBoth++;
+      }
+      std::printf("  %-22s %10.2f%% of the brain overlaps the bone\n",
+                  layout.fName, inBrain > 0 ? 100.*inBoth/inBrain : 0.);
+    }
+
+    long nbSteps = 0;
+    G4Random::setTheSeed(options.fSeed);
+    double rate = StepsPerSecond(world, half, options, nbSteps);
+    if (firstRate == 0.) firstRate = rate;
+    std::printf("  %-22s %12.4g steps/s (%ld steps): x%.2f\n", layout.fName,
+                rate, nbSteps, firstRate > 0. ? rate/firstRate : 0.);
+  }
+}
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
+
+void Usage()
+{
+  std::fprintf(stderr,
+    "usage: solidsB3b [-n points] [-m rays] [-t tolerance] [-s seed]\n");
+}
+
+}
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
+
+int main(int argc, char** argv)
+{
+  Options options;
+
+  for (int i = 1; i < argc; i++) {
+    std::string arg = argv[i];
+    bool hasValue = i+1 < argc;
+    if (arg == "-n" && hasValue) options.fNbPoints = std::atol(argv[++i]);
+    else if (arg == "-m" && hasValue) options.fNbRays = std::atol(argv[++i]);
+    else if (arg == "-t" && hasValue) options.fTolerance = std::atof(argv[++i])*mm;
+    else if (arg == "-s" && hasValue) options.fSeed = std::atol(argv[++i]);
+    else { Usage(); return 1; }
+  }
+  if (options.fNbPoints < 1 || options.fNbRays < 1 || options.fTolerance < 0.) {
+    Usage();
+    return 1;
+  }
+
+  long failures = 0;
+  for (const Case& solidCase : kCases) {
+    G4VSolid* analytic = solidCase.fBuild(true);
+    G4VSolid* boolean = solidCase.fBuild(false);
+
+    G4Random::setTheSeed(options.fSeed);
+    std::printf("%s: %s against %s\n", solidCase.fName,
+                analytic->GetEntityType().c_str(), boolean->GetEntityType().c_str());
+    failures += Compare(analytic, boolean, options);
+
+    long analyticSteps = 0, booleanSteps = 0;
+    G4Random::setTheSeed(options.fSeed);
+    double analyticRate = StepsPerSecond(analytic, solidCase.fMaterial, options,
+                                         analyticSteps);
+    G4Random::setTheSeed(options.fSeed);
+    double booleanRate = StepsPerSecond(boolean, solidCase.fMaterial, options,
+                                        booleanSteps);
+    std::printf("  navigation            %12.4g steps/s analytic (%ld steps),"
+                " %.4g Boolean (%ld steps): x%.2f\n",
+                analyticRate, analyticSteps, booleanRate, booleanSteps,
+                booleanRate > 0. ? analyticRate/booleanRate : 0.);
+  }
+
+  CompareLayouts(options);
+
+  return failures == 0 ? 0 : 1;
+}
@@ -28,17 +28,26 @@
 /// \brief Implementation of the B3::DetectorConstruction class
 
 #include "DetectorConstruction.hh"
+#include "CrystalSD.hh"
+#include "OrganRegistry.hh"
+#include "OrganDoseSD.hh"
+#include "EllipsoidalShell.hh"
 
 #include "G4NistManager.hh"
 #include "G4LogicalVolume.hh"
+#include "G4LogicalVolumeStore.hh"
+#include "G4PhysicalVolumeStore.hh"
+#include "G4SolidStore.hh"
+#include "G4GeometryManager.hh"
 #include "G4PVPlacement.hh"
 #include "G4RotationMatrix.hh"
 #include "G4Transform3D.hh"
 #include "G4SDManager.hh"
-#include "G4MultiFunctionalDetector.hh"
-#include "G4VPrimitiveScorer.hh"
-#include "G4PSEnergyDeposit.hh"
-#include "G4PSDoseDeposit.hh"
+#include "G4RunManager.hh"
+#include "G4StateManager.hh"
+#include "G4GenericMessenger.hh"
+#include "G4UIcommand.hh"
+#include "G4UIcommandStatus.hh"
 #include "G4VisAttributes.hh"
 #include "G4PhysicalConstants.hh"
 #include "G4SystemOfUnits.hh"
@@ -49,6 +58,17 @@
 #include "G4Box.hh"
 #include "G4Tubs.hh"
 
+#include <algorithm>
+
+namespace
+{
+  // semi-axes of the skull and of its cavity, which the brain fills
+  const G4ThreeVector kCraniumOut(6.8*cm, 9.8*cm, 8.3*cm);
+  const G4ThreeVector kCraniumIn(6.*cm, 9.*cm, 6.5*cm);
+  // the cavity is 1 cm higher than the centre of the skull
+  const G4ThreeVector kCavityCentre(0.0, 0.0, 1.*cm);
+}
+
 namespace B3
 {
 
@@ -56,13 +76,23 @@ namespace B3
 
 DetectorConstruction::DetectorConstruction()
 {
+  // Gamma detector Parameters
+  //
+  fCrystalDX = 6*cm;
+  fCrystalDY = 6*cm;
+  fCrystalDZ = 3*cm;
+  fGap = 0.5*mm;        //a gap for wrapping
+
   DefineMaterials();
+  DefineCommands();
 }
 
 //....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
 
 DetectorConstruction::~DetectorConstruction()
-{ }
+{
+  delete fMessenger;
+}
 
 //....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
 
@@ -80,17 +110,50 @@ void DetectorConstruction::DefineMaterials()
   LSO->AddElement(Lu, 2);
   LSO->AddElement(Si, 1);
   LSO->AddElement(O , 5);
+
+  // the other scintillators selectable with /B3/detector/material
+  // (BGO is G4_BGO); the cerium doping is neglected
+  //
+  G4Element*  Y = man->FindOrBuildElement("Y" , isotopes);
+  G4Element* Gd = man->FindOrBuildElement("Gd", isotopes);
+
+  // Lu1.8Y0.2SiO5
+  G4Material* LYSO = new G4Material("LYSO", 7.1*g/cm3, 4);
+  LYSO->AddElement(Lu, 18);
+  LYSO->AddElement(Y ,  2);
+  LYSO->AddElement(Si, 10);
+  LYSO->AddElement(O , 50);
+
+  // Lu1.8Gd0.2SiO5
+  G4Material* LFS = new G4Material("LFS", 7.35*g/cm3, 4);
+  LFS->AddElement(Lu, 18);
+  LFS->AddElement(Gd,  2);
+  LFS->AddElement(Si, 10);
+  LFS->AddElement(O , 50);
+
+  G4Material* GSO = new G4Material("GSO", 6.71*g/cm3, 3);
+  GSO->AddElement(Gd, 2);
+  GSO->AddElement(Si, 1);
+  GSO->AddElement(O , 5);
 }
 
 //....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
 
 G4VPhysicalVolume* DetectorConstruction::Construct()
 {
+  // the previous geometry, when the scanner has been changed
+  //
+  G4GeometryManager::GetInstance()->OpenGeometry();
+  G4PhysicalVolumeStore::GetInstance()->Clean();
+  G4LogicalVolumeStore::GetInstance()->Clean();
+  G4SolidStore::GetInstance()->Clean();
+
   // Gamma detector Parameters
   //
-  G4double cryst_dX = 6*cm, cryst_dY = 6*cm, cryst_dZ = 3*cm;
-  G4int nb_cryst = 32;
-  G4int nb_rings = 9;
+  G4double cryst_dX = fCrystalDX, cryst_dY = fCrystalDY, cryst_dZ = fCrystalDZ;
+  G4int nb_cryst = fNbCrystals;
+  G4int nb_rings = fNbRings;
+  fDetectorID = DetectorID(nb_rings, nb_cryst);
   //
   G4double dPhi = twopi/nb_cryst, half_dPhi = 0.5*dPhi;
   G4double cosdPhi = std::cos(half_dPhi);
@@ -103,7 +166,7 @@ G4VPhysicalVolume* DetectorConstruction::Construct()
   //
   G4NistManager* nist = G4NistManager::Instance();
   G4Material* default_mat = nist->FindOrBuildMaterial("G4_AIR");
-  G4Material* cryst_mat   = nist->FindOrBuildMaterial("Lu2SiO5");
+  G4Material* cryst_mat   = nist->FindOrBuildMaterial(fCrystalMaterial);
 
   //
   // World
@@ -144,7 +207,7 @@ G4VPhysicalVolume* DetectorConstruction::Construct()
   //
   // define crystal
   //
-  G4double gap = 0.5*mm;        //a gap for wrapping
+  G4double gap = fGap;
   G4double dX = cryst_dX - gap, dY = cryst_dY - gap;
   G4Box* solidCryst = new G4Box("crystal", dX/2, dY/2, cryst_dZ/2);
 
@@ -169,7 +232,7 @@ G4VPhysicalVolume* DetectorConstruction::Construct()
                       "crystal",             //its name
                       logicRing,             //its mother  volume
                       false,                 //no boolean operation
-                      icrys,                 //copy number
+                      fDetectorID.Pack(0,icrys), //copy number
                       fCheckOverlaps);       // checking overlaps
   }
 
@@ -196,7 +259,7 @@ G4VPhysicalVolume* DetectorConstruction::Construct()
                       "ring",                //its name
                       logicDetector,         //its mother  volume
                       false,                 //no boolean operation
-                      iring,                 //copy number
+                      fDetectorID.Pack(iring,0), //copy number
                       fCheckOverlaps);       // checking overlaps
   }
 
@@ -213,102 +276,122 @@ G4VPhysicalVolume* DetectorConstruction::Construct()
                     fCheckOverlaps);         // checking overlaps
 
   //
-  // patient
+  // patient: the brain and the skull
   //
+  G4LogicalVolume* logicSkull = PlaceHead(logicWorld, fNestedHead, fAnalyticSolids);
 
-  G4Material* patient_mat = nist->FindOrBuildMaterial("G4_BRAIN_ICRP");
-
-  G4double ax = 6. * cm;
-  G4double by= 9. * cm;
-  G4double cz= 6.5 * cm;
-  G4Ellipsoid* solidPatient = new G4Ellipsoid("Patient", ax, by, cz);
+  // the outer surface of the skull encloses the patient
+  G4ThreeVector phantomMin, phantomMax;
+  logicSkull->GetSolid()->BoundingLimits(phantomMin, phantomMax);
+  fPhantomSize = phantomMax - phantomMin;
+  FitWorld(solidWorld, ring_R1, world_sizeXY, world_sizeZ);
 
 
-  G4LogicalVolume* logicPatient =
-    new G4LogicalVolume(solidPatient,        //its solid
-                        patient_mat,         //its material
-                        "PatientLV");        //its name
-
-
-  //
-  // skull
+  // Visualization attributes
   //
+  logicRing->SetVisAttributes (G4VisAttributes::GetInvisible());
+  logicDetector->SetVisAttributes (G4VisAttributes::GetInvisible());
 
-  G4Material* bone_mat = nist->FindOrBuildMaterial("G4_BONE_COMPACT_ICRU");
- 
-  G4Ellipsoid* craniumIn =  new G4Ellipsoid("CraniumIn", ax, by, cz);
- 
-  ax = 6.8 * cm;//a out skull
-  by = 9.8 * cm; // bout
-  cz = 8.3 * cm; //cout
- 
-  G4Ellipsoid* craniumOut =  new G4Ellipsoid("CraniumOut", ax, by, cz);
 
- 
+  // definisco colori
+  G4VisAttributes * col_det = new G4VisAttributes(G4Colour(0.75,0.75,0.75,0.5));
+  col_det -> SetVisibility (true);
+  col_det-> SetForceSolid (true);
 
-  G4SubtractionSolid* cranium =  new G4SubtractionSolid("Cranium",
-							craniumOut,
-							craniumIn,0,
-							G4ThreeVector(0.0, 0.0,1. * cm));
 
-  G4LogicalVolume* logicSkull = new G4LogicalVolume(cranium, bone_mat, 
-						    "skullLV");
+  //colore visibile
+  logicCryst -> SetVisAttributes(col_det);
 
-  //
-  // place patient in world
-  //
-  new G4PVPlacement(0,                       //no rotation
-                    G4ThreeVector(),         //at (0,0,0)
-                    logicPatient,            //its logical volume
-                    "Patient",               //its name
-                    logicWorld,              //its mother  volume
-                    false,                   //no boolean operation
-                    0,                       //copy number
-                    fCheckOverlaps);         // checking overlaps
+  // Print materials
+  G4cout << *(G4Material::GetMaterialTable()) << G4endl;
 
+  // overlaps of the placements which are not in the cache
   //
-  // place skull in world
+  OverlapChecker(fOverlapCache).Check(physWorld, fOverlapMode);
+
+  //always return the physical World
   //
-  new G4PVPlacement(0,                       //no rotation
-                    G4ThreeVector(),         //at (0,0,0)
-                    logicSkull,            //its logical volume
-                    "Skull",               //its name
-                    logicWorld,              //its mother  volume
-                    false,                   //no boolean operation
-                    0,                       //copy number
-                    fCheckOverlaps);         // checking overlaps
+  return physWorld;
+}
 
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
 
+G4VSolid* DetectorConstruction::BuildSkull(G4bool analytic)
+{
+  if (analytic)
+    return new EllipsoidalShell("Cranium", kCraniumOut, kCraniumIn, kCavityCentre);
+
+  auto craniumIn = new G4Ellipsoid("CraniumIn", kCraniumIn.x(), kCraniumIn.y(),
+                                   kCraniumIn.z());
+  auto craniumOut = new G4Ellipsoid("CraniumOut", kCraniumOut.x(), kCraniumOut.y(),
+                                    kCraniumOut.z());
+  return new G4SubtractionSolid("Cranium", craniumOut, craniumIn, nullptr,
+                                kCavityCentre);
+}
 
-  // Visualization attributes
-  //
-  logicRing->SetVisAttributes (G4VisAttributes::GetInvisible());
-  logicDetector->SetVisAttributes (G4VisAttributes::GetInvisible());
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
 
+G4LogicalVolume* DetectorConstruction::PlaceHead(G4LogicalVolume* mother,
+                                                 G4bool nested, G4bool analytic)
+{
+  G4NistManager* nist = G4NistManager::Instance();
+  G4Material* patient_mat = nist->FindOrBuildMaterial("G4_BRAIN_ICRP");
+  G4Material* bone_mat = nist->FindOrBuildMaterial("G4_BONE_COMPACT_ICRU");
 
-  // definisco colori
+  G4Ellipsoid* solidPatient =
+    new G4Ellipsoid("Patient", kCraniumIn.x(), kCraniumIn.y(), kCraniumIn.z());
+  G4LogicalVolume* logicPatient =
+    new G4LogicalVolume(solidPatient,        //its solid
+                        patient_mat,         //its material
+                        "PatientLV");        //its name
+
+  if (nested) {
+    // the skull is the whole outer ellipsoid, mother of the brain which
+    // fills its cavity: every point is in one volume only, and the brain
+    // is looked for only inside the skull
+    G4Ellipsoid* cranium = new G4Ellipsoid("Cranium", kCraniumOut.x(),
+                                           kCraniumOut.y(), kCraniumOut.z());
+    G4LogicalVolume* logicSkull = new G4LogicalVolume(cranium, bone_mat,
+                                                      "skullLV");
+    new G4PVPlacement(0, G4ThreeVector(), logicSkull, "Skull", mother,
+                      false, 0);
+    new G4PVPlacement(0,                       //no rotation
+                      kCavityCentre,           //in the cavity frame
+                      logicPatient,            //its logical volume
+                      "Patient",               //its name
+                      logicSkull,              //its mother  volume
+                      false,                   //no boolean operation
+                      0);                      //copy number
+    SetHeadVisAttributes(logicPatient, logicSkull);
+    return logicSkull;
+  }
+
+  // side by side, both centred on the origin: the bottom of the brain
+  // overlaps the bone, and the top of the cavity is left empty
+  G4LogicalVolume* logicSkull = new G4LogicalVolume(BuildSkull(analytic),
+                                                    bone_mat, "skullLV");
+  new G4PVPlacement(0, G4ThreeVector(), logicPatient, "Patient", mother,
+                    false, 0);
+  new G4PVPlacement(0, G4ThreeVector(), logicSkull, "Skull", mother,
+                    false, 0);
+  SetHeadVisAttributes(logicPatient, logicSkull);
+  return logicSkull;
+}
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
+
+void DetectorConstruction::SetHeadVisAttributes(G4LogicalVolume* logicPatient,
+                                                G4LogicalVolume* logicSkull)
+{
   G4VisAttributes * col_patient = new G4VisAttributes(G4Colour(1.0,0.8,0.8));
   col_patient -> SetVisibility (true);
   col_patient-> SetForceSolid (true);
   G4VisAttributes * col_skull = new G4VisAttributes(G4Colour(1.0,1.0,1.0,0.3));
   col_skull -> SetVisibility (true);
   col_skull-> SetForceSolid (true);
-  G4VisAttributes * col_det = new G4VisAttributes(G4Colour(0.75,0.75,0.75,0.5));
-  col_det -> SetVisibility (true);
-  col_det-> SetForceSolid (true);
 
-
-  //colore visibile
   logicPatient -> SetVisAttributes(col_patient);
   logicSkull -> SetVisAttributes(col_skull);
-  logicCryst -> SetVisAttributes(col_det);
-
-  // Print materials
-  G4cout << *(G4Material::GetMaterialTable()) << G4endl;
-
-  //always return the physical World
-  //
-  return physWorld;
 }
 
 //....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
@@ -317,29 +400,281 @@ void DetectorConstruction::ConstructSDandField()
 {
   G4SDManager::GetSDMpointer()->SetVerboseLevel(1);
 
-  // declare crystal as a MultiFunctionalDetector scorer
+  // declare crystal as a CrystalSD: flat per-thread energy buffer
+  // indexed by global (ring, crystal) detector ID.
+  // When the geometry is rebuilt the detectors of the thread already exist:
+  // they are resized and attached to the new volumes.
   //
-  G4MultiFunctionalDetector* cryst = new G4MultiFunctionalDetector("crystal");
-  G4SDManager::GetSDMpointer()->AddNewDetector(cryst);
-  G4VPrimitiveScorer* primitiv1 = new G4PSEnergyDeposit("edep");
-  cryst->RegisterPrimitive(primitiv1);
+  G4SDManager* sdManager = G4SDManager::GetSDMpointer();
+  auto cryst =
+    static_cast<CrystalSD*>(sdManager->FindSensitiveDetector("crystal", false));
+  if (cryst == nullptr) {
+    cryst = new CrystalSD("crystal", fDetectorID);
+    sdManager->AddNewDetector(cryst);
+  }
+  else {
+    cryst->SetDetectorID(fDetectorID);
+  }
   SetSensitiveDetector("CrystalLV",cryst);
 
-  // declare patient as a MultiFunctionalDetector scorer
+  // declare the organs of the patient, as listed in the organ registry:
+  // a single OrganDoseSD accumulates the dose of all of them
   //
-  G4MultiFunctionalDetector* patient = new G4MultiFunctionalDetector("patient");
-  G4SDManager::GetSDMpointer()->AddNewDetector(patient);
-  G4VPrimitiveScorer* primitiv2 = new G4PSDoseDeposit("dose");
-  patient->RegisterPrimitive(primitiv2);
-  SetSensitiveDetector("PatientLV",patient);
+  OrganRegistry* organs = OrganRegistry::Instance();
+  organs->Register("PatientLV", "patient", "brain");
+  // the skull is the mother of the brain: its mass is that of the bone
+  organs->Register("skullLV",   "skull",   "skull", true, true);
+
+  auto organDose =
+    static_cast<OrganDoseSD*>(sdManager->FindSensitiveDetector("organDose", false));
+  if (organDose == nullptr) {
+    organDose = new OrganDoseSD("organDose", organs->GetNbOrgans());
+    sdManager->AddNewDetector(organDose);
+  }
+  else {
+    organDose->ClearVolumes();
+  }
 
-  // declare patient as a MultiFunctionalDetector scorer
-  //
-  G4MultiFunctionalDetector* skull = new G4MultiFunctionalDetector("skull");
-  G4SDManager::GetSDMpointer()->AddNewDetector(skull);
-  G4VPrimitiveScorer* primitiv3 = new G4PSDoseDeposit("doseSkull");
-  skull->RegisterPrimitive(primitiv3);
-  SetSensitiveDetector("skullLV",skull);
+  G4LogicalVolumeStore* lvStore = G4LogicalVolumeStore::GetInstance();
+  for (G4int i = 0; i < organs->GetNbOrgans(); i++) {
+    const OrganEntry& organ = organs->GetOrgan(i);
+    G4LogicalVolume* logicOrgan = lvStore->GetVolume(organ.fVolumeName);
+    organDose->AddVolume(logicOrgan, i, organ.fStatistics,
+                         organ.fExcludeDaughters);
+    SetSensitiveDetector(logicOrgan, organDose);
+  }
+}
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
+
+void DetectorConstruction::SetCrystalDX(G4double value)
+{
+  fCrystalDX = value;
+  GeometryChanged();
+}
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
+
+void DetectorConstruction::SetCrystalDY(G4double value)
+{
+  fCrystalDY = value;
+  GeometryChanged();
+}
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
+
+void DetectorConstruction::SetCrystalDZ(G4double value)
+{
+  fCrystalDZ = value;
+  GeometryChanged();
+}
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
+
+void DetectorConstruction::SetNbCrystals(G4int value)
+{
+  fNbCrystals = value;
+  GeometryChanged();
+}
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
+
+void DetectorConstruction::SetNbRings(G4int value)
+{
+  fNbRings = value;
+  GeometryChanged();
+}
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
+
+void DetectorConstruction::SetGap(G4double value)
+{
+  fGap = value;
+  GeometryChanged();
+}
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
+
+void DetectorConstruction::SetCrystalMaterial(const G4String& name)
+{
+  // short names of the usual PET scintillators
+  G4String material = name;
+  if (name == "LSO")      material = "Lu2SiO5";
+  else if (name == "BGO") material = "G4_BGO";
+
+  if (G4NistManager::Instance()->FindOrBuildMaterial(material) == nullptr) {
+    G4ExceptionDescription msg;
+    msg << "Unknown crystal material " << name
+        << ": the crystals stay in " << fCrystalMaterial << ".";
+    G4Exception("DetectorConstruction::SetCrystalMaterial()", "B3Detector001",
+                JustWarning, msg);
+    // through the command, its caller (a macro, the sweep) sees the failure
+    if (fMaterialCommand) {
+      fMaterialCommand->CommandFailed(fParameterOutOfCandidates, msg);
+    }
+    return;
+  }
+
+  fCrystalMaterial = material;
+  GeometryChanged();
+}
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
+
+void DetectorConstruction::SetOverlapMode(const G4String& mode)
+{
+  if (mode == "none")     fOverlapMode = kOverlapNone;
+  else if (mode == "all") fOverlapMode = kOverlapAll;
+  else                    fOverlapMode = kOverlapNew;
+}
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
+
+void DetectorConstruction::SetAnalyticSolids(G4bool value)
+{
+  fAnalyticSolids = value;
+  GeometryChanged();
+}
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
+
+void DetectorConstruction::SetNestedHead(G4bool value)
+{
+  fNestedHead = value;
+  GeometryChanged();
+}
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
+
+G4double DetectorConstruction::GetRingRadius() const
+{
+  // the crystals touch along their inner face
+  return 0.5*fCrystalDY/std::tan(pi/fNbCrystals);
+}
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
+
+G4bool DetectorConstruction::FitsPhantom() const
+{
+  return GetRingRadius() > 0.5*std::max(fPhantomSize.x(), fPhantomSize.y());
+}
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
+
+void DetectorConstruction::FitWorld(G4Box* solidWorld, G4double ringRadius,
+                                    G4double worldXY, G4double worldZ) const
+{
+  // the crystals must stay outside the phantom, whatever the scanner
+  G4double phantomRadius = 0.5*std::max(fPhantomSize.x(), fPhantomSize.y());
+  if (ringRadius <= phantomRadius) {
+    G4ExceptionDescription msg;
+    msg << "The inner radius of the rings, " << ringRadius/cm
+        << " cm, is inside the phantom, which extends to " << phantomRadius/cm
+        << " cm: more crystals per ring or wider crystals are needed.";
+    G4Exception("DetectorConstruction::FitWorld()", "B3Detector002",
+                FatalException, msg);
+  }
+
+  // the world encloses the detector and the phantom, with the same margin
+  solidWorld->SetXHalfLength(0.5*std::max(worldXY, 1.2*fPhantomSize.x()));
+  solidWorld->SetYHalfLength(0.5*std::max(worldXY, 1.2*fPhantomSize.y()));
+  solidWorld->SetZHalfLength(0.5*std::max(worldZ, 1.2*fPhantomSize.z()));
+}
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
+
+void DetectorConstruction::GeometryChanged()
+{
+  // before /run/initialize, Construct() simply takes the new values;
+  // afterwards the geometry is rebuilt at the next run, on all the threads
+  // (the same as /run/reinitializeGeometry). The physics tables are kept,
+  // only those of a new material are added.
+  if (G4StateManager::GetStateManager()->GetCurrentState() != G4State_PreInit)
+    G4RunManager::GetRunManager()->ReinitializeGeometry();
+}
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
+
+void DetectorConstruction::DefineCommands()
+{
+  fMessenger = new G4GenericMessenger(this, "/B3/detector/",
+                                      "Scanner geometry");
+
+  // the detector construction is shared: the commands act on the master
+  // only, which propagates the geometry change to the workers
+  fMessenger->DeclareMethodWithUnit("crystalDX", "cm",
+                                    &DetectorConstruction::SetCrystalDX,
+                                    "Crystal size along the scanner axis.")
+    .SetParameterName("dX", false)
+    .SetRange("dX>0.")
+    .SetToBeBroadcasted(false);
+
+  fMessenger->DeclareMethodWithUnit("crystalDY", "cm",
+                                    &DetectorConstruction::SetCrystalDY,
+                                    "Crystal size along the ring.")
+    .SetParameterName("dY", false)
+    .SetRange("dY>0.")
+    .SetToBeBroadcasted(false);
+
+  fMessenger->DeclareMethodWithUnit("crystalDZ", "cm",
+                                    &DetectorConstruction::SetCrystalDZ,
+                                    "Crystal depth, along the radius.")
+    .SetParameterName("dZ", false)
+    .SetRange("dZ>0.")
+    .SetToBeBroadcasted(false);
+
+  fMessenger->DeclareMethod("nbCrystals", &DetectorConstruction::SetNbCrystals,
+                            "Number of crystals per ring.")
+    .SetParameterName("nb", false)
+    .SetRange("nb>=3")
+    .SetToBeBroadcasted(false);
+
+  fMessenger->DeclareMethod("nbRings", &DetectorConstruction::SetNbRings,
+                            "Number of rings.")
+    .SetParameterName("nb", false)
+    .SetRange("nb>=1")
+    .SetToBeBroadcasted(false);
+
+  fMessenger->DeclareMethodWithUnit("gap", "mm", &DetectorConstruction::SetGap,
+                                    "Wrapping gap between the crystals.")
+    .SetParameterName("gap", false)
+    .SetRange("gap>=0.")
+    .SetToBeBroadcasted(false);
+
+  fMaterialCommand =
+    fMessenger->DeclareMethod("material", &DetectorConstruction::SetCrystalMaterial,
+                              "Crystal material: LSO, LYSO, BGO, LFS, GSO or any"
+                              " material name.")
+      .SetParameterName("material", false)
+      .SetToBeBroadcasted(false)
+      .command;
+
+  fMessenger->DeclareMethod("checkOverlaps", &DetectorConstruction::SetOverlapMode,
+                            "Check the overlaps of no placement, of the new"
+                            " ones (not in the cache) or of all of them.")
+    .SetParameterName("mode", false)
+    .SetCandidates("none new all")
+    .SetToBeBroadcasted(false);
+
+  fMessenger->DeclareProperty("overlapCache", fOverlapCache,
+                              "File of the placements found free of overlaps.")
+    .SetToBeBroadcasted(false);
+
+  fMessenger->DeclareMethod("analyticSolids",
+                            &DetectorConstruction::SetAnalyticSolids,
+                            "Build the skull of the flat head as one analytic"
+                            " solid rather than as a Boolean solid.")
+    .SetParameterName("analytic", true)
+    .SetDefaultValue("true")
+    .SetToBeBroadcasted(false);
+
+  fMessenger->DeclareMethod("nestedHead", &DetectorConstruction::SetNestedHead,
+                            "Place the brain inside the skull, in its cavity,"
+                            " rather than beside it in the world, centred on"
+                            " the origin as the skull.")
+    .SetParameterName("nested", true)
+    .SetDefaultValue("true")
+    .SetToBeBroadcasted(false);
 }
 
 //....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
@@ -0,0 +1,225 @@
+//
+// ********************************************************************
+// * License and Disclaimer                                           *
+// *                                                                  *
+// * The  Geant4 software  is  copyright of the Copyright Holders  of *
+// * the Geant4 Collaboration.  It is provided  under  the terms  and *
+// * conditions of the Geant4 Software License,  included in the file *
+// * LICENSE and available at  http://cern.ch/geant4/license .  These *
+// * include a list of copyright holders.                             *
+// *                                                                  *
+// * Neither the authors of this software system, nor their employing *
+// * institutes,nor the agencies providing financial support for this *
+// * work  make  any representation or  warranty, express or implied, *
+// * regarding  this  software system or assume any liability for its *
+// * use.  Please see the license in the file  LICENSE  and URL above *
+// * for the full disclaimer and the limitation of liability.         *
+// *                                                                  *
+// * This  code  implementation is the result of  the  scientific and *
+// * technical work of the GEANT4 collaboration.                      *
+// * By using,  copying,  modifying or  distributing the software (or *
+// * any work based  on the software)  you  agree  to acknowledge its *
+// * use  in  resulting  scientific  publications,  and indicate your *
+// * acceptance of all terms of the Geant4 Software license.          *
+// ********************************************************************
+//
+/// \file DoseVolumeHistogram.cc
+/// \brief Implementation of the B3b::DoseVolumeHistogram class
+
+#include "DoseVolumeHistogram.hh"
+#include "DoseGrid.hh"
+#include "OrganRegistry.hh"
+
+#include "G4SystemOfUnits.hh"
+
+#include <algorithm>
+#include <cmath>
+#include <fstream>
+#include <functional>
+#include <thread>
+
+namespace
+{
+  const G4double kNbDecades = 18.;          // from 1e-15 Gy to 1e3 Gy
+
+  // below this number of voxels a plain loop beats spawning threads
+  const std::size_t kParallelFillSize = std::size_t(1) << 20;
+}
+
+namespace B3b
+{
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
+
+DoseVolumeHistogram::DoseVolumeHistogram(const std::vector<std::uint8_t>& labels,
+                                         G4int nbOrgans, G4double voxelVolume,
+                                         const DvhParameters& parameters)
+ : fLabels(labels), fNbOrgans(nbOrgans), fVoxelVolume(voxelVolume),
+   fParameters(parameters)
+{
+  fParameters.fBinsPerDecade = std::max(1, fParameters.fBinsPerDecade);
+  fNbBins = 1 + G4int(kNbDecades)*fParameters.fBinsPerDecade;
+  fMinDose = 1.e-15*gray;
+  fCounts.resize(std::size_t(fNbOrgans)*fNbBins, 0);
+}
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
+
+G4int DoseVolumeHistogram::Bin(G4double dose) const
+{
+  if (dose < fMinDose) return 0;
+  G4int bin = 1 + G4int(std::log10(dose/fMinDose)*fParameters.fBinsPerDecade);
+  return std::min(bin, fNbBins - 1);
+}
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
+
+G4double DoseVolumeHistogram::GetBinLowEdge(G4int bin) const
+{
+  if (bin == 0) return 0.;
+  return fMinDose*std::pow(10., G4double(bin - 1)/fParameters.fBinsPerDecade);
+}
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
+
+void DoseVolumeHistogram::Fill(const DoseGrid& grid)
+{
+  // one histogram per thread over a contiguous range of voxels
+  auto fillRange = [this, &grid](std::size_t first, std::size_t last,
+                                 std::vector<G4long>& counts) {
+    counts.assign(fCounts.size(), 0);
+    const std::uint8_t* labels = fLabels.data();
+    for (std::size_t voxel = first; voxel < last; voxel++) {
+      if (labels[voxel] >= fNbOrgans) continue;
+      counts[std::size_t(labels[voxel])*fNbBins + Bin(grid.GetDose(voxel))]++;
+    }
+  };
+
+  std::size_t size = std::min(fLabels.size(), grid.GetNbVoxels());
+  std::size_t nbThreads = std::min<std::size_t>(
+    std::max(1u, std::thread::hardware_concurrency()), size/kParallelFillSize);
+  nbThreads = std::max<std::size_t>(1, nbThreads);
+  std::vector<std::vector<G4long>> partial(nbThreads);
+  std::vector<std::thread> threads;
+  std::size_t chunk = (size + nbThreads - 1)/nbThreads;
+  for (std::size_t t = 1; t < nbThreads; t++) {
+    threads.emplace_back(fillRange, t*chunk, std::min((t + 1)*chunk, size),
+                         std::ref(partial[t]));
+  }
+  fillRange(0, std::min(chunk, size), partial[0]);
+  for (std::thread& thread : threads) thread.join();
+
+  std::fill(fCounts.begin(), fCounts.end(), 0);
+  for (const auto& counts : partial) {
+    for (std::size_t i = 0; i < fCounts.size(); i++) fCounts[i] += counts[i];
+  }
+}
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
+
+void DoseVolumeHistogram::Update(DoseGrid& grid)
+{
+  grid.TakeChanges(fChanges);
+  if (fChanges.empty()) return;
+
+  // a voxel may have changed several times: its first entry holds the
+  // dose it was binned with
+  std::stable_sort(fChanges.begin(), fChanges.end(),
+                   [](const auto& a, const auto& b) { return a.first < b.first; });
+  for (std::size_t i = 0; i < fChanges.size(); i++) {
+    std::size_t voxel = fChanges[i].first;
+    if (i > 0 && voxel == fChanges[i-1].first) continue;
+    if (fLabels[voxel] >= fNbOrgans) continue;
+    G4int before = Bin(fChanges[i].second), now = Bin(grid.GetDose(voxel));
+    if (before == now) continue;
+    G4long* counts = &fCounts[std::size_t(fLabels[voxel])*fNbBins];
+    counts[before]--;
+    counts[now]++;
+  }
+}
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
+
+void DoseVolumeHistogram::SetCheckpointFile(const G4String& fileName,
+                                            G4long nbRunEvents)
+{
+  fCheckpointFile = fileName;
+  fNbEvents = 0;
+  fNbRunEvents = nbRunEvents;
+  std::ofstream file(fileName);
+  file << "thread_events,run_events,organ,dose_Gy,volume_cm3,fraction\n";
+}
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
+
+void DoseVolumeHistogram::EndOfEvent(DoseGrid& grid)
+{
+  fNbEvents++;
+  if (fParameters.fCheckpoint <= 0 || fNbEvents%fParameters.fCheckpoint != 0) {
+    return;
+  }
+  Update(grid);
+  if (fCheckpointFile.empty()) return;
+
+  // the dose of the thread, projected to the events of the whole run
+  std::ofstream file(fCheckpointFile, std::ios::app);
+  G4double scale =
+    fNbRunEvents > fNbEvents ? G4double(fNbRunEvents)/fNbEvents : 1.;
+  WriteRows(file, std::to_string(fNbEvents) + ","
+                  + std::to_string(std::max(fNbRunEvents, fNbEvents)) + ",",
+            scale);
+}
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
+
+G4bool DoseVolumeHistogram::Write(const G4String& fileName, G4long nbEvents,
+                                  G4bool append) const
+{
+  std::ofstream file(fileName, append ? std::ios::app : std::ios::trunc);
+  if (!file) {
+    G4ExceptionDescription msg;
+    msg << "Cannot write the dose-volume histograms to " << fileName;
+    G4Exception("DoseVolumeHistogram::Write()", "B3bDVH001", JustWarning, msg);
+    return false;
+  }
+  if (!append) file << "events,organ,dose_Gy,volume_cm3,fraction\n";
+  WriteRows(file, std::to_string(nbEvents) + ",", 1.);
+  return bool(file);
+}
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
+
+void DoseVolumeHistogram::WriteRows(std::ostream& file, const G4String& prefix,
+                                    G4double doseScale) const
+{
+  const B3::OrganRegistry* organs = B3::OrganRegistry::Instance();
+  for (G4int organ = 0; organ < fNbOrgans; organ++) {
+    const G4long* counts = &fCounts[std::size_t(organ)*fNbBins];
+    G4long total = 0;
+    G4int first = fNbBins, last = 0;
+    for (G4int bin = 0; bin < fNbBins; bin++) {
+      total += counts[bin];
+      if (counts[bin] > 0 && bin > 0) {
+        first = std::min(first, bin);
+        last = bin;
+      }
+    }
+    if (total == 0) continue;
+
+    // cumulative: volume receiving at least the lower edge of the bin, from
+    // zero dose then from the lowest dose scored up to the first empty bin
+    // above the maximum
+    const G4String& name = organs->GetOrgan(organ).fScorerName;
+    G4long above = total;
+    for (G4int bin = 0; bin <= std::min(last + 1, fNbBins - 1); bin++) {
+      if (bin > 0 && bin < first) continue;
+      file << prefix << name << ',' << doseScale*GetBinLowEdge(bin)/gray << ','
+           << above*fVoxelVolume/cm3 << ',' << G4double(above)/total << '\n';
+      above -= counts[bin];
+    }
+  }
+}
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
+
+}
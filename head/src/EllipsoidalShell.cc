@@ -0,0 +1,474 @@
+//
+// ********************************************************************
+// * License and Disclaimer                                           *
+// *                                                                  *
+// * The  Geant4 software  is  copyright of the Copyright Holders  of *
+// * the Geant4 Collaboration.  It is provided  under  the terms  and *
+// * conditions of the Geant4 Software License,  included in the file *
+// * LICENSE and available at  http://cern.ch/geant4/license .  These *
+// * include a list of copyright holders.                             *
+// *                                                                  *
+// * Neither the authors of this software system, nor their employing *
+// * institutes,nor the agencies providing financial support for this *
+// * work  make  any representation or  warranty, express or implied, *
+// * regarding  this  software system or assume any liability for its *
+// * use.  Please see the license in the file  LICENSE  and URL above *
+// * for the full disclaimer and the limitation of liability.         *
+// *                                                                  *
+// * This  code  implementation is the result of  the  scientific and *
+// * technical work of the GEANT4 collaboration.                      *
+// * By using,  copying,  modifying or  distributing the software (or *
+// * any work based  on the software)  you  agree  to acknowledge its *
+// * use  in  resulting  scientific  publications,  and indicate your *
+// * acceptance of all terms of the Geant4 Software license.          *
+// ********************************************************************
+/// \file EllipsoidalShell.cc
+/// \brief Implementation of the B3::EllipsoidalShell class
+
+#include "EllipsoidalShell.hh"
+
+#include "G4Ellipsoid.hh"
+#include "G4SubtractionSolid.hh"
+#include "G4BoundingEnvelope.hh"
+#include "G4VGraphicsScene.hh"
+#include "G4Polyhedron.hh"
+#include "G4QuickRand.hh"
+#include "G4AutoLock.hh"
+#include "G4PhysicalConstants.hh"
+#include "G4SystemOfUnits.hh"
+
+#include <algorithm>
+#include <cmath>
+
+namespace
+{
+  G4Mutex polyhedronMutex = G4MUTEX_INITIALIZER;
+}
+
+namespace B3
+{
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
+
+G4double EllipsoidalShell::Ellipsoid::ScaledRadius(const G4ThreeVector& p) const
+{
+  G4double x = (p.x() - fCentre.x())/fSemiAxes.x();
+  G4double y = (p.y() - fCentre.y())/fSemiAxes.y();
+  G4double z = (p.z() - fCentre.z())/fSemiAxes.z();
+  return std::sqrt(x*x + y*y + z*z);
+}
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
+
+G4double EllipsoidalShell::Ellipsoid::Distance(const G4ThreeVector& p) const
+{
+  // F/|grad F|, exact to first order near the surface
+  G4double x = (p.x() - fCentre.x())/fSemiAxes.x();
+  G4double y = (p.y() - fCentre.y())/fSemiAxes.y();
+  G4double z = (p.z() - fCentre.z())/fSemiAxes.z();
+  G4double f = x*x + y*y + z*z - 1.;
+  G4double gx = x/fSemiAxes.x(), gy = y/fSemiAxes.y(), gz = z/fSemiAxes.z();
+  G4double gradient = 2.*std::sqrt(gx*gx + gy*gy + gz*gz);
+  return gradient > 0. ? f/gradient : -fMinAxis;
+}
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
+
+G4ThreeVector EllipsoidalShell::Ellipsoid::Normal(const G4ThreeVector& p) const
+{
+  G4ThreeVector normal(
+    (p.x() - fCentre.x())/(fSemiAxes.x()*fSemiAxes.x()),
+    (p.y() - fCentre.y())/(fSemiAxes.y()*fSemiAxes.y()),
+    (p.z() - fCentre.z())/(fSemiAxes.z()*fSemiAxes.z()));
+  G4double mag = normal.mag();
+  return mag > 0. ? normal/mag : G4ThreeVector(0., 0., 1.);
+}
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
+
+G4bool EllipsoidalShell::Ellipsoid::Chord(const G4ThreeVector& p,
+                                          const G4ThreeVector& v,
+                                          G4double& t1, G4double& t2) const
+{
+  // |P + t V|^2 = 1 in the frame of the unit sphere
+  G4double px = (p.x() - fCentre.x())/fSemiAxes.x();
+  G4double py = (p.y() - fCentre.y())/fSemiAxes.y();
+  G4double pz = (p.z() - fCentre.z())/fSemiAxes.z();
+  G4double vx = v.x()/fSemiAxes.x(), vy = v.y()/fSemiAxes.y();
+  G4double vz = v.z()/fSemiAxes.z();
+  G4double a = vx*vx + vy*vy + vz*vz;
+  G4double b = px*vx + py*vy + pz*vz;
+  G4double c = px*px + py*py + pz*pz - 1.;
+  G4double discriminant = b*b - a*c;
+  if (discriminant <= 0.) return false;
+
+  // roots without cancellation
+  G4double q = -(b + std::copysign(std::sqrt(discriminant), b));
+  t1 = std::min(q/a, c/q);
+  t2 = std::max(q/a, c/q);
+  return true;
+}
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
+
+G4double EllipsoidalShell::Ellipsoid::Area() const
+{
+  const G4double k = 1.6075;
+  G4double ab = std::pow(fSemiAxes.x()*fSemiAxes.y(), k);
+  G4double ac = std::pow(fSemiAxes.x()*fSemiAxes.z(), k);
+  G4double bc = std::pow(fSemiAxes.y()*fSemiAxes.z(), k);
+  return 4.*pi*std::pow((ab + ac + bc)/3., 1./k);
+}
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
+
+G4ThreeVector EllipsoidalShell::Ellipsoid::PointOnSurface() const
+{
+  // a point of the unit sphere, mapped onto the ellipsoid and kept with the
+  // probability of the stretching of the area there
+  G4double a = fSemiAxes.x(), b = fSemiAxes.y(), c = fSemiAxes.z();
+  G4double maxStretch = std::max({ a*b, a*c, b*c });
+  for (;;) {
+    G4double cost = 2.*G4QuickRand() - 1.;
+    G4double sint = std::sqrt((1. - cost)*(1. + cost));
+    G4double phi = twopi*G4QuickRand();
+    G4double ux = sint*std::cos(phi), uy = sint*std::sin(phi), uz = cost;
+    G4double stretch = std::sqrt(b*c*ux*b*c*ux + a*c*uy*a*c*uy + a*b*uz*a*b*uz);
+    if (maxStretch*G4QuickRand() <= stretch)
+      return fCentre + G4ThreeVector(a*ux, b*uy, c*uz);
+  }
+}
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
+
+EllipsoidalShell::EllipsoidalShell(const G4String& name,
+                                   const G4ThreeVector& outer,
+                                   const G4ThreeVector& inner,
+                                   const G4ThreeVector& cavityCentre)
+ : G4VSolid(name)
+{
+  fOuter.fSemiAxes = outer;
+  fOuter.fMinAxis = std::min({ outer.x(), outer.y(), outer.z() });
+  fInner.fSemiAxes = inner;
+  fInner.fCentre = cavityCentre;
+  fInner.fMinAxis = std::min({ inner.x(), inner.y(), inner.z() });
+  fHalfTolerance = 0.5*kCarTolerance;
+
+  // the whole cavity surface has to lie inside the outer ellipsoid
+  G4bool valid = fOuter.fMinAxis > 0. && fInner.fMinAxis > 0.
+                 && MaxOuterQuadric() < 1.;
+  if (!valid) {
+    G4ExceptionDescription msg;
+    msg << "Invalid shell " << name << ": semi-axes " << outer/mm
+        << " mm, cavity of semi-axes " << inner/mm << " mm at "
+        << cavityCentre/mm << " mm.";
+    G4Exception("EllipsoidalShell::EllipsoidalShell()", "B3EllipsoidalShell001",
+                FatalErrorInArgument, msg);
+  }
+}
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
+
+G4double EllipsoidalShell::MaxOuterQuadric() const
+{
+  // the cavity surface is c + b*u with |u| = 1, where the outer quadric
+  // sum ((c_i + b_i u_i)/a_i)^2 is u.D.u + 2 e.u + k, D diagonal. From the
+  // Lagrange condition, its maximum is k plus the minimum, for lambda above
+  // the largest d_i, of the convex h = lambda + sum e_i^2/(lambda - d_i):
+  // the root of its slope is bisected, approached from above.
+  G4double d[3], e[3], k = 0., dMax = 0., eNorm2 = 0.;
+  for (G4int axis = 0; axis < 3; axis++) {
+    G4double a = fOuter.fSemiAxes[axis], b = fInner.fSemiAxes[axis];
+    G4double c = fInner.fCentre[axis];
+    d[axis] = b*b/(a*a);
+    e[axis] = c*b/(a*a);
+    k += c*c/(a*a);
+    dMax = std::max(dMax, d[axis]);
+    eNorm2 += e[axis]*e[axis];
+  }
+  auto h = [&](G4double lambda, G4double& slope) {
+    G4double value = lambda;
+    slope = 1.;
+    for (G4int axis = 0; axis < 3; axis++) {
+      if (e[axis] == 0.) continue;
+      G4double inverse = 1./(lambda - d[axis]);
+      value += e[axis]*e[axis]*inverse;
+      slope -= e[axis]*e[axis]*inverse*inverse;
+    }
+    return value;
+  };
+  // the slope is positive from dMax + |e| on
+  G4double low = dMax, high = dMax + std::sqrt(eNorm2) + 1., slope;
+  for (G4int i = 0; i < 100; i++) {
+    G4double middle = 0.5*(low + high);
+    h(middle, slope);
+    if (slope < 0.) low = middle;
+    else high = middle;
+  }
+  return k + h(high, slope);
+}
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
+
+EllipsoidalShell::EllipsoidalShell(const EllipsoidalShell& other)
+ : G4VSolid(other), fOuter(other.fOuter), fInner(other.fInner),
+   fHalfTolerance(other.fHalfTolerance)
+{ }
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
+
+EllipsoidalShell::~EllipsoidalShell()
+{
+  delete fpPolyhedron;
+}
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
+
+EInside EllipsoidalShell::Inside(const G4ThreeVector& p) const
+{
+  const G4ThreeVector& axes = fOuter.fSemiAxes;
+  if (std::abs(p.x()) > axes.x() + fHalfTolerance ||
+      std::abs(p.y()) > axes.y() + fHalfTolerance ||
+      std::abs(p.z()) > axes.z() + fHalfTolerance) return kOutside;
+
+  G4double distance = std::max(fOuter.Distance(p), -fInner.Distance(p));
+  if (distance > fHalfTolerance) return kOutside;
+  return distance < -fHalfTolerance ? kInside : kSurface;
+}
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
+
+G4ThreeVector EllipsoidalShell::SurfaceNormal(const G4ThreeVector& p) const
+{
+  // the two surfaces never meet: the nearer one
+  if (std::abs(fOuter.Distance(p)) <= std::abs(fInner.Distance(p)))
+    return fOuter.Normal(p);
+  return -fInner.Normal(p);
+}
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
+
+G4bool EllipsoidalShell::HitsBoundingBox(const G4ThreeVector& p,
+                                         const G4ThreeVector& v) const
+{
+  G4double tMin = 0., tMax = kInfinity;
+  for (G4int axis = 0; axis < 3; axis++) {
+    G4double half = fOuter.fSemiAxes[axis] + fHalfTolerance;
+    if (v[axis] == 0.) {
+      if (std::abs(p[axis]) > half) return false;
+      continue;
+    }
+    G4double t1 = (-half - p[axis])/v[axis], t2 = (half - p[axis])/v[axis];
+    tMin = std::max(tMin, std::min(t1, t2));
+    tMax = std::min(tMax, std::max(t1, t2));
+    if (tMax < tMin) return false;
+  }
+  return true;
+}
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
+
+G4double EllipsoidalShell::DistanceToIn(const G4ThreeVector& p,
+                                        const G4ThreeVector& v) const
+{
+  if (!HitsBoundingBox(p, v)) return kInfinity;
+
+  G4double out1, out2;
+  if (!fOuter.Chord(p, v, out1, out2) || out2 <= fHalfTolerance) return kInfinity;
+
+  // the chord of the outer ellipsoid, before and after the cavity
+  G4double pieces[2][2] = { { out1, out2 }, { kInfinity, kInfinity } };
+  G4double cavity1, cavity2;
+  if (fInner.Chord(p, v, cavity1, cavity2) && cavity2 > out1 && cavity1 < out2) {
+    pieces[0][1] = cavity1;
+    pieces[1][0] = cavity2;
+    pieces[1][1] = out2;
+  }
+  for (const auto& piece : pieces) {
+    // behind the point, or only grazing the surface
+    if (piece[1] <= fHalfTolerance || piece[1] - piece[0] <= fHalfTolerance) continue;
+    return piece[0] > fHalfTolerance ? piece[0] : 0.;
+  }
+  return kInfinity;
+}
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
+
+G4double EllipsoidalShell::DistanceToIn(const G4ThreeVector& p) const
+{
+  // outside the bounding box or the outer ellipsoid
+  const G4ThreeVector& axes = fOuter.fSemiAxes;
+  G4double box = std::max({ std::abs(p.x()) - axes.x(), std::abs(p.y()) - axes.y(),
+                            std::abs(p.z()) - axes.z() });
+  G4double outside = std::max(box, fOuter.fMinAxis*(fOuter.ScaledRadius(p) - 1.));
+  if (outside > 0.) return outside;
+
+  // in the cavity
+  return std::max(fInner.fMinAxis*(1. - fInner.ScaledRadius(p)), 0.);
+}
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
+
+G4double EllipsoidalShell::DistanceToOut(const G4ThreeVector& p,
+                                         const G4ThreeVector& v,
+                                         const G4bool calcNorm,
+                                         G4bool* validNorm,
+                                         G4ThreeVector* n) const
+{
+  G4double out1, out2;
+  if (fOuter.Chord(p, v, out1, out2) &&
+      out1 <= fHalfTolerance && out2 > -fHalfTolerance) {
+    // into the cavity if it is ahead, else through the outer surface
+    G4double cavity1, cavity2;
+    if (fInner.Chord(p, v, cavity1, cavity2) &&
+        cavity1 > -fHalfTolerance && cavity1 < out2) {
+      G4double distance = std::max(cavity1, 0.);
+      if (calcNorm) {
+        *validNorm = false;
+        *n = -fInner.Normal(p + distance*v);
+      }
+      return distance;
+    }
+    G4double distance = std::max(out2, 0.);
+    if (calcNorm) {
+      // the shell is inside the outer ellipsoid, which is convex
+      *validNorm = true;
+      *n = fOuter.Normal(p + distance*v);
+    }
+    return distance;
+  }
+
+  // the point is not inside
+  if (calcNorm) {
+    *validNorm = false;
+    *n = SurfaceNormal(p);
+  }
+  return 0.;
+}
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
+
+G4double EllipsoidalShell::DistanceToOut(const G4ThreeVector& p) const
+{
+  G4double safety = std::min(fOuter.fMinAxis*(1. - fOuter.ScaledRadius(p)),
+                             fInner.fMinAxis*(fInner.ScaledRadius(p) - 1.));
+  return std::max(safety, 0.);
+}
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
+
+void EllipsoidalShell::BoundingLimits(G4ThreeVector& pMin,
+                                      G4ThreeVector& pMax) const
+{
+  pMin = -fOuter.fSemiAxes;
+  pMax =  fOuter.fSemiAxes;
+}
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
+
+G4bool EllipsoidalShell::CalculateExtent(const EAxis pAxis,
+                                         const G4VoxelLimits& pVoxelLimit,
+                                         const G4AffineTransform& pTransform,
+                                         G4double& pMin, G4double& pMax) const
+{
+  G4ThreeVector bmin, bmax;
+  BoundingLimits(bmin, bmax);
+  G4BoundingEnvelope bbox(bmin, bmax);
+  return bbox.CalculateExtent(pAxis, pVoxelLimit, pTransform, pMin, pMax);
+}
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
+
+G4double EllipsoidalShell::GetCubicVolume()
+{
+  const G4ThreeVector& outer = fOuter.fSemiAxes;
+  const G4ThreeVector& inner = fInner.fSemiAxes;
+  return 4.*pi/3.*(outer.x()*outer.y()*outer.z() - inner.x()*inner.y()*inner.z());
+}
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
+
+G4double EllipsoidalShell::GetSurfaceArea()
+{
+  return fOuter.Area() + fInner.Area();
+}
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
+
+G4ThreeVector EllipsoidalShell::GetPointOnSurface() const
+{
+  G4double outer = fOuter.Area();
+  if ((outer + fInner.Area())*G4QuickRand() < outer) return fOuter.PointOnSurface();
+  return fInner.PointOnSurface();
+}
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
+
+G4GeometryType EllipsoidalShell::GetEntityType() const
+{
+  return G4String("EllipsoidalShell");
+}
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
+
+G4VSolid* EllipsoidalShell::Clone() const
+{
+  return new EllipsoidalShell(*this);
+}
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
+
+std::ostream& EllipsoidalShell::StreamInfo(std::ostream& os) const
+{
+  std::streamsize oldPrecision = os.precision(16);
+  os << "-----------------------------------------------------------\n"
+     << "    *** Dump for solid - " << GetName() << " ***\n"
+     << "    ===================================================\n"
+     << " Solid type: " << GetEntityType() << "\n"
+     << " Parameters: \n"
+     << "    outer semi-axes: " << fOuter.fSemiAxes/mm << " mm \n"
+     << "    inner semi-axes: " << fInner.fSemiAxes/mm << " mm \n"
+     << "    cavity centre: " << fInner.fCentre/mm << " mm \n"
+     << "-----------------------------------------------------------\n";
+  os.precision(oldPrecision);
+  return os;
+}
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
+
+void EllipsoidalShell::DescribeYourselfTo(G4VGraphicsScene& scene) const
+{
+  scene.AddSolid(*this);
+}
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
+
+G4Polyhedron* EllipsoidalShell::CreatePolyhedron() const
+{
+  // drawn as the equivalent Boolean solid
+  const G4ThreeVector& outer = fOuter.fSemiAxes;
+  const G4ThreeVector& inner = fInner.fSemiAxes;
+  G4Ellipsoid outside("outside", outer.x(), outer.y(), outer.z());
+  G4Ellipsoid cavity("cavity", inner.x(), inner.y(), inner.z());
+  G4SubtractionSolid shell(GetName(), &outside, &cavity, nullptr, fInner.fCentre);
+  return shell.CreatePolyhedron();
+}
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
+
+G4Polyhedron* EllipsoidalShell::GetPolyhedron() const
+{
+  if (fpPolyhedron == nullptr || fRebuildPolyhedron ||
+      fpPolyhedron->GetNumberOfRotationStepsAtTimeOfCreation() !=
+      fpPolyhedron->GetNumberOfRotationSteps()) {
+    G4AutoLock lock(&polyhedronMutex);
+    delete fpPolyhedron;
+    fpPolyhedron = CreatePolyhedron();
+    fRebuildPolyhedron = false;
+  }
+  return fpPolyhedron;
+}
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
+
+}
@@ -0,0 +1,196 @@
+//
+// ********************************************************************
+// * License and Disclaimer                                           *
+// *                                                                  *
+// * The  Geant4 software  is  copyright of the Copyright Holders  of *
+// * the Geant4 Collaboration.  It is provided  under  the terms  and *
+// * conditions of the Geant4 Software License,  included in the file *
+// * LICENSE and available at  http://cern.ch/geant4/license .  These *
+// * include a list of copyright holders.                             *
+// *                                                                  *
+// * Neither the authors of this software system, nor their employing *
+// * institutes,nor the agencies providing financial support for this *
+// * work  make  any representation or  warranty, express or implied, *
+// * regarding  this  software system or assume any liability for its *
+// * use.  Please see the license in the file  LICENSE  and URL above *
+// * for the full disclaimer and the limitation of liability.         *
+// *                                                                  *
+// * This  code  implementation is the result of  the  scientific and *
+// * technical work of the GEANT4 collaboration.                      *
+// * By using,  copying,  modifying or  distributing the software (or *
+// * any work based  on the software)  you  agree  to acknowledge its *
+// * use  in  resulting  scientific  publications,  and indicate your *
+// * acceptance of all terms of the Geant4 Software license.          *
+// ********************************************************************
+//
+/// \file ListModeWriter.cc
+/// \brief Implementation of the B3b::ListModeWriter class
+
+#include "ListModeWriter.hh"
+
+#include <chrono>
+
+namespace B3b
+{
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
+
+ListModeChannel::ListModeChannel(ListModeWriter* writer)
+ : fWriter(writer)
+{
+  fBlocks[0].fRecords.resize(kBlockSize);
+  fBlocks[1].fRecords.resize(kBlockSize);
+}
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
+
+void ListModeChannel::Submit()
+{
+  ListModeBlock& full = fBlocks[fActive];
+  full.fSize = fCount;
+  full.fState.store(ListModeBlock::kFull, std::memory_order_release);
+  fWriter->Notify();
+
+  fActive ^= 1;
+  fCount = 0;
+  while (fBlocks[fActive].fState.load(std::memory_order_acquire)
+         != ListModeBlock::kFree) {
+    std::this_thread::yield();
+  }
+}
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
+
+ListModeWriter* ListModeWriter::Instance()
+{
+  static ListModeWriter instance;
+  return &instance;
+}
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
+
+ListModeWriter::~ListModeWriter()
+{
+  Close();
+}
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
+
+G4bool ListModeWriter::Open(const G4String& fileName,
+                            const ListModeHeader& header)
+{
+  if (IsOpen()) Close();
+
+  // append to an existing file of the same scanner
+  G4bool append = false;
+  if (std::FILE* existing = std::fopen(fileName.c_str(), "rb")) {
+    ListModeHeader previous;
+    std::size_t nRead = std::fread(&previous, sizeof(previous), 1, existing);
+    std::fclose(existing);
+    if (nRead == 1) {
+      if (!IsValidListModeHeader(previous) || !IsSameScanner(previous, header)) {
+        G4ExceptionDescription msg;
+        msg << "List-mode file " << fileName
+            << " exists and was written for another scanner"
+            << " or in another format: list-mode output disabled.";
+        G4Exception("ListModeWriter::Open()", "B3bListMode001",
+                    JustWarning, msg);
+        return false;
+      }
+      append = true;
+    }
+  }
+
+  fFile = std::fopen(fileName.c_str(), append ? "ab" : "wb");
+  if (!fFile) {
+    G4ExceptionDescription msg;
+    msg << "Cannot open list-mode file " << fileName
+        << ": list-mode output disabled.";
+    G4Exception("ListModeWriter::Open()", "B3bListMode002", JustWarning, msg);
+    return false;
+  }
+  if (!append) std::fwrite(&header, sizeof(header), 1, fFile);
+
+  fFileName = fileName;
+  fNbRecords = 0;
+  fStop.store(false);
+  fThread = std::thread(&ListModeWriter::WriterLoop, this);
+  fOpen.store(true, std::memory_order_release);
+
+  G4cout << "### List-mode output " << (append ? "appended to " : "written to ")
+         << fileName << G4endl;
+  return true;
+}
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
+
+void ListModeWriter::Close()
+{
+  if (!IsOpen()) return;
+  fOpen.store(false, std::memory_order_release);
+
+  // the channels have been flushed: drain them and stop
+  fStop.store(true, std::memory_order_release);
+  Notify();
+  fThread.join();
+
+  std::fclose(fFile);
+  fFile = nullptr;
+  fChannels.clear();
+
+  G4cout << "### List-mode output: " << fNbRecords << " coincidences written to "
+         << fFileName << G4endl;
+}
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
+
+ListModeChannel* ListModeWriter::CreateChannel()
+{
+  std::lock_guard<std::mutex> lock(fChannelsMutex);
+  fChannels.emplace_back(new ListModeChannel(this));
+  return fChannels.back().get();
+}
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
+
+std::size_t ListModeWriter::WriteFullBlocks()
+{
+  std::lock_guard<std::mutex> lock(fChannelsMutex);
+  std::size_t nbBlocks = 0;
+  for (auto& channel : fChannels) {
+    // both blocks may be full: the one submitted first is written first
+    while (true) {
+      ListModeBlock& block = channel->fBlocks[channel->fNextWritten];
+      if (block.fState.load(std::memory_order_acquire) != ListModeBlock::kFull)
+        break;
+      std::fwrite(block.fRecords.data(), sizeof(ListModeRecord), block.fSize,
+                  fFile);
+      fNbRecords += block.fSize;
+      block.fState.store(ListModeBlock::kFree, std::memory_order_release);
+      channel->fNextWritten ^= 1;
+      nbBlocks++;
+    }
+  }
+  return nbBlocks;
+}
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
+
+void ListModeWriter::WriterLoop()
+{
+  while (true) {
+    // read the stop flag before the pass: blocks published before the
+    // stop request are always written
+    G4bool stop = fStop.load(std::memory_order_acquire);
+    if (WriteFullBlocks() > 0) continue;
+    if (stop) break;
+
+    std::unique_lock<std::mutex> lock(fWakeMutex);
+    fWake.wait_for(lock, std::chrono::milliseconds(20));
+  }
+  std::fflush(fFile);
+}
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
+
+}
@@ -0,0 +1,129 @@
+//
+// ********************************************************************
+// * License and Disclaimer                                           *
+// *                                                                  *
+// * The  Geant4 software  is  copyright of the Copyright Holders  of *
+// * the Geant4 Collaboration.  It is provided  under  the terms  and *
+// * conditions of the Geant4 Software License,  included in the file *
+// * LICENSE and available at  http://cern.ch/geant4/license .  These *
+// * include a list of copyright holders.                             *
+// *                                                                  *
+// * Neither the authors of this software system, nor their employing *
+// * institutes,nor the agencies providing financial support for this *
+// * work  make  any representation or  warranty, express or implied, *
+// * regarding  this  software system or assume any liability for its *
+// * use.  Please see the license in the file  LICENSE  and URL above *
+// * for the full disclaimer and the limitation of liability.         *
+// *                                                                  *
+// * This  code  implementation is the result of  the  scientific and *
+// * technical work of the GEANT4 collaboration.                      *
+// * By using,  copying,  modifying or  distributing the software (or *
+// * any work based  on the software)  you  agree  to acknowledge its *
+// * use  in  resulting  scientific  publications,  and indicate your *
+// * acceptance of all terms of the Geant4 Software license.          *
+// ********************************************************************
+//
+/// \file OrganDoseSD.cc
+/// \brief Implementation of the B3::OrganDoseSD class
+
+#include "OrganDoseSD.hh"
+#include "DoseGrid.hh"
+
+#include "G4Step.hh"
+#include "G4StepPoint.hh"
+#include "G4Track.hh"
+#include "G4ParticleDefinition.hh"
+#include "G4LogicalVolume.hh"
+#include "G4VPhysicalVolume.hh"
+#include "G4VSolid.hh"
+#include "G4Material.hh"
+
+namespace B3
+{
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
+
+OrganDoseSD::OrganDoseSD(const G4String& name, G4int nbOrgans)
+ : G4VSensitiveDetector(name),
+   fEventDose(nbOrgans, 0.)
+{
+  fTouched.reserve(nbOrgans);
+}
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
+
+OrganDoseSD::~OrganDoseSD()
+{ }
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
+
+void OrganDoseSD::AddVolume(G4LogicalVolume* volume, G4int organ,
+                            G4bool statistics, G4bool excludeDaughters)
+{
+  G4int id = volume->GetInstanceID();
+  if (id >= G4int(fVolumes.size())) fVolumes.resize(id+1);
+
+  // same mass as G4PSDoseDeposit: full solid volume times density.
+  // Without the daughters, as G4LogicalVolume::GetMass() does it, but not
+  // cached in the shared volume
+  G4double cubicVolume = volume->GetSolid()->GetCubicVolume();
+  if (excludeDaughters) {
+    for (std::size_t i = 0; i < volume->GetNoDaughters(); i++) {
+      cubicVolume -=
+        volume->GetDaughter(i)->GetLogicalVolume()->GetSolid()->GetCubicVolume();
+    }
+  }
+  G4double mass = cubicVolume*volume->GetMaterial()->GetDensity();
+
+  VolumeInfo& info = fVolumes[id];
+  info.fOrgan = organ;
+  info.fInvMass = 1./mass;
+  info.fStatistics = statistics;
+}
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
+
+void OrganDoseSD::Initialize(G4HCofThisEvent*)
+{
+  for (G4int organ : fTouched) fEventDose[organ] = 0.;
+  fTouched.clear();
+}
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
+
+G4bool OrganDoseSD::ProcessHits(G4Step* step, G4TouchableHistory*)
+{
+  G4double edep = step->GetTotalEnergyDeposit();
+  if (edep <= 0.) return false;
+
+  G4StepPoint* preStep = step->GetPreStepPoint();
+  const VolumeInfo& info =
+    fVolumes[preStep->GetPhysicalVolume()->GetLogicalVolume()->GetInstanceID()];
+
+  G4double dose = edep*info.fInvMass*preStep->GetWeight();
+
+  // a Run is always bound while events are processed
+  fRunDose[info.fOrgan] += dose;
+
+  if (info.fStatistics) {
+    if (fEventDose[info.fOrgan] == 0.) fTouched.push_back(info.fOrgan);
+    fEventDose[info.fOrgan] += dose;
+  }
+
+  if (fRunDoseGrid) {
+    // a charged particle deposits along its step, a neutral one at its end;
+    // the midpoint draws no random number, the histories stay unchanged
+    G4ThreeVector position = step->GetPostStepPoint()->GetPosition();
+    if (step->GetTrack()->GetDefinition()->GetPDGCharge() != 0.) {
+      position = 0.5*(preStep->GetPosition() + position);
+    }
+    fRunDoseGrid->Deposit(position, edep*preStep->GetWeight()
+                                    /preStep->GetMaterial()->GetDensity());
+  }
+
+  return true;
+}
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
+
+}
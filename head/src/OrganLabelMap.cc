@@ -0,0 +1,163 @@
+//
+// ********************************************************************
+// * License and Disclaimer                                           *
+// *                                                                  *
+// * The  Geant4 software  is  copyright of the Copyright Holders  of *
+// * the Geant4 Collaboration.  It is provided  under  the terms  and *
+// * conditions of the Geant4 Software License,  included in the file *
+// * LICENSE and available at  http://cern.ch/geant4/license .  These *
+// * include a list of copyright holders.                             *
+// *                                                                  *
+// * Neither the authors of this software system, nor their employing *
+// * institutes,nor the agencies providing financial support for this *
+// * work  make  any representation or  warranty, express or implied, *
+// * regarding  this  software system or assume any liability for its *
+// * use.  Please see the license in the file  LICENSE  and URL above *
+// * for the full disclaimer and the limitation of liability.         *
+// *                                                                  *
+// * This  code  implementation is the result of  the  scientific and *
+// * technical work of the GEANT4 collaboration.                      *
+// * By using,  copying,  modifying or  distributing the software (or *
+// * any work based  on the software)  you  agree  to acknowledge its *
+// * use  in  resulting  scientific  publications,  and indicate your *
+// * acceptance of all terms of the Geant4 Software license.          *
+// ********************************************************************
+//
+/// \file OrganLabelMap.cc
+/// \brief Implementation of the B3::OrganLabelMap class
+
+#include "OrganLabelMap.hh"
+#include "OrganRegistry.hh"
+#include "DoseGrid.hh"
+#include "DoseVolumeHistogram.hh"
+
+#include "G4Navigator.hh"
+#include "G4TransportationManager.hh"
+#include "G4LogicalVolume.hh"
+#include "G4LogicalVolumeStore.hh"
+#include "G4VPhysicalVolume.hh"
+#include "G4ThreeVector.hh"
+
+#include <algorithm>
+
+namespace B3
+{
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
+
+OrganLabelMap* OrganLabelMap::Instance()
+{
+  static OrganLabelMap instance;
+  return &instance;
+}
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
+
+G4bool OrganLabelMap::Key::operator==(const Key& other) const
+{
+  for (G4int axis = 0; axis < 3; axis++) {
+    if (fNbBins[axis] != other.fNbBins[axis] || fMin[axis] != other.fMin[axis] ||
+        fVoxel[axis] != other.fVoxel[axis]) return false;
+  }
+  return fSamples == other.fSamples && fNbOrgans == other.fNbOrgans &&
+         fWorld == other.fWorld;
+}
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
+
+const std::vector<std::uint8_t>&
+OrganLabelMap::Build(const B3b::DoseGrid& grid, G4int samples)
+{
+  G4VPhysicalVolume* world = G4TransportationManager::GetTransportationManager()
+                               ->GetNavigatorForTracking()->GetWorldVolume();
+  const OrganRegistry* organs = OrganRegistry::Instance();
+
+  Key key;
+  for (G4int axis = 0; axis < 3; axis++) {
+    key.fNbBins[axis] = grid.GetNbBins(axis);
+    key.fMin[axis] = grid.GetMin(axis);
+    key.fVoxel[axis] = grid.GetVoxelSize(axis);
+  }
+  key.fSamples = std::max(1, samples);
+  key.fNbOrgans = organs->GetNbOrgans();
+  key.fWorld = world;
+
+  // the first thread of a run with a new grid or geometry starts a new map
+  {
+    std::lock_guard<std::mutex> lock(fMutex);
+    if (!(key == fKey)) {
+      fKey = key;
+      fLabels.assign(grid.GetNbVoxels(), B3b::DoseVolumeHistogram::kNoOrgan);
+      fOrganOfVolume.assign(G4LogicalVolumeStore::GetInstance()->size(), -1);
+      for (G4int i = 0; i < organs->GetNbOrgans(); i++) {
+        G4LogicalVolume* volume = G4LogicalVolumeStore::GetInstance()
+                                    ->GetVolume(organs->GetOrgan(i).fVolumeName);
+        if (!volume) continue;
+        std::size_t id = volume->GetInstanceID();
+        if (id >= fOrganOfVolume.size()) fOrganOfVolume.resize(id + 1, -1);
+        fOrganOfVolume[id] = i;
+      }
+      fNbDone = 0;
+      fNextSlice = 0;
+    }
+  }
+
+  // label slices until none is left, then wait for the other threads
+  const G4int nbSlices = key.fNbBins[2];
+  G4Navigator navigator;
+  navigator.SetWorldVolume(world);
+  G4int z;
+  while ((z = fNextSlice.fetch_add(1)) < nbSlices) {
+    LabelSlice(navigator, grid, z, key.fSamples);
+    std::lock_guard<std::mutex> lock(fMutex);
+    if (++fNbDone == nbSlices) fDone.notify_all();
+  }
+  std::unique_lock<std::mutex> lock(fMutex);
+  fDone.wait(lock, [this, nbSlices] { return fNbDone >= nbSlices; });
+  return fLabels;
+}
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
+
+void OrganLabelMap::LabelSlice(G4Navigator& navigator,
+                               const B3b::DoseGrid& grid, G4int z, G4int samples)
+{
+  const G4int nx = grid.GetNbBins(0), ny = grid.GetNbBins(1);
+  const G4int nbOrgans = fKey.fNbOrgans;
+  std::vector<G4int> votes(nbOrgans + 1);
+  G4bool relative = false;
+  std::uint8_t* labels = &fLabels[std::size_t(z)*nx*ny];
+
+  for (G4int y = 0; y < ny; y++) {
+    for (G4int x = 0; x < nx; x++) {
+      std::fill(votes.begin(), votes.end(), 0);
+      G4int index[3] = { x, y, z };
+      for (G4int s = 0; s < samples*samples*samples; s++) {
+        G4int sub[3] = { s%samples, (s/samples)%samples, s/(samples*samples) };
+        G4double point[3];
+        for (G4int axis = 0; axis < 3; axis++) {
+          point[axis] = grid.GetMin(axis) + grid.GetVoxelSize(axis)
+                      *(index[axis] + (sub[axis] + 0.5)/samples);
+        }
+        G4VPhysicalVolume* volume = navigator.LocateGlobalPointAndSetup(
+          G4ThreeVector(point[0], point[1], point[2]), nullptr, relative, true);
+        relative = true;
+        G4int organ = nbOrgans;
+        if (volume) {
+          std::size_t id = volume->GetLogicalVolume()->GetInstanceID();
+          if (id < fOrganOfVolume.size() && fOrganOfVolume[id] >= 0) {
+            organ = fOrganOfVolume[id];
+          }
+        }
+        votes[organ]++;
+      }
+      G4int organ = G4int(std::max_element(votes.begin(), votes.end())
+                          - votes.begin());
+      if (organ < nbOrgans) labels[std::size_t(y)*nx + x] = std::uint8_t(organ);
+    }
+  }
+}
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
+
+}
@@ -0,0 +1,69 @@
+//
+// ********************************************************************
+// * License and Disclaimer                                           *
+// *                                                                  *
+// * The  Geant4 software  is  copyright of the Copyright Holders  of *
+// * the Geant4 Collaboration.  It is provided  under  the terms  and *
+// * conditions of the Geant4 Software License,  included in the file *
+// * LICENSE and available at  http://cern.ch/geant4/license .  These *
+// * include a list of copyright holders.                             *
+// *                                                                  *
+// * Neither the authors of this software system, nor their employing *
+// * institutes,nor the agencies providing financial support for this *
+// * work  make  any representation or  warranty, express or implied, *
+// * regarding  this  software system or assume any liability for its *
+// * use.  Please see the license in the file  LICENSE  and URL above *
+// * for the full disclaimer and the limitation of liability.         *
+// *                                                                  *
+// * This  code  implementation is the result of  the  scientific and *
+// * technical work of the GEANT4 collaboration.                      *
+// * By using,  copying,  modifying or  distributing the software (or *
+// * any work based  on the software)  you  agree  to acknowledge its *
+// * use  in  resulting  scientific  publications,  and indicate your *
+// * acceptance of all terms of the Geant4 Software license.          *
+// ********************************************************************
+//
+/// \file OrganRegistry.cc
+/// \brief Implementation of the B3::OrganRegistry class
+
+#include "OrganRegistry.hh"
+
+#include "G4AutoLock.hh"
+
+namespace
+{
+  G4Mutex registryMutex = G4MUTEX_INITIALIZER;
+}
+
+namespace B3
+{
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
+
+OrganRegistry* OrganRegistry::Instance()
+{
+  static OrganRegistry instance;
+  return &instance;
+}
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
+
+G4int OrganRegistry::Register(const G4String& volumeName,
+                              const G4String& scorerName,
+                              const G4String& label,
+                              G4bool statistics,
+                              G4bool excludeDaughters)
+{
+  G4AutoLock lock(&registryMutex);
+
+  for (std::size_t i = 0; i < fOrgans.size(); i++) {
+    if (fOrgans[i].fScorerName == scorerName) return G4int(i);
+  }
+  fOrgans.push_back({volumeName, scorerName, label, statistics,
+                     excludeDaughters});
+  return G4int(fOrgans.size()) - 1;
+}
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
+
+}
@@ -0,0 +1,197 @@
+//
+// ********************************************************************
+// * License and Disclaimer                                           *
+// *                                                                  *
+// * The  Geant4 software  is  copyright of the Copyright Holders  of *
+// * the Geant4 Collaboration.  It is provided  under  the terms  and *
+// * conditions of the Geant4 Software License,  included in the file *
+// * LICENSE and available at  http://cern.ch/geant4/license .  These *
+// * include a list of copyright holders.                             *
+// *                                                                  *
+// * Neither the authors of this software system, nor their employing *
+// * institutes,nor the agencies providing financial support for this *
+// * work  make  any representation or  warranty, express or implied, *
+// * regarding  this  software system or assume any liability for its *
+// * use.  Please see the license in the file  LICENSE  and URL above *
+// * for the full disclaimer and the limitation of liability.         *
+// *                                                                  *
+// * This  code  implementation is the result of  the  scientific and *
+// * technical work of the GEANT4 collaboration.                      *
+// * By using,  copying,  modifying or  distributing the software (or *
+// * any work based  on the software)  you  agree  to acknowledge its *
+// * use  in  resulting  scientific  publications,  and indicate your *
+// * acceptance of all terms of the Geant4 Software license.          *
+// ********************************************************************
+//
+/// \file PhiloxEngine.cc
+/// \brief Implementation of the B3b::PhiloxEngine class
+
+#include "PhiloxEngine.hh"
+
+#include <fstream>
+#include <iostream>
+
+namespace B3b
+{
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
+
+PhiloxEngine::PhiloxEngine()
+{
+  setSeed(19780503L, 0);
+}
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
+
+PhiloxEngine::PhiloxEngine(long seed)
+{
+  setSeed(seed, 0);
+}
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
+
+void PhiloxEngine::Block(const std::uint32_t counter[4],
+                         const std::uint32_t key[2], std::uint32_t out[4])
+{
+  const std::uint64_t kMul0 = 0xD2511F53, kMul1 = 0xCD9E8D57;
+  const std::uint32_t kWeyl0 = 0x9E3779B9, kWeyl1 = 0xBB67AE85;
+
+  std::uint32_t c0 = counter[0], c1 = counter[1], c2 = counter[2],
+                c3 = counter[3];
+  std::uint32_t k0 = key[0], k1 = key[1];
+  for (int round = 0; round < 10; round++) {
+    std::uint64_t product0 = kMul0*c0, product1 = kMul1*c2;
+    std::uint32_t hi0 = std::uint32_t(product0 >> 32), lo0 = std::uint32_t(product0);
+    std::uint32_t hi1 = std::uint32_t(product1 >> 32), lo1 = std::uint32_t(product1);
+    c0 = hi1 ^ c1 ^ k0;
+    c1 = lo1;
+    c2 = hi0 ^ c3 ^ k1;
+    c3 = lo0;
+    k0 += kWeyl0;
+    k1 += kWeyl1;
+  }
+  out[0] = c0; out[1] = c1; out[2] = c2; out[3] = c3;
+}
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
+
+void PhiloxEngine::SetStream(std::uint64_t seed, std::uint32_t run,
+                             std::uint32_t event)
+{
+  fKey[0] = std::uint32_t(seed);
+  fKey[1] = std::uint32_t(seed >> 32);
+  fCounter[0] = 0;
+  fCounter[1] = 0;
+  fCounter[2] = event;
+  fCounter[3] = run;
+  fUsed = 4;
+}
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
+
+double PhiloxEngine::flat()
+{
+  // 53 random bits, centred in their interval: never 0 nor 1
+  std::uint64_t high = Next() >> 5, low = Next() >> 6;
+  return ((high << 26 | low) + 0.5)*(1./9007199254740992.);
+}
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
+
+void PhiloxEngine::flatArray(const int size, double* vect)
+{
+  for (int i = 0; i < size; i++) vect[i] = flat();
+}
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
+
+void PhiloxEngine::setSeed(long seed, int)
+{
+  theSeed = seed;
+  SetStream(std::uint64_t(seed), 0, 0);
+}
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
+
+void PhiloxEngine::setSeeds(const long* seeds, int)
+{
+  // two seeds make the key, as in the per-event seeding of the run managers
+  theSeeds = seeds;
+  std::uint64_t seed = std::uint32_t(seeds[0]);
+  if (seeds[0] != 0 && seeds[1] != 0) {
+    seed |= std::uint64_t(std::uint32_t(seeds[1])) << 32;
+  }
+  theSeed = seeds[0];
+  SetStream(seed, 0, 0);
+}
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
+
+std::ostream& PhiloxEngine::put(std::ostream& os) const
+{
+  os << engineName() << "-begin";
+  for (std::uint32_t word : fKey) os << " " << word;
+  for (std::uint32_t word : fCounter) os << " " << word;
+  os << " " << fUsed << " " << engineName() << "-end\n";
+  return os;
+}
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
+
+std::istream& PhiloxEngine::get(std::istream& is)
+{
+  std::string tag;
+  is >> tag;
+  if (tag != engineName() + "-begin") {
+    is.clear(std::ios::badbit | is.rdstate());
+    std::cerr << "PhiloxEngine: no " << engineName() << " state to read\n";
+    return is;
+  }
+  for (std::uint32_t& word : fKey) is >> word;
+  for (std::uint32_t& word : fCounter) is >> word;
+  is >> fUsed >> tag;
+
+  // the buffer is the block before the counter
+  if (fUsed < 4) {
+    std::uint32_t counter[4] = { fCounter[0] - 1, fCounter[1], fCounter[2],
+                                 fCounter[3] };
+    if (fCounter[0] == 0) counter[1]--;
+    Block(counter, fKey, fBuffer);
+  }
+  return is;
+}
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
+
+void PhiloxEngine::saveStatus(const char filename[]) const
+{
+  std::ofstream output(filename);
+  put(output);
+}
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
+
+void PhiloxEngine::restoreStatus(const char filename[])
+{
+  std::ifstream input(filename);
+  if (!input) {
+    std::cerr << "PhiloxEngine: cannot read " << filename << "\n";
+    return;
+  }
+  get(input);
+}
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
+
+void PhiloxEngine::showStatus() const
+{
+  std::cout << "--------- Philox engine status ---------\n"
+            << " Key     = " << fKey[0] << " " << fKey[1] << "\n"
+            << " Counter = " << fCounter[0] << " " << fCounter[1] << " "
+            << fCounter[2] << " " << fCounter[3] << "\n"
+            << "----------------------------------------\n";
+}
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
+
+}
@@ -23,111 +23,186 @@
 // * acceptance of all terms of the Geant4 Software license.          *
 // ********************************************************************
 //
-//
 /// \file Run.cc
 /// \brief Implementation of the B3b::Run class
 
 #include "Run.hh"
+#include "CrystalSD.hh"
+#include "OrganRegistry.hh"
+#include "OrganDoseSD.hh"
+#include "ListModeWriter.hh"
+#include "SinglesSorter.hh"
+#include "Sinogram.hh"
+#include "DoseGrid.hh"
+#include "DoseVolumeHistogram.hh"
+#include "ConvergenceMonitor.hh"
+#include "BatchStatistics.hh"
+#include "ThroughputMonitor.hh"
 
 #include "G4RunManager.hh"
 #include "G4Event.hh"
 
 #include "G4SDManager.hh"
-#include "G4HCofThisEvent.hh"
-#include "G4THitsMap.hh"
+#include "G4Threading.hh"
 #include "G4SystemOfUnits.hh"
 
+
 namespace B3b
 {
 
 //....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
 
-Run::Run()
-{ }
+Run::Run(const DigitizerParameters& digitizer)
+{
+  const B3::OrganRegistry* organs = B3::OrganRegistry::Instance();
+  G4int nbOrgans = organs->GetNbOrgans();
+  fSumDose.resize(nbOrgans, 0.);
+  fStatDose.resize(nbOrgans);
+
+  // the master of a multi-threaded run has no sensitive detectors:
+  // it only merges the worker runs
+  if (G4Threading::IsMultithreadedApplication() &&
+      G4Threading::IsMasterThread()) return;
+
+  // find the sensitive detectors once per run, and let the organ
+  // detector accumulate the run totals directly in this run
+  G4SDManager* sdManager = G4SDManager::GetSDMpointer();
+  fCrystalSD =
+    static_cast<B3::CrystalSD*>(sdManager->FindSensitiveDetector("crystal"));
+  fOrganSD =
+    static_cast<B3::OrganDoseSD*>(sdManager->FindSensitiveDetector("organDose"));
+  fOrganSD->SetRunDose(fSumDose.data());
+  fDigitizer = new Digitizer(digitizer, fCrystalSD->GetNbCrystals());
+
+  for (G4int i = 0; i < nbOrgans; i++) {
+    if (organs->GetOrgan(i).fStatistics) fStatOrgans.push_back(i);
+  }
+}
 
 //....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
 
 Run::~Run()
-{ }
+{
+  if (fOrganSD && fOrganSD->GetRunDose() == fSumDose.data()) {
+    fOrganSD->SetRunDose(nullptr);
+  }
+  if (fOrganSD && fOrganSD->GetRunDoseGrid() == fDoseGrid) {
+    fOrganSD->SetRunDoseGrid(nullptr);
+  }
+  delete fDigitizer;
+  delete fSinogram;
+  delete fDoseGrid;
+  delete fDvh;
+}
 
 //....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
 
-void Run::RecordEvent(const G4Event* event)
+void Run::SetDoseGrid(DoseGrid* grid)
 {
-  if ( fCollID_cryst < 0 ) {
-   fCollID_cryst
-     = G4SDManager::GetSDMpointer()->GetCollectionID("crystal/edep");
-   //G4cout << " fCollID_cryst: " << fCollID_cryst << G4endl;
-  }
+  fDoseGrid = grid;
+  if (fOrganSD) fOrganSD->SetRunDoseGrid(grid);
+}
 
-  if ( fCollID_patient < 0 ) {
-   fCollID_patient
-     = G4SDManager::GetSDMpointer()->GetCollectionID("patient/dose");
-   //G4cout << " fCollID_patient: " << fCollID_patient << G4endl;
-  }
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
 
-  if ( fCollID_skull < 0 ) {
-   fCollID_skull
-     = G4SDManager::GetSDMpointer()->GetCollectionID("skull/doseSkull");
-   //G4cout << " fCollID_patient: " << fCollID_patient << G4endl;
+std::vector<G4String> Run::GetBatchQuantities() const
+{
+  const B3::OrganRegistry* organs = B3::OrganRegistry::Instance();
+  std::vector<G4String> names;
+  for (G4int organ : fStatOrgans) {
+    names.push_back(organs->GetOrgan(organ).fScorerName + " [Gy]");
   }
+  names.push_back("good events");
+  return names;
+}
 
-  G4int evtNb = event->GetEventID();
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
 
-  if (evtNb%fPrintModulo == 0) {
-    G4cout << G4endl << "---> end of event: " << evtNb << G4endl;
-  }
+void Run::SetBatchChannel(BatchChannel* channel)
+{
+  fBatch = channel;
+  fBatchValues.assign(fStatOrgans.size() + 1, 0.);
+}
 
-  //Hits collections
-  //
-  G4HCofThisEvent* HCE = event->GetHCofThisEvent();
-  if(!HCE) return;
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
+
+void Run::RecordEvent(const G4Event* event)
+{
+  G4int evtNb = event->GetEventID();
 
-  //Energy in crystals : identify 'good events'
+  // the progress is reported by the master, from the counters
+  if (fThroughput) fThroughput->CountEvent();
+
+  //Energy in crystals : digitize the singles, identify 'good events'
   //
-  const G4double eThreshold = 500*keV;
-  G4int nbOfFired = 0;
-
-  G4THitsMap<G4double>* evtMap =
-    static_cast<G4THitsMap<G4double>*>(HCE->GetHC(fCollID_cryst));
-
-  std::map<G4int,G4double*>::iterator itr;
-  for (itr = evtMap->GetMap()->begin(); itr != evtMap->GetMap()->end(); itr++) {
-    G4double edep = *(itr->second);
-    if (edep > eThreshold) nbOfFired++;
-    ///G4int copyNb  = (itr->first);
-    ///G4cout << G4endl << "  cryst" << copyNb << ": " << edep/keV << " keV ";
+  fSingles.Clear();
+  for (G4int detID : fCrystalSD->GetFiredCrystals()) {
+    fSingles.Add(detID, fCrystalSD->GetEdep(detID), fCrystalSD->GetTime(detID),
+                 fCrystalSD->IsScattered(detID) ? kScatter : kTrue, evtNb);
+  }
+  fSingles.SortByTime();
+  if (fSorter) fSorter->PushEvent(fSingles);
+
+  // per event, dead time and pile-up only act among the singles of the
+  // event; the sorter applies them across events
+  fDigitizer->ResetState();
+  fDigitizer->Process(fSingles);
+  fNbSingles += fSingles.Size();
+  fNbPiledUp = fDigitizer->GetNbPiledUp();
+  fNbDeadTimeLost = fDigitizer->GetNbDeadTimeLost();
+
+  G4bool good = fSingles.Size() == 2;
+  if (good) {
+    fGoodEvents++;
+    // with the sorter, the coincidences are binned by the sorter
+    if (fSinogram && !fSorter) {
+      fSinogram->Fill(fSingles.fDetector[0], fSingles.fDetector[1]);
+    }
+    if (fListMode) {
+      // singles are time-ordered: first single first
+      ListModeRecord record;
+      record.fEventID   = evtNb;
+      record.fTime      = fSingles.fTime[0]/ns;
+      record.fDeltaTime = (fSingles.fTime[1] - fSingles.fTime[0])/ns;
+      record.fEnergy1   = fSingles.fEnergy[0]/keV;
+      record.fEnergy2   = fSingles.fEnergy[1]/keV;
+      record.fDetector1 = fSingles.fDetector[0];
+      record.fDetector2 = fSingles.fDetector[1];
+      record.fFlags     = fSingles.fFlags[0] | fSingles.fFlags[1];
+      fListMode->Push(record);
+    }
   }
-  if (nbOfFired == 2) fGoodEvents++;
 
-  //Dose deposit in the skull
+  //Dose deposit in the organs: the run totals are already accumulated
+  //by the organ detector, only the statistics need the event dose
   //
-  G4double doseSkull = 0.;
-
-  evtMap = static_cast<G4THitsMap<G4double>*>(HCE->GetHC(fCollID_skull));
-
-  for (itr = evtMap->GetMap()->begin(); itr != evtMap->GetMap()->end(); itr++) {
-    ///G4int copyNb  = (itr->first);
-    doseSkull = *(itr->second);
+  for (G4int organ : fStatOrgans) {
+    fStatDose[organ] += fOrganSD->GetEventDose(organ);
+  }
+  if (fBatch) {
+    for (std::size_t i = 0; i < fStatOrgans.size(); i++) {
+      fBatchValues[i] = fOrganSD->GetEventDose(fStatOrgans[i])/gray;
+    }
+    fBatchValues.back() = good ? 1. : 0.;
+    fBatch->Fill(fBatchValues.data());
   }
-  fSumDoseSkull += doseSkull;
-  fStatDoseSkull += doseSkull;
+  if (fDoseGrid) fDoseGrid->EndOfEvent();
+  if (fDvh) fDvh->EndOfEvent(*fDoseGrid);
 
   G4Run::RecordEvent(event);
 
-  //Dose deposit in the patient
-  G4double dose= 0.;
-
-  evtMap = static_cast<G4THitsMap<G4double>*>(HCE->GetHC(fCollID_patient));
-
-  for (itr = evtMap->GetMap()->begin(); itr != evtMap->GetMap()->end(); itr++) {
-    ///G4int copyNb  = (itr->first);
-    dose = *(itr->second);
+  // publish the statistics of the thread now and then; once the targets
+  // are met, finish the current event and stop
+  if (fConvergence) {
+    if (numberOfEvent%fConvergence->GetInterval() == 0) {
+      fConvergence->Publish(G4Threading::G4GetThreadId(), numberOfEvent,
+                            fGoodEvents, fStatDose);
+    }
+    if (fConvergence->IsConverged()) {
+      fConvergence = nullptr;
+      G4RunManager::GetRunManager()->AbortRun(true);
+    }
   }
-  fSumDose += dose;
-  fStatDose += dose;
-
-  G4Run::RecordEvent(event);
 }
 
 //....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
@@ -136,10 +211,23 @@ void Run::Merge(const G4Run* aRun)
 {
   const Run* localRun = static_cast<const Run*>(aRun);
   fGoodEvents += localRun->fGoodEvents;
-  fSumDose    += localRun->fSumDose;
-  fStatDose   += localRun->fStatDose;
-  fSumDoseSkull    += localRun->fSumDoseSkull;
-  fStatDoseSkull   += localRun->fStatDoseSkull;
+  fNbSingles += localRun->fNbSingles;
+  fNbPiledUp += localRun->fNbPiledUp;
+  fNbDeadTimeLost += localRun->fNbDeadTimeLost;
+  if (fSinogram && localRun->fSinogram) fSinogram->Add(*localRun->fSinogram);
+  if (fDoseGrid && localRun->fDoseGrid) fDoseGrid->Add(*localRun->fDoseGrid);
+
+  // the master run may have been created before the workers
+  // filled the organ registry
+  std::size_t nbOrgans = localRun->fSumDose.size();
+  if (fSumDose.size() < nbOrgans) {
+    fSumDose.resize(nbOrgans, 0.);
+    fStatDose.resize(nbOrgans);
+  }
+  for (std::size_t i = 0; i < nbOrgans; i++) {
+    fSumDose[i]  += localRun->fSumDose[i];
+    fStatDose[i] += localRun->fStatDose[i];
+  }
   G4Run::Merge(aRun);
 }
 
@@ -29,15 +29,62 @@
 
 #include "RunAction.hh"
 #include "Run.hh"
+#include "OrganRegistry.hh"
 #include "PrimaryGeneratorAction.hh"
+#include "DetectorConstruction.hh"
+#include "ListModeWriter.hh"
+#include "SinglesSorter.hh"
+#include "OrganLabelMap.hh"
+#include "WorkerInitialization.hh"
+#include "SteppingAction.hh"
+#include "TrackingAction.hh"
 
 #include "G4Run.hh"
 #include "G4RunManager.hh"
+#include "G4MTRunManager.hh"
+#include "G4GenericMessenger.hh"
+#include "G4LogicalVolumeStore.hh"
+#include "G4LogicalVolume.hh"
+#include "G4Threading.hh"
 #include "G4UnitsTable.hh"
 #include "G4SystemOfUnits.hh"
 
+#include <algorithm>
+#include <sstream>
+
 using namespace B3;
 
+namespace
+{
+  const DetectorConstruction* GetDetectorConstruction()
+  {
+    return static_cast<const DetectorConstruction*>(
+      G4RunManager::GetRunManager()->GetUserDetectorConstruction());
+  }
+
+  // list-mode header describing the current scanner
+  B3b::ListModeHeader MakeListModeHeader()
+  {
+    const DetectorConstruction* detector = GetDetectorConstruction();
+    const DetectorID& detectorID = detector->GetDetectorID();
+
+    B3b::ListModeHeader header;
+    B3b::InitListModeHeader(header);
+    header.fNbRings       = detectorID.GetNbRings();
+    header.fNbSectors     = detectorID.GetNbSectors();
+    header.fNbModules     = detectorID.GetNbModules();
+    header.fNbSubCrystals = detectorID.GetNbSubCrystals();
+    header.fRingRadius    = detector->GetRingRadius()/mm;
+    header.fCrystalDX     = detector->GetCrystalDX()/mm;
+    header.fCrystalDY     = detector->GetCrystalDY()/mm;
+    header.fCrystalDZ     = detector->GetCrystalDZ()/mm;
+    header.fGap           = detector->GetGap()/mm;
+    detector->GetCrystalMaterial().copy(header.fMaterial,
+                                        sizeof(header.fMaterial)-1);
+    return header;
+  }
+}
+
 namespace B3b
 {
 
@@ -56,17 +103,76 @@ RunAction::RunAction()
   new G4UnitDefinition("microgray", "microGy" , "Dose", microgray);
   new G4UnitDefinition("nanogray" , "nanoGy"  , "Dose", nanogray);
   new G4UnitDefinition("picogray" , "picoGy"  , "Dose", picogray);
+
+  //ideal detector: threshold on the energy deposit only
+  //
+  fDigitizer.fLowEnergy = 500*keV;
+
+  //singles sorter
+  //
+  fSorter.fActivity = 1.e6*becquerel;
+  fSorter.fWindow = 4.5*ns;
+
+  DefineCommands();
 }
 
 //....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
 
 RunAction::~RunAction()
-{ }
+{
+  delete fMessenger;
+  delete fDigitizerMessenger;
+  delete fSorterMessenger;
+  delete fSinogramMessenger;
+  delete fDoseMessenger;
+  delete fDvhMessenger;
+  delete fConvergenceMessenger;
+  delete fBatchMessenger;
+  delete fThroughputMessenger;
+  delete fRandomMessenger;
+  delete fSourceMessenger;
+}
 
 //....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
 
 G4Run* RunAction::GenerateRun()
-{ return new Run; }
+{
+  Run* run = new Run(fDigitizer);
+  run->SetEventStreams(fStreams);
+  run->SetSource(fSource);
+
+  // with the sorter, only the master run has a sinogram:
+  // the sorter thread fills it
+  if (fSinogramOn && (IsMaster() || !fSorting)) {
+    const DetectorID& detectorID = GetDetectorConstruction()->GetDetectorID();
+    run->SetSinogram(new Sinogram(detectorID.GetNbRings(),
+                                  detectorID.GetNbDetectorsPerRing(),
+                                  fSinogram));
+  }
+
+  // the dose map covers the phantom unless its size is given
+  if (fDoseOn || fDvhOn) {
+    DoseGridParameters dose = fDose;
+    if (dose.fSize.x() <= 0. || dose.fSize.y() <= 0. || dose.fSize.z() <= 0.) {
+      dose.fSize = GetDetectorConstruction()->GetPhantomSize();
+      dose.fCenter = G4ThreeVector();
+    }
+    // every thread and the master hold a grid: check it before any is made
+    std::size_t memory = DoseGrid::GetMemory(dose);
+    if (IsMaster() && memory > std::size_t(dose.fMaxMemory) << 20) {
+      G4ExceptionDescription msg;
+      msg << "The dose grid of " << dose.fNbBins[0] << "x" << dose.fNbBins[1]
+          << "x" << dose.fNbBins[2] << " voxels needs " << (memory >> 20)
+          << " MiB per thread, above /B3/dose/maxMemory (" << dose.fMaxMemory
+          << " MiB). Use fewer voxels, /B3/dose/uncertainty false, or raise"
+          << " the limit.";
+      G4Exception("RunAction::GenerateRun()", "B3bRunAction003",
+                  FatalErrorInArgument, msg);
+    }
+    run->SetDoseGrid(new DoseGrid(dose));
+  }
+  return run;
+}
 
 //....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
 
@@ -76,12 +182,155 @@ void RunAction::BeginOfRunAction(const G4Run* run)
 
   //inform the runManager to save random number seed
   G4RunManager::GetRunManager()->SetRandomNumberStore(false);
+
+  //list-mode output and singles sorter: the master opens them,
+  //each thread which processes events gets its own channel
+  ListModeWriter* listMode = ListModeWriter::Instance();
+  SinglesSorter* sorter = SinglesSorter::Instance();
+  if (IsMaster() && fListMode) {
+    listMode->Open(fListModeFile, MakeListModeHeader());
+  }
+  ConvergenceMonitor* convergence = ConvergenceMonitor::Instance();
+  if (IsMaster() && fConvergenceOn) convergence->Start(fConvergence);
+  G4RunManager* runManager = G4RunManager::GetRunManager();
+  Run* b3Run = static_cast<Run*>(runManager->GetNonConstCurrentRun());
+  BatchStatistics* batches = BatchStatistics::Instance();
+  if (IsMaster() && fBatchOn) {
+    batches->Open(fBatch, runManager->GetNumberOfThreads());
+  }
+  if (IsMaster() && fThroughput.IsActive()) {
+    ThroughputMonitor::Instance()->Start(fThroughput,
+                                         run->GetNumberOfEventToBeProcessed());
+  }
+  if (IsMaster()) {
+    if (auto workers = dynamic_cast<const WorkerInitialization*>(
+          runManager->GetUserWorkerInitialization())) {
+      workers->ConfigureEventLoop(run->GetNumberOfEventToBeProcessed());
+    }
+    // the events reseed themselves: one seed per request of a worker is
+    // enough, instead of one per event
+    if (fStreams.fEnabled) {
+      if (auto mt = dynamic_cast<G4MTRunManager*>(runManager)) {
+        mt->SetSeedOncePerCommunication(1);
+      }
+    }
+  }
+  if (IsMaster() && fSorting) {
+    ListModeChannel* output =
+      listMode->IsOpen() ? listMode->CreateChannel() : nullptr;
+    sorter->Open(fSorter, fDigitizer,
+                 GetDetectorConstruction()->GetDetectorID().GetNbDetectors(),
+                 runManager->GetNumberOfThreads(), output, b3Run->GetSinogram());
+  }
+  G4bool processesEvents =
+    !IsMaster() || !G4Threading::IsMultithreadedApplication();
+  if (processesEvents) {
+    // with the sorter, the coincidences are formed across events
+    if (sorter->IsOpen()) {
+      b3Run->SetSorterChannel(sorter->OpenChannel(G4Threading::G4GetThreadId()));
+    }
+    else if (listMode->IsOpen()) {
+      b3Run->SetListModeChannel(listMode->CreateChannel());
+    }
+    if (convergence->IsActive()) b3Run->SetConvergenceMonitor(convergence);
+    if (batches->IsOpen()) {
+      b3Run->SetBatchChannel(
+        batches->CreateChannel(G4Threading::G4GetThreadId(),
+                               b3Run->GetBatchQuantities()));
+    }
+
+    ThroughputChannel* throughput =
+      ThroughputMonitor::Instance()->GetChannel(G4Threading::G4GetThreadId());
+    b3Run->SetThroughputChannel(throughput);
+
+    // with the breakdown, the steps are counted per logical volume and the
+    // tracks per particle; the actions stay for the next runs of the thread
+    if (fThroughput.fBreakdown) {
+      G4int nbVolumes = 0;
+      for (const G4LogicalVolume* volume : *G4LogicalVolumeStore::GetInstance()) {
+        nbVolumes = std::max(nbVolumes, G4int(volume->GetInstanceID()) + 1);
+      }
+      throughput->Reserve(nbVolumes);
+      if (!fCounting) {
+        runManager->SetUserAction(new SteppingAction(throughput));
+        runManager->SetUserAction(new TrackingAction(throughput));
+        fCounting = true;
+      }
+    }
+
+    // the organ labels of the voxels are built by all these threads
+    // together; the histograms start with all the voxels at zero dose
+    DoseGrid* dose = b3Run->GetDoseGrid();
+    if (fDvhOn && dose) {
+      const auto& labels =
+        OrganLabelMap::Instance()->Build(*dose, fDvh.fSamples);
+      auto dvh = new DoseVolumeHistogram(labels,
+                                         OrganRegistry::Instance()->GetNbOrgans(),
+                                         dose->GetVoxelVolume(), fDvh);
+      dvh->Fill(*dose);
+      if (fDvh.fCheckpoint > 0) {
+        // the doses of the thread are scaled to the events of the run
+        G4long nbRunEvents = run->GetNumberOfEventToBeProcessed();
+        if (auto master = G4MTRunManager::GetMasterRunManager()) {
+          nbRunEvents = master->GetNumberOfEventsToBeProcessed();
+        }
+        dose->SetTrackChanges(true);
+        dvh->SetCheckpointFile(fDvhFile + "_run" + std::to_string(run->GetRunID())
+          + "_thread" + std::to_string(std::max(0, G4Threading::G4GetThreadId()))
+          + ".csv", nbRunEvents);
+      }
+      b3Run->SetDoseVolumeHistogram(dvh);
+    }
+  }
 }
 
 //....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
 
 void RunAction::EndOfRunAction(const G4Run* run)
 {
+  //list-mode output and singles sorter: publish the last records of this
+  //thread, the master closes them once all the workers are done
+  const Run* localRun = static_cast<const Run*>(run);
+  if (ListModeChannel* channel = localRun->GetListModeChannel()) channel->Flush();
+  if (SorterChannel* singles = localRun->GetSorterChannel()) singles->Close();
+  if (IsMaster()) {
+    ConvergenceMonitor::Instance()->Stop(run->GetNumberOfEventToBeProcessed(),
+                                         run->GetNumberOfEvent());
+    ThroughputMonitor::Instance()->Stop();
+    BatchStatistics::Instance()->Close();
+    SinglesSorter::Instance()->Close();
+    ListModeWriter::Instance()->Close();
+    if (const Sinogram* sinogram = localRun->GetSinogram()) {
+      const DetectorConstruction* detector = GetDetectorConstruction();
+      G4String base = fSinogramFile + "_run" + std::to_string(run->GetRunID());
+      if (sinogram->Write(base + ".s", base + ".hs",
+                          detector->GetRingRadius(), detector->GetCrystalDX())) {
+        G4cout << "### Sinogram: " << sinogram->GetTotal()
+               << " coincidences written to " << base << ".s" << G4endl;
+      }
+    }
+    const DoseGrid* dose = localRun->GetDoseGrid();
+    if (fDoseOn && dose) {
+      G4String base = fDoseFile + "_run" + std::to_string(run->GetRunID());
+      if (dose->Write(base)) {
+        G4cout << "### Dose map: maximum "
+               << G4BestUnit(dose->GetMaxDose(), "Dose")
+               << ", written to " << base << "_dose.v" << G4endl;
+      }
+    }
+    const auto& labels = OrganLabelMap::Instance()->GetLabels();
+    if (fDvhOn && dose && labels.size() == dose->GetNbVoxels()) {
+      DoseVolumeHistogram dvh(labels, OrganRegistry::Instance()->GetNbOrgans(),
+                              dose->GetVoxelVolume(), fDvh);
+      dvh.Fill(*dose);
+      G4String name =
+        fDvhFile + "_run" + std::to_string(run->GetRunID()) + ".csv";
+      if (dvh.Write(name, dose->GetNbEvents())) {
+        G4cout << "### Dose-volume histograms written to " << name << G4endl;
+      }
+    }
+  }
+
   G4int nofEvents = run->GetNumberOfEvent();
   if (nofEvents == 0) return;
 
@@ -103,11 +352,7 @@ void RunAction::EndOfRunAction(const G4Run* run)
   //
   const Run* b3Run = static_cast<const Run*>(run);
   G4int nbGoodEvents = b3Run->GetNbGoodEvents();
-  G4double sumDose   = b3Run->GetSumDose();
-  G4StatAnalysis statDose = b3Run->GetStatDose();
-  G4double sumDoseSkull   = b3Run->GetSumDoseSkull();
-  G4StatAnalysis statDoseSkull = b3Run->GetStatDoseSkull();
-
+  const OrganRegistry* organs = OrganRegistry::Instance();
 
   //print
   //
@@ -127,19 +372,375 @@ void RunAction::EndOfRunAction(const G4Run* run)
      << G4endl
      << "  The run was " << nofEvents << " "<< partName;
   }
-  statDose /= gray;
-  statDoseSkull /= gray;
   G4cout
      << "; Nb of 'good' e+ annihilations: " << nbGoodEvents  << G4endl
-     << " Total dose in brain : " << G4BestUnit(sumDose, "Dose") << G4endl
-     << " Total dose in brain : " << statDose << " Gy" << G4endl
-     << " Total dose in skull : " << G4BestUnit(sumDoseSkull, "Dose") << G4endl
-     << " Total dose in skull : " << statDoseSkull << " Gy" << G4endl
+     << " Singles: " << b3Run->GetNbSingles()
+     << " (piled-up: " << b3Run->GetNbPiledUp()
+     << ", lost in dead time: " << b3Run->GetNbDeadTimeLost() << ")" << G4endl;
+  for (G4int i = 0; i < b3Run->GetNbOrgans(); i++) {
+    const OrganEntry& organ = organs->GetOrgan(i);
+    G4cout
+     << " Total dose in " << organ.fLabel << " : "
+     << G4BestUnit(b3Run->GetSumDose(i), "Dose") << G4endl;
+    if (organ.fStatistics) {
+      G4StatAnalysis statDose = b3Run->GetStatDose(i);
+      statDose /= gray;
+      G4cout
+       << " Total dose in " << organ.fLabel << " : " << statDose << " Gy"
+       << G4endl;
+    }
+  }
+  G4cout
      << "------------------------------------------------------------" << G4endl
      << G4endl;
 }
 
 //....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
 
+void RunAction::DefineCommands()
+{
+  fMessenger = new G4GenericMessenger(this, "/B3/listmode/",
+                                      "List-mode output of the coincidences");
+
+  fMessenger->DeclareProperty("enable", fListMode,
+                              "Write every coincidence to the list-mode file.")
+    .SetParameterName("enable", true)
+    .SetDefaultValue("true");
+
+  fMessenger->DeclareProperty("file", fListModeFile,
+                              "List-mode file; appended to if it exists.");
+
+  fDigitizerMessenger = new G4GenericMessenger(this, "/B3/digitizer/",
+                                               "Digitization of the singles");
+
+  fDigitizerMessenger->DeclareProperty("resolution", fDigitizer.fResolution,
+                                       "Energy resolution FWHM/E at 511 keV.")
+    .SetParameterName("resolution", false)
+    .SetRange("resolution>=0.");
+
+  fDigitizerMessenger->DeclarePropertyWithUnit("lowEnergy", "keV",
+                                               fDigitizer.fLowEnergy,
+                                               "Low edge of the energy window.");
+
+  fDigitizerMessenger->DeclarePropertyWithUnit("highEnergy", "keV",
+                                               fDigitizer.fHighEnergy,
+                                               "High edge of the energy window.");
+
+  fDigitizerMessenger->DeclarePropertyWithUnit("deadTime", "ns",
+                                               fDigitizer.fDeadTime,
+                                               "Dead time per unit (0: none).");
+
+  fDigitizerMessenger->DeclareProperty("paralyzable", fDigitizer.fParalyzable,
+                                       "Paralyzable dead time.")
+    .SetParameterName("paralyzable", true)
+    .SetDefaultValue("true");
+
+  fDigitizerMessenger->DeclareProperty("deadTimeBlock", fDigitizer.fDeadTimeBlock,
+                                       "Nb of consecutive crystals sharing a dead time.")
+    .SetParameterName("block", false)
+    .SetRange("block>=1");
+
+  fDigitizerMessenger->DeclarePropertyWithUnit("pileUp", "ns",
+                                               fDigitizer.fPileUpWindow,
+                                               "Pile-up window (0: none).");
+
+  fSorterMessenger = new G4GenericMessenger(this, "/B3/sorter/",
+                                            "Coincidences across events");
+
+  fSorterMessenger->DeclareProperty("enable", fSorting,
+                                    "Sort the singles of all the threads in time"
+                                    " and form the coincidences across events.")
+    .SetParameterName("enable", true)
+    .SetDefaultValue("true");
+
+  fSorterMessenger->DeclarePropertyWithUnit("activity", "MBq", fSorter.fActivity,
+                                            "Source activity: decay rate.");
+
+  fSorterMessenger->DeclarePropertyWithUnit("window", "ns", fSorter.fWindow,
+                                            "Coincidence window.");
+
+  fSorterMessenger->DeclareMethod("policy", &RunAction::SetMultiplesPolicy,
+                                  "Multiples policy.")
+    .SetParameterName("policy", false)
+    .SetCandidates("takeAll killAll takeWinner");
+
+  fSinogramMessenger = new G4GenericMessenger(this, "/B3/sinogram/",
+                                              "Sinogram of the coincidences");
+
+  fSinogramMessenger->DeclareProperty("enable", fSinogramOn,
+                                      "Bin the coincidences of each run in a"
+                                      " sinogram.")
+    .SetParameterName("enable", true)
+    .SetDefaultValue("true");
+
+  fSinogramMessenger->DeclareProperty("span", fSinogram.fSpan,
+                                      "Axial compression: odd span.")
+    .SetParameterName("span", false)
+    .SetRange("span>=1");
+
+  fSinogramMessenger->DeclareProperty("maxRingDifference",
+                                      fSinogram.fMaxRingDifference,
+                                      "Maximum ring difference (-1: all).");
+
+  fSinogramMessenger->DeclareProperty("file", fSinogramFile,
+                                      "Base name of the sinogram files:"
+                                      " <file>_run<N>.s and .hs.");
+
+  fDoseMessenger = new G4GenericMessenger(this, "/B3/dose/",
+                                          "Voxel dose map of the phantom");
+
+  fDoseMessenger->DeclareProperty("enable", fDoseOn,
+                                  "Score the dose of each run in a voxel grid.")
+    .SetParameterName("enable", true)
+    .SetDefaultValue("true");
+
+  fDoseMessenger->DeclareMethod("bins", &RunAction::SetDoseBins,
+                                "Number of voxels along x, y and z.")
+    .SetParameterName("bins", false);
+
+  fDoseMessenger->DeclarePropertyWithUnit("size", "cm", fDose.fSize,
+                                          "Full size of the grid"
+                                          " (0 0 0: the phantom bounding box).");
+
+  fDoseMessenger->DeclarePropertyWithUnit("center", "cm", fDose.fCenter,
+                                          "Centre of the grid.");
+
+  fDoseMessenger->DeclareProperty("uncertainty", fDose.fUncertainty,
+                                  "Keep the sum of squares for the per-voxel"
+                                  " uncertainty (twice the memory).")
+    .SetParameterName("uncertainty", true)
+    .SetDefaultValue("true");
+
+  fDoseMessenger->DeclareProperty("maxMemory", fDose.fMaxMemory,
+                                  "Largest grid accepted, in MiB per thread"
+                                  " (8 bytes per voxel, 16 with the"
+                                  " uncertainty).")
+    .SetParameterName("MiB", false)
+    .SetRange("MiB>0");
+
+  fDoseMessenger->DeclareProperty("file", fDoseFile,
+                                  "Base name of the dose files:"
+                                  " <file>_run<N>_dose.v/.hv and _error.v/.hv.");
+
+  fDvhMessenger = new G4GenericMessenger(this, "/B3/dvh/",
+                                         "Dose-volume histograms of the organs");
+
+  fDvhMessenger->DeclareProperty("enable", fDvhOn,
+                                 "Compute the dose-volume histograms of each run"
+                                 " (on the /B3/dose/ grid).")
+    .SetParameterName("enable", true)
+    .SetDefaultValue("true");
+
+  fDvhMessenger->DeclareProperty("samples", fDvh.fSamples,
+                                 "Points per voxel and per axis to find the organ"
+                                 " of the voxels.")
+    .SetParameterName("samples", false)
+    .SetRange("samples>=1");
+
+  fDvhMessenger->DeclareProperty("binsPerDecade", fDvh.fBinsPerDecade,
+                                 "Logarithmic dose bins per decade.")
+    .SetParameterName("bins", false)
+    .SetRange("bins>=1");
+
+  fDvhMessenger->DeclareProperty("checkpoint", fDvh.fCheckpoint,
+                                 "Events of a thread between two updates of its"
+                                 " histograms (0: end of run only).")
+    .SetParameterName("events", false)
+    .SetRange("events>=0");
+
+  fDvhMessenger->DeclareProperty("file", fDvhFile,
+                                 "Base name of the CSV files: <file>_run<N>.csv,"
+                                 " <file>_run<N>_thread<T>.csv at checkpoints.");
+
+  fConvergenceMessenger =
+    new G4GenericMessenger(this, "/B3/convergence/",
+                           "Stop the run once the statistical targets are met");
+
+  fConvergenceMessenger->DeclareProperty("enable", fConvergenceOn,
+                                         "Stop each run as soon as all the"
+                                         " targets are met.")
+    .SetParameterName("enable", true)
+    .SetDefaultValue("true");
+
+  fConvergenceMessenger->DeclareMethod("organ", &RunAction::AddOrganTarget,
+                                       "Target relative error of the dose of an"
+                                       " organ: <scorer name|all> <error>.")
+    .SetParameterName("target", false);
+
+  fConvergenceMessenger->DeclareProperty("efficiency", fConvergence.fEfficiency,
+                                         "Target relative error of the fraction"
+                                         " of good events (0: none).")
+    .SetParameterName("error", false)
+    .SetRange("error>=0.");
+
+  fConvergenceMessenger->DeclareProperty("coincidences",
+                                         fConvergence.fCoincidences,
+                                         "Target relative error of the number"
+                                         " of good events (0: none).")
+    .SetParameterName("error", false)
+    .SetRange("error>=0.");
+
+  fConvergenceMessenger->DeclareProperty("interval", fConvergence.fInterval,
+                                         "Events of a thread between two"
+                                         " publications of its statistics.")
+    .SetParameterName("events", false)
+    .SetRange("events>=1");
+
+  fConvergenceMessenger->DeclareProperty("minEvents", fConvergence.fMinEvents,
+                                         "Events of the run before any decision.")
+    .SetParameterName("events", false)
+    .SetRange("events>=0");
+
+  fConvergenceMessenger->DeclareMethod("clear", &RunAction::ClearTargets,
+                                       "Remove all the targets.");
+
+  fBatchMessenger = new G4GenericMessenger(this, "/B3/batch/",
+                                           "Batch means of the run statistics");
+
+  fBatchMessenger->DeclareProperty("enable", fBatchOn,
+                                   "Accumulate the organ doses and the good"
+                                   " events of each thread in batches.")
+    .SetParameterName("enable", true)
+    .SetDefaultValue("true");
+
+  fBatchMessenger->DeclareProperty("size", fBatch.fBatchSize,
+                                   "Events per batch.")
+    .SetParameterName("events", false)
+    .SetRange("events>=1");
+
+  fBatchMessenger->DeclareProperty("report", fBatch.fReport,
+                                   "Seconds between two live reports"
+                                   " (0: end of run only).")
+    .SetParameterName("seconds", false)
+    .SetRange("seconds>=0.");
+
+  fBatchMessenger->DeclareProperty("outlier", fBatch.fOutlier,
+                                   "Deviation of a thread from the others, in"
+                                   " standard errors, reported as anomalous.")
+    .SetParameterName("sigmas", false)
+    .SetRange("sigmas>0.");
+
+  fThroughputMessenger = new G4GenericMessenger(this, "/B3/throughput/",
+                                                "Progress and throughput");
+
+  fThroughputMessenger->DeclareProperty("report", fThroughput.fReport,
+                                        "Seconds between two progress lines"
+                                        " (0: none).")
+    .SetParameterName("seconds", false)
+    .SetRange("seconds>=0.");
+
+  fThroughputMessenger->DeclareProperty("breakdown", fThroughput.fBreakdown,
+                                        "Count the steps per logical volume and"
+                                        " the tracks per particle, and print"
+                                        " them at the end of the run.")
+    .SetParameterName("breakdown", true)
+    .SetDefaultValue("true");
+
+  fThroughputMessenger->DeclareProperty("file", fThroughput.fFile,
+                                        "Append the threads, events and seconds"
+                                        " of each run to this file.");
+
+  fRandomMessenger = new G4GenericMessenger(this, "/B3/random/",
+                                            "Per-event random streams");
+
+  fRandomMessenger->DeclareProperty("eventStreams", fStreams.fEnabled,
+                                    "Draw the random numbers of each event from"
+                                    " its own stream (seed, run, event).")
+    .SetParameterName("enable", true)
+    .SetDefaultValue("true");
+
+  fRandomMessenger->DeclareProperty("seed", fStreams.fSeed,
+                                    "Seed of the event streams.");
+
+  fRandomMessenger->DeclareProperty("run", fStreams.fRun,
+                                    "Run of the event streams (-1: the run ID).");
+
+  fRandomMessenger->DeclareProperty("firstEvent", fStreams.fFirstEvent,
+                                    "Stream of the first event of the run, to"
+                                    " replay an event alone.")
+    .SetParameterName("event", false)
+    .SetRange("event>=0");
+
+  fSourceMessenger = new G4GenericMessenger(this, "/B3/source/",
+                                            "Position of the source");
+
+  fSourceMessenger->DeclareMethodWithUnit("position", "cm",
+                                          &RunAction::SetSourcePosition,
+                                          "Centre of the source zone.");
+
+  fSourceMessenger->DeclareMethod("reset", &RunAction::ResetSource,
+                                  "Back to the source zone of the example.");
+}
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
+
+void RunAction::SetMultiplesPolicy(const G4String& policy)
+{
+  if (policy == "takeAll")       fSorter.fPolicy = kTakeAll;
+  else if (policy == "killAll")  fSorter.fPolicy = kKillAll;
+  else                           fSorter.fPolicy = kTakeWinner;
+}
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
+
+void RunAction::SetDoseBins(const G4String& bins)
+{
+  std::istringstream input(bins);
+  G4int nx = 0, ny = 0, nz = 0;
+  if (!(input >> nx >> ny >> nz) || nx < 1 || ny < 1 || nz < 1) {
+    G4ExceptionDescription msg;
+    msg << "Expected three positive numbers of voxels, got \"" << bins << "\".";
+    G4Exception("RunAction::SetDoseBins()", "B3bRunAction001", JustWarning, msg);
+    return;
+  }
+  fDose.fNbBins[0] = nx;
+  fDose.fNbBins[1] = ny;
+  fDose.fNbBins[2] = nz;
+}
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
+
+void RunAction::AddOrganTarget(const G4String& target)
+{
+  std::istringstream input(target);
+  G4String name;
+  G4double error = 0.;
+  if (!(input >> name >> error) || error <= 0.) {
+    G4ExceptionDescription msg;
+    msg << "Expected an organ scorer name and a positive relative error, got \""
+        << target << "\".";
+    G4Exception("RunAction::AddOrganTarget()", "B3bRunAction002", JustWarning,
+                msg);
+    return;
+  }
+  fConvergence.fOrgans.emplace_back(name, error);
+}
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
+
+void RunAction::ClearTargets()
+{
+  fConvergence.fOrgans.clear();
+  fConvergence.fEfficiency = 0.;
+  fConvergence.fCoincidences = 0.;
+}
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
+
+void RunAction::SetSourcePosition(const G4ThreeVector& position)
+{
+  fSource.fMoved = true;
+  fSource.fPosition = position;
+}
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
+
+void RunAction::ResetSource()
+{
+  fSource = SourceParameters();
+}
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
+
 }
 
@@ -0,0 +1,280 @@
+//
+// ********************************************************************
+// * License and Disclaimer                                           *
+// *                                                                  *
+// * The  Geant4 software  is  copyright of the Copyright Holders  of *
+// * the Geant4 Collaboration.  It is provided  under  the terms  and *
+// * conditions of the Geant4 Software License,  included in the file *
+// * LICENSE and available at  http://cern.ch/geant4/license .  These *
+// * include a list of copyright holders.                             *
+// *                                                                  *
+// * Neither the authors of this software system, nor their employing *
+// * institutes,nor the agencies providing financial support for this *
+// * work  make  any representation or  warranty, express or implied, *
+// * regarding  this  software system or assume any liability for its *
+// * use.  Please see the license in the file  LICENSE  and URL above *
+// * for the full disclaimer and the limitation of liability.         *
+// *                                                                  *
+// * This  code  implementation is the result of  the  scientific and *
+// * technical work of the GEANT4 collaboration.                      *
+// * By using,  copying,  modifying or  distributing the software (or *
+// * any work based  on the software)  you  agree  to acknowledge its *
+// * use  in  resulting  scientific  publications,  and indicate your *
+// * acceptance of all terms of the Geant4 Software license.          *
+// ********************************************************************
+//
+/// \file Sinogram.cc
+/// \brief Implementation of the B3b::Sinogram class
+
+#include "Sinogram.hh"
+
+#include "G4SystemOfUnits.hh"
+
+#include <algorithm>
+#include <cstdio>
+#include <fstream>
+#include <numeric>
+#include <thread>
+
+namespace
+{
+  // below this size a plain loop beats spawning threads
+  const std::size_t kParallelAddSize = std::size_t(1) << 22;
+}
+
+namespace B3b
+{
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
+
+Sinogram::Sinogram(G4int nbRings, G4int nbCrystals,
+                   const SinogramParameters& parameters)
+ : fNbRings(nbRings), fNbCrystals(nbCrystals), fParameters(parameters)
+{
+  if (fParameters.fSpan < 1 || fParameters.fSpan%2 == 0) {
+    G4ExceptionDescription msg;
+    msg << "The span must be odd: " << fParameters.fSpan << " changed to "
+        << std::max(1, fParameters.fSpan + 1) << ".";
+    G4Exception("Sinogram::Sinogram()", "B3bSinogram001", JustWarning, msg);
+    fParameters.fSpan = std::max(1, fParameters.fSpan + 1);
+  }
+  if (fParameters.fMaxRingDifference < 0 ||
+      fParameters.fMaxRingDifference > fNbRings - 1) {
+    fParameters.fMaxRingDifference = fNbRings - 1;
+  }
+  const G4int span = fParameters.fSpan;
+  const G4int maxRD = fParameters.fMaxRingDifference;
+
+  // segments 0, +1, -1, ... up to the maximum ring difference
+  G4int nbSegments = 0;
+  while (MinRingDifference(nbSegments + 1) <= maxRD) nbSegments++;
+  std::vector<G4int> firstPlane(2*nbSegments + 1);
+  fSegmentPlanes.resize(2*nbSegments + 1);
+  for (G4int k = -nbSegments; k <= nbSegments; k++) {
+    G4int dmin = MinRingDifference(std::abs(k));
+    fSegmentPlanes[SegmentIndex(k)] =
+      span == 1 ? fNbRings - dmin : 2*fNbRings - 1 - 2*dmin;
+  }
+  for (std::size_t i = 0; i < fSegmentPlanes.size(); i++) {
+    firstPlane[i] = fNbPlanes;
+    fNbPlanes += fSegmentPlanes[i];
+  }
+
+  // transaxial: crystal pair -> (view, tangential), folded into [0, pi)
+  const G4int n = fNbCrystals;
+  fNbViews = n%2 == 0 ? n/2 : n;
+  fNbTangential = n;
+  fPlaneSize = std::size_t(fNbViews)*fNbTangential;
+  fTransaxial.assign(n*n, -1);
+  for (G4int c1 = 0; c1 < n; c1++) {
+    for (G4int c2 = 0; c2 < n; c2++) {
+      if (c1 == c2) continue;
+      G4int a = std::min(c1, c2), b = std::max(c1, c2);
+      G4int sum = a + b, tangential = n/2 - (b - a);
+      G4bool fold = sum >= n;
+      if (fold) {
+        // angle beyond pi: same line, seen from the other side
+        sum -= n;
+        tangential = -tangential;
+      }
+      G4int view = n%2 == 0 ? sum/2 : sum;
+      G4int bin = view*fNbTangential + tangential + n/2;
+      G4bool flip = (c1 > c2) != fold;
+      fTransaxial[c1*n + c2] = 2*bin + (flip ? 1 : 0);
+    }
+  }
+
+  // axial: ring pair -> plane
+  fAxial.assign(fNbRings*fNbRings, -1);
+  for (G4int r1 = 0; r1 < fNbRings; r1++) {
+    for (G4int r2 = 0; r2 < fNbRings; r2++) {
+      G4int difference = r2 - r1;
+      if (std::abs(difference) > maxRD) continue;
+      G4int k = Segment(difference);
+      G4int plane = r1 + r2 - MinRingDifference(std::abs(k));
+      if (span == 1) plane /= 2;
+      fAxial[r1*fNbRings + r2] = firstPlane[SegmentIndex(k)] + plane;
+    }
+  }
+
+  fCounts.assign(std::size_t(fNbPlanes)*fPlaneSize, 0);
+}
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
+
+G4int Sinogram::Segment(G4int ringDifference) const
+{
+  const G4int half = (fParameters.fSpan - 1)/2;
+  return ringDifference >= 0 ?  (ringDifference + half)/fParameters.fSpan
+                             : -((half - ringDifference)/fParameters.fSpan);
+}
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
+
+G4int Sinogram::MinRingDifference(G4int segment) const
+{
+  if (segment == 0) return 0;
+  return segment*fParameters.fSpan - (fParameters.fSpan - 1)/2;
+}
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
+
+void Sinogram::Add(const Sinogram& other)
+{
+  if (other.fCounts.size() != fCounts.size()) {
+    G4ExceptionDescription msg;
+    msg << "Sinograms of different sizes: not added.";
+    G4Exception("Sinogram::Add()", "B3bSinogram002", JustWarning, msg);
+    return;
+  }
+
+  auto addRange = [this, &other](std::size_t first, std::size_t last) {
+    std::uint32_t* counts = fCounts.data();
+    const std::uint32_t* otherCounts = other.fCounts.data();
+    for (std::size_t i = first; i < last; i++) counts[i] += otherCounts[i];
+  };
+
+  std::size_t size = fCounts.size();
+  std::size_t nbThreads = std::min<std::size_t>(
+    std::max(1u, std::thread::hardware_concurrency()), size/kParallelAddSize);
+  if (nbThreads < 2) {
+    addRange(0, size);
+    return;
+  }
+
+  std::vector<std::thread> threads;
+  std::size_t chunk = (size + nbThreads - 1)/nbThreads;
+  for (std::size_t first = chunk; first < size; first += chunk) {
+    threads.emplace_back(addRange, first, std::min(first + chunk, size));
+  }
+  addRange(0, chunk);
+  for (std::thread& thread : threads) thread.join();
+}
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
+
+void Sinogram::Reset()
+{
+  std::fill(fCounts.begin(), fCounts.end(), 0);
+}
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
+
+std::uint64_t Sinogram::GetTotal() const
+{
+  return std::accumulate(fCounts.begin(), fCounts.end(), std::uint64_t(0));
+}
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
+
+G4bool Sinogram::Write(const G4String& dataFile, const G4String& headerFile,
+                       G4double ringRadius, G4double ringSpacing) const
+{
+  std::FILE* file = std::fopen(dataFile.c_str(), "wb");
+  std::size_t nbWritten = 0;
+  if (file) {
+    nbWritten = std::fwrite(fCounts.data(), sizeof(std::uint32_t),
+                            fCounts.size(), file);
+    std::fclose(file);
+  }
+  std::ofstream header(headerFile);
+  if (nbWritten != fCounts.size() || !header) {
+    G4ExceptionDescription msg;
+    msg << "Cannot write the sinogram to " << dataFile << " and " << headerFile;
+    G4Exception("Sinogram::Write()", "B3bSinogram003", JustWarning, msg);
+    return false;
+  }
+
+  const std::uint16_t probe = 1;
+  G4bool littleEndian = *reinterpret_cast<const char*>(&probe) == 1;
+  const G4int span = fParameters.fSpan, half = (span - 1)/2;
+  const G4int maxRD = fParameters.fMaxRingDifference;
+
+  // segments in storage order
+  std::vector<G4int> segments;
+  for (G4int k = 0; k < GetNbSegments(); k++) {
+    segments.push_back(k%2 == 1 ? (k + 1)/2 : -(k/2));
+  }
+  auto list = [&segments](auto value) {
+    std::string text = "{";
+    for (std::size_t i = 0; i < segments.size(); i++) {
+      text += (i ? "," : "") + std::to_string(value(segments[i]));
+    }
+    return text + "}";
+  };
+  auto ringDifference = [span, half, maxRD](G4int k, G4bool upper) {
+    G4int low = k == 0 ? -std::min(half, maxRD) : std::abs(k)*span - half;
+    G4int high = std::min(maxRD, std::abs(k)*span + half);
+    if (k < 0) {
+      G4int lowest = -high;
+      high = -low;
+      low = lowest;
+    }
+    return upper ? high : low;
+  };
+
+  std::string dataName = dataFile.substr(dataFile.find_last_of('/') + 1);
+  header
+    << "!INTERFILE  :=\n"
+    << "!imaging modality := PT\n"
+    << "name of data file := " << dataName << "\n"
+    << "originating system := B3 Geant4 example\n"
+    << "!version of keys := STIR3.0\n"
+    << "!GENERAL DATA :=\n"
+    << "!GENERAL IMAGE DATA :=\n"
+    << "!type of data := PET\n"
+    << "imagedata byte order := "
+    << (littleEndian ? "LITTLEENDIAN" : "BIGENDIAN") << "\n"
+    << "!PET STUDY (General) :=\n"
+    << "!PET data type := Emission\n"
+    << "applied corrections := {None}\n"
+    << "!number format := unsigned integer\n"
+    << "!number of bytes per pixel := 4\n"
+    << "number of dimensions := 4\n"
+    << "matrix axis label [4] := segment\n"
+    << "!matrix size [4] := " << GetNbSegments() << "\n"
+    << "matrix axis label [3] := axial coordinate\n"
+    << "!matrix size [3] := "
+    << list([this](G4int k) { return fSegmentPlanes[SegmentIndex(k)]; }) << "\n"
+    << "matrix axis label [2] := view\n"
+    << "!matrix size [2] := " << fNbViews << "\n"
+    << "matrix axis label [1] := tangential coordinate\n"
+    << "!matrix size [1] := " << fNbTangential << "\n"
+    << "minimum ring difference per segment := "
+    << list([&](G4int k) { return ringDifference(k, false); }) << "\n"
+    << "maximum ring difference per segment := "
+    << list([&](G4int k) { return ringDifference(k, true); }) << "\n"
+    << "Scanner parameters:=\n"
+    << "number of rings := " << fNbRings << "\n"
+    << "number of detectors per ring := " << fNbCrystals << "\n"
+    << "inner ring diameter (cm) := " << 2*ringRadius/cm << "\n"
+    << "distance between rings (cm) := " << ringSpacing/cm << "\n"
+    << "end scanner parameters:=\n"
+    << "number of time frames := 1\n"
+    << "!END OF INTERFILE :=\n";
+  return true;
+}
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
+
+}
@@ -0,0 +1,278 @@
+//
+// ********************************************************************
+// * License and Disclaimer                                           *
+// *                                                                  *
+// * The  Geant4 software  is  copyright of the Copyright Holders  of *
+// * the Geant4 Collaboration.  It is provided  under  the terms  and *
+// * conditions of the Geant4 Software License,  included in the file *
+// * LICENSE and available at  http://cern.ch/geant4/license .  These *
+// * include a list of copyright holders.                             *
+// *                                                                  *
+// * Neither the authors of this software system, nor their employing *
+// * institutes,nor the agencies providing financial support for this *
+// * work  make  any representation or  warranty, express or implied, *
+// * regarding  this  software system or assume any liability for its *
+// * use.  Please see the license in the file  LICENSE  and URL above *
+// * for the full disclaimer and the limitation of liability.         *
+// *                                                                  *
+// * This  code  implementation is the result of  the  scientific and *
+// * technical work of the GEANT4 collaboration.                      *
+// * By using,  copying,  modifying or  distributing the software (or *
+// * any work based  on the software)  you  agree  to acknowledge its *
+// * use  in  resulting  scientific  publications,  and indicate your *
+// * acceptance of all terms of the Geant4 Software license.          *
+// ********************************************************************
+/// \file SweepDriver.cc
+/// \brief Implementation of the B3b::SweepDriver class
+
+#include "SweepDriver.hh"
+#include "DetectorConstruction.hh"
+#include "Run.hh"
+#include "OrganRegistry.hh"
+
+#include "G4RunManager.hh"
+#include "G4StateManager.hh"
+#include "G4UImanager.hh"
+#include "G4SystemOfUnits.hh"
+
+#include <algorithm>
+#include <cctype>
+#include <chrono>
+#include <cstdlib>
+#include <fstream>
+#include <sstream>
+
+namespace B3b
+{
+
+namespace
+{
+
+// The parameters a grid can sweep, in the order of their rank
+struct SweepParameter
+{
+  const char* fName;
+  const char* fCommand;
+  G4bool      fLength;
+};
+
+const SweepParameter kParameters[] = {
+  { "material",   "/B3/detector/material",   false },
+  { "crystalDX",  "/B3/detector/crystalDX",  true  },
+  { "crystalDY",  "/B3/detector/crystalDY",  true  },
+  { "crystalDZ",  "/B3/detector/crystalDZ",  true  },
+  { "gap",        "/B3/detector/gap",        true  },
+  { "nbCrystals", "/B3/detector/nbCrystals", false },
+  { "nbRings",    "/B3/detector/nbRings",    false },
+  { "source",     "/B3/source/position",     true  }
+};
+
+G4bool IsNumber(const G4String& token)
+{
+  char first = token.empty() ? ' ' : token[0];
+  return std::isdigit(first) || first == '-' || first == '+' || first == '.';
+}
+
+}
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
+
+G4bool SweepDriver::Read(const G4String& fileName)
+{
+  std::ifstream input(fileName);
+  if (!input) {
+    G4ExceptionDescription msg;
+    msg << "Cannot read the sweep grid " << fileName << ".";
+    G4Exception("SweepDriver::Read()", "B3bSweep001", JustWarning, msg);
+    return false;
+  }
+
+  fAxes.clear();
+  for (std::string line; std::getline(input, line);) {
+    std::istringstream words(line.substr(0, line.find('#')));
+    std::vector<G4String> tokens;
+    for (std::string word; words >> word;) tokens.push_back(word);
+    if (tokens.empty()) continue;
+
+    G4String name = tokens.front();
+    tokens.erase(tokens.begin());
+    G4bool known = true;
+    if (name == "events" && tokens.size() == 1) {
+      fNbEvents = std::atoi(tokens[0].c_str());
+    }
+    else if (name == "table" && tokens.size() == 1) {
+      fTable = tokens[0];
+    }
+    else {
+      known = AddAxis(name, tokens);
+    }
+    if (!known) {
+      G4ExceptionDescription msg;
+      msg << "Unknown parameter, or no value, in the sweep grid " << fileName
+          << ": \"" << line << "\".";
+      G4Exception("SweepDriver::Read()", "B3bSweep002", JustWarning, msg);
+      return false;
+    }
+  }
+
+  std::stable_sort(fAxes.begin(), fAxes.end(),
+                   [](const SweepAxis& a, const SweepAxis& b)
+                   { return a.fRank < b.fRank; });
+  return true;
+}
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
+
+G4bool SweepDriver::AddAxis(const G4String& name, std::vector<G4String>& tokens)
+{
+  const G4int nbParameters = sizeof(kParameters)/sizeof(kParameters[0]);
+  G4int rank = 0;
+  while (rank < nbParameters && name != kParameters[rank].fName) rank++;
+  if (rank == nbParameters) return false;
+
+  SweepAxis axis;
+  axis.fName = name;
+  axis.fCommand = kParameters[rank].fCommand;
+  axis.fRank = rank;
+  if (kParameters[rank].fLength && tokens.size() > 1 && !IsNumber(tokens.back())) {
+    axis.fUnit = tokens.back();
+    tokens.pop_back();
+  }
+  axis.fValues = tokens;
+  if (axis.fValues.empty()) return false;
+
+  // a parameter given twice: the last line counts
+  auto known = std::find_if(fAxes.begin(), fAxes.end(),
+                            [&](const SweepAxis& a) { return a.fName == name; });
+  if (known != fAxes.end()) *known = axis;
+  else fAxes.push_back(axis);
+  return true;
+}
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
+
+G4int SweepDriver::GetNbPoints() const
+{
+  G4int nbPoints = 1;
+  for (const SweepAxis& axis : fAxes) nbPoints *= G4int(axis.fValues.size());
+  return nbPoints;
+}
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
+
+G4int SweepDriver::Run()
+{
+  using Clock = std::chrono::steady_clock;
+  G4UImanager* UImanager = G4UImanager::GetUIpointer();
+  G4RunManager* runManager = G4RunManager::GetRunManager();
+
+  // the geometry is built before the first point, so that the phantom is
+  // known when the scanners are checked against it
+  if (G4StateManager::GetStateManager()->GetCurrentState() == G4State_PreInit)
+    runManager->Initialize();
+  const auto detector = static_cast<const B3::DetectorConstruction*>(
+    runManager->GetUserDetectorConstruction());
+
+  std::ifstream existing(fTable);
+  G4bool header = !existing || existing.peek() == std::ifstream::traits_type::eof();
+  existing.close();
+
+  const G4int nbAxes = G4int(fAxes.size());
+  const G4int nbPoints = GetNbPoints();
+  std::vector<G4int> point(nbAxes, 0), previous(nbAxes, -1);
+  G4int nbFailed = 0;
+  for (G4int n = 0; n < nbPoints; n++) {
+    // next point: the last axis changes the most often
+    for (G4int a = nbAxes - 1; n > 0 && a >= 0; a--) {
+      if (++point[a] < G4int(fAxes[a].fValues.size())) break;
+      point[a] = 0;
+    }
+
+    // only the parameters which changed are set again
+    G4bool ok = true;
+    std::ostringstream label;
+    for (G4int a = 0; a < nbAxes; a++) {
+      const SweepAxis& axis = fAxes[a];
+      const G4String& value = axis.fValues[point[a]];
+      label << " " << axis.fName << " " << value << (axis.fUnit.empty() ? "" : " ")
+            << axis.fUnit;
+      if (point[a] == previous[a]) continue;
+      G4String arguments = value;
+      std::replace(arguments.begin(), arguments.end(), ',', ' ');
+      if (!axis.fUnit.empty()) arguments += " " + axis.fUnit;
+      if (UImanager->ApplyCommand(axis.fCommand + " " + arguments) != 0) ok = false;
+    }
+    G4cout << "### Sweep point " << n+1 << "/" << nbPoints << ":" << label.str()
+           << G4endl;
+    if (!ok) {
+      G4cout << "### Sweep point " << n+1 << " skipped: a command failed"
+             << G4endl;
+      previous.assign(nbAxes, -1);
+      nbFailed++;
+      continue;
+    }
+    previous = point;
+
+    // rings cutting into the phantom would be fatal when the geometry is
+    // built again, at the start of the run
+    if (!detector->FitsPhantom()) {
+      G4cout << "### Sweep point " << n+1 << " skipped: the inner radius of"
+             << " the rings, " << detector->GetRingRadius()/cm
+             << " cm, is inside the phantom" << G4endl;
+      nbFailed++;
+      continue;
+    }
+
+    auto start = Clock::now();
+    runManager->BeamOn(fNbEvents);
+    G4double seconds =
+      std::chrono::duration<G4double>(Clock::now() - start).count();
+
+    WriteRow(point, seconds, header);
+    header = false;
+  }
+  return nbFailed;
+}
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
+
+void SweepDriver::WriteRow(const std::vector<G4int>& point, G4double seconds,
+                           G4bool header) const
+{
+  // the master run of the point, kept by the run manager until the next one
+  const auto run =
+    static_cast<const B3b::Run*>(G4RunManager::GetRunManager()->GetCurrentRun());
+  if (run == nullptr) return;
+
+  std::ofstream output(fTable, std::ios::app);
+  if (header) {
+    for (const SweepAxis& axis : fAxes) {
+      output << axis.fName;
+      if (!axis.fUnit.empty()) output << "[" << axis.fUnit << "]";
+      output << '\t';
+    }
+    output << "events\tgood\tefficiency\tsingles\tseconds";
+    const B3::OrganRegistry* organs = B3::OrganRegistry::Instance();
+    for (G4int i = 0; i < run->GetNbOrgans(); i++) {
+      output << '\t' << organs->GetOrgan(i).fScorerName << "[Gy]";
+    }
+    output << '\n';
+  }
+
+  for (std::size_t a = 0; a < fAxes.size(); a++) {
+    output << fAxes[a].fValues[point[a]] << '\t';
+  }
+  G4int nbEvents = run->GetNumberOfEvent();
+  G4int nbGood = run->GetNbGoodEvents();
+  output << nbEvents << '\t' << nbGood << '\t'
+         << (nbEvents > 0 ? G4double(nbGood)/nbEvents : 0.) << '\t'
+         << run->GetNbSingles() << '\t' << seconds;
+  for (G4int i = 0; i < run->GetNbOrgans(); i++) {
+    output << '\t' << run->GetSumDose(i)/gray;
+  }
+  output << '\n';
+}
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
+
+}
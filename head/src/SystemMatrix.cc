@@ -0,0 +1,325 @@
+//
+// ********************************************************************
+// * License and Disclaimer                                           *
+// *                                                                  *
+// * The  Geant4 software  is  copyright of the Copyright Holders  of *
+// * the Geant4 Collaboration.  It is provided  under  the terms  and *
+// * conditions of the Geant4 Software License,  included in the file *
+// * LICENSE and available at  http://cern.ch/geant4/license .  These *
+// * include a list of copyright holders.                             *
+// *                                                                  *
+// * Neither the authors of this software system, nor their employing *
+// * institutes,nor the agencies providing financial support for this *
+// * work  make  any representation or  warranty, express or implied, *
+// * regarding  this  software system or assume any liability for its *
+// * use.  Please see the license in the file  LICENSE  and URL above *
+// * for the full disclaimer and the limitation of liability.         *
+// *                                                                  *
+// * This  code  implementation is the result of  the  scientific and *
+// * technical work of the GEANT4 collaboration.                      *
+// * By using,  copying,  modifying or  distributing the software (or *
+// * any work based  on the software)  you  agree  to acknowledge its *
+// * use  in  resulting  scientific  publications,  and indicate your *
+// * acceptance of all terms of the Geant4 Software license.          *
+// ********************************************************************
+//
+/// \file SystemMatrix.cc
+/// \brief Implementation of the B3b::SystemMatrix class
+
+#include "SystemMatrix.hh"
+
+#include <cerrno>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace B3b
+{
+
+namespace
+{
+const char kSystemMatrixMagic[8] = { 'B','3','C','S','R','1','\0','\0' };
+}
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
+
+SystemMatrix::SystemMatrix(const ScannerGeometry& scanner, const ImageGrid& grid)
+ : fScanner(scanner), fGrid(grid), fProjector(grid),
+   fNbCrystals(scanner.GetNbCrystals()), fNbRings(scanner.GetNbRings()),
+   fNbXY(grid.fNx*grid.fNy)
+{
+  BuildSymmetries();
+}
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
+
+SystemMatrix::~SystemMatrix()
+{
+  Close();
+}
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
+
+void SystemMatrix::BuildSymmetries()
+{
+  const int n = fNbCrystals;
+  const int nx = fGrid.fNx, ny = fGrid.fNy;
+
+  // transaxial symmetries, applied in this order: bit 0 swaps x and y,
+  // bit 1 flips x, bit 2 flips y. Crystal i is at angle 2*pi*i/n, so they
+  // map crystals onto crystals when n is a multiple of 4 (swap) or 2 (x).
+  bool canSwap = n%4 == 0 && nx == ny && fGrid.fVx == fGrid.fVy;
+  bool canFlipX = n%2 == 0;
+  std::vector<int> transforms;
+  for (int t = 0; t < 8; t++) {
+    if ((t & 1) && !canSwap) continue;
+    if ((t & 2) && !canFlipX) continue;
+    transforms.push_back(t);
+  }
+  fNbTransforms = int(transforms.size());
+
+  auto crystal = [n](int t, int i) {
+    if (t & 1) i = n/4 - i;
+    if (t & 2) i = n/2 - i;
+    if (t & 4) i = -i;
+    return (i%n + n)%n;
+  };
+  auto voxel = [nx, ny](int t, int ix, int iy) {
+    if (t & 1) std::swap(ix, iy);
+    if (t & 2) ix = nx - 1 - ix;
+    if (t & 4) iy = ny - 1 - iy;
+    return iy*nx + ix;
+  };
+
+  // the voxels of a line of response are those of its unique row mapped
+  // back through the inverse symmetry
+  fXYMaps.resize(std::size_t(fNbTransforms)*fNbXY);
+  for (int s = 0; s < fNbTransforms; s++) {
+    std::int32_t* xyMap = &fXYMaps[std::size_t(s)*fNbXY];
+    for (int iy = 0; iy < ny; iy++) {
+      for (int ix = 0; ix < nx; ix++) {
+        xyMap[voxel(transforms[s], ix, iy)] = iy*nx + ix;
+      }
+    }
+  }
+
+  // crystal pairs: the unique pair is the smallest image over the symmetries
+  fPairs.assign(std::size_t(n)*n, PairEntry());
+  fCanonicalPairs.clear();
+  std::vector<std::int32_t> pairIndex(std::size_t(n)*n, -1);
+  for (int c1 = 0; c1 < n; c1++) {
+    for (int c2 = 0; c2 < n; c2++) {
+      if (c1 == c2) continue;
+      int bestA = n, bestB = n;
+      PairEntry best;
+      for (int s = 0; s < fNbTransforms; s++) {
+        int g1 = crystal(transforms[s], c1), g2 = crystal(transforms[s], c2);
+        int a = std::min(g1, g2), b = std::max(g1, g2);
+        if (a < bestA || (a == bestA && b < bestB)) {
+          bestA = a;
+          bestB = b;
+          best.fTransform = std::uint8_t(s);
+          best.fSwap = g1 > g2;
+        }
+      }
+      std::int32_t& index = pairIndex[std::size_t(bestA)*n + bestB];
+      if (index < 0) {
+        index = std::int32_t(fCanonicalPairs.size());
+        fCanonicalPairs.emplace_back(bestA, bestB);
+      }
+      best.fPair = index;
+      fPairs[std::size_t(c1)*n + c2] = best;
+    }
+  }
+
+  // ring pairs: mirrored so that the first ring is the lower one, then
+  // translated to ring 0 when the rings fall on whole numbers of planes
+  // inside the image
+  const int nr = fNbRings;
+  double planes = fScanner.GetRingPitch()/fGrid.fVz;
+  int step = int(std::lround(planes));
+  fTranslation = nr > 1 && step >= 1 && std::abs(planes - step) < 1.e-4*planes
+              && (nr - 1)*fScanner.GetRingPitch() <= fGrid.fNz*fGrid.fVz;
+
+  fAxial.resize(std::size_t(nr)*nr);
+  fCanonicalRings.clear();
+  if (fTranslation) {
+    for (int d = 0; d < nr; d++) fCanonicalRings.emplace_back(0, d);
+  }
+  std::vector<std::int32_t> rowIndex(std::size_t(nr)*nr, -1);
+  for (int rA = 0; rA < nr; rA++) {
+    for (int rB = 0; rB < nr; rB++) {
+      AxialEntry& entry = fAxial[std::size_t(rA)*nr + rB];
+      entry.fMirror = rB < rA;
+      int a = entry.fMirror ? nr - 1 - rA : rA;
+      int b = entry.fMirror ? nr - 1 - rB : rB;
+      if (fTranslation) {
+        entry.fRow = b - a;
+        entry.fShift = step*a;
+        continue;
+      }
+      std::int32_t& index = rowIndex[std::size_t(a)*nr + b];
+      if (index < 0) {
+        index = std::int32_t(fCanonicalRings.size());
+        fCanonicalRings.emplace_back(a, b);
+      }
+      entry.fRow = index;
+      entry.fShift = 0;
+    }
+  }
+  fNbAxialRows = int(fCanonicalRings.size());
+}
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
+
+void SystemMatrix::TraceRow(std::size_t row, std::vector<Entry>& entries) const
+{
+  const auto& pair = fCanonicalPairs[row/fNbAxialRows];
+  const auto& rings = fCanonicalRings[row%fNbAxialRows];
+  const float* p1 = fScanner.GetPosition(rings.first*fNbCrystals + pair.first);
+  const float* p2 = fScanner.GetPosition(rings.second*fNbCrystals + pair.second);
+  entries.clear();
+  fProjector.Trace(p1, p2, [&](std::size_t voxel, float length) {
+    std::uint32_t z = std::uint32_t(voxel/fNbXY);
+    std::uint32_t xy = std::uint32_t(voxel%fNbXY);
+    entries.push_back({(z << kXYBits) | xy, length});
+  });
+}
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
+
+bool SystemMatrix::Generate(const std::string& fileName, std::uint64_t key,
+                            unsigned nbThreads)
+{
+  Close();
+  if (fNbXY > (1 << kXYBits) || fGrid.fNz > (1 << (32 - kXYBits))) {
+    fError = "image grid too large for the system matrix voxel encoding";
+    return false;
+  }
+
+  // written under a temporary name, renamed once complete
+  std::string tmpName = fileName + ".tmp";
+  std::FILE* file = std::fopen(tmpName.c_str(), "wb");
+  if (!file) {
+    fError = "cannot create " + tmpName + ": " + std::strerror(errno);
+    return false;
+  }
+
+  const std::size_t nbRows = GetNbRows();
+  std::vector<std::uint64_t> offsets(nbRows + 1, 0);
+  off_t dataStart = sizeof(SystemMatrixHeader)
+                  + offsets.size()*sizeof(std::uint64_t);
+  bool ok = ::fseeko(file, dataStart, SEEK_SET) == 0;
+
+  // rows traced in parallel by blocks, written in order
+  const std::size_t kBlock = 4096;
+  std::vector<std::vector<Entry>> rows(std::min(kBlock, nbRows));
+  for (std::size_t first = 0; ok && first < nbRows; first += kBlock) {
+    std::size_t size = std::min(kBlock, nbRows - first);
+    ParallelFor(nbThreads, size, 16,
+      [&](std::size_t begin, std::size_t end, unsigned) {
+        for (std::size_t i = begin; i < end; i++) TraceRow(first + i, rows[i]);
+      });
+    for (std::size_t i = 0; ok && i < size; i++) {
+      offsets[first + i + 1] = offsets[first + i] + rows[i].size();
+      ok = std::fwrite(rows[i].data(), sizeof(Entry), rows[i].size(), file)
+        == rows[i].size();
+    }
+  }
+
+  SystemMatrixHeader header;
+  std::memset(&header, 0, sizeof(header));
+  std::memcpy(header.fMagic, kSystemMatrixMagic, 8);
+  header.fKey = key;
+  header.fNbRows = nbRows;
+  header.fNbEntries = offsets.back();
+  header.fNbPairs = std::int32_t(fCanonicalPairs.size());
+  header.fNbAxialRows = fNbAxialRows;
+  header.fNx = fGrid.fNx;  header.fNy = fGrid.fNy;  header.fNz = fGrid.fNz;
+  ok = ok && ::fseeko(file, 0, SEEK_SET) == 0
+          && std::fwrite(&header, sizeof(header), 1, file) == 1
+          && std::fwrite(offsets.data(), sizeof(std::uint64_t), offsets.size(),
+                         file) == offsets.size();
+  ok = std::fclose(file) == 0 && ok;
+  if (!ok || std::rename(tmpName.c_str(), fileName.c_str()) != 0) {
+    fError = "cannot write " + fileName + ": " + std::strerror(errno);
+    std::remove(tmpName.c_str());
+    return false;
+  }
+  return Open(fileName, key);
+}
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
+
+bool SystemMatrix::Open(const std::string& fileName, std::uint64_t key)
+{
+  Close();
+
+  int fd = ::open(fileName.c_str(), O_RDONLY);
+  if (fd < 0) {
+    fError = "cannot open " + fileName + ": " + std::strerror(errno);
+    return false;
+  }
+  struct stat status;
+  if (::fstat(fd, &status) != 0 ||
+      std::size_t(status.st_size) < sizeof(SystemMatrixHeader)) {
+    fError = fileName + " is not a system matrix file (too short)";
+    ::close(fd);
+    return false;
+  }
+
+  fMapSize = status.st_size;
+  fMap = ::mmap(nullptr, fMapSize, PROT_READ, MAP_PRIVATE, fd, 0);
+  ::close(fd);
+  if (fMap == MAP_FAILED) {
+    fMap = nullptr;
+    fError = "cannot map " + fileName + ": " + std::strerror(errno);
+    return false;
+  }
+
+  // the rows are visited in the order of the events: all of the file is
+  // used at every iteration, read ahead
+  ::madvise(fMap, fMapSize, MADV_WILLNEED);
+
+  SystemMatrixHeader header;
+  std::memcpy(&header, fMap, sizeof(header));
+  const std::size_t nbRows = GetNbRows();
+  std::size_t dataStart = sizeof(header) + (nbRows + 1)*sizeof(std::uint64_t);
+  if (std::memcmp(header.fMagic, kSystemMatrixMagic, 8) != 0 ||
+      header.fKey != key || header.fNbRows != nbRows ||
+      header.fNbPairs != std::int32_t(fCanonicalPairs.size()) ||
+      header.fNbAxialRows != fNbAxialRows ||
+      header.fNx != fGrid.fNx || header.fNy != fGrid.fNy ||
+      header.fNz != fGrid.fNz ||
+      fMapSize != dataStart + header.fNbEntries*sizeof(Entry)) {
+    fError = fileName + " does not match the scanner and image grid";
+    Close();
+    return false;
+  }
+
+  const char* bytes = static_cast<const char*>(fMap);
+  fRowOffsets = reinterpret_cast<const std::uint64_t*>(bytes + sizeof(header));
+  fEntries = reinterpret_cast<const Entry*>(bytes + dataStart);
+  fNbEntries = header.fNbEntries;
+  return true;
+}
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
+
+void SystemMatrix::Close()
+{
+  if (fMap) ::munmap(fMap, fMapSize);
+  fMap = nullptr;
+  fMapSize = 0;
+  fRowOffsets = nullptr;
+  fEntries = nullptr;
+  fNbEntries = 0;
+}
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
+
+}
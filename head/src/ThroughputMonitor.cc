@@ -0,0 +1,354 @@
+//
+// ********************************************************************
+// * License and Disclaimer                                           *
+// *                                                                  *
+// * The  Geant4 software  is  copyright of the Copyright Holders  of *
+// * the Geant4 Collaboration.  It is provided  under  the terms  and *
+// * conditions of the Geant4 Software License,  included in the file *
+// * LICENSE and available at  http://cern.ch/geant4/license .  These *
+// * include a list of copyright holders.                             *
+// *                                                                  *
+// * Neither the authors of this software system, nor their employing *
+// * institutes,nor the agencies providing financial support for this *
+// * work  make  any representation or  warranty, express or implied, *
+// * regarding  this  software system or assume any liability for its *
+// * use.  Please see the license in the file  LICENSE  and URL above *
+// * for the full disclaimer and the limitation of liability.         *
+// *                                                                  *
+// * This  code  implementation is the result of  the  scientific and *
+// * technical work of the GEANT4 collaboration.                      *
+// * By using,  copying,  modifying or  distributing the software (or *
+// * any work based  on the software)  you  agree  to acknowledge its *
+// * use  in  resulting  scientific  publications,  and indicate your *
+// * acceptance of all terms of the Geant4 Software license.          *
+// ********************************************************************
+//
+/// \file ThroughputMonitor.cc
+/// \brief Implementation of the B3b::ThroughputMonitor class
+
+#include "ThroughputMonitor.hh"
+
+#include "G4ParticleDefinition.hh"
+#include "G4LogicalVolume.hh"
+#include "G4LogicalVolumeStore.hh"
+
+#include <algorithm>
+#include <fstream>
+#include <iomanip>
+#include <numeric>
+#include <sstream>
+
+namespace
+{
+  using Clock = std::chrono::steady_clock;
+
+  G4double Seconds(Clock::time_point from, Clock::time_point to)
+  {
+    return std::chrono::duration<G4double>(to - from).count();
+  }
+
+  G4long Sum(const std::vector<G4long>& counts)
+  {
+    return std::accumulate(counts.begin(), counts.end(), G4long(0));
+  }
+
+  // count of the run: current count minus the count at the baseline
+  G4long Delta(const std::vector<G4long>& current,
+               const std::vector<G4long>& baseline, std::size_t i)
+  {
+    return current[i] - (i < baseline.size() ? baseline[i] : 0);
+  }
+}
+
+namespace B3b
+{
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
+
+ThroughputChannel::ThroughputChannel(ThroughputMonitor* monitor)
+  : fMonitor(monitor)
+{
+  for (auto& tracks : fTracks) tracks.store(0, std::memory_order_relaxed);
+}
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
+
+void ThroughputChannel::CountTrack(const G4ParticleDefinition* particle)
+{
+  for (G4int i = 0; i < fNbParticles; i++) {
+    if (fParticles[i] == particle) {
+      Increment(fTracks[i]);
+      return;
+    }
+  }
+
+  // a new particle: the table is read by the master
+  if (fNbParticles < kMaxParticles) {
+    std::lock_guard<std::mutex> lock(fMonitor->fMutex);
+    fParticles[fNbParticles] = particle;
+    Increment(fTracks[fNbParticles]);
+    fNbParticles++;
+  }
+  else {
+    Increment(fTracks[kMaxParticles]);
+  }
+}
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
+
+void ThroughputChannel::Reserve(G4int nbVolumes)
+{
+  if (nbVolumes <= fNbVolumes) return;
+  std::unique_ptr<std::atomic<G4long>[]> steps(new std::atomic<G4long>[nbVolumes]);
+  for (G4int i = 0; i < nbVolumes; i++) {
+    steps[i].store(i < fNbVolumes ? fSteps[i].load(std::memory_order_relaxed) : 0,
+                   std::memory_order_relaxed);
+  }
+  std::lock_guard<std::mutex> lock(fMonitor->fMutex);
+  fSteps.swap(steps);
+  fNbVolumes = nbVolumes;
+}
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
+
+ThroughputMonitor* ThroughputMonitor::Instance()
+{
+  static ThroughputMonitor instance;
+  return &instance;
+}
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
+
+ThroughputMonitor::~ThroughputMonitor()
+{
+  {
+    std::lock_guard<std::mutex> lock(fWakeMutex);
+    fStop = true;
+  }
+  fWake.notify_one();
+  if (fThread.joinable()) fThread.join();
+}
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
+
+ThroughputChannel* ThroughputMonitor::GetChannel(G4int thread)
+{
+  std::size_t slot = std::max(0, thread);
+  std::lock_guard<std::mutex> lock(fMutex);
+  if (slot >= fChannels.size()) fChannels.resize(slot + 1);
+  if (!fChannels[slot]) fChannels[slot] = std::make_unique<ThroughputChannel>(this);
+  return fChannels[slot].get();
+}
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
+
+ThroughputSample ThroughputMonitor::Sample() const
+{
+  ThroughputSample sample;
+  sample.fTime = Clock::now();
+
+  std::lock_guard<std::mutex> lock(fMutex);
+  for (const auto& channel : fChannels) {
+    G4long events = 0, steps = 0;
+    if (channel) {
+      events = channel->fNbEvents.load(std::memory_order_relaxed);
+      if (sample.fVolumeSteps.size() < std::size_t(channel->fNbVolumes) + 1) {
+        sample.fVolumeSteps.resize(channel->fNbVolumes + 1, 0);
+      }
+      for (G4int i = 0; i < channel->fNbVolumes; i++) {
+        G4long count = channel->fSteps[i].load(std::memory_order_relaxed);
+        sample.fVolumeSteps[i] += count;
+        steps += count;
+      }
+      G4long other = channel->fOtherSteps.load(std::memory_order_relaxed);
+      sample.fVolumeSteps.back() += other;
+      steps += other;
+
+      // tracks merged by particle name across the threads
+      auto addTracks = [&sample](const G4String& name, G4long count) {
+        std::size_t index = std::find(sample.fParticles.begin(),
+                                      sample.fParticles.end(), name)
+                            - sample.fParticles.begin();
+        if (index == sample.fParticles.size()) {
+          sample.fParticles.push_back(name);
+          sample.fTracks.push_back(0);
+        }
+        sample.fTracks[index] += count;
+      };
+      for (G4int i = 0; i < channel->fNbParticles; i++) {
+        addTracks(channel->fParticles[i]->GetParticleName(),
+                  channel->fTracks[i].load(std::memory_order_relaxed));
+      }
+      G4long otherTracks = channel->fTracks[ThroughputChannel::kMaxParticles]
+                             .load(std::memory_order_relaxed);
+      if (otherTracks > 0) addTracks("other", otherTracks);
+    }
+    sample.fEvents.push_back(events);
+    sample.fSteps.push_back(steps);
+  }
+  return sample;
+}
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
+
+void ThroughputMonitor::Start(const ThroughputParameters& parameters,
+                              G4long nbRequested)
+{
+  Stop();
+  fParameters = parameters;
+  fNbRequested = nbRequested;
+  fBaseline = Sample();
+  fStarted = true;
+  fStop = false;
+  if (fParameters.fReport > 0.) {
+    fThread = std::thread(&ThroughputMonitor::SamplerLoop, this);
+  }
+}
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
+
+void ThroughputMonitor::Stop()
+{
+  if (!fStarted) return;
+  {
+    std::lock_guard<std::mutex> lock(fWakeMutex);
+    fStop = true;
+  }
+  fWake.notify_one();
+  if (fThread.joinable()) fThread.join();
+  fStarted = false;
+
+  Summary(Sample());
+}
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
+
+void ThroughputMonitor::SamplerLoop()
+{
+  const auto period = std::chrono::duration<G4double>(fParameters.fReport);
+  ThroughputSample previous = fBaseline;
+  std::unique_lock<std::mutex> lock(fWakeMutex);
+  while (!fWake.wait_for(lock, period, [this] { return fStop; })) {
+    lock.unlock();
+    ThroughputSample current = Sample();
+    Progress(previous, current);
+    previous = std::move(current);
+    lock.lock();
+  }
+}
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
+
+void ThroughputMonitor::Progress(const ThroughputSample& previous,
+                                 const ThroughputSample& current) const
+{
+  G4double elapsed = Seconds(previous.fTime, current.fTime);
+  G4long events = Sum(current.fEvents) - Sum(fBaseline.fEvents);
+  std::ostringstream out;
+  out << "---> " << events << " events";
+  if (fNbRequested > 0) {
+    out << " (" << std::fixed << std::setprecision(1)
+        << 100.*events/fNbRequested << " %)" << std::defaultfloat;
+  }
+  if (elapsed > 0.) {
+    out << std::setprecision(4)
+        << ", " << (Sum(current.fEvents) - Sum(previous.fEvents))/elapsed
+        << " events/s";
+    if (fParameters.fBreakdown) {
+      out << ", " << (Sum(current.fSteps) - Sum(previous.fSteps))/elapsed
+          << " steps/s";
+    }
+  }
+  G4cout << out.str() << G4endl;
+}
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
+
+void ThroughputMonitor::Summary(const ThroughputSample& current) const
+{
+  G4double elapsed = Seconds(fBaseline.fTime, current.fTime);
+  if (elapsed <= 0.) return;
+
+  std::ostringstream out;
+  out << std::setprecision(4) << G4endl
+      << "--------------------Throughput------------------------------" << G4endl;
+  G4long events = 0, steps = 0;
+  for (std::size_t i = 0; i < current.fEvents.size(); i++) {
+    G4long threadEvents = Delta(current.fEvents, fBaseline.fEvents, i);
+    G4long threadSteps = Delta(current.fSteps, fBaseline.fSteps, i);
+    events += threadEvents;
+    steps += threadSteps;
+    if (threadEvents == 0) continue;
+    out << "  thread " << std::setw(3) << i << ": " << threadEvents
+        << " events, " << threadEvents/elapsed << " events/s";
+    if (fParameters.fBreakdown) out << ", " << threadSteps/elapsed << " steps/s";
+    out << G4endl;
+  }
+  if (!fParameters.fFile.empty()) {
+    G4int nbThreads = 0;
+    for (std::size_t i = 0; i < current.fEvents.size(); i++) {
+      if (Delta(current.fEvents, fBaseline.fEvents, i) > 0) nbThreads++;
+    }
+    std::ofstream(fParameters.fFile, std::ios::app)
+      << nbThreads << " " << events << " " << elapsed << "\n";
+  }
+  out << " Total: " << events << " events in " << elapsed << " s, "
+      << events/elapsed << " events/s";
+  if (fParameters.fBreakdown) {
+    out << ", " << steps/elapsed << " steps/s";
+    if (events > 0) out << ", " << G4double(steps)/events << " steps/event";
+  }
+  out << G4endl;
+
+  if (fParameters.fBreakdown && steps > 0) {
+    // logical volume names by instance ID
+    std::vector<G4String> volumes(current.fVolumeSteps.size());
+    for (const G4LogicalVolume* volume : *G4LogicalVolumeStore::GetInstance()) {
+      std::size_t id = volume->GetInstanceID();
+      if (id + 1 < volumes.size()) volumes[id] = volume->GetName();
+    }
+    if (!volumes.empty()) volumes.back() = "other";
+
+    std::vector<std::pair<G4long, G4String>> rows;
+    for (std::size_t i = 0; i < volumes.size(); i++) {
+      G4long count = Delta(current.fVolumeSteps, fBaseline.fVolumeSteps, i);
+      if (count > 0) rows.emplace_back(count, volumes[i]);
+    }
+    std::sort(rows.rbegin(), rows.rend());
+    out << " Steps per logical volume:" << G4endl;
+    for (const auto& row : rows) {
+      out << "  " << std::setw(20) << std::left << row.second << std::right
+          << std::setw(14) << row.first << std::setw(8)
+          << 100.*row.first/steps << " %" << G4endl;
+    }
+
+    // tracks by particle name, the baseline may list them in another order
+    rows.clear();
+    G4long tracks = 0;
+    for (std::size_t i = 0; i < current.fParticles.size(); i++) {
+      G4long count = current.fTracks[i];
+      auto known = std::find(fBaseline.fParticles.begin(),
+                             fBaseline.fParticles.end(), current.fParticles[i]);
+      if (known != fBaseline.fParticles.end()) {
+        count -= fBaseline.fTracks[known - fBaseline.fParticles.begin()];
+      }
+      if (count > 0) rows.emplace_back(count, current.fParticles[i]);
+      tracks += count;
+    }
+    std::sort(rows.rbegin(), rows.rend());
+    out << " Tracks per particle:";
+    if (tracks > 0) out << " " << G4double(steps)/tracks << " steps/track";
+    out << G4endl;
+    for (const auto& row : rows) {
+      out << "  " << std::setw(20) << std::left << row.second << std::right
+          << std::setw(14) << row.first << std::setw(8)
+          << 100.*row.first/tracks << " %" << G4endl;
+    }
+  }
+  out << "------------------------------------------------------------" << G4endl;
+  G4cout << out.str();
+}
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
+
+}